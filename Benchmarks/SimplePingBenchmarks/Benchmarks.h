@@ -0,0 +1,70 @@
+/*
+    Abstract:
+    Declarations shared by the source files of the benchmark tool.
+ */
+
+#import "SimplePing.h"
+#import "SimpleTraceroute.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! A sink for benchmark results, so the compiler can't discard the work.
+ */
+
+extern volatile uint32_t gSink;
+
+/*! Compares SimplePingChecksum with the implementations it replaced.
+ */
+
+extern void BenchmarkChecksums(void);
+
+/*! Times building probe packets and filtering the packets the kernel returns.
+ */
+
+extern void BenchmarkPackets(void);
+
+/*! Pings and traces the loopback interface as fast as it answers.
+ *  \param duration How long to run each scenario, in seconds.
+ */
+
+extern void BenchmarkLoad(NSTimeInterval duration);
+
+/*! Replays a session recording through the packet parsers and summarises it.
+ *  \param path The recording, as written by a `SimplePingSessionRecorder`.
+ */
+
+extern void BenchmarkReplay(const char * path);
+
+#pragma mark * Fixtures
+
+/*! Returns an echo reply as the kernel returns it from an ICMP socket.
+ *  \details For IPv4 that's the IPv4 header, from 127.0.0.1, and the ICMP message, with a 
+ *      valid checksum; for IPv6 it's just the ICMPv6 message.
+ *  \param family AF_INET or AF_INET6.
+ *  \param identifier The ICMP identifier, in host byte order.
+ *  \param sequenceNumber The ICMP sequence number, in host byte order.
+ *  \param payloadLength The length of the payload after the ICMP header.
+ *  \returns The packet.
+ */
+
+extern NSData * BenchmarkEchoReplyPacket(sa_family_t family, uint16_t identifier, uint16_t sequenceNumber, size_t payloadLength);
+
+/*! Returns a time exceeded message, quoting an echo request, as the kernel returns it.
+ *  \details The router quotes the whole request, as RFC 1812 recommends, rather than just 
+ *      the 8 bytes RFC 792 requires.
+ *  \param family AF_INET or AF_INET6.
+ *  \param identifier The identifier of the quoted echo request, in host byte order.
+ *  \param sequenceNumber The sequence number of the quoted echo request, in host byte order.
+ *  \param payloadLength The length of the quoted request's payload.
+ *  \returns The packet.
+ */
+
+extern NSData * BenchmarkTimeExceededPacket(sa_family_t family, uint16_t identifier, uint16_t sequenceNumber, size_t payloadLength);
+
+/*! Returns the loopback address, 127.0.0.1 or ::1, as a (struct sockaddr).
+ *  \param family AF_INET or AF_INET6.
+ */
+
+extern NSData * BenchmarkLoopbackAddress(sa_family_t family);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,391 @@
+/*
+    Abstract:
+    An end-to-end load harness that pings and traces the loopback interface as fast as it answers.
+ */
+
+#import "Benchmarks.h"
+
+#include <sys/resource.h>
+
+#pragma mark * Tallies
+
+/*! What the clients of one scenario have done so far.
+ */
+
+typedef struct LoadTally {
+    uint64_t    sent;                           ///< Probes sent.
+    uint64_t    received;                       ///< Replies received.
+    uint64_t    sendFailures;                   ///< Probes `sendto` refused.
+    uint64_t    roundTripNanoseconds;           ///< Sum of the replies' round trips.
+    uint64_t    deliveryDelayNanoseconds;       ///< Sum of the time replies waited to be read.
+    uint64_t    runs;                           ///< Traceroutes finished.
+} LoadTally;
+
+/*! Returns the CPU time the process has used, user and system, in nanoseconds.
+ */
+
+static uint64_t ProcessCPUNanoseconds(void) {
+    struct rusage   usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return ((uint64_t) usage.ru_utime.tv_sec + (uint64_t) usage.ru_stime.tv_sec) * 1000000000
+         + ((uint64_t) usage.ru_utime.tv_usec + (uint64_t) usage.ru_stime.tv_usec) * 1000;
+}
+
+#pragma mark * LoadPinger
+
+/*! Keeps a window of pings outstanding to one address, sending another as each reply arrives.
+ *  \details Pings that go unanswered for kLoadStallInterval are written off, so that the 
+ *      window refills when the kernel drops or rate limits replies.
+ */
+
+@interface LoadPinger : NSObject <SimplePingDelegate>
+
+- (instancetype)initWithAddress:(NSData *)address engine:(nullable SimplePingEngine *)engine window:(NSUInteger)window tally:(LoadTally *)tally;
+
+@property (nonatomic, strong, readonly) SimplePing *    pinger;
+
+/*! Writes off stalled pings and sends more; called by the harness every few milliseconds.
+ */
+
+- (void)tick;
+
+@end
+
+static const uint64_t kLoadStallInterval = 250 * 1000 * 1000;
+
+@implementation LoadPinger {
+    NSUInteger  _window;
+    LoadTally * _tally;
+    uint64_t    _sent;
+    uint64_t    _settled;                       ///< Replies, failures and pings written off.
+    uint64_t    _lastProgressTime;
+    BOOL        _started;
+    BOOL        _backingOff;                    ///< A send failed; wait for the next tick.
+}
+
+- (instancetype)initWithAddress:(NSData *)address engine:(SimplePingEngine *)engine window:(NSUInteger)window tally:(LoadTally *)tally {
+    self = [super init];
+    if (self != nil) {
+        self->_pinger = [[SimplePing alloc] initWithHostAddress:address engine:engine];
+        self->_pinger.delegate = self;
+        self->_pinger.sequenceWindow = 32768;
+        self->_window = window;
+        self->_tally = tally;
+    }
+    return self;
+}
+
+/*! Sends pings until the window is full.
+ */
+
+- (void)fill {
+    while ( self->_started && ! self->_backingOff && (self->_sent - self->_settled < self->_window) ) {
+        self->_sent += 1;
+        [self.pinger sendPingWithData:nil];
+    }
+}
+
+- (void)tick {
+    uint64_t    now;
+
+    now = SimplePingMonotonicNanoseconds();
+    if ( (self->_sent > self->_settled) && (now - self->_lastProgressTime > kLoadStallInterval) ) {
+        self->_settled = self->_sent;
+        self->_lastProgressTime = now;
+    }
+    self->_backingOff = NO;
+    [self fill];
+}
+
+- (void)simplePing:(SimplePing *)pinger didStartWithAddress:(NSData *)address {
+    #pragma unused(pinger)
+    #pragma unused(address)
+    self->_started = YES;
+    self->_lastProgressTime = SimplePingMonotonicNanoseconds();
+    [self fill];
+}
+
+- (void)simplePing:(SimplePing *)pinger didFailWithError:(NSError *)error {
+    #pragma unused(pinger)
+    fprintf(stderr, "ping failed: %s\n", error.description.UTF8String);
+    self->_started = NO;
+}
+
+- (void)simplePing:(SimplePing *)pinger didSendPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    #pragma unused(sequenceNumber)
+    self->_tally->sent += 1;
+}
+
+- (void)simplePing:(SimplePing *)pinger didFailToSendPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber error:(NSError *)error {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    #pragma unused(sequenceNumber)
+    #pragma unused(error)
+
+    // Typically ENOBUFS; stop until the next tick rather than spinning.
+
+    self->_tally->sendFailures += 1;
+    self->_settled += 1;
+    self->_backingOff = YES;
+}
+
+- (void)simplePing:(SimplePing *)pinger didReceivePingResponsePacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber timing:(SimplePingTiming)timing {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    #pragma unused(sequenceNumber)
+    self->_tally->received += 1;
+    self->_tally->roundTripNanoseconds += SimplePingTimingRoundTripNanoseconds(timing);
+    self->_tally->deliveryDelayNanoseconds += SimplePingTimingDeliveryDelayNanoseconds(timing);
+    self->_settled += 1;
+    self->_lastProgressTime = timing.userReceiveTime;
+    [self fill];
+}
+
+- (void)simplePing:(SimplePing *)pinger didReceivePingResponsePacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    #pragma unused(sequenceNumber)
+    // Never called, as we implement the variant with timing.
+}
+
+- (void)simplePing:(SimplePing *)pinger didReceiveUnexpectedPacket:(NSData *)packet {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    // Counted by the metrics.
+}
+
+@end
+
+#pragma mark * LoadTracer
+
+/*! Traces the loopback address over and over, starting again as soon as each trace finishes.
+ */
+
+@interface LoadTracer : NSObject <SimpleTracerouteDelegate>
+
+- (instancetype)initWithAddress:(NSData *)address tally:(LoadTally *)tally;
+
+@property (nonatomic, strong, readonly) SimpleTraceroute *  traceroute;
+
+- (void)start;
+- (void)stop;
+
+@end
+
+@implementation LoadTracer {
+    NSData *    _address;
+    LoadTally * _tally;
+    BOOL        _running;
+}
+
+- (instancetype)initWithAddress:(NSData *)address tally:(LoadTally *)tally {
+    self = [super init];
+    if (self != nil) {
+        self->_address = [address copy];
+        self->_tally = tally;
+        self->_traceroute = [[SimpleTraceroute alloc] initWithHostName:@"localhost"];
+        self->_traceroute.delegate = self;
+        self->_traceroute.maxHops = 4;
+        self->_traceroute.probesPerHop = 3;
+        self->_traceroute.waitsForAllProbes = YES;
+        self->_traceroute.timeout = 1.0;
+    }
+    return self;
+}
+
+- (void)start {
+    self->_running = YES;
+    [self.traceroute startWithAddress:self->_address];
+}
+
+- (void)stop {
+    self->_running = NO;
+    [self.traceroute stop];
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didStartWithAddress:(NSData *)address {
+    #pragma unused(traceroute)
+    #pragma unused(address)
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didFailWithError:(NSError *)error {
+    #pragma unused(traceroute)
+    fprintf(stderr, "traceroute failed: %s\n", error.description.UTF8String);
+    self->_running = NO;
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didReceiveResponseFromHop:(uint8_t)hopNumber latency:(NSTimeInterval)latency {
+    #pragma unused(traceroute)
+    #pragma unused(hopNumber)
+    self->_tally->received += 1;
+    self->_tally->roundTripNanoseconds += (uint64_t) (latency * 1e9);
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didCompleteHop:(TracerouteHopResult *)hopResult {
+    #pragma unused(traceroute)
+    #pragma unused(hopResult)
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didFinishWithResult:(TracerouteResult *)result {
+    #pragma unused(traceroute)
+    #pragma unused(result)
+    self->_tally->runs += 1;
+
+    // Start again once the traceroute has finished unwinding.
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (self->_running) {
+            [self.traceroute startWithAddress:self->_address];
+        }
+    });
+}
+
+@end
+
+#pragma mark * Scenarios
+
+/*! Runs the main run loop until a deadline, topping up every pinger's window as it goes.
+ */
+
+static void RunUntil(uint64_t deadline, NSArray<LoadPinger *> * pingers) {
+    while (SimplePingMonotonicNanoseconds() < deadline) {
+        (void) CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, false);
+        for (LoadPinger * pinger in pingers) {
+            [pinger tick];
+        }
+    }
+}
+
+/*! Prints what a scenario did.
+ *  \param name The name of the scenario.
+ *  \param tally Its tally.
+ *  \param wallNanoseconds How long it ran.
+ *  \param cpuNanoseconds The CPU time it took.
+ *  \param metrics The difference of the process-wide metrics over the run.
+ */
+
+static void PrintScenario(const char * name, const LoadTally * tally, uint64_t wallNanoseconds, uint64_t cpuNanoseconds, SimplePingMetricsSnapshot * metrics) {
+    double      replies;
+
+    replies = (double) MAX(tally->received, (uint64_t) 1);
+    fprintf(stdout, "  %-24s %9.0f pps  %7.2f us CPU/reply  RTT %7.2f us  read delay %7.2f us  p99 callback %7.2f us\n",
+        name,
+        (double) tally->received * 1e9 / (double) wallNanoseconds,
+        (double) cpuNanoseconds / replies / 1e3,
+        (double) tally->roundTripNanoseconds / replies / 1e3,
+        (double) tally->deliveryDelayNanoseconds / replies / 1e3,
+        [metrics callbackLatencyAtQuantile:0.99] * 1e6
+    );
+    fprintf(stdout, "  %-24s sent %llu, replies %llu, send failures %llu, unexpected %llu, timeouts %llu",
+        "",
+        (unsigned long long) metrics.packetsSent,
+        (unsigned long long) tally->received,
+        (unsigned long long) tally->sendFailures,
+        (unsigned long long) metrics.unexpectedPackets,
+        (unsigned long long) metrics.timeouts
+    );
+    if (tally->runs != 0) {
+        fprintf(stdout, ", %.0f traces/s", (double) tally->runs * 1e9 / (double) wallNanoseconds);
+    }
+    fprintf(stdout, "\n");
+}
+
+/*! Pings loopback with some pingers, each keeping a window of pings outstanding.
+ *  \param name The name of the scenario.
+ *  \param family AF_INET or AF_INET6.
+ *  \param pingerCount How many pingers.
+ *  \param window How many pings each keeps outstanding.
+ *  \param useEngine YES to share one engine's socket, NO to give each pinger its own.
+ *  \param duration How long to run, in seconds.
+ */
+
+static void RunPingScenario(const char * name, sa_family_t family, NSUInteger pingerCount, NSUInteger window, BOOL useEngine, NSTimeInterval duration) {
+    LoadTally *                     tally;
+    SimplePingEngine *              engine;
+    NSMutableArray<LoadPinger *> *  pingers;
+    SimplePingMetricsSnapshot *     metricsBefore;
+    uint64_t                        start;
+    uint64_t                        cpuStart;
+    uint64_t                        end;
+
+    tally = calloc(1, sizeof(*tally));
+    engine = useEngine ? [[SimplePingEngine alloc] init] : nil;
+    pingers = [NSMutableArray array];
+    for (NSUInteger i = 0; i < pingerCount; i++) {
+        [pingers addObject:[[LoadPinger alloc] initWithAddress:BenchmarkLoopbackAddress(family) engine:engine window:window tally:tally]];
+    }
+
+    metricsBefore = [SimplePingMetricsSnapshot processSnapshot];
+    start = SimplePingMonotonicNanoseconds();
+    cpuStart = ProcessCPUNanoseconds();
+    for (LoadPinger * pinger in pingers) {
+        [pinger.pinger start];
+    }
+    RunUntil(start + (uint64_t) (duration * 1e9), pingers);
+    end = SimplePingMonotonicNanoseconds();
+    PrintScenario(name, tally, end - start, ProcessCPUNanoseconds() - cpuStart, [[SimplePingMetricsSnapshot processSnapshot] snapshotBySubtracting:metricsBefore]);
+
+    for (LoadPinger * pinger in pingers) {
+        [pinger.pinger stop];
+    }
+    free(tally);
+}
+
+/*! Traces loopback with some traceroutes, each starting again as soon as it finishes.
+ *  \param name The name of the scenario.
+ *  \param family AF_INET or AF_INET6.
+ *  \param tracerCount How many traceroutes.
+ *  \param duration How long to run, in seconds.
+ */
+
+static void RunTracerouteScenario(const char * name, sa_family_t family, NSUInteger tracerCount, NSTimeInterval duration) {
+    LoadTally *                     tally;
+    NSMutableArray<LoadTracer *> *  tracers;
+    SimplePingMetricsSnapshot *     metricsBefore;
+    uint64_t                        start;
+    uint64_t                        cpuStart;
+    uint64_t                        end;
+
+    tally = calloc(1, sizeof(*tally));
+    tracers = [NSMutableArray array];
+    for (NSUInteger i = 0; i < tracerCount; i++) {
+        [tracers addObject:[[LoadTracer alloc] initWithAddress:BenchmarkLoopbackAddress(family) tally:tally]];
+    }
+
+    metricsBefore = [SimplePingMetricsSnapshot processSnapshot];
+    start = SimplePingMonotonicNanoseconds();
+    cpuStart = ProcessCPUNanoseconds();
+    for (LoadTracer * tracer in tracers) {
+        [tracer start];
+    }
+    RunUntil(start + (uint64_t) (duration * 1e9), @[]);
+    end = SimplePingMonotonicNanoseconds();
+    PrintScenario(name, tally, end - start, ProcessCPUNanoseconds() - cpuStart, [[SimplePingMetricsSnapshot processSnapshot] snapshotBySubtracting:metricsBefore]);
+
+    for (LoadTracer * tracer in tracers) {
+        [tracer stop];
+    }
+
+    // Let any restart already queued run, and find the tracer stopped.
+
+    (void) CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, false);
+    free(tally);
+}
+
+void BenchmarkLoad(NSTimeInterval duration) {
+    fprintf(stdout, "loopback load (%.1f s per scenario)\n", duration);
+    fprintf(stdout, "  macOS rate limits ICMP replies to net.inet.icmp.icmplim per second; if the rates\n");
+    fprintf(stdout, "  below stall near that limit, raise it with sysctl to measure this package instead.\n");
+
+    @autoreleasepool {
+        RunPingScenario("single target v4",           AF_INET,  1,  64, NO,  duration);
+        RunPingScenario("single target v6",           AF_INET6, 1,  64, NO,  duration);
+        RunPingScenario("16 targets v4, own sockets", AF_INET,  16, 8,  NO,  duration);
+        RunPingScenario("16 targets v4, engine",      AF_INET,  16, 8,  YES, duration);
+        RunTracerouteScenario("traceroute v4 x4",     AF_INET,  4,  duration);
+        RunTracerouteScenario("traceroute v6 x4",     AF_INET6, 4,  duration);
+    }
+}
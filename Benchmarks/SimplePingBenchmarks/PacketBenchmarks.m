@@ -0,0 +1,233 @@
+/*
+    Abstract:
+    Benchmarks of building probe packets and of filtering the packets the kernel returns.
+ */
+
+#import "Benchmarks.h"
+
+#pragma mark * Private interfaces
+
+// The benchmarks drive the receive paths directly, without a socket, so they can time 
+// them alone and with packets whose contents they control.
+
+@interface SimplePing (Benchmarking)
+
+- (void)setHostAddress:(NSData *)hostAddress;
+- (void)setNextSequenceNumber:(uint16_t)nextSequenceNumber;
+- (BOOL)validatePingResponsePacket:(NSMutableData *)packet sequenceNumber:(uint16_t *)sequenceNumberPtr;
+
+@end
+
+@interface SimpleTraceroute (Benchmarking)
+
+- (void)setHostAddress:(NSData *)hostAddress;
+- (void)processReceivedBytes:(const uint8_t *)bytes length:(size_t)length fromAddress:(const struct sockaddr *)sourceAddress addressLength:(socklen_t)sourceAddressLength timing:(SimplePingTiming)timing;
+
+@end
+
+#pragma mark * Earlier implementations
+
+/*! How SimplePing built each ping before SimplePingPacketTemplate.
+ *  \details A fresh payload, a fresh packet and a checksum over all of it, every send.
+ */
+
+static NSData * LegacyPingPacket(uint16_t identifier, uint16_t sequenceNumber) {
+    NSData *            payload;
+    NSMutableData *     packet;
+    ICMPHeader *        icmpPtr;
+
+    payload = [[NSString stringWithFormat:@"%28zd bottles of beer on the wall", (ssize_t) 99 - (size_t) (sequenceNumber % 100) ] dataUsingEncoding:NSASCIIStringEncoding];
+    packet = [NSMutableData dataWithLength:sizeof(*icmpPtr) + payload.length];
+    icmpPtr = packet.mutableBytes;
+    icmpPtr->type = ICMPv4TypeEchoRequest;
+    icmpPtr->code = 0;
+    icmpPtr->checksum = 0;
+    icmpPtr->identifier     = OSSwapHostToBigInt16(identifier);
+    icmpPtr->sequenceNumber = OSSwapHostToBigInt16(sequenceNumber);
+    memcpy(&icmpPtr[1], payload.bytes, payload.length);
+    icmpPtr->checksum = SimplePingChecksum(packet.bytes, packet.length);
+    return packet;
+}
+
+#pragma mark * Benchmarks
+
+/*! Times a block.
+ *  \param name The name to print.
+ *  \param iterations How many times to call it.
+ *  \param block The block to time; it's passed the iteration number.
+ */
+
+static void BenchmarkBlock(const char * name, uint32_t iterations, void (^block)(uint32_t iteration)) {
+    uint64_t    start;
+    uint64_t    elapsed;
+    uint32_t    i;
+
+    @autoreleasepool {
+        for (i = 0; i < iterations / 16; i++) {         // warm up
+            block(i);
+        }
+    }
+    start = SimplePingMonotonicNanoseconds();
+    @autoreleasepool {
+        for (i = 0; i < iterations; i++) {
+            block(i);
+        }
+    }
+    elapsed = SimplePingMonotonicNanoseconds() - start;
+
+    fprintf(stdout, "  %-34s %8.2f ns/op  %8.2f Mpps\n",
+        name,
+        (double) elapsed / iterations,
+        (elapsed == 0) ? 0.0 : ((double) iterations * 1000.0) / (double) elapsed
+    );
+}
+
+/*! Compares building pings and traceroute probes afresh with patching a template.
+ */
+
+static void BenchmarkPacketBuilding(void) {
+    static const uint32_t       kIterations = 1000000;
+    static const char           kPayload[] = "                          99 bottles of beer on the wall";
+    SimplePingPacketTemplate *  pingTemplate;
+    SimplePingPacketTemplate *  probeTemplate;
+    uint8_t                     probePayload[16];
+
+    // The blocks capture pointers, as they can't capture the structures themselves by reference.
+
+    pingTemplate  = calloc(1, sizeof(*pingTemplate));
+    probeTemplate = calloc(1, sizeof(*probeTemplate));
+    memset(probePayload, 0, sizeof(probePayload));
+    if ( ! SimplePingPacketTemplateInit(pingTemplate, ICMPv4TypeEchoRequest, 0x1234, kPayload, sizeof(kPayload) - 1, true) ||
+         ! SimplePingPacketTemplateInit(probeTemplate, ICMPv4TypeEchoRequest, 0x1234, probePayload, sizeof(probePayload), true) ) {
+        fprintf(stderr, "packet template allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stdout, "packet building\n");
+    BenchmarkBlock("pingPacketWithType (legacy)", kIterations / 10, ^(uint32_t iteration) {
+        gSink += ((const uint8_t *) LegacyPingPacket(0x1234, (uint16_t) iteration).bytes)[2];
+    });
+    BenchmarkBlock("ping template", kIterations, ^(uint32_t iteration) {
+        uint8_t     count[2];
+        unsigned    bottles;
+
+        bottles = 99 - (iteration % 100);
+        count[0] = (bottles >= 10) ? (uint8_t) ('0' + bottles / 10) : ' ';
+        count[1] = (uint8_t) ('0' + bottles % 10);
+        SimplePingPacketTemplateSetSequenceNumber(pingTemplate, (uint16_t) iteration);
+        SimplePingPacketTemplatePatch(pingTemplate, sizeof(ICMPHeader) + 26, count, sizeof(count));
+        gSink += pingTemplate->bytes[2];
+    });
+    BenchmarkBlock("traceroute probe template", kIterations, ^(uint32_t iteration) {
+        uint64_t    sendTime;
+        uint8_t     hopAndIndex[2];
+
+        sendTime = SimplePingMonotonicNanoseconds();
+        hopAndIndex[0] = (uint8_t) (iteration % 30 + 1);
+        hopAndIndex[1] = (uint8_t) (iteration % 3);
+        SimplePingPacketTemplateSetSequenceNumber(probeTemplate, (uint16_t) iteration);
+        SimplePingPacketTemplatePatch(probeTemplate, sizeof(ICMPHeader), &sendTime, sizeof(sendTime));
+        SimplePingPacketTemplatePatch(probeTemplate, sizeof(ICMPHeader) + sizeof(sendTime), hopAndIndex, sizeof(hopAndIndex));
+        gSink += probeTemplate->bytes[2];
+    });
+
+    SimplePingPacketTemplateDestroy(pingTemplate);
+    SimplePingPacketTemplateDestroy(probeTemplate);
+    free(pingTemplate);
+    free(probeTemplate);
+}
+
+/*! Times SimplePing's response validation, and SimpleTraceroute's response filtering, on fixtures.
+ *  \details IPv4 validation strips the IPv4 header, so every iteration first copies the 
+ *      fixture into the receive buffer, as a read would; "copy only" is that cost alone.  
+ *      The traceroute isn't running, so every response fails to match a probe: that's the 
+ *      work it does for every packet on the socket before finding out whether it was its own.
+ */
+
+static void BenchmarkPacketParsing(void) {
+    static const uint32_t       kIterations = 1000000;
+    static const sa_family_t    kFamilies[] = { AF_INET, AF_INET6 };
+
+    fprintf(stdout, "packet parsing\n");
+    for (size_t familyIndex = 0; familyIndex < sizeof(kFamilies) / sizeof(kFamilies[0]); familyIndex++) {
+        sa_family_t         family;
+        const char *        familyName;
+        SimplePing *        pinger;
+        SimpleTraceroute *  traceroute;
+        NSData *            sourceAddress;
+        NSData *            echoReply;
+        NSData *            foreignReply;
+        NSData *            timeExceeded;
+        NSMutableData *     buffer;
+        char                name[64];
+
+        family = kFamilies[familyIndex];
+        familyName = (family == AF_INET) ? "v4" : "v6";
+        sourceAddress = BenchmarkLoopbackAddress(family);
+
+        pinger = [[SimplePing alloc] initWithHostAddress:sourceAddress];
+        [pinger setHostAddress:sourceAddress];
+        [pinger setNextSequenceNumber:100];
+        traceroute = [[SimpleTraceroute alloc] initWithHostName:@"localhost"];
+        [traceroute setHostAddress:sourceAddress];
+
+        echoReply    = BenchmarkEchoReplyPacket(family, pinger.identifier, 50, 56);
+        foreignReply = BenchmarkEchoReplyPacket(family, (uint16_t) (pinger.identifier + 1), 50, 56);
+        timeExceeded = BenchmarkTimeExceededPacket(family, traceroute.identifier, 50, 16);
+        buffer = [NSMutableData dataWithCapacity:65535];
+
+        // Check the answers before timing anything.
+
+        [buffer setData:echoReply];
+        {
+            uint16_t    sequenceNumber;
+
+            if ( ! [pinger validatePingResponsePacket:buffer sequenceNumber:&sequenceNumber] || (sequenceNumber != 50) ) {
+                fprintf(stderr, "echo reply fixture (%s) failed validation\n", familyName);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        snprintf(name, sizeof(name), "copy only (%s)", familyName);
+        BenchmarkBlock(name, kIterations, ^(uint32_t iteration) {
+            #pragma unused(iteration)
+            [buffer setData:echoReply];
+            gSink += ((const uint8_t *) buffer.bytes)[0];
+        });
+        snprintf(name, sizeof(name), "ping echo reply (%s)", familyName);
+        BenchmarkBlock(name, kIterations, ^(uint32_t iteration) {
+            uint16_t    sequenceNumber;
+
+            #pragma unused(iteration)
+            [buffer setData:echoReply];
+            gSink += [pinger validatePingResponsePacket:buffer sequenceNumber:&sequenceNumber];
+        });
+        snprintf(name, sizeof(name), "ping foreign echo reply (%s)", familyName);
+        BenchmarkBlock(name, kIterations, ^(uint32_t iteration) {
+            uint16_t    sequenceNumber;
+
+            #pragma unused(iteration)
+            [buffer setData:foreignReply];
+            gSink += [pinger validatePingResponsePacket:buffer sequenceNumber:&sequenceNumber];
+        });
+        snprintf(name, sizeof(name), "traceroute echo reply (%s)", familyName);
+        BenchmarkBlock(name, kIterations, ^(uint32_t iteration) {
+            SimplePingTiming    timing = { 0, 0, 0 };
+
+            #pragma unused(iteration)
+            [traceroute processReceivedBytes:echoReply.bytes length:echoReply.length fromAddress:sourceAddress.bytes addressLength:(socklen_t) sourceAddress.length timing:timing];
+        });
+        snprintf(name, sizeof(name), "traceroute time exceeded (%s)", familyName);
+        BenchmarkBlock(name, kIterations, ^(uint32_t iteration) {
+            SimplePingTiming    timing = { 0, 0, 0 };
+
+            #pragma unused(iteration)
+            [traceroute processReceivedBytes:timeExceeded.bytes length:timeExceeded.length fromAddress:sourceAddress.bytes addressLength:(socklen_t) sourceAddress.length timing:timing];
+        });
+    }
+}
+
+void BenchmarkPackets(void) {
+    BenchmarkPacketBuilding();
+    BenchmarkPacketParsing();
+}
@@ -0,0 +1,165 @@
+/*
+    Abstract:
+    Packets laid out as the kernel returns them from ICMP sockets, for the parsing benchmarks.
+ */
+
+#import "Benchmarks.h"
+
+#include <netinet/in.h>
+
+enum {
+    kIPv4HeaderLength = 20,
+    kIPv6HeaderLength = 40,
+    kICMPHeaderLength = 8,
+    kICMPv4TimeExceeded = 11,
+    kICMPv6TimeExceeded = 3
+};
+
+/*! Writes a 16-bit value, big endian.
+ */
+
+static void WriteBigEndian16(uint8_t * bytes, uint16_t value) {
+    bytes[0] = (uint8_t) (value >> 8);
+    bytes[1] = (uint8_t) value;
+}
+
+/*! Writes an IPv4 header carrying ICMP, with a valid header checksum.
+ *  \param bytes Where to write it.
+ *  \param totalLength The length of the datagram, header included.
+ *  \param timeToLive The TTL.
+ *  \param source The last byte of the source address, in 192.0.2.0/24; 0 for 127.0.0.1.
+ *  \param destination The last byte of the destination address; 0 for 127.0.0.1.
+ */
+
+static void WriteIPv4Header(uint8_t * bytes, size_t totalLength, uint8_t timeToLive, uint8_t source, uint8_t destination) {
+    static const uint8_t    kLoopback[4] = { 127, 0, 0, 1 };
+    uint8_t                 address[4];
+    uint16_t                checksum;
+
+    memset(bytes, 0, kIPv4HeaderLength);
+    bytes[0] = 0x45;                                    // version 4, 5 words
+    WriteBigEndian16(&bytes[2], (uint16_t) totalLength);
+    WriteBigEndian16(&bytes[4], (uint16_t) arc4random());
+    bytes[8] = timeToLive;
+    bytes[9] = IPPROTO_ICMP;
+
+    memcpy(address, kLoopback, sizeof(address));
+    if (source != 0) {
+        address[0] = 192; address[1] = 0; address[2] = 2; address[3] = source;
+    }
+    memcpy(&bytes[12], address, sizeof(address));
+    memcpy(address, kLoopback, sizeof(address));
+    if (destination != 0) {
+        address[0] = 192; address[1] = 0; address[2] = 2; address[3] = destination;
+    }
+    memcpy(&bytes[16], address, sizeof(address));
+
+    checksum = SimplePingChecksum(bytes, kIPv4HeaderLength);
+    memcpy(&bytes[10], &checksum, sizeof(checksum));
+}
+
+/*! Writes an IPv6 header carrying ICMPv6, from 2001:db8::1 to 2001:db8::2.
+ */
+
+static void WriteIPv6Header(uint8_t * bytes, size_t payloadLength, uint8_t hopLimit) {
+    memset(bytes, 0, kIPv6HeaderLength);
+    bytes[0] = 0x60;                                    // version 6
+    WriteBigEndian16(&bytes[4], (uint16_t) payloadLength);
+    bytes[6] = IPPROTO_ICMPV6;
+    bytes[7] = hopLimit;
+    bytes[8] = 0x20; bytes[9] = 0x01; bytes[10] = 0x0d; bytes[11] = 0xb8; bytes[23] = 1;
+    bytes[24] = 0x20; bytes[25] = 0x01; bytes[26] = 0x0d; bytes[27] = 0xb8; bytes[39] = 2;
+}
+
+/*! Writes an echo message with a payload like a traceroute probe's: a send time, then zeros.
+ *  \returns The length written.
+ */
+
+static size_t WriteEcho(uint8_t * bytes, uint8_t type, uint16_t identifier, uint16_t sequenceNumber, size_t payloadLength, bool checksummed) {
+    uint64_t    sendTime;
+    uint16_t    checksum;
+
+    memset(bytes, 0, kICMPHeaderLength + payloadLength);
+    bytes[0] = type;
+    WriteBigEndian16(&bytes[4], identifier);
+    WriteBigEndian16(&bytes[6], sequenceNumber);
+    sendTime = SimplePingMonotonicNanoseconds();
+    if (payloadLength >= sizeof(sendTime)) {
+        memcpy(&bytes[kICMPHeaderLength], &sendTime, sizeof(sendTime));
+    }
+    if (checksummed) {
+        checksum = SimplePingChecksum(bytes, kICMPHeaderLength + payloadLength);
+        memcpy(&bytes[2], &checksum, sizeof(checksum));
+    }
+    return kICMPHeaderLength + payloadLength;
+}
+
+NSData * BenchmarkEchoReplyPacket(sa_family_t family, uint16_t identifier, uint16_t sequenceNumber, size_t payloadLength) {
+    NSMutableData *     packet;
+    uint8_t *           bytes;
+
+    if (family == AF_INET) {
+        packet = [NSMutableData dataWithLength:kIPv4HeaderLength + kICMPHeaderLength + payloadLength];
+        bytes = packet.mutableBytes;
+        WriteIPv4Header(bytes, packet.length, 64, 0, 0);
+        (void) WriteEcho(bytes + kIPv4HeaderLength, ICMPv4TypeEchoReply, identifier, sequenceNumber, payloadLength, true);
+    } else {
+        // The kernel checks ICMPv6 checksums and strips the IPv6 header.
+
+        packet = [NSMutableData dataWithLength:kICMPHeaderLength + payloadLength];
+        (void) WriteEcho(packet.mutableBytes, ICMPv6TypeEchoReply, identifier, sequenceNumber, payloadLength, false);
+    }
+    return packet;
+}
+
+NSData * BenchmarkTimeExceededPacket(sa_family_t family, uint16_t identifier, uint16_t sequenceNumber, size_t payloadLength) {
+    NSMutableData *     packet;
+    uint8_t *           bytes;
+    uint16_t            checksum;
+    size_t              quotedLength;
+
+    if (family == AF_INET) {
+
+        // Outer header from the router, time exceeded, then the request it dropped, whose 
+        // TTL had run out.
+
+        quotedLength = kIPv4HeaderLength + kICMPHeaderLength + payloadLength;
+        packet = [NSMutableData dataWithLength:kIPv4HeaderLength + kICMPHeaderLength + quotedLength];
+        bytes = packet.mutableBytes;
+        WriteIPv4Header(bytes, packet.length, 254, 1, 0);
+        bytes += kIPv4HeaderLength;
+        bytes[0] = kICMPv4TimeExceeded;
+        WriteIPv4Header(bytes + kICMPHeaderLength, quotedLength, 1, 0, 2);
+        (void) WriteEcho(bytes + kICMPHeaderLength + kIPv4HeaderLength, ICMPv4TypeEchoRequest, identifier, sequenceNumber, payloadLength, true);
+        checksum = SimplePingChecksum(bytes, kICMPHeaderLength + quotedLength);
+        memcpy(&bytes[2], &checksum, sizeof(checksum));
+    } else {
+        quotedLength = kIPv6HeaderLength + kICMPHeaderLength + payloadLength;
+        packet = [NSMutableData dataWithLength:kICMPHeaderLength + quotedLength];
+        bytes = packet.mutableBytes;
+        bytes[0] = kICMPv6TimeExceeded;
+        WriteIPv6Header(bytes + kICMPHeaderLength, kICMPHeaderLength + payloadLength, 1);
+        (void) WriteEcho(bytes + kICMPHeaderLength + kIPv6HeaderLength, ICMPv6TypeEchoRequest, identifier, sequenceNumber, payloadLength, false);
+    }
+    return packet;
+}
+
+NSData * BenchmarkLoopbackAddress(sa_family_t family) {
+    if (family == AF_INET) {
+        struct sockaddr_in      address;
+
+        memset(&address, 0, sizeof(address));
+        address.sin_len = sizeof(address);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return [NSData dataWithBytes:&address length:sizeof(address)];
+    } else {
+        struct sockaddr_in6     address;
+
+        memset(&address, 0, sizeof(address));
+        address.sin6_len = sizeof(address);
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_loopback;
+        return [NSData dataWithBytes:&address length:sizeof(address)];
+    }
+}
@@ -0,0 +1,282 @@
+/*
+    Abstract:
+    Replays a session recording through the packet parsers, timing them on real traffic,
+    and summarises what was recorded.
+ */
+
+#import "Benchmarks.h"
+
+#include <stdlib.h>
+
+#pragma mark * Private interfaces
+
+// As in PacketBenchmarks.m, the replay drives the receive paths directly, without a socket.
+
+@interface SimplePing (Replay)
+
+- (void)setHostAddress:(NSData *)hostAddress;
+- (void)setNextSequenceNumber:(uint16_t)nextSequenceNumber;
+- (void)setNextSequenceNumberHasWrapped:(BOOL)nextSequenceNumberHasWrapped;
+- (BOOL)validatePingResponsePacket:(NSMutableData *)packet sequenceNumber:(uint16_t *)sequenceNumberPtr;
+
+@end
+
+@interface SimpleTraceroute (Replay)
+
+- (void)setHostAddress:(NSData *)hostAddress;
+- (void)setIdentifier:(uint16_t)identifier;
+- (void)processReceivedBytes:(const uint8_t *)bytes length:(size_t)length fromAddress:(const struct sockaddr *)sourceAddress addressLength:(socklen_t)sourceAddressLength timing:(SimplePingTiming)timing;
+
+@end
+
+#pragma mark * Summaries
+
+/*! What one kind of record in a recording adds up to.
+ */
+
+typedef struct {
+    uint64_t    records;
+    uint64_t    responses;          ///< Records with SimplePingSessionRecordFlagValid.
+    uint64_t    timeouts;           ///< Records with SimplePingSessionRecordFlagTimeout.
+    uint64_t    mismatches;         ///< Recorded replies the parser now rejects.
+    uint64_t    parseNanoseconds;   ///< Time spent in the parser, over every packet replayed.
+    uint64_t    packets;            ///< Packets replayed.
+    uint64_t    rttCount;           ///< Responses with a round trip time.
+    uint64_t    minimumRTT;
+    uint64_t    maximumRTT;
+    double      totalRTT;
+} ReplaySummary;
+
+/*! Adds a record's round trip time, if it has one, to a summary.
+ */
+
+static void ReplaySummaryAddRTT(ReplaySummary * summary, const SimplePingSessionRecord * record) {
+    if (record->roundTripNanoseconds != 0) {
+        if ( (summary->minimumRTT == 0) || (record->roundTripNanoseconds < summary->minimumRTT) ) {
+            summary->minimumRTT = record->roundTripNanoseconds;
+        }
+        if (record->roundTripNanoseconds > summary->maximumRTT) {
+            summary->maximumRTT = record->roundTripNanoseconds;
+        }
+        summary->totalRTT += (double) record->roundTripNanoseconds;
+        summary->rttCount += 1;
+    }
+}
+
+/*! Works out whether a recorded ping is the first record of that ping.
+ *  \details A ping can be recorded more than once: a timeout followed by the late reply,
+ *      which SimplePing still accepts while its sequence number is inside its sequence
+ *      window, or a reply followed by its duplicates.  Live, only the first of these was
+ *      counted.  Sequence numbers wrap, so a ping only matches one counted within the last
+ *      half of the sequence space, the most the sequence window can be.
+ *  \param pingerCounts Maps each pinger, by target and identifier, to the number of its
+ *      pings counted so far.
+ *  \param countedPings Maps each ping counted to its pinger's count when it was counted.
+ *  \param record The record, of a reply or a timeout.
+ *  \returns YES if the ping hadn't been counted yet.
+ */
+
+static BOOL ReplayCountPing(NSMutableDictionary<NSNumber *, NSNumber *> * pingerCounts, NSMutableDictionary<NSNumber *, NSNumber *> * countedPings, const SimplePingSessionRecord * record) {
+    NSNumber *  pingerKey;
+    NSNumber *  pingKey;
+    NSNumber *  previous;
+    uint64_t    ordinal;
+
+    pingerKey = @(((uint64_t) record->targetIdentifier << 16) | record->identifier);
+    pingKey   = @(((uint64_t) record->targetIdentifier << 32) | ((uint64_t) record->identifier << 16) | record->sequenceNumber);
+    ordinal   = pingerCounts[pingerKey].unsignedLongLongValue;
+    previous  = countedPings[pingKey];
+    if ( (previous != nil) && ((ordinal - previous.unsignedLongLongValue) < 32768) ) {
+        return NO;
+    }
+    countedPings[pingKey]   = @(ordinal);
+    pingerCounts[pingerKey] = @(ordinal + 1);
+    return YES;
+}
+
+/*! Prints a summary.
+ *  \param name The kind of record summarised.
+ *  \param summary The summary.
+ */
+
+static void ReplaySummaryPrint(const char * name, const ReplaySummary * summary) {
+    uint64_t    probes;
+
+    if (summary->records == 0) {
+        return;
+    }
+    probes = summary->responses + summary->timeouts;
+    fprintf(stdout, "  %-10s %10llu records  %10llu responses  %10llu timeouts  %6.2f%% loss\n",
+        name,
+        (unsigned long long) summary->records,
+        (unsigned long long) summary->responses,
+        (unsigned long long) summary->timeouts,
+        (probes == 0) ? 0.0 : 100.0 * (double) summary->timeouts / (double) probes
+    );
+    if (summary->rttCount != 0) {
+        fprintf(stdout, "  %-10s rtt min/avg/max %.3f/%.3f/%.3f ms\n",
+            "",
+            (double) summary->minimumRTT / 1e6,
+            summary->totalRTT / (double) summary->rttCount / 1e6,
+            (double) summary->maximumRTT / 1e6
+        );
+    }
+    if (summary->packets != 0) {
+        fprintf(stdout, "  %-10s parsing %8.2f ns/packet, %llu recorded replies now rejected\n",
+            "",
+            (double) summary->parseNanoseconds / (double) summary->packets,
+            (unsigned long long) summary->mismatches
+        );
+    }
+}
+
+#pragma mark * Replay
+
+/*! Feeds a recorded ping reply back through SimplePing's validation.
+ *  \details The pinger is set up as the recording one was, as far as this packet is
+ *      concerned: its identifier, and a sequence number just sent.  The recording doesn't
+ *      say what an unexpected packet's sequence number was checked against, so only
+ *      replies are checked for the parser still accepting them.
+ */
+
+static void ReplayPingRecord(SimplePing * pinger, NSMutableData * buffer, const SimplePingSessionRecord * record, ReplaySummary * summary) {
+    uint64_t    start;
+    uint16_t    sequenceNumber;
+    BOOL        valid;
+
+    if (pinger.identifier != record->identifier) {
+        [pinger setValue:@(record->identifier) forKey:@"identifier"];
+    }
+    [pinger setNextSequenceNumber:(uint16_t) (record->sequenceNumber + 1)];
+
+    start = SimplePingMonotonicNanoseconds();
+    [buffer replaceBytesInRange:NSMakeRange(0, buffer.length) withBytes:record->packet length:record->capturedLength];
+    valid = [pinger validatePingResponsePacket:buffer sequenceNumber:&sequenceNumber];
+    summary->parseNanoseconds += SimplePingMonotonicNanoseconds() - start;
+    summary->packets += 1;
+
+    if ( ! valid && ((record->flags & SimplePingSessionRecordFlagValid) != 0) ) {
+        summary->mismatches += 1;
+    }
+}
+
+/*! Feeds a recorded traceroute response back through SimpleTraceroute's parser and filter.
+ *  \details The traceroute isn't running, so the response is parsed and checked for being
+ *      ours, then fails to match a probe; see BenchmarkPacketParsing.
+ */
+
+static void ReplayTracerouteRecord(SimpleTraceroute * traceroute, const SimplePingSessionRecord * record, ReplaySummary * summary) {
+    struct sockaddr_storage responder;
+    socklen_t               responderLength;
+    SimplePingTiming        timing = { 0, 0, 0 };
+    uint64_t                start;
+
+    if (traceroute.identifier != record->identifier) {
+        [traceroute setIdentifier:record->identifier];
+    }
+    responderLength = SimplePingSessionRecordGetResponder(record, &responder);
+
+    start = SimplePingMonotonicNanoseconds();
+    [traceroute processReceivedBytes:record->packet length:record->capturedLength fromAddress:(const struct sockaddr *) &responder addressLength:responderLength timing:timing];
+    summary->parseNanoseconds += SimplePingMonotonicNanoseconds() - start;
+    summary->packets += 1;
+}
+
+void BenchmarkReplay(const char * path) {
+    SimplePingSessionReader *   reader;
+    int                         err;
+    uint64_t                    recordCount;
+    uint64_t                    startWall;
+    uint64_t                    index;
+    ReplaySummary               pingSummary;
+    ReplaySummary               tracerouteSummary;
+    SimplePing *                pingers[2];
+    SimpleTraceroute *          traceroutes[2];
+    NSMutableData *             buffer;
+    NSMutableDictionary *       pingerCounts;
+    NSMutableDictionary *       countedPings;
+
+    err = SimplePingSessionReaderOpen(path, &reader);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(err));
+        exit(EXIT_FAILURE);
+    }
+    recordCount = SimplePingSessionReaderRecordCount(reader);
+    SimplePingSessionReaderGetStartTime(reader, NULL, &startWall);
+
+    // One pinger and one traceroute per address family, as the parsers expect the IPv4
+    // header on IPv4 packets only.
+
+    for (index = 0; index < 2; index++) {
+        NSData *    address;
+
+        address = BenchmarkLoopbackAddress((index == 0) ? AF_INET : AF_INET6);
+        pingers[index] = [[SimplePing alloc] initWithHostAddress:address];
+        [pingers[index] setHostAddress:address];
+        [pingers[index] setNextSequenceNumberHasWrapped:YES];
+        traceroutes[index] = [[SimpleTraceroute alloc] initWithHostName:@"localhost"];
+        [traceroutes[index] setHostAddress:address];
+    }
+    buffer = [NSMutableData dataWithCapacity:kSimplePingSessionRecordPacketCapacity];
+    memset(&pingSummary, 0, sizeof(pingSummary));
+    memset(&tracerouteSummary, 0, sizeof(tracerouteSummary));
+    pingerCounts = [NSMutableDictionary dictionary];
+    countedPings = [NSMutableDictionary dictionary];
+
+    fprintf(stdout, "replay %s, %llu records, recorded %s\n",
+        path,
+        (unsigned long long) recordCount,
+        [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval) startWall / 1e9].description.UTF8String
+    );
+    @autoreleasepool {
+        for (index = 0; index < recordCount; index++) {
+            const SimplePingSessionRecord * record;
+            ReplaySummary *                 summary;
+            size_t                          familyIndex;
+            BOOL                            counts;
+
+            record = SimplePingSessionReaderRecordAtIndex(reader, index);
+            if (record->kind == SimplePingSessionRecordKindPing) {
+                summary = &pingSummary;
+            } else if (record->kind == SimplePingSessionRecordKindTraceroute) {
+                summary = &tracerouteSummary;
+            } else {
+                continue;
+            }
+            summary->records += 1;
+
+            // Late and duplicate replies are parsed, but not counted again.
+
+            counts = YES;
+            if ( (summary == &pingSummary) && ((record->flags & (SimplePingSessionRecordFlagValid | SimplePingSessionRecordFlagTimeout)) != 0) ) {
+                counts = ReplayCountPing(pingerCounts, countedPings, record);
+            }
+            if ((record->flags & SimplePingSessionRecordFlagTimeout) != 0) {
+                if (counts) {
+                    summary->timeouts += 1;
+                }
+                continue;
+            }
+            if ( counts && ((record->flags & SimplePingSessionRecordFlagValid) != 0) ) {
+                summary->responses += 1;
+                ReplaySummaryAddRTT(summary, record);
+            }
+
+            // Packets cut short by the capture would fail the checksum, so aren't replayed.
+
+            if ( (record->addressFamily != AF_INET && record->addressFamily != AF_INET6) || (record->capturedLength != record->packetLength) ) {
+                continue;
+            }
+            familyIndex = (record->addressFamily == AF_INET) ? 0 : 1;
+            if (summary == &pingSummary) {
+                ReplayPingRecord(pingers[familyIndex], buffer, record, summary);
+            } else {
+                ReplayTracerouteRecord(traceroutes[familyIndex], record, summary);
+            }
+        }
+    }
+    ReplaySummaryPrint("ping", &pingSummary);
+    ReplaySummaryPrint("traceroute", &tracerouteSummary);
+
+    SimplePingSessionReaderClose(reader);
+}
@@ -0,0 +1,199 @@
+/*
+    Abstract:
+    A command line tool that measures the hot paths of SimplePing against their earlier versions, 
+    and the package end to end on the loopback interface.
+ */
+
+#import "Benchmarks.h"
+
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#pragma mark * Earlier implementations
+
+/*! The checksum SimplePing used before SimplePingChecksum.
+ *  \details This is the standard BSD checksum code, modified to use modern types.
+ */
+
+static uint16_t LegacyInCksum(const void * buffer, size_t bufferLen) {
+    size_t              bytesLeft;
+    int32_t             sum;
+    const uint16_t *    cursor;
+    union {
+        uint16_t        us;
+        uint8_t         uc[2];
+    } last;
+
+    bytesLeft = bufferLen;
+    sum = 0;
+    cursor = buffer;
+
+    while (bytesLeft > 1) {
+        sum += *cursor;
+        cursor += 1;
+        bytesLeft -= 2;
+    }
+    if (bytesLeft == 1) {
+        last.uc[0] = * (const uint8_t *) cursor;
+        last.uc[1] = 0;
+        sum += last.us;
+    }
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+/*! The checksum SimpleTraceroute used before SimplePingChecksum.
+ *  \details This one byte swaps every word.
+ */
+
+static uint16_t LegacyTracerouteChecksum(const void * buffer, size_t bufferLen) {
+    const uint16_t *    words;
+    size_t              wordCount;
+    uint32_t            sum;
+    size_t              i;
+
+    words = buffer;
+    wordCount = bufferLen / 2;
+    sum = 0;
+    for (i = 0; i < wordCount; i++) {
+        sum += ntohs(words[i]);
+    }
+    if (bufferLen % 2 == 1) {
+        sum += (uint32_t) ((const uint8_t *) buffer)[bufferLen - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons((uint16_t) ~sum);
+}
+
+#pragma mark * Benchmarks
+
+typedef uint16_t (*ChecksumFunction)(const void * buffer, size_t bufferLen);
+
+volatile uint32_t gSink;
+
+/*! Times a checksum function over a buffer.
+ *  \param name The name to print.
+ *  \param function The function to time.
+ *  \param buffer The data to checksum.
+ *  \param bufferLen The length of that data.
+ *  \param iterations How many times to checksum it.
+ */
+
+static void BenchmarkChecksum(const char * name, ChecksumFunction function, const uint8_t * buffer, size_t bufferLen, uint32_t iterations) {
+    uint64_t    start;
+    uint64_t    elapsed;
+    uint32_t    sum;
+    uint32_t    i;
+
+    sum = 0;
+    for (i = 0; i < iterations / 16; i++) {             // warm up
+        sum += function(buffer, bufferLen);
+    }
+    start = SimplePingMonotonicNanoseconds();
+    for (i = 0; i < iterations; i++) {
+        sum += function(buffer, bufferLen);
+    }
+    elapsed = SimplePingMonotonicNanoseconds() - start;
+    gSink += sum;
+
+    fprintf(stdout, "  %-22s %6zu bytes  %8.2f ns/op  %8.2f GB/s\n",
+        name,
+        bufferLen,
+        (double) elapsed / iterations,
+        (elapsed == 0) ? 0.0 : ((double) bufferLen * iterations) / (double) elapsed
+    );
+}
+
+/*! Compares SimplePingChecksum with the implementations it replaced.
+ *  \details The buffers are offset by one byte so that none of them is aligned.
+ */
+
+void BenchmarkChecksums(void) {
+    static const size_t kLengths[] = { 64, 65, 1400, 9000 };
+    uint8_t *           storage;
+    const uint8_t *     buffer;
+    size_t              i;
+    size_t              lengthIndex;
+
+    storage = malloc(9000 + 1);
+    for (i = 0; i < 9000 + 1; i++) {
+        storage[i] = (uint8_t) arc4random();
+    }
+    buffer = storage + 1;
+
+    fprintf(stdout, "checksum\n");
+    for (lengthIndex = 0; lengthIndex < sizeof(kLengths) / sizeof(kLengths[0]); lengthIndex++) {
+        size_t      length;
+        uint32_t    iterations;
+
+        length = kLengths[lengthIndex];
+        iterations = (uint32_t) (64 * 1024 * 1024 / length);
+
+        // Check the answers before timing anything.
+
+        if ( (SimplePingChecksum(buffer, length) != LegacyInCksum(buffer, length)) || (SimplePingChecksum(buffer, length) != LegacyTracerouteChecksum(buffer, length)) ) {
+            fprintf(stderr, "checksum mismatch at length %zu\n", length);
+            exit(EXIT_FAILURE);
+        }
+
+        BenchmarkChecksum("in_cksum",              LegacyInCksum,            buffer, length, iterations);
+        BenchmarkChecksum("traceroute (ntohs)",    LegacyTracerouteChecksum, buffer, length, iterations);
+        BenchmarkChecksum("SimplePingChecksum",    SimplePingChecksum,       buffer, length, iterations);
+    }
+    free(storage);
+}
+
+#pragma mark * Main
+
+/*! Prints how to run the tool.
+ */
+
+static void PrintUsage(void) {
+    fprintf(stderr, "usage: SimplePingBenchmarks [micro | load [seconds] | all [seconds] | replay path]\n");
+    fprintf(stderr, "  micro  checksum, packet building and packet parsing (the default)\n");
+    fprintf(stderr, "  load   ping and traceroute loopback as fast as it answers, 5 seconds a scenario\n");
+    fprintf(stderr, "  replay parse the packets of a session recording, and summarise it\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char *    mode;
+    NSTimeInterval  duration;
+
+    mode = (argc > 1) ? argv[1] : "micro";
+    if (strcmp(mode, "replay") == 0) {
+        if (argc != 3) {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+        @autoreleasepool {
+            BenchmarkReplay(argv[2]);
+        }
+        return EXIT_SUCCESS;
+    }
+    duration = (argc > 2) ? atof(argv[2]) : 5.0;
+    if ( (argc > 3) || (duration <= 0.0) ) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    @autoreleasepool {
+        if (strcmp(mode, "micro") == 0) {
+            BenchmarkChecksums();
+            BenchmarkPackets();
+        } else if (strcmp(mode, "load") == 0) {
+            BenchmarkLoad(duration);
+        } else if (strcmp(mode, "all") == 0) {
+            BenchmarkChecksums();
+            BenchmarkPackets();
+            BenchmarkLoad(duration);
+        } else {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
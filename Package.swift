@@ -39,6 +39,11 @@ let package = Package(
             dependencies: ["SimplePing", "SimpleTraceroute"],
             path: "SwiftSimplePing"
         ),
+        .executableTarget(
+            name: "SimplePingBenchmarks",
+            dependencies: ["SimplePing", "SimpleTraceroute"],
+            path: "Benchmarks/SimplePingBenchmarks"
+        ),
 
     ]
 )
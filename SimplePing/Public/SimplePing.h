@@ -9,10 +9,24 @@
 @import Foundation;
 #import <sys/socket.h>
 #include <AssertMacros.h>           // for __Check_Compile_Time
+#import "SimplePingTiming.h"
+#import "SimplePingPacketTemplate.h"
+#import "SimplePingChecksum.h"
+#import "SimplePingEventSources.h"
+#import "SimplePingHostCache.h"
+#import "SimplePingHostResolver.h"
+#import "SimplePingRateLimiter.h"
+#import "SimplePingTimeoutWheel.h"
+#import "SimplePingLog.h"
+#import "SimplePingMetrics.h"
+#import "SimplePingSocketFilter.h"
+#import "SimplePingSessionRecorder.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @protocol SimplePingDelegate;
+@class SimplePingEngine;
+@class SimplePingResponse;
 
 /*! Controls the IP address version used by SimplePing instances.
  */
@@ -23,6 +37,20 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
     SimplePingAddressStyleICMPv6        ///< Use the first IPv6 address found.
 };
 
+/*! Returns the address family an address style resolves to.
+ *  \param addressStyle The address style.
+ *  \returns `AF_INET`, `AF_INET6`, or `AF_UNSPEC` for `SimplePingAddressStyleAny`; suitable 
+ *      for `-[SimplePingHostResolver addressFamily]`.
+ */
+
+static inline sa_family_t SimplePingAddressFamilyForAddressStyle(SimplePingAddressStyle addressStyle) {
+    switch (addressStyle) {
+        case SimplePingAddressStyleICMPv4: return AF_INET;
+        case SimplePingAddressStyleICMPv6: return AF_INET6;
+        default:                           return AF_UNSPEC;
+    }
+}
+
 /*! An object wrapper around the low-level BSD Sockets ping function.
  *  \details To use the class create an instance, set the delegate and call `-start` 
  *      to start the instance on the current run loop.  If things go well you'll soon get the 
@@ -32,7 +60,9 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
  *      `-simplePing:didReceiveUnexpectedPacket:` delegate callbacks as ICMP packets arrive.
  *
  *      The class can be used from any thread but the use of any single instance must be 
- *      confined to a specific thread and that thread must run its run loop.
+ *      confined to a specific thread and that thread must run its run loop.  Alternatively, 
+ *      set `dispatchQueue` and the instance runs on that serial queue instead, with no run 
+ *      loop involved.
  */
 
 @interface SimplePing : NSObject
@@ -45,20 +75,75 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
  *  \returns The initialised object.
  */
 
-- (instancetype)initWithHostName:(NSString *)hostName NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithHostName:(NSString *)hostName;
+
+/*! Initialise the object to ping the specified host through a shared engine.
+ *  \details Instead of opening its own ICMP socket the object sends and receives through 
+ *      the engine's shared sockets, so that many pingers cost only one socket per address 
+ *      family.  Apart from that the object behaves exactly like one created with 
+ *      `-initWithHostName:`.
+ *  \param hostName The DNS name of the host to ping; an IPv4 or IPv6 address in string form will 
+ *      work here.
+ *  \param engine The engine to use, or nil to use a private socket.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostName:(NSString *)hostName engine:(nullable SimplePingEngine *)engine NS_DESIGNATED_INITIALIZER;
 
-/*! A copy of the value passed to `-initWithHostName:`.
+/*! Initialise the object to ping an address that has already been resolved.
+ *  \details Equivalent to `-initWithHostAddress:engine:` with a nil engine.
+ *  \param hostAddress The address to ping; the contents of the NSData is a (struct sockaddr) 
+ *      of some form.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress;
+
+/*! Initialise the object to ping an address that has already been resolved.
+ *  \details Starting the object then skips name resolution entirely, so it can't fail for 
+ *      DNS reasons and costs no lookup, however often it's restarted.  `hostName` is the 
+ *      address in numeric form and `addressStyle` is not consulted.  Because there's 
+ *      nothing to wait for, `-simplePing:didStartWithAddress:` is called before `-start` 
+ *      returns.
+ *  \param hostAddress The address to ping; the contents of the NSData is a (struct sockaddr) 
+ *      of some form.
+ *  \param engine The engine to use, or nil to use a private socket.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress engine:(nullable SimplePingEngine *)engine;
+
+/*! A copy of the value passed to `-initWithHostName:`, or the address passed to 
+ *  `-initWithHostAddress:` in numeric form.
  */
 
 @property (nonatomic, copy, readonly) NSString * hostName;
 
+/*! The engine passed to `-initWithHostName:engine:`, if any.
+ */
+
+@property (nonatomic, strong, readonly, nullable) SimplePingEngine * engine;
+
 /*! The delegate for this object.
  *  \details Delegate callbacks are schedule in the default run loop mode of the run loop of the 
- *      thread that calls `-start`.
+ *      thread that calls `-start`, or on `dispatchQueue` if that's set.
  */
 
 @property (nonatomic, weak, readwrite, nullable) id<SimplePingDelegate> delegate;
 
+/*! The serial queue the object runs on, or nil to use the run loop of the thread that calls `-start`.
+ *  \details With a queue, name resolution, socket reads and delegate callbacks all happen on 
+ *      that queue, using dispatch sources rather than run loop sources.  This lets you pin 
+ *      pinging to a dedicated queue, for example one with `QOS_CLASS_USER_INTERACTIVE`, so 
+ *      that replies are read promptly however busy the main thread is.  You must then 
+ *      call `-start`, `-sendPingWithData:` and `-stop` on that queue.
+ *
+ *      You should set this value before starting the object.  If the object uses an engine 
+ *      this must be the engine's `dispatchQueue`.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) dispatch_queue_t dispatchQueue;
+
 /*! Controls the IP address version used by the object.
  *  \details You should set this value before starting the object.
  */
@@ -80,7 +165,9 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
 
 /*! The identifier used by pings by this object.
  *  \details When you create an instance of this object it generates a random identifier 
- *      that it uses to identify its own pings.
+ *      that it uses to identify its own pings.  If the object uses an engine, the engine 
+ *      may re-pick this value on start to keep it unique among the pingers of the same 
+ *      address.
  */
 
 @property (nonatomic, assign, readonly) uint16_t identifier;
@@ -94,6 +181,94 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
 
 @property (nonatomic, assign, readonly) uint16_t nextSequenceNumber;
 
+/*! The maximum number of packets read per socket readiness callback.
+ *  \details When the socket becomes readable the object keeps reading, without blocking, 
+ *      until the socket is drained or this many packets have been read, rather than going 
+ *      back to the run loop after every packet.  This matters when replies arrive in bursts. 
+ *      The default is 32; 1 restores the one-packet-per-callback behaviour.  Objects that 
+ *      use an engine are governed by the engine's `receiveBatchLimit` instead.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger receiveBatchLimit;
+
+/*! How many of the most recently sent sequence numbers responses are accepted for, once 
+ *  sequence numbers have wrapped.
+ *  \details Before the wrap any sequence number already sent is accepted.  After it the 
+ *      object can't tell an old sequence number from a new one, so it only accepts the last 
+ *      this many.  The default of 120 is two minutes, the classic maximum packet lifetime, 
+ *      at one ping per second; scale it with the ping rate, for example to 
+ *      `120 * packetsPerSecond`.  Values above 32768 are treated as 32768, so that at least 
+ *      half of the sequence space is always rejected.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger sequenceWindow;
+
+/*! Whether packets that are certainly someone else's are dropped without telling the delegate.
+ *  \details Every ICMP socket on the host sees every ICMP message, so most of what a busy 
+ *      host reads is other processes' pings and, on IPv6, Neighbor Discovery traffic.  Each 
+ *      packet read is first checked, on the raw bytes and before any copy is made, with 
+ *      `SimplePingPacketIsForeign`.  If this is YES, or the delegate doesn't implement 
+ *      `-simplePing:didReceiveUnexpectedPacket:`, a foreign packet is counted in `metrics` 
+ *      as unexpected and dropped there; otherwise it's still passed to that callback.  ICMP 
+ *      errors about our own pings are never dropped.  The default is NO.  Objects that use 
+ *      an engine get only the packets the engine has matched to them, so for them this 
+ *      makes no difference.
+ */
+
+@property (nonatomic, assign, readwrite) BOOL ignoresForeignPackets;
+
+/*! Whether the object's socket is connected to `hostAddress`.
+ *  \details A connected socket only receives packets from the host being pinged, so the 
+ *      kernel drops everyone else's replies before the object ever wakes up.  But it also 
+ *      drops ICMP errors, such as destination unreachable, that come from routers along 
+ *      the way, so those never reach `-simplePing:didReceiveUnexpectedPacket:`.  The 
+ *      default is NO.  You should set this value before starting the object.  It has no 
+ *      effect if the object uses an engine, whose sockets are shared.
+ */
+
+@property (nonatomic, assign, readwrite) BOOL usesConnectedSocket;
+
+/*! A recorder to append every packet the object reads to, with its raw bytes, or nil.
+ *  \details Each packet is recorded whether or not it turns out to be a reply to one of 
+ *      our pings; replies have `SimplePingSessionRecordFlagValid` set, their sequence 
+ *      number, and their round trip time if the send time is still known.  Foreign 
+ *      packets dropped by `ignoresForeignPackets` aren't recorded.  The object doesn't know 
+ *      when a ping is lost, so that's up to the client; `SwiftSimplePing` records its reply 
+ *      timeouts.  The default is nil.  You may set this at any time.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingSessionRecorder * sessionRecorder;
+
+/*! The `targetIdentifier` of the object's records, to tell targets apart in a shared recording.
+ *  \details The default is 0.
+ */
+
+@property (nonatomic, assign, readwrite) uint32_t sessionTargetIdentifier;
+
+/*! Whether pings are sent with the don't fragment bit set.
+ *  \details With this YES the object sets `IP_DONTFRAG` or `IPV6_DONTFRAG` on its socket, 
+ *      so a ping too big for the path is dropped, rather than fragmented, by whichever 
+ *      host or router can't pass it.  If that's this host, sending fails with `EMSGSIZE`; 
+ *      if it's a router, it sends back a "fragmentation needed" or "packet too big" error, 
+ *      which arrives via `-simplePing:didReceiveUnexpectedPacket:`.  The object fails to 
+ *      start if the option can't be set.  The default is NO.  You should set this value 
+ *      before starting the object.  It has no effect if the object uses an engine.  See 
+ *      `SimplePingPathMTUDiscovery`, which is built on this.
+ */
+
+@property (nonatomic, assign, readwrite) BOOL dontFragment;
+
+/*! A snapshot of the object's metrics: packets sent and received, and so on.
+ *  \details The counts are kept for the object's whole life, across `-stop` and `-start`, 
+ *      and each is also added to `+[SimplePingMetricsSnapshot processSnapshot]`.  Counting 
+ *      costs a few relaxed atomic adds per packet and takes no locks, so it's always on.  
+ *      `filteringTime` runs from reading a packet to deciding whether it's ours, and 
+ *      `callbackCount` counts the response callbacks.  This object never times out pings, 
+ *      so its `timeouts` stays 0.  You may read this from any thread.
+ */
+
+@property (nonatomic, strong, readonly) SimplePingMetricsSnapshot * metrics;
+
 /*! Starts the object.
  *  \details You should set up the delegate and any ping parameters before calling this.
  *      
@@ -218,7 +393,9 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
  *      IMPORTANT: This callback is especially common when using IPv6 because IPv6 uses ICMP 
  *      for important network management functions.  For example, IPv6 routers periodically 
  *      send out Router Advertisement (RA) packets via Neighbor Discovery Protocol (NDP), which 
- *      is implemented on top of ICMP.
+ *      is implemented on top of ICMP.  On IPv6 the object asks the kernel for echo replies 
+ *      and errors only, with `SimplePingInstallICMPFilter`, which rules those out, and 
+ *      `ignoresForeignPackets` rules out other processes' traffic too.
  *
  *      For more on matching, see the discussion associated with 
  *      `-simplePing:didReceivePingResponsePacket:sequenceNumber:`.
@@ -229,6 +406,61 @@ typedef NS_ENUM(NSInteger, SimplePingAddressStyle) {
 
 - (void)simplePing:(SimplePing *)pinger didReceiveUnexpectedPacket:(NSData *)packet;
 
+@optional
+
+/*! A SimplePing delegate callback, called when the object receives a ping response, with timing.
+ *  \details If the delegate implements this callback it is called instead of 
+ *      `-simplePing:didReceivePingResponsePacket:sequenceNumber:`.  The send time is taken 
+ *      from a monotonic clock just before the request is handed to the kernel, and the 
+ *      receive time is the kernel's own receive timestamp, so the round trip time is 
+ *      unaffected both by wall clock changes and by how long the run loop took to get 
+ *      around to reading the response.  See `SimplePingTiming`.
+ *  \param pinger The object issuing the callback.
+ *  \param packet The packet received; see `-simplePing:didReceivePingResponsePacket:sequenceNumber:`.
+ *  \param sequenceNumber The ICMP sequence number of that packet.
+ *  \param timing The times of the exchange.  `sendTime` is 0 if the request is too old 
+ *      for the object to remember when it was sent.
+ */
+
+- (void)simplePing:(SimplePing *)pinger didReceivePingResponsePacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber timing:(SimplePingTiming)timing;
+
+/*! A SimplePing delegate callback, called with all the ping responses read in one go.
+ *  \details If the delegate implements this callback the object collects the ping responses 
+ *      it reads from one socket readiness callback (see `receiveBatchLimit`) and delivers 
+ *      them here, in the order received, instead of calling 
+ *      `-simplePing:didReceivePingResponsePacket:sequenceNumber:` or 
+ *      `-simplePing:didReceivePingResponsePacket:sequenceNumber:timing:` per packet. 
+ *      Unexpected packets are still reported one at a time, as they are read.
+ *  \param pinger The object issuing the callback.
+ *  \param responses The responses; never empty.
+ */
+
+- (void)simplePing:(SimplePing *)pinger didReceivePingResponses:(NSArray<SimplePingResponse *> *)responses;
+
+@end
+
+/*! A ping response, as delivered by `-simplePing:didReceivePingResponses:`.
+ */
+
+@interface SimplePingResponse : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! The packet received; see `-simplePing:didReceivePingResponsePacket:sequenceNumber:`.
+ */
+
+@property (nonatomic, copy,   readonly) NSData *            packet;
+
+/*! The ICMP sequence number of that packet.
+ */
+
+@property (nonatomic, assign, readonly) uint16_t            sequenceNumber;
+
+/*! The times of the exchange; see `-simplePing:didReceivePingResponsePacket:sequenceNumber:timing:`.
+ */
+
+@property (nonatomic, assign, readonly) SimplePingTiming    timing;
+
 @end
 
 #pragma mark * ICMP On-The-Wire Format
@@ -269,3 +501,6 @@ enum {
 };
 
 NS_ASSUME_NONNULL_END
+
+#import "SimplePingEngine.h"
+#import "SimplePingPathMTUDiscovery.h"
@@ -0,0 +1,50 @@
+/*
+    Abstract:
+    The Internet checksum (RFC 1071), using a wide accumulator and SIMD where available.
+ */
+
+#ifndef SimplePingChecksum_h
+#define SimplePingChecksum_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Calculates an IP checksum.
+ *  \details This computes the same value as the classic BSD `in_cksum`, but sums 32-bit 
+ *      words into a 64-bit accumulator (which can't overflow for any packet size) and, on 
+ *      arm64 and x86_64, 16 bytes at a time with NEON or SSE2.  The buffer needn't be 
+ *      aligned.
+ *  \param buffer A pointer to the data to checksum.
+ *  \param bufferLen The length of that data.
+ *  \returns The checksum value, in network byte order.
+ */
+
+extern uint16_t SimplePingChecksum(const void * buffer, size_t bufferLen);
+
+/*! Adds data to a running checksum sum.
+ *  \details Use this, and `SimplePingChecksumFinish`, to checksum data that isn't 
+ *      contiguous.  Every piece but the last must have an even length.
+ *  \param sum The running sum; start with 0.
+ *  \param buffer A pointer to the data to add.
+ *  \param bufferLen The length of that data.
+ *  \returns The new running sum.
+ */
+
+extern uint64_t SimplePingChecksumAccumulate(uint64_t sum, const void * buffer, size_t bufferLen);
+
+/*! Turns a running sum into a checksum.
+ *  \param sum The running sum from `SimplePingChecksumAccumulate`.
+ *  \returns The checksum value, in network byte order.
+ */
+
+extern uint16_t SimplePingChecksumFinish(uint64_t sum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingChecksum_h */
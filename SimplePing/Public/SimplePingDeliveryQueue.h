@@ -0,0 +1,71 @@
+/*
+    Abstract:
+    A lock-free single-producer, single-consumer ring of pointers, for handing results from the queue that produces them to the queue that delivers them.
+ */
+
+#ifndef SimplePingDeliveryQueue_h
+#define SimplePingDeliveryQueue_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! A fixed size ring of pointers, written by one thread and read by another, with no locks.
+ *  \details One thread (or serial queue) may push and one other may pop, concurrently;
+ *      anything else needs a lock around it.  Each side keeps its own index and a cached
+ *      copy of the other's, on separate cache lines, so a push or pop touches memory the
+ *      other side is writing only when the ring looks full or empty.  The ring doesn't own
+ *      what the pointers point to.
+ */
+
+typedef struct SimplePingDeliveryQueue SimplePingDeliveryQueue;
+
+/*! Creates an empty ring.
+ *  \param capacity The number of pointers the ring holds, rounded up to a power of two.
+ *  \returns The ring, or NULL if capacity is 0 or there isn't the memory for it.
+ */
+
+extern SimplePingDeliveryQueue * SimplePingDeliveryQueueCreate(size_t capacity);
+
+/*! Frees a ring.
+ *  \details Neither side may be using it.  Pointers still in the ring are dropped; pop them
+ *      first if they need releasing.
+ *  \param queue The ring; may be NULL.
+ */
+
+extern void SimplePingDeliveryQueueDestroy(SimplePingDeliveryQueue * queue);
+
+/*! Returns the number of pointers the ring holds.
+ */
+
+extern size_t SimplePingDeliveryQueueCapacity(const SimplePingDeliveryQueue * queue);
+
+/*! Adds a pointer at the back of the ring; producer side only.
+ *  \param queue The ring.
+ *  \param item The pointer; must not be NULL, which `SimplePingDeliveryQueuePop` uses for empty.
+ *  \returns false if the ring is full, in which case nothing was added.
+ */
+
+extern bool SimplePingDeliveryQueuePush(SimplePingDeliveryQueue * queue, void * item);
+
+/*! Removes the pointer at the front of the ring; consumer side only.
+ *  \param queue The ring.
+ *  \returns The pointer, or NULL if the ring is empty.
+ */
+
+extern void * SimplePingDeliveryQueuePop(SimplePingDeliveryQueue * queue);
+
+/*! Returns the number of pointers in the ring.
+ *  \details Exact on either side when the other is idle, and otherwise a moment out of date.
+ */
+
+extern size_t SimplePingDeliveryQueueCount(const SimplePingDeliveryQueue * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingDeliveryQueue_h */
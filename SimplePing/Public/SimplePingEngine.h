@@ -0,0 +1,189 @@
+/*
+    Abstract:
+    Multiplexes many SimplePing instances over a single ICMPv4 and a single ICMPv6 socket.
+ */
+
+@import Foundation;
+#import <sys/socket.h>
+#import "SimplePing.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@protocol SimplePingEngineDelegate;
+@protocol SimplePingEngineClient;
+
+/*! Multiplexes many SimplePing instances over a single ICMPv4 and a single ICMPv6 socket.
+ *  \details Without an engine every SimplePing instance opens its own ICMP socket, and
+ *      the kernel delivers every incoming ICMP packet to every one of those sockets.  With
+ *      thousands of targets that means thousands of file descriptors and each reply being
+ *      copied and rejected thousands of times.
+ *
+ *      Create one engine, then create each pinger with `-initWithHostName:engine:`.  Each
+ *      pinger still resolves its own host name and reports to its own delegate exactly as
+ *      before, but sends and receives through the engine's shared sockets.  The engine
+ *      reads each packet once and hands it to the one pinger it belongs to, looked up in a
+ *      hash table keyed by (address, identifier).  Echo replies are keyed by their source
+ *      address; ICMP error messages (destination unreachable, time exceeded and so on) are
+ *      keyed by the destination and identifier of the request they quote.  The pinger then
+ *      applies its usual sequence number checks.
+ *
+ *      The engine opens its sockets lazily, when the first pinger of an address family
+ *      starts, and closes them when the last one stops.  Pingers sharing an engine have
+ *      their identifiers re-picked on start, if necessary, so that no two of them pinging
+ *      the same address use the same identifier.
+ *
+ *      Anything else that sends ICMP echo requests, such as SimpleTraceroute, can share the 
+ *      sockets too by adopting `SimplePingEngineClient`; that's what `-addClient:error:` and 
+ *      `-sendPacket:length:toAddress:hopLimit:` are for.
+ *
+ *      The engine and all of its pingers must be used from the same thread, and that thread
+ *      must run its run loop.  Alternatively, set the engine's `dispatchQueue`, and that of
+ *      each of its pingers, to the same serial queue and use them all from that queue.
+ */
+
+@interface SimplePingEngine : NSObject
+
+/*! The delegate for this object.
+ *  \details Receives packets that don't belong to any pinger using the engine.
+ */
+
+@property (nonatomic, weak, readwrite, nullable) id<SimplePingEngineDelegate> delegate;
+
+/*! The number of started pingers, and other clients, currently using the engine.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger pingerCount;
+
+/*! The maximum number of packets read per socket readiness callback.
+ *  \details See `-[SimplePing receiveBatchLimit]`; the same applies to the shared sockets. 
+ *      Pingers whose delegates take batches get one batch per drain.  The default is 32.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger receiveBatchLimit;
+
+/*! The serial queue the engine's sockets are read on, or nil to use the current run loop.
+ *  \details See `-[SimplePing dispatchQueue]`.  Set this before starting the first pinger; 
+ *      every pinger using the engine must have the same `dispatchQueue`.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) dispatch_queue_t dispatchQueue;
+
+/*! The timer wheel that everything using the engine keeps its probe timeouts on.
+ *  \details Created on first use, with a 10 ms tick, on the engine's `dispatchQueue` or on 
+ *      the current run loop, so set `dispatchQueue` first.  With thousands of clients this 
+ *      costs one timer rather than one per client.
+ */
+
+@property (nonatomic, strong, readonly) SimplePingTimeoutWheel *    timeoutWheel;
+
+/*! Starts routing packets for the specified client through the engine.
+ *  \details SimplePing calls this itself; other clients call it once they have a 
+ *      `hostAddress`.  This opens the engine's socket for that address family if necessary, 
+ *      and may re-pick the client's identifier so that no other client of the same address 
+ *      uses it, so build any packets after this returns.  The engine doesn't retain the 
+ *      client; it must call `-removeClient:` before it goes away.
+ *  \param client The client to add.
+ *  \param errorPtr If not NULL, set to the error if the socket could not be opened, or 
+ *      to ENOMEM if there isn't the memory to route the client's packets.
+ *  \returns YES on success.
+ */
+
+- (BOOL)addClient:(id<SimplePingEngineClient>)client error:(NSError * _Nullable * _Nullable)errorPtr;
+
+/*! Stops routing packets for the specified client.
+ *  \details It's safe to call this for a client that was never added.  The client's 
+ *      `hostAddress` and `identifier` must not have changed since it was added.
+ *  \param client The client to remove.
+ */
+
+- (void)removeClient:(id<SimplePingEngineClient>)client;
+
+/*! Sends a packet on the shared socket for the address's family.
+ *  \details The hop limit is a property of the socket, so the engine remembers what it 
+ *      last set and only calls `setsockopt()` when a send asks for something different.  
+ *      Clients with different hop limits can therefore share a socket, at the cost of a 
+ *      system call each time the hop limit changes.
+ *  \param bytes The packet to send.
+ *  \param length The length of that packet.
+ *  \param address The destination; the contents of the NSData is a (struct sockaddr) of 
+ *      some form.
+ *  \param hopLimit The IPv4 TTL or IPv6 hop limit to send with, or 0 for the system default.
+ *  \returns The number of bytes sent, or -1 with `errno` set, just like `sendto()`.
+ */
+
+- (ssize_t)sendPacket:(const void *)bytes length:(size_t)length toAddress:(NSData *)address hopLimit:(uint8_t)hopLimit;
+
+@end
+
+/*! Something that sends and receives ICMP echo requests through a SimplePingEngine.
+ *  \details The engine routes a packet to the client whose (`hostAddress`, `identifier`) 
+ *      it belongs to, just as it does for pingers.  All of these are called on the engine's 
+ *      run loop thread or queue.
+ */
+
+@protocol SimplePingEngineClient <NSObject>
+
+/*! The address the client sends to; the engine reads this in `-addClient:error:`.
+ */
+
+@property (nonatomic, copy,   readonly, nullable) NSData *  hostAddress;
+
+/*! The ICMP identifier of the client's packets, in host byte order.
+ *  \details `-addClient:error:` may change this.
+ */
+
+@property (nonatomic, assign, readwrite) uint16_t           identifier;
+
+/*! Called by the engine with a packet that belongs to the client.
+ *  \param engine The engine issuing the callback.
+ *  \param packet The packet, exactly as returned by the kernel (in the IPv4 case this 
+ *      includes the IP header); ownership passes to the client.
+ *  \param address The address the packet came from.
+ *  \param addressLength The length of that address.
+ *  \param kernelReceiveTime When the kernel received the packet; see `SimplePingTiming`.
+ *  \param userReceiveTime When the packet was read from the socket.
+ */
+
+- (void)simplePingEngine:(SimplePingEngine *)engine didReceivePacket:(NSMutableData *)packet fromAddress:(const struct sockaddr *)address addressLength:(socklen_t)addressLength kernelReceiveTime:(uint64_t)kernelReceiveTime userReceiveTime:(uint64_t)userReceiveTime;
+
+/*! Called by the engine when its shared socket fails.
+ *  \details The client should stop, which includes calling `-removeClient:`.
+ *  \param engine The engine issuing the callback.
+ *  \param error Describes the failure.
+ */
+
+- (void)simplePingEngine:(SimplePingEngine *)engine didFailWithError:(NSError *)error;
+
+@optional
+
+/*! Called by the engine once it has drained its socket, for every client it gave packets to.
+ *  \param engine The engine issuing the callback.
+ */
+
+- (void)simplePingEngineDidDrainSocket:(SimplePingEngine *)engine;
+
+@end
+
+/*! A delegate protocol for the SimplePingEngine class.
+ */
+
+@protocol SimplePingEngineDelegate <NSObject>
+
+@optional
+
+/*! A SimplePingEngine delegate callback, called when a packet matches no pinger.
+ *  \details The nature of ICMP handling in a BSD kernel makes this a common event; see
+ *      `-simplePing:didReceiveUnexpectedPacket:`.  The IPv6 socket only receives echo replies
+ *      and errors, so Neighbor Discovery and the like never get here.
+ *  \param engine The object issuing the callback.
+ *  \param packet The packet received, exactly as returned by the kernel (in the IPv4 case
+ *      this includes the IP header).
+ *  \param address The address the packet came from; the contents of the NSData is a
+ *      (struct sockaddr) of some form.
+ */
+
+- (void)simplePingEngine:(SimplePingEngine *)engine didReceiveUnexpectedPacket:(NSData *)packet fromAddress:(NSData *)address;
+
+@end
+
+NS_ASSUME_NONNULL_END
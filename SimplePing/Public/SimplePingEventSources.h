@@ -0,0 +1,159 @@
+/*
+    Abstract:
+    Socket read and timer event sources that run either on a run loop or on a dispatch queue.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Calls a handler whenever a socket becomes readable.
+ *  \details With a nil queue this wraps the socket in a CFSocket scheduled in the default
+ *      mode of the current run loop, which is what SimplePing has always done.  With a
+ *      queue it uses a `DISPATCH_SOURCE_TYPE_READ` source targeting that queue instead,
+ *      so no run loop is involved at all.  In both cases the source owns the socket and
+ *      closes it when invalidated.
+ *
+ *      A source must be created, used and invalidated on its run loop's thread, or on its
+ *      queue.
+ */
+
+@interface SimplePingReadSource : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Starts watching a socket.
+ *  \param fd The socket; ownership passes to the source.
+ *  \param queue The serial queue to call the handler on, or nil to use the current run loop.
+ *  \param handler The block to call when the socket is readable.  It should read without
+ *      blocking; it is called again if data remains.
+ *  \returns The started source.
+ */
+
+- (instancetype)initWithSocket:(int)fd queue:(nullable dispatch_queue_t)queue handler:(dispatch_block_t)handler NS_DESIGNATED_INITIALIZER;
+
+/*! The socket, or -1 once the source has been invalidated.
+ */
+
+@property (nonatomic, assign, readonly) int nativeSocket;
+
+/*! Stops the source and closes its socket.
+ *  \details The handler is not called after this returns.  It's safe to call this more
+ *      than once.
+ */
+
+- (void)invalidate;
+
+@end
+
+/*! Calls a handler after an interval, optionally repeating.
+ *  \details With a nil queue this is an NSTimer on the current run loop whose `tolerance`
+ *      is the leeway.  With a queue it's a `DISPATCH_SOURCE_TYPE_TIMER` source targeting
+ *      that queue, which lets the system coalesce wakeups within the leeway.
+ *
+ *      A timer must be created, used and invalidated on its run loop's thread, or on its
+ *      queue.
+ */
+
+@interface SimplePingTimerSource : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Starts a timer.
+ *  \param interval Seconds until the first firing, and between firings if repeating.
+ *  \param leeway How late, in seconds, the timer may fire; 0 asks for the least delay
+ *      the system allows.
+ *  \param repeats YES to fire every `interval`, NO to fire once.
+ *  \param queue The serial queue to call the handler on, or nil to use the current run loop.
+ *  \param handler The block to call when the timer fires.
+ *  \returns The started timer.
+ */
+
+- (instancetype)initWithInterval:(NSTimeInterval)interval leeway:(NSTimeInterval)leeway repeats:(BOOL)repeats queue:(nullable dispatch_queue_t)queue handler:(dispatch_block_t)handler NS_DESIGNATED_INITIALIZER;
+
+/*! NO once the timer has been invalidated, or has fired if it doesn't repeat.
+ */
+
+@property (nonatomic, assign, readonly, getter=isValid) BOOL valid;
+
+/*! Stops the timer.
+ *  \details The handler is not called after this returns.  It's safe to call this more
+ *      than once.
+ */
+
+- (void)invalidate;
+
+@end
+
+/*! Calls a handler on a fixed schedule of deadlines, for sending at high rates.
+ *  \details Deadline n falls at the start time plus n times `1 / packetsPerSecond`, however 
+ *      late earlier wakeups were, so the achieved rate doesn't drift the way a chain of 
+ *      timers, each scheduled from when the last one fired, does.  Each wakeup passes the 
+ *      handler the number of deadlines that have passed since the last one; to keep the 
+ *      wakeup rate sane at thousands of packets per second, wakeups are at least 
+ *      `minimumWakeInterval` apart, and the deadlines in between are handed out together. 
+ *      If the handler falls too far behind, deadlines beyond `maximumBatch` are skipped 
+ *      rather than sent in a burst, and counted in `missedDeadlineCount`.
+ *
+ *      The first deadline is the moment the scheduler is created.  With a nil queue this is 
+ *      an NSTimer on the current run loop; with a queue it's a strict 
+ *      `DISPATCH_SOURCE_TYPE_TIMER` source targeting that queue.  Either way it asks for no 
+ *      leeway.  A scheduler must be created, used and invalidated on its run loop's thread, 
+ *      or on its queue.
+ */
+
+@interface SimplePingSendScheduler : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Starts a scheduler.
+ *  \param packetsPerSecond The rate of deadlines; must be positive.
+ *  \param queue The serial queue to call the handler on, or nil to use the current run loop.
+ *  \param handler The block to call with the number of deadlines due, at least 1.
+ *  \returns The started scheduler.
+ */
+
+- (instancetype)initWithRate:(double)packetsPerSecond queue:(nullable dispatch_queue_t)queue handler:(void (^)(NSUInteger count))handler NS_DESIGNATED_INITIALIZER;
+
+/*! The value passed to `-initWithRate:queue:handler:`.
+ */
+
+@property (nonatomic, assign, readonly) double              packetsPerSecond;
+
+/*! The most deadlines passed to one call of the handler.
+ *  \details Default value is 64.  Set it to 1 to never send in bursts.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger         maximumBatch;
+
+/*! The least time between wakeups, in seconds.
+ *  \details Default value is 0.001.  At rates below its reciprocal it has no effect.
+ */
+
+@property (nonatomic, assign, readwrite) NSTimeInterval     minimumWakeInterval;
+
+/*! Deadlines passed to the handler so far.
+ */
+
+@property (nonatomic, assign, readonly) uint64_t            handledDeadlineCount;
+
+/*! Deadlines skipped because the handler was more than `maximumBatch` behind.
+ */
+
+@property (nonatomic, assign, readonly) uint64_t            missedDeadlineCount;
+
+/*! NO once the scheduler has been invalidated.
+ */
+
+@property (nonatomic, assign, readonly, getter=isValid) BOOL valid;
+
+/*! Stops the scheduler.
+ *  \details The handler is not called after this returns.  It's safe to call this more 
+ *      than once, including from the handler.
+ */
+
+- (void)invalidate;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,72 @@
+/*
+    Abstract:
+    A process-wide cache of resolved host addresses that honours DNS record TTLs.
+ */
+
+@import Foundation;
+#import <sys/socket.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! A process-wide cache of resolved host addresses that honours DNS record TTLs.
+ *  \details SimplePingHostResolver consults `+sharedCache` before going to DNS and fills
+ *      it afterwards, so restarting a pinger or traceroute to the same host costs no
+ *      lookup until the records expire.  Each entry lives for the shortest TTL of the
+ *      records it was built from, capped at `maximumTimeToLive`.  Entries are keyed by
+ *      host name, ignoring case, and by the address family that was asked for.
+ *
+ *      The object is thread safe.
+ */
+
+@interface SimplePingHostCache : NSObject
+
+/*! The cache used by SimplePingHostResolver unless told otherwise.
+ */
+
+@property (class, nonatomic, strong, readonly) SimplePingHostCache *  sharedCache;
+
+/*! The longest an entry is kept, in seconds, whatever its TTL.
+ *  \details Default value is 300.  Set it to 0 to stop caching.  Changes apply to entries
+ *      added later.
+ */
+
+@property (nonatomic, assign, readwrite) NSTimeInterval maximumTimeToLive;
+
+/*! Number of entries, including expired ones not yet pruned.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger      count;
+
+/*! Returns the cached addresses of a host, if they haven't expired.
+ *  \param hostName The host name.
+ *  \param addressFamily `AF_INET`, `AF_INET6`, or `AF_UNSPEC` for either.
+ *  \returns The addresses, each a (struct sockaddr) of some form, in preference order, or
+ *      nil if there's no live entry.
+ */
+
+- (nullable NSArray<NSData *> *)addressesForHostName:(NSString *)hostName addressFamily:(sa_family_t)addressFamily;
+
+/*! Caches the addresses of a host.
+ *  \param addresses The addresses, in preference order; must not be empty.
+ *  \param hostName The host name.
+ *  \param addressFamily The address family that was asked for.
+ *  \param timeToLive How long the addresses are valid for, in seconds; typically the
+ *      smallest TTL of their records.
+ */
+
+- (void)setAddresses:(NSArray<NSData *> *)addresses forHostName:(NSString *)hostName addressFamily:(sa_family_t)addressFamily timeToLive:(NSTimeInterval)timeToLive;
+
+/*! Forgets the addresses of a host, for every address family.
+ *  \param hostName The host name.
+ */
+
+- (void)removeAddressesForHostName:(NSString *)hostName;
+
+/*! Empties the cache, for example after the network has changed.
+ */
+
+- (void)removeAllAddresses;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,81 @@
+/*
+    Abstract:
+    Resolves a host name to its addresses, either on a run loop or on a dispatch queue.
+ */
+
+@import Foundation;
+#import <sys/socket.h>
+#import "SimplePingHostCache.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Resolves a host name to its addresses, either on a run loop or on a dispatch queue.
+ *  \details The resolver asks DNS-SD (`DNSServiceGetAddrInfo()`) for the A and AAAA records 
+ *      in parallel, with its socket scheduled in the default mode of the current run loop, 
+ *      or on the queue.  When both families are wanted, AAAA answers are used as soon as 
+ *      they arrive, while A answers wait up to 50 ms for AAAA ones (the Resolution Delay of 
+ *      Happy Eyeballs, RFC 8305); either way IPv6 addresses come first.  The answers are 
+ *      stored in `cache` for as long as their records' TTLs allow, and an unexpired entry 
+ *      there, or a host name that is an address in string form, is used without any 
+ *      lookup.  Even then the completion handler runs after 
+ *      `-startWithCompletionHandler:` returns.
+ *
+ *      Errors match those of CFHost, which the resolver used to use: 
+ *      `kCFErrorDomainCFNetwork` with `kCFHostErrorUnknown`, and the equivalent 
+ *      `getaddrinfo()` error in the `kCFGetAddrInfoFailureKey` user info entry.
+ *
+ *      A resolver must be started and cancelled on its run loop's thread, or on its queue.
+ */
+
+@interface SimplePingHostResolver : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialise the object to resolve the specified host.
+ *  \param hostName The DNS name of the host; an IPv4 or IPv6 address in string form will 
+ *      work here.
+ *  \param queue The serial queue to deliver the result on, or nil to use the current run loop.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostName:(NSString *)hostName queue:(nullable dispatch_queue_t)queue NS_DESIGNATED_INITIALIZER;
+
+/*! A copy of the value passed to `-initWithHostName:queue:`.
+ */
+
+@property (nonatomic, copy,   readonly) NSString *  hostName;
+
+/*! The address family to resolve to: `AF_INET`, `AF_INET6`, or `AF_UNSPEC` for both.
+ *  \details Only that family's records are looked up, and only its addresses returned. 
+ *      Default value is `AF_UNSPEC`.  You should set this before starting the resolver.
+ */
+
+@property (nonatomic, assign, readwrite) sa_family_t    addressFamily;
+
+/*! The cache consulted before, and filled after, each lookup, or nil for none.
+ *  \details Default value is `+[SimplePingHostCache sharedCache]`.  You should set this 
+ *      before starting the resolver.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingHostCache *    cache;
+
+/*! Starts the resolution.
+ *  \details The completion handler is called exactly once, unless the resolver is 
+ *      cancelled first.  If the resolution can't even be started it's called before this 
+ *      method returns.
+ *  \param completionHandler Called with either the addresses, each a (struct sockaddr) of 
+ *      some form, in preference order, or an error.
+ */
+
+- (void)startWithCompletionHandler:(void (^)(NSArray<NSData *> * _Nullable addresses, NSError * _Nullable error))completionHandler;
+
+/*! Cancels the resolution.
+ *  \details The completion handler is not called after this returns.  It's safe to call 
+ *      this more than once, or on a resolver that has completed.
+ */
+
+- (void)cancel;
+
+@end
+
+NS_ASSUME_NONNULL_END
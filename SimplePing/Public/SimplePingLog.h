@@ -0,0 +1,125 @@
+/*
+    Abstract:
+    Levelled logging to the unified log, and signposts for profiling probes in Instruments.
+ */
+
+@import Foundation;
+#include <os/log.h>
+#include <os/signpost.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! The subsystem all SimplePing messages and signposts are logged under.
+ */
+
+#define kSimplePingLogSubsystem "com.simpleping"
+
+/*! What a message is about; each category is its own os_log category.
+ */
+
+typedef NS_ENUM(NSInteger, SimplePingLogCategory) {
+    SimplePingLogCategoryPing,          ///< SimplePing and SwiftSimplePing, "Ping"
+    SimplePingLogCategoryTraceroute,    ///< SimpleTraceroute and SwiftSimpleTraceroute, "Traceroute"
+    SimplePingLogCategoryEngine,        ///< SimplePingEngine and batches, "Engine"
+};
+
+/*! How much is logged; each level includes the ones before it.
+ */
+
+typedef NS_ENUM(NSInteger, SimplePingLogLevel) {
+    SimplePingLogLevelOff,              ///< Nothing.
+    SimplePingLogLevelError,            ///< Failures, logged as OS_LOG_TYPE_ERROR.
+    SimplePingLogLevelInfo,             ///< Notable events, such as reaching a destination; the default.
+    SimplePingLogLevelDebug,            ///< Every send, receive and decision, logged as OS_LOG_TYPE_DEBUG.
+};
+
+/*! The most verbose level compiled in.
+ *  \details Messages above it are removed by the compiler, arguments and all.  Define it,
+ *      say to `SimplePingLogLevelInfo`, when building to drop the debug messages from the
+ *      hot paths for good.
+ */
+
+#if !defined(SIMPLEPING_LOG_MAX_LEVEL)
+    #define SIMPLEPING_LOG_MAX_LEVEL SimplePingLogLevelDebug
+#endif
+
+/*! Do not use; read through `SimplePingLogLevelEnabled`.
+ */
+
+extern SimplePingLogLevel _SimplePingLogLevel;
+
+/*! Sets the level messages are logged at, for the whole process.
+ *  \details Thread safe.  The default is `SimplePingLogLevelInfo`, or the value of the
+ *      `SIMPLEPING_LOG_LEVEL` environment variable ("off", "error", "info" or "debug")
+ *      if it's set at launch.
+ */
+
+extern void SimplePingLogSetLevel(SimplePingLogLevel level);
+
+/*! Returns the level set by `SimplePingLogSetLevel`.
+ */
+
+extern SimplePingLogLevel SimplePingLogGetLevel(void);
+
+/*! Returns whether messages at a level are logged.
+ *  \details A single load, so it's cheap enough to check before every message.
+ */
+
+static inline BOOL SimplePingLogLevelEnabled(SimplePingLogLevel level) {
+    return (level <= SIMPLEPING_LOG_MAX_LEVEL) && (level <= __atomic_load_n(&_SimplePingLogLevel, __ATOMIC_RELAXED));
+}
+
+/*! Returns the log handle of a category.
+ */
+
+extern os_log_t SimplePingLogHandle(SimplePingLogCategory category);
+
+/*! Returns a signpost ID for a probe, the same for its send and its response.
+ *  \param identifier The ICMP identifier.
+ *  \param sequenceNumber The ICMP sequence number.
+ */
+
+static inline os_signpost_id_t SimplePingSignpostProbeID(uint16_t identifier, uint16_t sequenceNumber) {
+    // Never OS_SIGNPOST_ID_NULL (0) or OS_SIGNPOST_ID_INVALID (~0)
+    return (((uint64_t) identifier << 16) | sequenceNumber) + 1;
+}
+
+NS_ASSUME_NONNULL_END
+
+// The macros below take a format string literal, as os_log does ("%d", not @"%d"), and
+// evaluate their arguments only if the message is logged.  Dynamic strings are private
+// in the unified log unless marked %{public}@ or %{public}s.
+
+#define SimplePingLogWithLevel(category, level, type, format, ...) \
+    do { \
+        if (SimplePingLogLevelEnabled(level)) { \
+            os_log_with_type(SimplePingLogHandle(category), (type), format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define SimplePingLogError(category, format, ...) \
+    SimplePingLogWithLevel(category, SimplePingLogLevelError, OS_LOG_TYPE_ERROR, format, ##__VA_ARGS__)
+#define SimplePingLogInfo(category, format, ...) \
+    SimplePingLogWithLevel(category, SimplePingLogLevelInfo, OS_LOG_TYPE_DEFAULT, format, ##__VA_ARGS__)
+#define SimplePingLogDebug(category, format, ...) \
+    SimplePingLogWithLevel(category, SimplePingLogLevelDebug, OS_LOG_TYPE_DEBUG, format, ##__VA_ARGS__)
+
+// Signposts cost next to nothing unless Instruments is recording them.  name must be a
+// string literal; an interval's begin and end must use the same name and ID.
+
+#define SimplePingSignpost(kind, category, signpostID, name, format, ...) \
+    do { \
+        if (__builtin_available(macOS 10.14, iOS 12.0, tvOS 12.0, watchOS 5.0, *)) { \
+            os_log_t _log = SimplePingLogHandle(category); \
+            if (os_signpost_enabled(_log)) { \
+                os_signpost_##kind(_log, (signpostID), name, format, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define SimplePingSignpostBegin(category, signpostID, name, format, ...) \
+    SimplePingSignpost(interval_begin, category, signpostID, name, format, ##__VA_ARGS__)
+#define SimplePingSignpostEnd(category, signpostID, name, format, ...) \
+    SimplePingSignpost(interval_end, category, signpostID, name, format, ##__VA_ARGS__)
+#define SimplePingSignpostEvent(category, signpostID, name, format, ...) \
+    SimplePingSignpost(event, category, signpostID, name, format, ##__VA_ARGS__)
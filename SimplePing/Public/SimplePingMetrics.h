@@ -0,0 +1,124 @@
+/*
+    Abstract:
+    Lock-free counters and a callback latency histogram, per prober and for the whole process.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! The events a prober counts.
+ */
+
+typedef NS_ENUM(NSInteger, SimplePingMetricsCounter) {
+    SimplePingMetricsCounterPacketsSent,            ///< Probes handed to the kernel.
+    SimplePingMetricsCounterSendFailures,           ///< Probes `sendto` failed or truncated.
+    SimplePingMetricsCounterPacketsReceived,        ///< Packets read, whether or not they were ours.
+    SimplePingMetricsCounterValidationFailures,     ///< Packets that failed the ICMP header checks.
+    SimplePingMetricsCounterUnexpectedPackets,      ///< Packets that didn't match a probe of ours.
+    SimplePingMetricsCounterExpiredProbes,          ///< Outstanding probes purged as stale.
+    SimplePingMetricsCounterTimeouts,               ///< Probes given up on.
+    SimplePingMetricsCounterFilteringNanoseconds,   ///< Time spent validating and matching received packets.
+
+    SimplePingMetricsCounterCount                   ///< The number of counters, not a counter.
+};
+
+/*! The number of callback latency buckets; bucket i counts latencies from 2^i to 2^(i+1)
+ *  nanoseconds, and the last one everything longer.
+ */
+
+#define kSimplePingMetricsLatencyBucketCount 32
+
+/*! The metrics of one prober.
+ *  \details Every field is only changed with relaxed atomic adds, so recording is a few
+ *      uncontended instructions and never takes a lock, and any thread may read a snapshot
+ *      at any time.  Each metric recorded for a prober is also added to the process-wide
+ *      totals.  Use the functions below rather than touching the fields directly.
+ */
+
+typedef struct SimplePingMetrics {
+    uint64_t    counters[SimplePingMetricsCounterCount];
+    uint64_t    callbackCount;                  ///< Delegate callbacks timed.
+    uint64_t    callbackNanoseconds;            ///< Total time spent in them.
+    uint64_t    callbackLatencyBuckets[kSimplePingMetricsLatencyBucketCount];
+} SimplePingMetrics;
+
+/*! Do not use; the process-wide totals, read through `+[SimplePingMetricsSnapshot processSnapshot]`.
+ */
+
+extern SimplePingMetrics _SimplePingProcessMetrics;
+
+/*! Adds to a counter of a prober and of the process.
+ *  \param metrics The prober's metrics.
+ *  \param counter The counter.
+ *  \param amount The amount to add.
+ */
+
+static inline void SimplePingMetricsAdd(SimplePingMetrics * metrics, SimplePingMetricsCounter counter, uint64_t amount) {
+    __atomic_fetch_add(&metrics->counters[counter], amount, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_SimplePingProcessMetrics.counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+/*! Records how long a delegate callback took, for a prober and for the process.
+ *  \param metrics The prober's metrics.
+ *  \param nanoseconds How long the callback took.
+ */
+
+extern void SimplePingMetricsRecordCallback(SimplePingMetrics * metrics, uint64_t nanoseconds);
+
+/*! A consistent-enough copy of a prober's or the process's metrics.
+ *  \details Each value is read atomically, but not all of them at the same instant, so a
+ *      snapshot taken while probing may be a packet or so out between counters.  Take two
+ *      and use `-snapshotBySubtracting:` to get rates.
+ */
+
+@interface SimplePingMetricsSnapshot : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Takes a snapshot of a prober's metrics.
+ *  \param metrics The metrics.
+ *  \returns The snapshot.
+ */
+
+- (instancetype)initWithMetrics:(const SimplePingMetrics *)metrics NS_DESIGNATED_INITIALIZER;
+
+/*! Takes a snapshot of the totals of every prober in the process, since launch.
+ */
+
++ (SimplePingMetricsSnapshot *)processSnapshot;
+
+@property (nonatomic, assign, readonly) uint64_t        packetsSent;            ///< See `SimplePingMetricsCounterPacketsSent`.
+@property (nonatomic, assign, readonly) uint64_t        sendFailures;           ///< See `SimplePingMetricsCounterSendFailures`.
+@property (nonatomic, assign, readonly) uint64_t        packetsReceived;        ///< See `SimplePingMetricsCounterPacketsReceived`.
+@property (nonatomic, assign, readonly) uint64_t        validationFailures;     ///< See `SimplePingMetricsCounterValidationFailures`.
+@property (nonatomic, assign, readonly) uint64_t        unexpectedPackets;      ///< See `SimplePingMetricsCounterUnexpectedPackets`.
+@property (nonatomic, assign, readonly) uint64_t        expiredProbes;          ///< See `SimplePingMetricsCounterExpiredProbes`.
+@property (nonatomic, assign, readonly) uint64_t        timeouts;               ///< See `SimplePingMetricsCounterTimeouts`.
+@property (nonatomic, assign, readonly) NSTimeInterval  filteringTime;          ///< See `SimplePingMetricsCounterFilteringNanoseconds`, in seconds.
+@property (nonatomic, assign, readonly) uint64_t        callbackCount;          ///< Delegate callbacks timed.
+@property (nonatomic, assign, readonly) NSTimeInterval  averageCallbackLatency; ///< Mean time spent in them, in seconds; 0 if none.
+
+/*! The callback latency histogram, `kSimplePingMetricsLatencyBucketCount` counts.
+ */
+
+@property (nonatomic, copy, readonly) NSArray<NSNumber *> * callbackLatencyBuckets;
+
+/*! Returns a callback latency quantile, from the histogram.
+ *  \param quantile The quantile, from 0 to 1; 0.99 for the 99th percentile.
+ *  \returns The upper bound of the bucket the quantile falls in, in seconds, so within a
+ *      factor of two; 0 if no callbacks were timed.
+ */
+
+- (NSTimeInterval)callbackLatencyAtQuantile:(double)quantile;
+
+/*! Returns what happened between an earlier snapshot and this one.
+ *  \param earlier A snapshot of the same metrics taken before this one.
+ *  \returns The differences; counters that went backwards, as they can't, are 0.
+ */
+
+- (SimplePingMetricsSnapshot *)snapshotBySubtracting:(SimplePingMetricsSnapshot *)earlier;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,104 @@
+/*
+    Abstract:
+    Preformatted ICMP echo request packets, patched in place for each send.
+ */
+
+#ifndef SimplePingPacketTemplate_h
+#define SimplePingPacketTemplate_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! An ICMP echo request, header and payload, built once and reused for every send.
+ *  \details Building a packet from scratch means allocating it, copying the payload and 
+ *      checksumming the whole thing.  A template does that once; each send then patches 
+ *      only the fields that change (the sequence number, a timestamp, and so on) and 
+ *      updates the checksum incrementally from the words that changed, as described in 
+ *      RFC 1624, before handing `bytes` straight to `sendto()`.
+ *
+ *      The packet starts with an ICMPHeader; see SimplePing.h.
+ */
+
+struct SimplePingPacketTemplate {
+    uint8_t *   bytes;                  ///< The packet, or NULL if the template isn't initialised.
+    size_t      length;                 ///< The length of the packet.
+    uint8_t     type;                   ///< The ICMP type the template was built with.
+    uint16_t    identifier;             ///< The identifier the template was built with, in host byte order.
+    bool        requiresChecksum;       ///< True if the checksum is maintained (ICMPv4); the kernel does it for ICMPv6.
+};
+typedef struct SimplePingPacketTemplate SimplePingPacketTemplate;
+
+/*! Builds a template.
+ *  \param packetTemplate The template to initialise; any previous packet is freed.
+ *  \param type The ICMP type.
+ *  \param identifier The ICMP identifier, in host byte order.
+ *  \param payload The payload to place after the ICMP header; may be NULL if 
+ *      `payloadLength` is 0.
+ *  \param payloadLength The length of that payload.
+ *  \param requiresChecksum Determines whether a checksum is calculated (ICMPv4) or not (ICMPv6).
+ *  \returns true on success, false if the allocation failed.
+ */
+
+extern bool SimplePingPacketTemplateInit(SimplePingPacketTemplate * packetTemplate, uint8_t type, uint16_t identifier, const void * payload, size_t payloadLength, bool requiresChecksum);
+
+/*! Frees the packet of a template.
+ *  \param packetTemplate The template; it may be initialised again afterwards.
+ */
+
+extern void SimplePingPacketTemplateDestroy(SimplePingPacketTemplate * packetTemplate);
+
+/*! Overwrites part of the packet, updating the checksum incrementally.
+ *  \details The cost is proportional to `length`, not to the size of the packet.
+ *  \param packetTemplate The template.
+ *  \param offset The offset of the bytes to replace, from the start of the ICMP header; 
+ *      `offset + length` must not exceed the packet length.
+ *  \param bytes The new bytes.
+ *  \param length The number of bytes.
+ */
+
+extern void SimplePingPacketTemplatePatch(SimplePingPacketTemplate * packetTemplate, size_t offset, const void * bytes, size_t length);
+
+/*! Sets the sequence number of the packet.
+ *  \param packetTemplate The template.
+ *  \param sequenceNumber The sequence number, in host byte order.
+ */
+
+extern void SimplePingPacketTemplateSetSequenceNumber(SimplePingPacketTemplate * packetTemplate, uint16_t sequenceNumber);
+
+/*! Returns the checksum of the packet as it stands.
+ *  \details For a template that maintains its checksum (ICMPv4) this is the value in the
+ *      packet; for one that doesn't (ICMPv6) it's the checksum of the ICMP message alone,
+ *      without the pseudo-header the kernel adds in.
+ *  \param packetTemplate The template.
+ *  \returns The checksum, in network byte order.
+ */
+
+extern uint16_t SimplePingPacketTemplateChecksum(const SimplePingPacketTemplate * packetTemplate);
+
+/*! Overwrites one word of the payload so that the packet's checksum comes out as a given value.
+ *  \details Load balancers that spread flows over equal cost paths hash the first words of 
+ *      the transport header, which for ICMP are the type, code and checksum.  Call this 
+ *      after patching everything else that changes and the packet's checksum stays the same, 
+ *      so every send takes the same path.  For a template that doesn't maintain its checksum 
+ *      (ICMPv6) the kernel's checksum then comes out the same every send too, since all 
+ *      it adds is the pseudo-header, which is the same every send to a given address.  
+ *      The cost is a pass over the packet.
+ *  \param packetTemplate The template.
+ *  \param offset The offset of the word to overwrite, from the start of the ICMP header; 
+ *      it must be even, past the ICMP header, and leave room for the word.
+ *  \param checksum The checksum to hold the packet at, in network byte order, such as 
+ *      one returned by `SimplePingPacketTemplateChecksum`.
+ */
+
+extern void SimplePingPacketTemplateFixChecksum(SimplePingPacketTemplate * packetTemplate, size_t offset, uint16_t checksum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingPacketTemplate_h */
@@ -0,0 +1,194 @@
+/*
+    Abstract:
+    Finds the path MTU to a host by pinging with the don't fragment bit set, several sizes at a time.
+ */
+
+@import Foundation;
+#import <sys/socket.h>
+#import "SimplePing.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@protocol SimplePingPathMTUDiscoveryDelegate;
+
+/*! The number of times a size is probed before going unanswered counts as too big.
+ */
+
+enum {
+    kSimplePingPathMTUMaximumAttempts = 3
+};
+
+/*! Finds the path MTU to a host by pinging with the don't fragment bit set, several sizes at a time.
+ *  \details Trying one ping size at a time costs a round trip per size, and a dozen or so
+ *      round trips to pin the MTU down.  This object instead pings, with a SimplePing whose
+ *      `dontFragment` is set, `probesPerRound` sizes at once, spread evenly over the sizes
+ *      still in doubt and always including the largest.  Each reply raises the largest size
+ *      known to fit; each "fragmentation needed" (ICMPv4) or "packet too big" (ICMPv6) error,
+ *      each `EMSGSIZE` from the local interface, and each size unanswered after
+ *      `kSimplePingPathMTUMaximumAttempts` probes of `timeout` each lowers the smallest size
+ *      known not to.  As soon as no probe in flight can narrow the
+ *      range further the next round starts, and when the two meet the path MTU is known.
+ *      An error that reports the MTU of the next hop narrows the range to it at once, so on
+ *      a well behaved path the search usually takes two or three round trips, and on one
+ *      that silently drops big packets (a black hole) a few timeouts.
+ *
+ *      Sizes are whole IP packets, header included, as MTUs are.  The search assumes
+ *      nothing fits until shown otherwise, so it fails, with `ETIMEDOUT`, if the host
+ *      answers nothing at all, even at the 68 (IPv4) or 1280 (IPv6) bytes every path must
+ *      carry.  A size whose probe goes unanswered is probed again, up to
+ *      `kSimplePingPathMTUMaximumAttempts` times in all (RFC 4821's MAX_PROBES), so that a
+ *      lost packet or two on a lossy path doesn't pass for a black hole.
+ *
+ *      The object opens its own socket, rather than sharing an engine's, since the don't
+ *      fragment bit is a socket option.  Delegate callbacks are scheduled in the default run
+ *      loop mode of the run loop of the thread that calls `-start`, or on `dispatchQueue` if
+ *      that's set.
+ */
+
+@interface SimplePingPathMTUDiscovery : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialise the object to find the path MTU to the specified host.
+ *  \param hostName The DNS name of the host, or an IPv4 or IPv6 address in string form.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostName:(NSString *)hostName NS_DESIGNATED_INITIALIZER;
+
+/*! Initialise the object to find the path MTU to an address that has already been resolved.
+ *  \param hostAddress The address; the contents of the NSData is a (struct sockaddr) of
+ *      some form.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress;
+
+/*! A copy of the value passed to `-initWithHostName:`, or the address passed to
+ *  `-initWithHostAddress:` in numeric form.
+ */
+
+@property (nonatomic, copy, readonly) NSString * hostName;
+
+/*! The delegate for this object.
+ */
+
+@property (nonatomic, weak, readwrite, nullable) id<SimplePingPathMTUDiscoveryDelegate> delegate;
+
+/*! The serial queue the object runs on, or nil to use the run loop of the thread that calls `-start`.
+ *  \details See `-[SimplePing dispatchQueue]`.  You should set this value before starting
+ *      the object.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) dispatch_queue_t dispatchQueue;
+
+/*! Controls the IP address version used by the object.
+ *  \details You should set this value before starting the object.
+ */
+
+@property (nonatomic, assign, readwrite) SimplePingAddressStyle addressStyle;
+
+/*! The largest MTU to try, in bytes.
+ *  \details The default is 1500, the Ethernet MTU; raise it to look for jumbo frames.
+ *      Values below the minimum MTU of the address family are treated as that minimum.
+ *      You should set this value before starting the object.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger maximumMTU;
+
+/*! The number of sizes probed at once.
+ *  \details Each round narrows the range to about `1 / (probesPerRound + 1)` of what it was;
+ *      the default is 4.  Values below 1 are treated as 1, which is a plain binary search
+ *      that tries the largest size first.  You should set this value before starting the
+ *      object.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger probesPerRound;
+
+/*! How long to wait for the reply to a probe, in seconds, before probing its size again.
+ *  \details The default is 1 second.  You should set this value before starting the object.
+ */
+
+@property (nonatomic, assign, readwrite) NSTimeInterval timeout;
+
+/*! The address being probed, or nil until `-pathMTUDiscovery:didStartWithAddress:` is called.
+ */
+
+@property (nonatomic, copy, readonly, nullable) NSData * hostAddress;
+
+/*! The path MTU, in bytes, or 0 until it's been found.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger pathMTU;
+
+/*! The number of probes sent so far.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger probeCount;
+
+/*! The number of rounds of probes started so far.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger roundCount;
+
+/*! Starts the search.
+ *  \details Resets `pathMTU`, `probeCount` and `roundCount`.  You'll get either
+ *      `-pathMTUDiscovery:didFindPathMTU:` or `-pathMTUDiscovery:didFailWithError:`, after
+ *      which the object is stopped.  It is not correct to start an already started object.
+ */
+
+- (void)start;
+
+/*! Stops the search, if it's still going; no further delegate callbacks are made.
+ */
+
+- (void)stop;
+
+@end
+
+/*! A delegate protocol for the SimplePingPathMTUDiscovery class.
+ */
+
+@protocol SimplePingPathMTUDiscoveryDelegate <NSObject>
+
+/*! A SimplePingPathMTUDiscovery delegate callback, called when the search is done.
+ *  \param discovery The object issuing the callback.
+ *  \param pathMTU The path MTU, in bytes; the same as `discovery.pathMTU`.
+ */
+
+- (void)pathMTUDiscovery:(SimplePingPathMTUDiscovery *)discovery didFindPathMTU:(NSUInteger)pathMTU;
+
+/*! A SimplePingPathMTUDiscovery delegate callback, called when the search fails.
+ *  \details For example the host name might not resolve, the don't fragment bit might not
+ *      be settable, or the host might not answer pings at all (`ETIMEDOUT`).
+ *  \param discovery The object issuing the callback.
+ *  \param error Describes the failure.
+ */
+
+- (void)pathMTUDiscovery:(SimplePingPathMTUDiscovery *)discovery didFailWithError:(NSError *)error;
+
+@optional
+
+/*! A SimplePingPathMTUDiscovery delegate callback, called once the host's address is known.
+ *  \param discovery The object issuing the callback.
+ *  \param address The address being probed; the contents of the NSData is a (struct sockaddr)
+ *      of some form.
+ */
+
+- (void)pathMTUDiscovery:(SimplePingPathMTUDiscovery *)discovery didStartWithAddress:(NSData *)address;
+
+/*! A SimplePingPathMTUDiscovery delegate callback, called as each probe is resolved.
+ *  \details Probes made moot by another's result, such as a smaller one still in flight when
+ *      a bigger one is answered, aren't reported.
+ *  \param discovery The object issuing the callback.
+ *  \param size The size of the probe, in bytes, IP header included.
+ *  \param fits YES if the probe was answered; NO if it was too big, or timed out every attempt.
+ *  \param reportedMTU The MTU of the next hop, as reported by the router that refused the
+ *      probe, or 0 if there was no such report.
+ */
+
+- (void)pathMTUDiscovery:(SimplePingPathMTUDiscovery *)discovery didProbeSize:(NSUInteger)size fits:(BOOL)fits reportedMTU:(NSUInteger)reportedMTU;
+
+@end
+
+NS_ASSUME_NONNULL_END
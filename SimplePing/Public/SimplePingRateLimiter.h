@@ -0,0 +1,56 @@
+/*
+    Abstract:
+    A token bucket that paces ICMP sends, shareable across instances and threads.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! A token bucket that paces ICMP sends, shareable across instances and threads.
+ *  \details The bucket holds up to `burst` tokens and refills at `packetsPerSecond`.  Each 
+ *      send takes one token.  Rather than blocking when the bucket is empty, 
+ *      `-reservePacket` hands out the next token in advance and returns how long the 
+ *      caller must wait before using it, so callers can schedule the send with a timer. 
+ *      Because tokens are reserved in order, everyone sharing the limiter together sends 
+ *      at no more than the configured rate.
+ *
+ *      Many routers and hosts rate limit the ICMP errors they generate; giving every 
+ *      traceroute (and any other prober) in a process the same limiter keeps them from 
+ *      collectively tripping those limits.  The object is thread safe.
+ */
+
+@interface SimplePingRateLimiter : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialise the limiter.
+ *  \param packetsPerSecond The sustained rate; must be positive.
+ *  \param burst How many packets may be sent back-to-back after an idle period; must be 
+ *      at least 1.
+ *  \returns The initialised object.
+ */
+
+- (instancetype)initWithRate:(double)packetsPerSecond burst:(NSUInteger)burst NS_DESIGNATED_INITIALIZER;
+
+/*! The value passed to `-initWithRate:burst:`.
+ */
+
+@property (nonatomic, assign, readonly) double      packetsPerSecond;
+
+/*! The value passed to `-initWithRate:burst:`.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger  burst;
+
+/*! Takes the next token.
+ *  \details The token is yours whether or not you have to wait for it, so call this once 
+ *      per packet, when you're about to send it.
+ *  \returns How many seconds to wait before sending; 0 to send now.
+ */
+
+- (NSTimeInterval)reservePacket;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,75 @@
+/*
+    Abstract:
+    Records every probe of the pingers and traceroutes given it to a compact binary file, shareable across instances and threads.
+ */
+
+@import Foundation;
+
+#import "SimplePingSessionRecording.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Records every probe of the pingers and traceroutes given it to a compact binary file, shareable across instances and threads.
+ *  \details Set a pinger's or traceroute's `sessionRecorder` and each packet it reads
+ *      past its filters, its own or not, is appended as a fixed size `SimplePingSessionRecord`
+ *      with the raw bytes the kernel returned, as are a traceroute's probe timeouts.  Records go
+ *      straight into a memory-mapped file (see `SimplePingSessionWriter`), a few hundred
+ *      bytes each with no formatting, so recording keeps up with a flood ping.  Read the
+ *      file back with `SimplePingSessionReader`, for offline analysis or to replay the
+ *      packets through the parsers.
+ *
+ *      Appends are serialised by a lock, so any number of pingers and traceroutes, on any
+ *      threads, may share a recorder.  The file is finished when the recorder is closed or
+ *      deallocated.
+ */
+
+@interface SimplePingSessionRecorder : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialise the recorder, creating the file.
+ *  \param path The file's path; any file already there is replaced.
+ *  \param errorPtr Where to put the error if the file can't be created; may be NULL.
+ *  \returns The initialised object, or nil on error.
+ */
+
+- (nullable instancetype)initWithPath:(NSString *)path error:(NSError **)errorPtr NS_DESIGNATED_INITIALIZER;
+
+/*! The value passed to `-initWithPath:error:`.
+ */
+
+@property (nonatomic, copy, readonly) NSString * path;
+
+/*! The number of records appended so far.
+ */
+
+@property (nonatomic, assign, readonly) uint64_t recordCount;
+
+/*! The first error an append hit, or nil.
+ *  \details Appends after an error, such as a full disk, are dropped, so that a problem
+ *      with the recording never stops the probing.
+ */
+
+@property (atomic, copy, readonly, nullable) NSError * error;
+
+/*! Appends a record.
+ *  \param record The record.
+ *  \returns NO if the record couldn't be written; see `error`.
+ */
+
+- (BOOL)appendRecord:(const SimplePingSessionRecord *)record;
+
+/*! Pushes everything appended so far to disk.
+ *  \details Recording doesn't wait for the disk; call this at checkpoints that matter.
+ */
+
+- (void)synchronize;
+
+/*! Finishes the file; later appends are dropped.
+ */
+
+- (void)close;
+
+@end
+
+NS_ASSUME_NONNULL_END
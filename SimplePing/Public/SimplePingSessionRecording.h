@@ -0,0 +1,211 @@
+/*
+    Abstract:
+    A compact binary recording of ping and traceroute probes, written to a memory-mapped, append-only file and read back for replay.
+ */
+
+#ifndef SimplePingSessionRecording_h
+#define SimplePingSessionRecording_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! What a record is about.
+ */
+
+enum {
+    SimplePingSessionRecordKindPing         = 1,    ///< A ping's reply, or its loss.
+    SimplePingSessionRecordKindTraceroute   = 2     ///< A traceroute probe's response, or its timeout.
+};
+
+/*! Flags of a record.
+ */
+
+enum {
+    SimplePingSessionRecordFlagValid        = 1 << 0,   ///< The packet was a response to one of our probes.
+    SimplePingSessionRecordFlagTimeout      = 1 << 1,   ///< The probe went unanswered; there's no packet.
+    SimplePingSessionRecordFlagDestination  = 1 << 2    ///< The target itself answered the traceroute probe.
+};
+
+/*! The number of bytes of each packet a record keeps.
+ *  \details Enough for an echo reply with the usual 56 byte payload, or an ICMP error
+ *      quoting a probe's headers and the start of its payload.  Longer packets are cut
+ *      short, as a packet capture with a snap length would.
+ */
+
+#define kSimplePingSessionRecordPacketCapacity 200
+
+/*! One probe's outcome: a packet received, with the raw bytes the kernel returned, or a timeout.
+ *  \details Every record is 256 bytes, in host byte order, so the Nth is found without
+ *      reading the others.  The packet bytes are as `SimplePing` and `SimpleTraceroute` get
+ *      them from the socket: with the IP header for ICMPv4, without it for ICMPv6.
+ */
+
+struct SimplePingSessionRecord {
+    uint64_t    timestamp;                  ///< When the kernel received the packet, or the probe timed out, on the `SimplePingMonotonicNanoseconds` clock.
+    uint64_t    roundTripNanoseconds;       ///< The probe's round trip time, or 0 if it's unknown or the probe timed out.
+    uint32_t    targetIdentifier;           ///< Whatever the recording client uses to tell its targets apart.
+    uint16_t    sequenceNumber;             ///< The probe's ICMP sequence number, if known.
+    uint16_t    packetLength;               ///< The length of the packet as received, which may be more than `capturedLength`.
+    uint8_t     kind;                       ///< A `SimplePingSessionRecordKind...` value.
+    uint8_t     flags;                      ///< `SimplePingSessionRecordFlag...` values.
+    uint8_t     hopNumber;                  ///< The traceroute probe's TTL; 0 for pings.
+    uint8_t     icmpType;                   ///< The packet's ICMP type, or 0 with no packet.
+    uint8_t     icmpCode;                   ///< The packet's ICMP code, or 0 with no packet.
+    uint8_t     addressFamily;              ///< AF_INET or AF_INET6, or 0 if there's no responder address.
+    uint8_t     capturedLength;             ///< The number of bytes in `packet`.
+    uint8_t     reserved0;
+    uint16_t    identifier;                 ///< The ICMP identifier of the pinger or traceroute.
+    uint16_t    reserved1;
+    uint32_t    reserved2;
+    uint8_t     responderAddress[16];       ///< The address the packet came from, 4 or 16 bytes of it as `addressFamily` says.
+    uint8_t     packet[kSimplePingSessionRecordPacketCapacity];
+};
+typedef struct SimplePingSessionRecord SimplePingSessionRecord;
+
+/*! Clears a record and fills in the fields every record has.
+ *  \param record The record.
+ *  \param kind A `SimplePingSessionRecordKind...` value.
+ *  \param targetIdentifier The recording client's identifier of the target.
+ *  \param timestamp When it happened, on the `SimplePingMonotonicNanoseconds` clock.
+ */
+
+extern void SimplePingSessionRecordInit(SimplePingSessionRecord * record, uint8_t kind, uint32_t targetIdentifier, uint64_t timestamp);
+
+/*! Copies a received packet into a record, and its ICMP type and code.
+ *  \param record The record.
+ *  \param bytes The packet, with the IP header for ICMPv4.
+ *  \param length The length of that.
+ *  \param family AF_INET or AF_INET6.
+ */
+
+extern void SimplePingSessionRecordSetPacket(SimplePingSessionRecord * record, const void * bytes, size_t length, int family);
+
+/*! Sets a record's responder address.
+ *  \param record The record.
+ *  \param address An IPv4 or IPv6 socket address; anything else is ignored.
+ *  \param addressLength The length of that.
+ */
+
+extern void SimplePingSessionRecordSetResponder(SimplePingSessionRecord * record, const struct sockaddr * address, socklen_t addressLength);
+
+/*! Gets a record's responder address as a socket address.
+ *  \param record The record.
+ *  \param address Where to put the address.
+ *  \returns The length of the address, or 0 if the record has none.
+ */
+
+extern socklen_t SimplePingSessionRecordGetResponder(const SimplePingSessionRecord * record, struct sockaddr_storage * address);
+
+#pragma mark * Writing
+
+/*! Writes records to the end of a file.
+ *  \details The file is mapped a megabyte at a time and records are copied straight into
+ *      the mapping, so an append costs no system call until the next megabyte is needed.
+ *      After every 1023 records comes an index block, giving the time span of the records
+ *      before it so that a reader can find a time without reading them all, and the record
+ *      count in the file header is brought up to date.  If the process dies, the records
+ *      the kernel had been handed are still there for a reader to find.  A writer is not
+ *      thread safe.
+ */
+
+typedef struct SimplePingSessionWriter SimplePingSessionWriter;
+
+/*! Creates a recording, replacing any file at the path.
+ *  \param path The file's path.
+ *  \param writerPtr Where to put the writer.
+ *  \returns 0 on success, an errno value otherwise.
+ */
+
+extern int SimplePingSessionWriterOpen(const char * path, SimplePingSessionWriter ** writerPtr);
+
+/*! Appends a record.
+ *  \param writer The writer.
+ *  \param record The record.
+ *  \returns 0 on success, an errno value otherwise, such as ENOSPC.
+ */
+
+extern int SimplePingSessionWriterAppend(SimplePingSessionWriter * writer, const SimplePingSessionRecord * record);
+
+/*! Returns the number of records appended.
+ */
+
+extern uint64_t SimplePingSessionWriterRecordCount(const SimplePingSessionWriter * writer);
+
+/*! Pushes everything appended so far to disk, and updates the header to match.
+ *  \returns 0 on success, an errno value otherwise.
+ */
+
+extern int SimplePingSessionWriterSync(SimplePingSessionWriter * writer);
+
+/*! Finishes a recording, trimming the file to the records in it, and frees the writer.
+ *  \param writer The writer; may be NULL.
+ *  \returns 0 on success, an errno value otherwise; the writer is freed either way.
+ */
+
+extern int SimplePingSessionWriterClose(SimplePingSessionWriter * writer);
+
+#pragma mark * Reading
+
+/*! Reads a recording, mapped into memory whole.
+ *  \details It may be read while it's being written, in which case it has the records
+ *      appended by the time it was opened.
+ */
+
+typedef struct SimplePingSessionReader SimplePingSessionReader;
+
+/*! Opens a recording.
+ *  \param path The file's path.
+ *  \param readerPtr Where to put the reader.
+ *  \returns 0 on success, an errno value otherwise; EFTYPE if the file isn't a recording.
+ */
+
+extern int SimplePingSessionReaderOpen(const char * path, SimplePingSessionReader ** readerPtr);
+
+/*! Returns the number of records in a recording.
+ */
+
+extern uint64_t SimplePingSessionReaderRecordCount(const SimplePingSessionReader * reader);
+
+/*! Returns a record.
+ *  \param reader The reader.
+ *  \param index The record's index, less than the record count.
+ *  \returns The record, valid until the reader is closed.
+ */
+
+extern const SimplePingSessionRecord * SimplePingSessionReaderRecordAtIndex(const SimplePingSessionReader * reader, uint64_t index);
+
+/*! Finds the first record at or after a time.
+ *  \details Uses the index blocks to skip to the right thousand or so records, assuming
+ *      that timestamps don't go backwards, which from one thread they seldom do by much.
+ *  \param reader The reader.
+ *  \param timestamp The time, on the `SimplePingMonotonicNanoseconds` clock.
+ *  \returns The record's index, or the record count if there's none.
+ */
+
+extern uint64_t SimplePingSessionReaderIndexOfTimestamp(const SimplePingSessionReader * reader, uint64_t timestamp);
+
+/*! Returns when the recording was created.
+ *  \param reader The reader.
+ *  \param monotonicNanoseconds Where to put the time on the `SimplePingMonotonicNanoseconds` clock; may be NULL.
+ *  \param wallNanoseconds Where to put the same time in nanoseconds since 1970; may be NULL.
+ */
+
+extern void SimplePingSessionReaderGetStartTime(const SimplePingSessionReader * reader, uint64_t * monotonicNanoseconds, uint64_t * wallNanoseconds);
+
+/*! Closes a recording.
+ *  \param reader The reader; may be NULL.
+ */
+
+extern void SimplePingSessionReaderClose(SimplePingSessionReader * reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingSessionRecording_h */
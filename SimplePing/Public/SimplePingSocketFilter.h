@@ -0,0 +1,63 @@
+/*
+    Abstract:
+    Cheap rejection of other processes' ICMP traffic, in the kernel where possible and on the raw bytes otherwise.
+ */
+
+#ifndef SimplePingSocketFilter_h
+#define SimplePingSocketFilter_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! The kinds of ICMP message a socket asks the kernel to deliver.
+ */
+
+enum {
+    SimplePingICMPFilterEchoReplies     = 1 << 0,   ///< Echo replies.
+    SimplePingICMPFilterTimeExceeded    = 1 << 1,   ///< Time exceeded, as traceroute needs.
+    SimplePingICMPFilterUnreachable     = 1 << 2,   ///< Destination unreachable.
+    SimplePingICMPFilterOtherErrors     = 1 << 3,   ///< Packet too big and parameter problem (ICMPv6 only).
+    SimplePingICMPFilterAllErrors       = SimplePingICMPFilterTimeExceeded | SimplePingICMPFilterUnreachable | SimplePingICMPFilterOtherErrors
+};
+
+/*! Asks the kernel to deliver only some kinds of ICMP message to a socket.
+ *  \details Every ICMP socket gets a copy of every ICMP message the host receives,
+ *      which on IPv6 includes a steady stream of Neighbor Discovery and Multicast
+ *      Listener traffic.  On an ICMPv6 socket this sets `ICMP6_FILTER` so that the kernel
+ *      drops everything else before it wakes us up.  There's no equivalent for ICMPv4
+ *      sockets, so there this does nothing and returns `EPROTONOSUPPORT`; callers should
+ *      treat failure as harmless, since the packets are still checked once read.
+ *  \param fd The socket.
+ *  \param family The socket's address family, AF_INET or AF_INET6.
+ *  \param messages The `SimplePingICMPFilter...` flags of the messages to deliver.
+ *  \returns 0 on success, an errno value otherwise.
+ */
+
+extern int SimplePingInstallICMPFilter(int fd, int family, unsigned int messages);
+
+/*! Checks, on the raw bytes, whether a packet is certainly not about one of our pings.
+ *  \details This is much cheaper than full validation and needs no copy of the packet,
+ *      so it's done first.  A packet is foreign if it's an echo reply with another
+ *      identifier, an error quoting anything but an echo request with our identifier,
+ *      or any other message, such as an echo request or Neighbor Discovery.  A packet too
+ *      short or too odd to tell is not foreign; full validation gets to decide about it.
+ *  \param bytes The packet, as the kernel returned it: with the IP header for ICMPv4,
+ *      without it for ICMPv6.
+ *  \param length The length of that packet.
+ *  \param family AF_INET or AF_INET6.
+ *  \param identifier Our ICMP identifier, in host byte order.
+ *  \returns true if the packet can be discarded.
+ */
+
+extern bool SimplePingPacketIsForeign(const uint8_t * bytes, size_t length, int family, uint16_t identifier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingSocketFilter_h */
@@ -0,0 +1,112 @@
+/*
+    Abstract:
+    A hashed timer wheel that tracks a deadline per outstanding probe for many clients at once.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! Identifies a timeout scheduled on a SimplePingTimeoutWheel; 0 is never a valid token.
+ */
+
+typedef uint64_t SimplePingTimeoutToken;
+
+/*! Called with the keys of a client's timeouts that have expired.
+ *  \param keys The keys, in the order their timeouts were scheduled within each tick.
+ *  \param count The number of keys, at least 1.
+ */
+
+typedef void (^SimplePingTimeoutWheelHandler)(const uint64_t * keys, NSUInteger count);
+
+/*! A hashed timer wheel that tracks a deadline per outstanding probe for many clients at once.
+ *  \details One timer per probe, or even per pinger, gets expensive with thousands of
+ *      probes in flight.  The wheel keeps every deadline in one of 256 slots, by the tick
+ *      it falls in, and runs a single one-shot timer, armed for the tick of the earliest
+ *      timeout, which expires every slot it passed and re-arms for the next.  An idle
+ *      wheel, or one whose timeouts are seconds away, doesn't wake every tick.
+ *      Scheduling and cancelling a timeout are O(1) and, once the wheel has grown to its
+ *      high-water mark, never allocate; expired and cancelled entries are reused, so
+ *      memory stays bounded by the most timeouts ever outstanding.
+ *
+ *      Timeouts belong to clients, each with its own handler.  All of a client's timeouts
+ *      that expire in one wakeup are passed to its handler in one call.  A timeout fires on
+ *      the first tick at or after its deadline, and the timer is given a tick of leeway so
+ *      its wakeups can be coalesced with others: up to twice `tickInterval` late, never early.
+ *
+ *      SimplePingEngine has one, shared by everything using the engine.  A wheel must be
+ *      created and used on its run loop's thread, or on its queue.
+ */
+
+@interface SimplePingTimeoutWheel : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialises a wheel.
+ *  \param tickInterval The granularity of the wheel, in seconds; must be positive.
+ *  \param queue The serial queue to call handlers on, or nil to use the current run loop.
+ *  \returns The initialised wheel.
+ */
+
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval queue:(nullable dispatch_queue_t)queue NS_DESIGNATED_INITIALIZER;
+
+/*! The value passed to `-initWithTickInterval:queue:`.
+ */
+
+@property (nonatomic, assign, readonly) NSTimeInterval  tickInterval;
+
+/*! The number of timeouts scheduled and not yet expired or cancelled.
+ */
+
+@property (nonatomic, assign, readonly) NSUInteger      count;
+
+/*! Registers a client.
+ *  \param handler The block to call with the keys of the client's expired timeouts.  It
+ *      may schedule and cancel timeouts, and remove clients, including its own.
+ *  \returns An identifier for the client, never 0.
+ */
+
+- (NSUInteger)addClientWithHandler:(SimplePingTimeoutWheelHandler)handler;
+
+/*! Unregisters a client, cancelling all of its timeouts.
+ *  \details It's safe to call this for a client that was already removed.
+ *  \param client The identifier returned by `-addClientWithHandler:`.
+ */
+
+- (void)removeClient:(NSUInteger)client;
+
+/*! Schedules a timeout.
+ *  \param key A value passed back to the client's handler, typically a sequence number.
+ *  \param client The identifier returned by `-addClientWithHandler:`.
+ *  \param deadline When the timeout expires, on the SimplePingMonotonicNanoseconds() clock.
+ *  \returns A token for `-cancelTimeout:`.
+ */
+
+- (SimplePingTimeoutToken)addTimeoutForKey:(uint64_t)key client:(NSUInteger)client deadline:(uint64_t)deadline;
+
+/*! Schedules a timeout relative to now.
+ *  \param key A value passed back to the client's handler.
+ *  \param client The identifier returned by `-addClientWithHandler:`.
+ *  \param interval Seconds from now until the timeout expires.
+ *  \returns A token for `-cancelTimeout:`.
+ */
+
+- (SimplePingTimeoutToken)addTimeoutForKey:(uint64_t)key client:(NSUInteger)client afterInterval:(NSTimeInterval)interval;
+
+/*! Cancels a timeout.
+ *  \param token The token returned when it was scheduled, or 0.
+ *  \returns YES if the timeout was still scheduled; NO if it had already expired or been
+ *      cancelled.
+ */
+
+- (BOOL)cancelTimeout:(SimplePingTimeoutToken)token;
+
+/*! Cancels every timeout of a client, leaving it registered.
+ *  \param client The identifier returned by `-addClientWithHandler:`.
+ */
+
+- (void)removeTimeoutsForClient:(NSUInteger)client;
+
+@end
+
+NS_ASSUME_NONNULL_END
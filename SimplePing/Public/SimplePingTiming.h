@@ -0,0 +1,84 @@
+/*
+    Abstract:
+    Monotonic send and kernel receive timestamps for ping round trip times.
+ */
+
+#ifndef SimplePingTiming_h
+#define SimplePingTiming_h
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! The times of one ping exchange, in nanoseconds on the `SimplePingMonotonicNanoseconds` clock.
+ *  \details The round trip time is `kernelReceiveTime - sendTime`; the time the response
+ *      spent waiting for us to read it (run loop scheduling, other callbacks, and so on) is
+ *      `userReceiveTime - kernelReceiveTime`.  Neither is affected by wall clock changes.
+ */
+
+struct SimplePingTiming {
+    uint64_t    sendTime;               ///< When the request was handed to the kernel, or 0 if unknown.
+    uint64_t    kernelReceiveTime;      ///< When the kernel received the response; equal to `userReceiveTime` if the kernel didn't say.
+    uint64_t    userReceiveTime;        ///< When we read the response from the socket.
+};
+typedef struct SimplePingTiming SimplePingTiming;
+
+/*! Returns the current time of a monotonic, high resolution clock.
+ *  \details This is `mach_absolute_time` in nanoseconds (`CLOCK_UPTIME_RAW`), which is the
+ *      timebase the kernel uses for `SO_TIMESTAMP_MONOTONIC` receive stamps.  It does not
+ *      jump when the wall clock is changed.
+ *  \returns The current time in nanoseconds since an arbitrary point.
+ */
+
+extern uint64_t SimplePingMonotonicNanoseconds(void);
+
+/*! Returns the round trip time of a ping exchange.
+ *  \param timing The times of the exchange.
+ *  \returns `kernelReceiveTime - sendTime`, or 0 if the send time is unknown.
+ */
+
+extern uint64_t SimplePingTimingRoundTripNanoseconds(SimplePingTiming timing);
+
+/*! Returns how long a response waited in the kernel before we read it.
+ *  \param timing The times of the exchange.
+ *  \returns `userReceiveTime - kernelReceiveTime`.
+ */
+
+extern uint64_t SimplePingTimingDeliveryDelayNanoseconds(SimplePingTiming timing);
+
+/*! Asks the kernel to stamp every packet received on a socket.
+ *  \details Uses `SO_TIMESTAMP_MONOTONIC` where available, falling back to `SO_TIMESTAMP`.
+ *  \param fd The socket.
+ *  \returns 0 on success, an errno value otherwise.
+ */
+
+extern int SimplePingEnableReceiveTimestamps(int fd);
+
+/*! Receives a packet along with its kernel receive time.
+ *  \details Works like `recvfrom()`, using `recvmsg()` to pick up the timestamp control
+ *      message enabled by `SimplePingEnableReceiveTimestamps`.  Wall clock (`SO_TIMESTAMP`)
+ *      stamps are converted to the monotonic clock by subtracting their age.
+ *  \param fd The socket.
+ *  \param buffer The buffer to receive into.
+ *  \param bufferLength The size of that buffer.
+ *  \param flags Flags as for `recvfrom()`.
+ *  \param address Receives the source address; may be NULL.
+ *  \param addressLength On input the size of `address`, on output the size of the source
+ *      address; may be NULL if `address` is NULL.
+ *  \param kernelReceiveTimePtr Receives the kernel receive time; if the kernel didn't supply
+ *      one, this is the same as the user receive time.  May be NULL.
+ *  \param userReceiveTimePtr Receives the time at which the packet was read.  May be NULL.
+ *  \returns As for `recvfrom()`.
+ */
+
+extern ssize_t SimplePingReceiveFrom(int fd, void * buffer, size_t bufferLength, int flags, struct sockaddr * address, socklen_t * addressLength, uint64_t * kernelReceiveTimePtr, uint64_t * userReceiveTimePtr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SimplePingTiming_h */
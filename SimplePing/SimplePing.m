@@ -7,10 +7,13 @@
  */
 
 #import "SimplePing.h"
+#import "SimplePingEngineInternal.h"
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <errno.h>
+#include <unistd.h>
 
 #pragma mark * IPv4 and ICMPv4 On-The-Wire Format
 
@@ -48,54 +51,6 @@ __Check_Compile_Time(offsetof(IPv4Header, headerChecksum) == 10);
 __Check_Compile_Time(offsetof(IPv4Header, sourceAddress) == 12);
 __Check_Compile_Time(offsetof(IPv4Header, destinationAddress) == 16);
 
-/*! Calculates an IP checksum.
- *  \details This is the standard BSD checksum code, modified to use modern types.
- *  \param buffer A pointer to the data to checksum.
- *  \param bufferLen The length of that data.
- *  \returns The checksum value, in network byte order.
- */
-
-static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
-    // 
-	size_t              bytesLeft;
-    int32_t             sum;
-	const uint16_t *    cursor;
-	union {
-		uint16_t        us;
-		uint8_t         uc[2];
-	} last;
-	uint16_t            answer;
-
-	bytesLeft = bufferLen;
-	sum = 0;
-	cursor = buffer;
-
-	/*
-	 * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-	 * sequential 16 bit words to it, and at the end, fold back all the
-	 * carry bits from the top 16 bits into the lower 16 bits.
-	 */
-	while (bytesLeft > 1) {
-		sum += *cursor;
-        cursor += 1;
-		bytesLeft -= 2;
-	}
-
-	/* mop up an odd byte, if necessary */
-	if (bytesLeft == 1) {
-		last.uc[0] = * (const uint8_t *) cursor;
-		last.uc[1] = 0;
-		sum += last.us;
-	}
-
-	/* add back carry outs from top 16 bits to low 16 bits */
-	sum = (sum >> 16) + (sum & 0xffff);	/* add hi 16 to low 16 */
-	sum += (sum >> 16);			/* add carry */
-	answer = (uint16_t) ~sum;   /* truncate to 16 bits */
-
-	return answer;
-}
-
 #pragma mark * SimplePing
 
 @interface SimplePing ()
@@ -112,35 +67,185 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
  
 @property (nonatomic, assign, readwrite)           BOOL         nextSequenceNumberHasWrapped;
 
-/*! A host object for name-to-address resolution.
+/*! The address passed to `-initWithHostAddress:engine:`, which `-start` uses rather than resolving.
+ */
+
+@property (nonatomic, copy,   readonly,  nullable) NSData *     initialHostAddress;
+
+/*! A resolver for name-to-address resolution.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingHostResolver * resolver;
+
+/*! A read source for our ICMP send and receive socket.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingReadSource *   readSource;
+
+/*! True if we've added ourselves to `engine`, in which case we use its socket rather than `readSource`.
+ */
+
+@property (nonatomic, assign, readwrite)           BOOL         addedToEngine;
+
+/*! True if our own socket is connected to `hostAddress`, in which case sends give no address.
+ */
+
+@property (nonatomic, assign, readwrite)           BOOL         socketIsConnected;
+
+/*! A reusable buffer for receiving packets; allocated on first use.
  */
 
-@property (nonatomic, strong, readwrite, nullable) CFHostRef host __attribute__ ((NSObject));
+@property (nonatomic, strong, readwrite, nullable) NSMutableData *  receiveBuffer;
 
-/*! A socket object for ICMP send and receive.
+/*! Ping responses waiting for `-flushReceivedPackets`, if the delegate takes batches.
  */
 
-@property (nonatomic, strong, readwrite, nullable) CFSocketRef socket __attribute__ ((NSObject));
+@property (nonatomic, strong, readonly )           NSMutableArray<SimplePingResponse *> *   pendingResponses;
+
+/*! The payload `_packetTemplate` was built with, or nil for the default payload.
+ */
+
+@property (nonatomic, copy,   readwrite, nullable) NSData *     packetTemplatePayload;
+
+@end
+
+#pragma mark * SimplePingResponse
+
+@interface SimplePingResponse ()
+
+- (instancetype)initWithPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber timing:(SimplePingTiming)timing NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation SimplePingResponse
+
+- (instancetype)initWithPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber timing:(SimplePingTiming)timing {
+    NSParameterAssert(packet != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_packet         = [packet copy];
+        self->_sequenceNumber = sequenceNumber;
+        self->_timing         = timing;
+    }
+    return self;
+}
 
 @end
 
-@implementation SimplePing
+#pragma mark * SimplePing
+
+/*! The number of send times we remember; must be a power of two.
+ *  \details Responses to requests more than this many sequence numbers old are reported 
+ *      with an unknown send time.
+ */
+
+enum {
+    kSimplePingSendTimeCount = 256
+};
+
+@implementation SimplePing {
+    uint64_t    _sendTimes[kSimplePingSendTimeCount];           ///< indexed by sequence number & (count - 1)
+    uint16_t    _sendTimeSequenceNumbers[kSimplePingSendTimeCount];
+    SimplePingPacketTemplate    _packetTemplate;                ///< see -preparePacketTemplateWithPayload:
+    SimplePingMetrics           _metrics;                       ///< see -metrics
+}
 
 - (instancetype)initWithHostName:(NSString *)hostName {
+    return [self initWithHostName:hostName engine:nil];
+}
+
+- (instancetype)initWithHostName:(NSString *)hostName engine:(SimplePingEngine *)engine {
     NSParameterAssert(hostName != nil);
     self = [super init];
     if (self != nil) {
         self->_hostName   = [hostName copy];
+        self->_engine     = engine;
         self->_identifier = (uint16_t) arc4random();
+        self->_receiveBatchLimit = 32;
+        self->_sequenceWindow    = 120;
+        self->_pendingResponses  = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+/*! Returns the numeric form of an address.
+ *  \param address Contains a (struct sockaddr) with the address to render.
+ *  \returns A string representation of that address, or "?" if it can't be rendered.
+ */
+
+static NSString * SimplePingNumericHostForAddress(NSData * address) {
+    char    hostStr[NI_MAXHOST];
+    
+    if ( (address.length >= sizeof(struct sockaddr)) && (getnameinfo(address.bytes, (socklen_t) address.length, hostStr, sizeof(hostStr), NULL, 0, NI_NUMERICHOST) == 0) ) {
+        return @(hostStr);
+    }
+    return @"?";
+}
+
+/*! Stops the kernel fragmenting packets sent on a socket.
+ *  \param fd The socket.
+ *  \param family The socket's address family.
+ *  \returns 0 on success, an errno value otherwise.
+ */
+
+static int SimplePingSetDontFragment(int fd, sa_family_t family) {
+    int     on;
+    int     result;
+
+    on = 1;
+    result = EPROTONOSUPPORT;
+    switch (family) {
+        case AF_INET: {
+            #if defined(IP_DONTFRAG)
+                result = (setsockopt(fd, IPPROTO_IP, IP_DONTFRAG, &on, sizeof(on)) == 0) ? 0 : errno;
+            #endif
+        } break;
+        case AF_INET6: {
+            result = (setsockopt(fd, IPPROTO_IPV6, IPV6_DONTFRAG, &on, sizeof(on)) == 0) ? 0 : errno;
+        } break;
+        default: {
+            // leave result as EPROTONOSUPPORT
+        } break;
+    }
+    return result;
+}
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress {
+    return [self initWithHostAddress:hostAddress engine:nil];
+}
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress engine:(SimplePingEngine *)engine {
+    NSParameterAssert(hostAddress.length >= sizeof(struct sockaddr));
+    self = [self initWithHostName:SimplePingNumericHostForAddress(hostAddress) engine:engine];
+    if (self != nil) {
+        self->_initialHostAddress = [hostAddress copy];
     }
     return self;
 }
 
 - (void)dealloc {
     [self stop];
-    // Double check that -stop took care of _host and _socket.
-    assert(self->_host == NULL);
-    assert(self->_socket == NULL);
+    // Double check that -stop took care of _resolver and _readSource.
+    assert(self->_resolver == nil);
+    assert(self->_readSource == nil);
+    assert( ! self->_addedToEngine );
+    SimplePingPacketTemplateDestroy(&self->_packetTemplate);
+}
+
+/*! Returns the native socket used for sending.
+ *  \returns Either our own socket or the engine's shared socket, or -1 if neither is open.
+ */
+
+- (int)nativeSocket {
+    int     result;
+    
+    result = -1;
+    if (self.addedToEngine) {
+        result = [self.engine socketForAddressFamily:self.hostAddressFamily];
+    } else if (self.readSource != nil) {
+        result = self.readSource.nativeSocket;
+    }
+    return result;
 }
 
 - (sa_family_t)hostAddressFamily {
@@ -177,61 +282,91 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
     }
 }
 
-/*! Shuts down the pinger object and tell the delegate about the error.
- *  \details This converts the CFStreamError to an NSError and then call through to 
- *      -didFailWithError: to do the real work.
- *  \param streamError Describes the failure.
+/*! The offset of the bottle count within the default payload.
+ *  \details The default payload is "%28zd bottles of beer on the wall", so the last two 
+ *      digits of the count are the two bytes before the 28th.
  */
 
-- (void)didFailWithHostStreamError:(CFStreamError)streamError {
-    NSDictionary *  userInfo;
-    NSError *       error;
+enum {
+    kSimplePingDefaultPayloadLength      = 56,
+    kSimplePingDefaultPayloadCountOffset = 26
+};
 
-    if (streamError.domain == kCFStreamErrorDomainNetDB) {
-        userInfo = @{(id) kCFGetAddrInfoFailureKey: @(streamError.error)};
-    } else {
-        userInfo = nil;
-    }
-    error = [NSError errorWithDomain:(NSString *) kCFErrorDomainCFNetwork code:kCFHostErrorUnknown userInfo:userInfo];
+/*! Makes sure the packet template matches the next ping.
+ *  \details The template is only rebuilt when the address family, identifier or payload 
+ *      change, which for almost all clients means once per start.
+ *  \param payload The payload passed to `-sendPingWithData:`, or nil for the default payload.
+ *  \returns YES on success, NO if the template could not be allocated.
+ */
 
-    [self didFailWithError:error];
+- (BOOL)preparePacketTemplateWithPayload:(nullable NSData *)payload {
+    uint8_t     type;
+    bool        requiresChecksum;
+    NSData *    templatePayload;
+    
+    switch (self.hostAddressFamily) {
+        case AF_INET: {
+            type = ICMPv4TypeEchoRequest;
+            requiresChecksum = true;
+        } break;
+        case AF_INET6: {
+            type = ICMPv6TypeEchoRequest;
+            requiresChecksum = false;
+        } break;
+        default: {
+            assert(NO);
+            return NO;
+        } break;
+    }
+    
+    if ( (self->_packetTemplate.bytes != NULL) 
+      && (self->_packetTemplate.type == type) 
+      && (self->_packetTemplate.identifier == self.identifier) 
+      && ( (payload == nil) ? (self.packetTemplatePayload == nil) : [payload isEqual:self.packetTemplatePayload] ) ) {
+        return YES;
+    }
+    
+    templatePayload = payload;
+    if (templatePayload == nil) {
+        templatePayload = [[NSString stringWithFormat:@"%28zd bottles of beer on the wall", (ssize_t) 99] dataUsingEncoding:NSASCIIStringEncoding];
+        assert(templatePayload != nil);
+        
+        // Our dummy payload is sized so that the resulting ICMP packet, including the ICMPHeader, is 
+        // 64-bytes, which makes it easier to recognise our packets on the wire.
+        
+        assert([templatePayload length] == kSimplePingDefaultPayloadLength);
+    }
+    if ( ! SimplePingPacketTemplateInit(&self->_packetTemplate, type, self.identifier, templatePayload.bytes, templatePayload.length, requiresChecksum) ) {
+        self.packetTemplatePayload = nil;
+        return NO;
+    }
+    self.packetTemplatePayload = payload;
+    return YES;
 }
 
-/*! Builds a ping packet from the supplied parameters.
- *  \param type The packet type, which is different for IPv4 and IPv6.
- *  \param payload Data to place after the ICMP header.
- *  \param requiresChecksum Determines whether a checksum is calculated (IPv4) or not (IPv6).
- *  \returns A ping packet suitable to be passed to the kernel.
+/*! Patches the sequence number, and the bottle count of the default payload, into the template.
+ *  \param isDefaultPayload YES if the template holds the default payload.
  */
 
-- (NSData *)pingPacketWithType:(uint8_t)type payload:(NSData *)payload requiresChecksum:(BOOL)requiresChecksum {
-    NSMutableData *         packet;
-    ICMPHeader *            icmpPtr;
-
-    packet = [NSMutableData dataWithLength:sizeof(*icmpPtr) + payload.length];
-    assert(packet != nil);
-
-    icmpPtr = packet.mutableBytes;
-    icmpPtr->type = type;
-    icmpPtr->code = 0;
-    icmpPtr->checksum = 0;
-    icmpPtr->identifier     = OSSwapHostToBigInt16(self.identifier);
-    icmpPtr->sequenceNumber = OSSwapHostToBigInt16(self.nextSequenceNumber);
-    memcpy(&icmpPtr[1], [payload bytes], [payload length]);
-    
-    if (requiresChecksum) {
-        // The IP checksum routine returns a 16-bit number that's already in correct byte order 
-        // (due to wacky 1's complement maths), so we just put it into the packet as a 16-bit unit.
+- (void)patchPacketTemplateForDefaultPayload:(BOOL)isDefaultPayload {
+    SimplePingPacketTemplateSetSequenceNumber(&self->_packetTemplate, self.nextSequenceNumber);
+    if (isDefaultPayload) {
+        uint8_t     count[2];
+        unsigned    bottles;
+        
+        // "%2u" without the allocation.
         
-        icmpPtr->checksum = in_cksum(packet.bytes, packet.length);
+        bottles = 99 - (self.nextSequenceNumber % 100);
+        count[0] = (bottles >= 10) ? (uint8_t) ('0' + bottles / 10) : ' ';
+        count[1] = (uint8_t) ('0' + bottles % 10);
+        SimplePingPacketTemplatePatch(&self->_packetTemplate, sizeof(ICMPHeader) + kSimplePingDefaultPayloadCountOffset, count, sizeof(count));
     }
-    
-    return packet;
 }
 
 - (void)sendPingWithData:(NSData *)data {
     int                     err;
-    NSData *                payload;
+    int                     fd;
+    BOOL                    success;
     NSData *                packet;
     ssize_t                 bytesSent;
     id<SimplePingDelegate>  strongDelegate;
@@ -239,60 +374,75 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
     // data may be nil
     NSParameterAssert(self.hostAddress != nil);     // gotta wait for -simplePing:didStartWithAddress:
     
-    // Construct the ping packet.
+    // Construct the ping packet.  This patches the sequence number (and the bottle count 
+    // of our dummy payload) into a packet built once, rather than building it afresh.
     
-    payload = data;
-    if (payload == nil) {
-        payload = [[NSString stringWithFormat:@"%28zd bottles of beer on the wall", (ssize_t) 99 - (size_t) (self.nextSequenceNumber % 100) ] dataUsingEncoding:NSASCIIStringEncoding];
-        assert(payload != nil);
-        
-        // Our dummy payload is sized so that the resulting ICMP packet, including the ICMPHeader, is 
-        // 64-bytes, which makes it easier to recognise our packets on the wire.
-        
-        assert([payload length] == 56);
-    }
-    
-    switch (self.hostAddressFamily) {
-        case AF_INET: {
-            packet = [self pingPacketWithType:ICMPv4TypeEchoRequest payload:payload requiresChecksum:YES];
-        } break;
-        case AF_INET6: {
-            packet = [self pingPacketWithType:ICMPv6TypeEchoRequest payload:payload requiresChecksum:NO];
-        } break;
-        default: {
-            assert(NO);
-        } break;
+    success = [self preparePacketTemplateWithPayload:data];
+    if ( ! success ) {
+        NSError *   error;
+
+        // There's no packet to send, so tell the client and move on to the next 
+        // sequence number, as for any other failed send.
+
+        error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:nil];
+        SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterSendFailures, 1);
+        SimplePingLogError(SimplePingLogCategoryPing, "Failed to build ping seq=%u: %{public}s", (unsigned) self.nextSequenceNumber, strerror(ENOMEM));
+        strongDelegate = self.delegate;
+        if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didFailToSendPacket:sequenceNumber:error:)] ) {
+            [strongDelegate simplePing:self didFailToSendPacket:[NSData data] sequenceNumber:self.nextSequenceNumber error:error];
+        }
+        self.nextSequenceNumber += 1;
+        if (self.nextSequenceNumber == 0) {
+            self.nextSequenceNumberHasWrapped = YES;
+        }
+        return;
     }
-    assert(packet != nil);
+    [self patchPacketTemplateForDefaultPayload:(data == nil)];
 
-    // Send the packet.
+    // Send the packet, noting the time just before we hand it to the kernel.
     
-    if (self.socket == NULL) {
+    fd = [self nativeSocket];
+    if (fd < 0) {
         bytesSent = -1;
         err = EBADF;
     } else {
-        bytesSent = sendto(
-            CFSocketGetNative(self.socket),
-            packet.bytes,
-            packet.length, 
-            0,
-            self.hostAddress.bytes, 
-            (socklen_t) self.hostAddress.length
-        );
+        self->_sendTimes[self.nextSequenceNumber & (kSimplePingSendTimeCount - 1)] = SimplePingMonotonicNanoseconds();
+        self->_sendTimeSequenceNumbers[self.nextSequenceNumber & (kSimplePingSendTimeCount - 1)] = self.nextSequenceNumber;
+        if (self.addedToEngine) {
+            // The engine puts the socket back to the default hop limit if a traceroute 
+            // sharing it changed that.
+            bytesSent = [self.engine sendPacket:self->_packetTemplate.bytes length:self->_packetTemplate.length toAddress:self.hostAddress hopLimit:0];
+        } else if (self.socketIsConnected) {
+            // Giving an address to a connected socket fails with EISCONN.
+            bytesSent = send(fd, self->_packetTemplate.bytes, self->_packetTemplate.length, 0);
+        } else {
+            bytesSent = sendto(
+                fd,
+                self->_packetTemplate.bytes,
+                self->_packetTemplate.length, 
+                0,
+                self.hostAddress.bytes, 
+                (socklen_t) self.hostAddress.length
+            );
+        }
         err = 0;
         if (bytesSent < 0) {
             err = errno;
         }
     }
 
-    // Handle the results of the send.
+    // Handle the results of the send.  The template is reused, so the delegate gets a 
+    // copy, made only if the delegate wants it.
     
     strongDelegate = self.delegate;
-    if ( (bytesSent > 0) && (((NSUInteger) bytesSent) == packet.length) ) {
+    if ( (bytesSent > 0) && (((size_t) bytesSent) == self->_packetTemplate.length) ) {
 
         // Complete success.  Tell the client.
 
+        SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterPacketsSent, 1);
+        SimplePingSignpostBegin(SimplePingLogCategoryPing, SimplePingSignpostProbeID(self.identifier, self.nextSequenceNumber), "Ping", "seq=%u", (unsigned) self.nextSequenceNumber);
         if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didSendPacket:sequenceNumber:)] ) {
+            packet = [NSData dataWithBytes:self->_packetTemplate.bytes length:self->_packetTemplate.length];
             [strongDelegate simplePing:self didSendPacket:packet sequenceNumber:self.nextSequenceNumber];
         }
     } else {
@@ -304,7 +454,10 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
             err = ENOBUFS;          // This is not a hugely descriptor error, alas.
         }
         error = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil];
+        SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterSendFailures, 1);
+        SimplePingLogError(SimplePingLogCategoryPing, "Failed to send ping seq=%u: %{public}s", (unsigned) self.nextSequenceNumber, strerror(err));
         if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didFailToSendPacket:sequenceNumber:error:)] ) {
+            packet = [NSData dataWithBytes:self->_packetTemplate.bytes length:self->_packetTemplate.length];
             [strongDelegate simplePing:self didFailToSendPacket:packet sequenceNumber:self.nextSequenceNumber error:error];
         }
     }
@@ -353,13 +506,14 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
     if (self.nextSequenceNumberHasWrapped) {
         // If the sequence numbers have wrapped that we can't reliably check 
         // whether this is a sequence number we sent.  Rather, we check to see 
-        // whether the sequence number is within the last 120 sequence numbers 
-        // we sent.  Note that the uint16_t subtraction here does the right 
-        // thing regardless of the wrapping.
+        // whether the sequence number is within the last `sequenceWindow` 
+        // sequence numbers we sent.  Note that the uint16_t subtraction here does 
+        // the right thing regardless of the wrapping.
         // 
-        // Why 120?  Well, if we send one ping per second, 120 is 2 minutes, which 
-        // is the standard "max time a packet can bounce around the Internet" value.
-        return ((uint16_t) (self.nextSequenceNumber - sequenceNumber)) < (uint16_t) 120;
+        // Why 120 by default?  Well, if we send one ping per second, 120 is 2 minutes, 
+        // which is the standard "max time a packet can bounce around the Internet" value. 
+        // Faster pingers scale the window up to match.
+        return ((uint16_t) (self.nextSequenceNumber - sequenceNumber)) < MIN(self.sequenceWindow, (NSUInteger) 32768);
     } else {
         return sequenceNumber < self.nextSequenceNumber;
     }
@@ -392,7 +546,7 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
 
         receivedChecksum   = icmpPtr->checksum;
         icmpPtr->checksum  = 0;
-        calculatedChecksum = in_cksum(icmpPtr, packet.length - icmpHeaderOffset);
+        calculatedChecksum = SimplePingChecksum(icmpPtr, packet.length - icmpHeaderOffset);
         icmpPtr->checksum  = receivedChecksum;
         
         if (receivedChecksum == calculatedChecksum) {
@@ -478,9 +632,162 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
     return result;
 }
 
+/*! Returns the time at which the request with the specified sequence number was sent.
+ *  \param sequenceNumber The sequence number of the request.
+ *  \returns The send time on the `SimplePingMonotonicNanoseconds` clock, or 0 if we 
+ *      no longer remember it.
+ */
+
+- (uint64_t)sendTimeForSequenceNumber:(uint16_t)sequenceNumber {
+    NSUInteger  index;
+    
+    index = sequenceNumber & (kSimplePingSendTimeCount - 1);
+    if (self->_sendTimeSequenceNumbers[index] != sequenceNumber) {
+        return 0;
+    }
+    return self->_sendTimes[index];
+}
+
+/*! Processes a packet received from the ICMP socket.
+ *  \details Called by `-readData` for our own socket, or by the engine for packets 
+ *      it has routed to us.  Validates the packet and passes it up to our client.
+ *  \param packet The packet, as returned to us by the kernel; note that we may end up 
+ *      modifying this data.
+ *  \param address The address the packet came from.
+ *  \param addressLength The length of that address.
+ *  \param kernelReceiveTime When the kernel received the packet.
+ *  \param userReceiveTime When the packet was read from the socket.
+ */
+
+- (void)processReceivedPacket:(NSMutableData *)packet fromAddress:(const struct sockaddr *)address addressLength:(socklen_t)addressLength kernelReceiveTime:(uint64_t)kernelReceiveTime userReceiveTime:(uint64_t)userReceiveTime {
+    id<SimplePingDelegate>      strongDelegate;
+    SimplePingSessionRecorder * recorder;
+    SimplePingSessionRecord     record;
+    uint16_t                    sequenceNumber;
+    BOOL                        valid;
+    uint64_t                    callbackStart;
+
+    // Copy the packet for the recorder first, as IPv4 validation strips its IP header.
+
+    recorder = self.sessionRecorder;
+    if (recorder != nil) {
+        SimplePingSessionRecordInit(&record, SimplePingSessionRecordKindPing, self.sessionTargetIdentifier, kernelReceiveTime);
+        SimplePingSessionRecordSetPacket(&record, packet.bytes, packet.length, self.hostAddressFamily);
+        SimplePingSessionRecordSetResponder(&record, address, addressLength);
+        record.identifier = self.identifier;
+    }
+
+    // Time the checks, as that's the cost every packet on a shared socket pays, even 
+    // those that turn out to be someone else's.
+
+    SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterPacketsReceived, 1);
+    valid = [self validatePingResponsePacket:packet sequenceNumber:&sequenceNumber];
+    callbackStart = SimplePingMonotonicNanoseconds();
+    SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterFilteringNanoseconds, callbackStart - userReceiveTime);
+
+    strongDelegate = self.delegate;
+    if (valid) {
+        SimplePingTiming    timing;
+        
+        timing.sendTime          = [self sendTimeForSequenceNumber:sequenceNumber];
+        timing.kernelReceiveTime = kernelReceiveTime;
+        timing.userReceiveTime   = userReceiveTime;
+        if (recorder != nil) {
+            record.flags = SimplePingSessionRecordFlagValid;
+            record.sequenceNumber = sequenceNumber;
+            record.roundTripNanoseconds = SimplePingTimingRoundTripNanoseconds(timing);
+            [recorder appendRecord:&record];
+        }
+        SimplePingSignpostEnd(SimplePingLogCategoryPing, SimplePingSignpostProbeID(self.identifier, sequenceNumber), "Ping", "seq=%u", (unsigned) sequenceNumber);
+        if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceivePingResponses:)] ) {
+        
+            // Hold it until -flushReceivedPackets.
+        
+            [self.pendingResponses addObject:[[SimplePingResponse alloc] initWithPacket:packet sequenceNumber:sequenceNumber timing:timing]];
+        } else if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceivePingResponsePacket:sequenceNumber:timing:)] ) {
+            [strongDelegate simplePing:self didReceivePingResponsePacket:packet sequenceNumber:sequenceNumber timing:timing];
+            SimplePingMetricsRecordCallback(&self->_metrics, SimplePingMonotonicNanoseconds() - callbackStart);
+        } else if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceivePingResponsePacket:sequenceNumber:)] ) {
+            [strongDelegate simplePing:self didReceivePingResponsePacket:packet sequenceNumber:sequenceNumber];
+            SimplePingMetricsRecordCallback(&self->_metrics, SimplePingMonotonicNanoseconds() - callbackStart);
+        }
+    } else {
+        SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterUnexpectedPackets, 1);
+        if (recorder != nil) {
+            [recorder appendRecord:&record];
+        }
+        if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceiveUnexpectedPacket:)] ) {
+            [strongDelegate simplePing:self didReceiveUnexpectedPacket:packet];
+        }
+    }
+}
+
+- (void)flushReceivedPackets {
+    NSArray<SimplePingResponse *> * responses;
+    id<SimplePingDelegate>          strongDelegate;
+
+    if (self.pendingResponses.count == 0) {
+        return;
+    }
+    responses = [self.pendingResponses copy];
+    [self.pendingResponses removeAllObjects];
+    
+    strongDelegate = self.delegate;
+    if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceivePingResponses:)] ) {
+        uint64_t    callbackStart;
+
+        callbackStart = SimplePingMonotonicNanoseconds();
+        [strongDelegate simplePing:self didReceivePingResponses:responses];
+        SimplePingMetricsRecordCallback(&self->_metrics, SimplePingMonotonicNanoseconds() - callbackStart);
+    }
+}
+
+- (void)simplePingEngine:(SimplePingEngine *)engine didReceivePacket:(NSMutableData *)packet fromAddress:(const struct sockaddr *)address addressLength:(socklen_t)addressLength kernelReceiveTime:(uint64_t)kernelReceiveTime userReceiveTime:(uint64_t)userReceiveTime {
+    #pragma unused(engine)
+    [self processReceivedPacket:packet fromAddress:address addressLength:addressLength kernelReceiveTime:kernelReceiveTime userReceiveTime:userReceiveTime];
+}
+
+- (void)simplePingEngineDidDrainSocket:(SimplePingEngine *)engine {
+    #pragma unused(engine)
+    [self flushReceivedPackets];
+}
+
+- (void)simplePingEngine:(SimplePingEngine *)engine didFailWithError:(NSError *)error {
+    #pragma unused(engine)
+    [self didFailWithError:error];
+}
+
+/*! Checks a packet just read from our socket for being someone else's.
+ *  \details Called by `-readData` before it copies the packet.  A foreign packet is 
+ *      counted as received and unexpected, just as `-processReceivedPacket:...` would 
+ *      have, but never reaches the delegate.
+ *  \param bytes The packet, as returned to us by the kernel.
+ *  \param length The length of that packet.
+ *  \param userReceiveTime When the packet was read from the socket.
+ *  \returns YES if the packet should be dropped.
+ */
+
+- (BOOL)shouldDropForeignPacket:(const uint8_t *)bytes length:(size_t)length userReceiveTime:(uint64_t)userReceiveTime {
+    id<SimplePingDelegate>  strongDelegate;
+
+    strongDelegate = self.delegate;
+    if ( ! self.ignoresForeignPackets && (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceiveUnexpectedPacket:)] ) {
+        return NO;
+    }
+    if ( ! SimplePingPacketIsForeign(bytes, length, self.hostAddressFamily, self.identifier) ) {
+        return NO;
+    }
+    SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterPacketsReceived, 1);
+    SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterUnexpectedPackets, 1);
+    SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterFilteringNanoseconds, SimplePingMonotonicNanoseconds() - userReceiveTime);
+    return YES;
+}
+
 /*! Reads data from the ICMP socket.
- *  \details Called by the socket handling code (SocketReadCallback) to process an ICMP 
- *      message waiting on the socket.
+ *  \details Called by our read source when there's data waiting on the socket to process the ICMP 
+ *      messages waiting on the socket.  We read, without blocking, until the socket is 
+ *      drained or we've read `receiveBatchLimit` packets, and only then go back to the 
+ *      run loop.
  */
 
 - (void)readData {
@@ -488,92 +795,77 @@ static uint16_t in_cksum(const void *buffer, size_t bufferLen) {
     struct sockaddr_storage addr;
     socklen_t               addrLen;
     ssize_t                 bytesRead;
-    void *                  buffer;
-    enum { kBufferSize = 65535 };
+    uint64_t                kernelReceiveTime;
+    uint64_t                userReceiveTime;
+    NSUInteger              packetCount;
+    NSUInteger              packetLimit;
 
     // 65535 is the maximum IP packet size, which seems like a reasonable bound 
-    // here (plus it's what <x-man-page://8/ping> uses).
-    
-    buffer = malloc(kBufferSize);
-    assert(buffer != NULL);
+    // here (plus it's what <x-man-page://8/ping> uses).  The buffer is reused across 
+    // packets and callbacks.
     
-    // Actually read the data.  We use recvfrom(), and thus get back the source address, 
-    // but we don't actually do anything with it.  It would be trivial to pass it to 
-    // the delegate but we don't need it in this example.
-    
-    addrLen = sizeof(addr);
-    bytesRead = recvfrom(CFSocketGetNative(self.socket), buffer, kBufferSize, 0, (struct sockaddr *) &addr, &addrLen);
-    err = 0;
-    if (bytesRead < 0) {
-        err = errno;
+    if (self.receiveBuffer == nil) {
+        self.receiveBuffer = [NSMutableData dataWithLength:65535];
+        assert(self.receiveBuffer != nil);
     }
     
-    // Process the data we read.
+    packetLimit = MAX(self.receiveBatchLimit, (NSUInteger) 1);
+    err = 0;
+    for (packetCount = 0; packetCount < packetLimit; packetCount++) {
     
-    if (bytesRead > 0) {
-        NSMutableData *         packet;
-        id<SimplePingDelegate>  strongDelegate;
-        uint16_t                sequenceNumber;
-
-        packet = [NSMutableData dataWithBytes:buffer length:(NSUInteger) bytesRead];
-        assert(packet != nil);
+        // The delegate may have stopped us while handling the previous packet.
+        
+        if (self.readSource == nil) {
+            break;
+        }
+        
+        // Actually read the data.  We use recvmsg() (via SimplePingReceiveFrom), and thus get 
+        // back the source address and the kernel's receive timestamp.  The address only goes 
+        // to the session recorder, if there is one.  MSG_DONTWAIT means we stop, rather than 
+        // block, once the socket is drained.
+        
+        addrLen = sizeof(addr);
+        bytesRead = SimplePingReceiveFrom(self.readSource.nativeSocket, self.receiveBuffer.mutableBytes, self.receiveBuffer.length, MSG_DONTWAIT, (struct sockaddr *) &addr, &addrLen, &kernelReceiveTime, &userReceiveTime);
+        if (bytesRead < 0) {
+            err = errno;
+            if ( (err == EAGAIN) || (err == EWOULDBLOCK) || (err == EINTR) ) {
+                err = 0;
+                break;
+            }
+        }
+        
+        // Process the data we read.  Packets that are certainly someone else's are 
+        // dropped before we copy them, unless the delegate wants to hear about them.
+        
+        if (bytesRead > 0) {
+            NSMutableData *         packet;
 
-        // We got some data, pass it up to our client.
+            if ( ! [self shouldDropForeignPacket:self.receiveBuffer.bytes length:(size_t) bytesRead userReceiveTime:userReceiveTime] ) {
+                packet = [NSMutableData dataWithBytes:self.receiveBuffer.bytes length:(NSUInteger) bytesRead];
+                assert(packet != nil);
 
-        strongDelegate = self.delegate;
-        if ( [self validatePingResponsePacket:packet sequenceNumber:&sequenceNumber] ) {
-            if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceivePingResponsePacket:sequenceNumber:)] ) {
-                [strongDelegate simplePing:self didReceivePingResponsePacket:packet sequenceNumber:sequenceNumber];
+                [self processReceivedPacket:packet fromAddress:(const struct sockaddr *) &addr addressLength:addrLen kernelReceiveTime:kernelReceiveTime userReceiveTime:userReceiveTime];
             }
         } else {
-            if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didReceiveUnexpectedPacket:)] ) {
-                [strongDelegate simplePing:self didReceiveUnexpectedPacket:packet];
+            if (err == 0) {
+                err = EPIPE;
             }
+            break;
         }
-    } else {
+    }
+
+    // Hand over any batched responses before reporting a failure, which stops us.
+    
+    [self flushReceivedPackets];
+    
+    if ( (err != 0) && (self.readSource != nil) ) {
     
         // We failed to read the data, so shut everything down.
         
-        if (err == 0) {
-            err = EPIPE;
-        }
         [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil]];
     }
     
-    free(buffer);
-    
-    // Note that we don't loop back trying to read more data.  Rather, we just 
-    // let CFSocket call us again.
-}
-
-/*! The callback for our CFSocket object.
- *  \details This simply routes the call to our `-readData` method.
- *  \param s See the documentation for CFSocketCallBack.
- *  \param type See the documentation for CFSocketCallBack.
- *  \param address See the documentation for CFSocketCallBack.
- *  \param data See the documentation for CFSocketCallBack.
- *  \param info See the documentation for CFSocketCallBack; this is actually a pointer to the 
- *      'owning' object.
- */
-
-static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type, CFDataRef address, const void *data, void *info) {
-    // This C routine is called by CFSocket when there's data waiting on our 
-    // ICMP socket.  It just redirects the call to Objective-C code.
-    SimplePing *    obj;
-    
-    obj = (__bridge SimplePing *) info;
-    assert([obj isKindOfClass:[SimplePing class]]);
-    
-    #pragma unused(s)
-    assert(s == obj.socket);
-    #pragma unused(type)
-    assert(type == kCFSocketReadCallBack);
-    #pragma unused(address)
-    assert(address == nil);
-    #pragma unused(data)
-    assert(data == nil);
-    
-    [obj readData];
+    // If we hit the limit we just let the read source call us again for the rest.
 }
 
 /*! Starts the send and receive infrastructure.
@@ -588,6 +880,25 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type, CFDataR
 
     assert(self.hostAddress != nil);
 
+    // If we have an engine, just join it; it owns the sockets.
+    
+    if (self.engine != nil) {
+        NSError *               error;
+        id<SimplePingDelegate>  strongDelegate;
+        
+        if ( ! [self.engine addClient:self error:&error] ) {
+            [self didFailWithError:error];
+        } else {
+            self.addedToEngine = YES;
+            
+            strongDelegate = self.delegate;
+            if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didStartWithAddress:)] ) {
+                [strongDelegate simplePing:self didStartWithAddress:self.hostAddress];
+            }
+        }
+        return;
+    }
+
     // Open the socket.
     
     fd = -1;
@@ -610,29 +921,54 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type, CFDataR
         } break;
     }
     
+    // Ask for kernel receive timestamps.  Failing that isn't fatal; we just fall back 
+    // to stamping packets as we read them.
+    
+    if (err == 0) {
+        (void) SimplePingEnableReceiveTimestamps(fd);
+    }
+    
+    // Have the kernel drop what can't be about our pings, and, if asked, everything that 
+    // doesn't come from the host.  Neither is fatal: without the filter (there's none for 
+    // ICMPv4) `-readData` drops those packets itself, and without the connection we just 
+    // send with an address.
+    
+    if (err == 0) {
+        (void) SimplePingInstallICMPFilter(fd, self.hostAddressFamily, SimplePingICMPFilterEchoReplies | SimplePingICMPFilterAllErrors);
+        if (self.usesConnectedSocket) {
+            if (connect(fd, self.hostAddress.bytes, (socklen_t) self.hostAddress.length) == 0) {
+                self.socketIsConnected = YES;
+            } else {
+                SimplePingLogInfo(SimplePingLogCategoryPing, "Failed to connect socket to %{public}s: %{public}s", self.hostName.UTF8String, strerror(errno));
+            }
+        }
+    }
+    
+    // Refuse to fragment, if asked.  That's the whole point of path MTU discovery, so 
+    // failing to is fatal.
+    
+    if ( (err == 0) && self.dontFragment ) {
+        err = SimplePingSetDontFragment(fd, self.hostAddressFamily);
+    }
+    
     if (err != 0) {
+        if (fd >= 0) {
+            (void) close(fd);
+            fd = -1;
+        }
         [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil]];
     } else {
-        CFSocketContext         context = {0, (__bridge void *)(self), NULL, NULL, NULL};
-        CFRunLoopSourceRef      rls;
+        __weak SimplePing *     weakSelf;
         id<SimplePingDelegate>  strongDelegate;
         
-        // Wrap it in a CFSocket and schedule it on the runloop.
-        
-        self.socket = (CFSocketRef) CFAutorelease( CFSocketCreateWithNative(NULL, fd, kCFSocketReadCallBack, SocketReadCallback, &context) );
-        assert(self.socket != NULL);
+        // Watch it with a read source, on the run loop or on our queue.  The source will 
+        // now take care of cleaning up our file descriptor.
         
-        // The socket will now take care of cleaning up our file descriptor.
-        
-        assert( CFSocketGetSocketFlags(self.socket) & kCFSocketCloseOnInvalidate );
+        weakSelf = self;
+        self.readSource = [[SimplePingReadSource alloc] initWithSocket:fd queue:self.dispatchQueue handler:^{
+            [weakSelf readData];
+        }];
         fd = -1;
-        
-        rls = CFSocketCreateRunLoopSource(NULL, self.socket, 0);
-        assert(rls != NULL);
-        
-        CFRunLoopAddSource(CFRunLoopGetCurrent(), rls, kCFRunLoopDefaultMode);
-        
-        CFRelease(rls);
 
         strongDelegate = self.delegate;
         if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePing:didStartWithAddress:)] ) {
@@ -643,44 +979,41 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type, CFDataR
 }
 
 /*! Processes the results of our name-to-address resolution.
- *  \details Called by our CFHost resolution callback (HostResolveCallback) when host 
- *      resolution is complete.  We just latch the first appropriate address and kick 
- *      off the send and receive infrastructure.
+ *  \details Called by our resolver's completion handler when host resolution is 
+ *      complete.  We just latch the first appropriate address and kick off the send and 
+ *      receive infrastructure.
+ *  \param addresses The addresses the host name resolved to.
  */
 
-- (void)hostResolutionDone {
+- (void)hostResolutionDoneWithAddresses:(NSArray<NSData *> *)addresses {
     Boolean     resolved;
-    NSArray *   addresses;
     
     // Find the first appropriate address.
     
-    addresses = (__bridge NSArray *) CFHostGetAddressing(self.host, &resolved);
-    if ( resolved && (addresses != nil) ) {
-        resolved = false;
-        for (NSData * address in addresses) {
-            const struct sockaddr * addrPtr;
-            
-            addrPtr = (const struct sockaddr *) address.bytes;
-            if ( address.length >= sizeof(struct sockaddr) ) {
-                switch (addrPtr->sa_family) {
-                    case AF_INET: {
-                        if (self.addressStyle != SimplePingAddressStyleICMPv6) {
-                            self.hostAddress = address;
-                            resolved = true;
-                        }
-                    } break;
-                    case AF_INET6: {
-                        if (self.addressStyle != SimplePingAddressStyleICMPv4) {
-                            self.hostAddress = address;
-                            resolved = true;
-                        }
-                    } break;
-                }
-            }
-            if (resolved) {
-                break;
+    resolved = false;
+    for (NSData * address in addresses) {
+        const struct sockaddr * addrPtr;
+        
+        addrPtr = (const struct sockaddr *) address.bytes;
+        if ( address.length >= sizeof(struct sockaddr) ) {
+            switch (addrPtr->sa_family) {
+                case AF_INET: {
+                    if (self.addressStyle != SimplePingAddressStyleICMPv6) {
+                        self.hostAddress = address;
+                        resolved = true;
+                    }
+                } break;
+                case AF_INET6: {
+                    if (self.addressStyle != SimplePingAddressStyleICMPv4) {
+                        self.hostAddress = address;
+                        resolved = true;
+                    }
+                } break;
             }
         }
+        if (resolved) {
+            break;
+        }
     }
 
     // We're done resolving, so shut that down.
@@ -696,66 +1029,47 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type, CFDataR
     }
 }
 
-/*! The callback for our CFHost object.
- *  \details This simply routes the call to our `-hostResolutionDone` or 
- *      `-didFailWithHostStreamError:` methods.
- *  \param theHost See the documentation for CFHostClientCallBack.
- *  \param typeInfo See the documentation for CFHostClientCallBack.
- *  \param error See the documentation for CFHostClientCallBack.
- *  \param info See the documentation for CFHostClientCallBack; this is actually a pointer to 
- *      the 'owning' object.
- */
-
-static void HostResolveCallback(CFHostRef theHost, CFHostInfoType typeInfo, const CFStreamError *error, void *info) {
-    // This C routine is called by CFHost when the host resolution is complete. 
-    // It just redirects the call to the appropriate Objective-C method.
-    SimplePing *    obj;
-
-    obj = (__bridge SimplePing *) info;
-    assert([obj isKindOfClass:[SimplePing class]]);
-    
-    #pragma unused(theHost)
-    assert(theHost == obj.host);
-    #pragma unused(typeInfo)
-    assert(typeInfo == kCFHostAddresses);
-    
-    if ( (error != NULL) && (error->domain != 0) ) {
-        [obj didFailWithHostStreamError:*error];
-    } else {
-        [obj hostResolutionDone];
-    }
+- (SimplePingMetricsSnapshot *)metrics {
+    return [[SimplePingMetricsSnapshot alloc] initWithMetrics:&self->_metrics];
 }
 
 - (void)start {
-    Boolean             success;
-    CFHostClientContext context = {0, (__bridge void *)(self), NULL, NULL, NULL};
-    CFStreamError       streamError;
+    __weak SimplePing *     weakSelf;
     
-    assert(self.host == NULL);
+    assert(self.resolver == nil);
     assert(self.hostAddress == nil);
+    assert( (self.engine == nil) || (self.dispatchQueue == self.engine.dispatchQueue) );
 
-    self.host = (CFHostRef) CFAutorelease( CFHostCreateWithName(NULL, (__bridge CFStringRef) self.hostName) );
-    assert(self.host != NULL);
-    
-    CFHostSetClient(self.host, HostResolveCallback, &context);
+    // With an address already in hand there's nothing to resolve.
     
-    CFHostScheduleWithRunLoop(self.host, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-    
-    success = CFHostStartInfoResolution(self.host, kCFHostAddresses, &streamError);
-    if ( ! success ) {
-        [self didFailWithHostStreamError:streamError];
+    if (self.initialHostAddress != nil) {
+        self.hostAddress = self.initialHostAddress;
+        [self startWithHostAddress];
+        return;
     }
+
+    self.resolver = [[SimplePingHostResolver alloc] initWithHostName:self.hostName queue:self.dispatchQueue];
+    assert(self.resolver != nil);
+    self.resolver.addressFamily = SimplePingAddressFamilyForAddressStyle(self.addressStyle);
+    
+    weakSelf = self;
+    [self.resolver startWithCompletionHandler:^(NSArray<NSData *> * addresses, NSError * error) {
+        if (error != nil) {
+            [weakSelf didFailWithError:error];
+        } else {
+            [weakSelf hostResolutionDoneWithAddresses:addresses];
+        }
+    }];
 }
 
 /*! Stops the name-to-address resolution infrastructure.
  */
 
 - (void)stopHostResolution {
-    // Shut down the CFHost.
-    if (self.host != NULL) {
-        CFHostSetClient(self.host, NULL, NULL);
-        CFHostUnscheduleFromRunLoop(self.host, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-        self.host = NULL;
+    // Shut down the resolver.
+    if (self.resolver != nil) {
+        [self.resolver cancel];
+        self.resolver = nil;
     }
 }
 
@@ -763,10 +1077,16 @@ static void HostResolveCallback(CFHostRef theHost, CFHostInfoType typeInfo, cons
  */
 
 - (void)stopSocket {
-    if (self.socket != NULL) {
-        CFSocketInvalidate(self.socket);
-        self.socket = NULL;
+    [self.pendingResponses removeAllObjects];
+    if (self.addedToEngine) {
+        [self.engine removeClient:self];
+        self.addedToEngine = NO;
+    }
+    if (self.readSource != nil) {
+        [self.readSource invalidate];
+        self.readSource = nil;
     }
+    self.socketIsConnected = NO;
 }
 
 - (void)stop {
@@ -0,0 +1,128 @@
+/*
+    Abstract:
+    The Internet checksum (RFC 1071), using a wide accumulator and SIMD where available.
+ */
+
+#include "SimplePingChecksum.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/*
+ * The ones' complement sum of 16-bit words doesn't care how the words are grouped: 
+ * summing 32-bit words and folding the carries back in at the end gives the same 
+ * result, on either byte order, because 2^16 is 1 modulo 2^16 - 1.  So we add 32-bit 
+ * words into 64-bit lanes, which can't overflow for anything smaller than 16 GB, and 
+ * only fold once at the end.
+ */
+
+uint64_t SimplePingChecksumAccumulate(uint64_t sum, const void * buffer, size_t bufferLen) {
+    const uint8_t *     cursor;
+    size_t              bytesLeft;
+    uint32_t            word32;
+    union {
+        uint16_t        us;
+        uint8_t         uc[2];
+    } word16;
+
+    cursor = buffer;
+    bytesLeft = bufferLen;
+
+    #if defined(__ARM_NEON)
+        if (bytesLeft >= 16) {
+            uint64x2_t  acc0;
+            uint64x2_t  acc1;
+
+            // vpadalq_u32 adds pairs of 32-bit lanes into 64-bit lanes; two accumulators 
+            // keep the adds independent.
+            
+            acc0 = vdupq_n_u64(0);
+            acc1 = vdupq_n_u64(0);
+            while (bytesLeft >= 32) {
+                acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(cursor)));
+                acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(cursor + 16)));
+                cursor += 32;
+                bytesLeft -= 32;
+            }
+            if (bytesLeft >= 16) {
+                acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(cursor)));
+                cursor += 16;
+                bytesLeft -= 16;
+            }
+            acc0 = vaddq_u64(acc0, acc1);
+            sum += vgetq_lane_u64(acc0, 0);
+            sum += vgetq_lane_u64(acc0, 1);
+        }
+    #elif defined(__SSE2__)
+        if (bytesLeft >= 16) {
+            __m128i     zero;
+            __m128i     acc0;
+            __m128i     acc1;
+            uint64_t    lanes[2];
+
+            // Widen each 32-bit word to 64 bits by interleaving with zero, then add.
+            
+            zero = _mm_setzero_si128();
+            acc0 = _mm_setzero_si128();
+            acc1 = _mm_setzero_si128();
+            while (bytesLeft >= 16) {
+                __m128i     v;
+
+                v = _mm_loadu_si128((const __m128i *) (const void *) cursor);
+                acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+                acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+                cursor += 16;
+                bytesLeft -= 16;
+            }
+            acc0 = _mm_add_epi64(acc0, acc1);
+            _mm_storeu_si128((__m128i *) (void *) lanes, acc0);
+            sum += lanes[0];
+            sum += lanes[1];
+        }
+    #endif
+
+    // The portable path, which also mops up what the vector loop left.
+
+    while (bytesLeft >= 4) {
+        memcpy(&word32, cursor, sizeof(word32));
+        sum += word32;
+        cursor += 4;
+        bytesLeft -= 4;
+    }
+    if (bytesLeft >= 2) {
+        memcpy(&word16.us, cursor, sizeof(word16.us));
+        sum += word16.us;
+        cursor += 2;
+        bytesLeft -= 2;
+    }
+
+    // mop up an odd byte, if necessary
+
+    if (bytesLeft == 1) {
+        word16.uc[0] = *cursor;
+        word16.uc[1] = 0;
+        sum += word16.us;
+    }
+    return sum;
+}
+
+uint16_t SimplePingChecksumFinish(uint64_t sum) {
+
+    // fold 64 bits down to 16, adding back the carries each time
+
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t) ~sum;
+}
+
+uint16_t SimplePingChecksum(const void * buffer, size_t bufferLen) {
+    return SimplePingChecksumFinish(SimplePingChecksumAccumulate(0, buffer, bufferLen));
+}
@@ -0,0 +1,107 @@
+/*
+    Abstract:
+    A lock-free single-producer, single-consumer ring of pointers, for handing results from the queue that produces them to the queue that delivers them.
+ */
+
+#include "SimplePingDeliveryQueue.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*! The size of a cache line, which the two sides' indices are kept apart by.
+ */
+
+#define kSimplePingCacheLineSize 64
+
+struct SimplePingDeliveryQueue {
+    // Written by the consumer, read by the producer when the ring looks full
+    alignas(kSimplePingCacheLineSize) _Atomic size_t head;
+    // The consumer's own copy of tail, refreshed when the ring looks empty
+    size_t      cachedTail;
+
+    // Written by the producer, read by the consumer when the ring looks empty
+    alignas(kSimplePingCacheLineSize) _Atomic size_t tail;
+    // The producer's own copy of head, refreshed when the ring looks full
+    size_t      cachedHead;
+
+    alignas(kSimplePingCacheLineSize) size_t mask;
+    void *      items[];
+};
+
+SimplePingDeliveryQueue * SimplePingDeliveryQueueCreate(size_t capacity) {
+    SimplePingDeliveryQueue *   queue;
+    size_t                      rounded;
+    size_t                      size;
+
+    if ( (capacity == 0) || (capacity > (SIZE_MAX / 2 / sizeof(void *))) ) {
+        return NULL;
+    }
+    rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    // posix_memalign rather than aligned_alloc, which is newer than the OSes we support
+    size = sizeof(SimplePingDeliveryQueue) + (rounded * sizeof(void *));
+    if (posix_memalign((void **) &queue, kSimplePingCacheLineSize, size) != 0) {
+        return NULL;
+    }
+    atomic_init(&queue->head, 0);
+    queue->cachedTail = 0;
+    atomic_init(&queue->tail, 0);
+    queue->cachedHead = 0;
+    queue->mask = rounded - 1;
+    return queue;
+}
+
+void SimplePingDeliveryQueueDestroy(SimplePingDeliveryQueue * queue) {
+    free(queue);
+}
+
+size_t SimplePingDeliveryQueueCapacity(const SimplePingDeliveryQueue * queue) {
+    return queue->mask + 1;
+}
+
+bool SimplePingDeliveryQueuePush(SimplePingDeliveryQueue * queue, void * item) {
+    size_t      tail;
+
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if ((tail - queue->cachedHead) > queue->mask) {
+        // Acquire, so the consumer's read of the slot is done before we overwrite it
+        queue->cachedHead = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if ((tail - queue->cachedHead) > queue->mask) {
+            return false;
+        }
+    }
+    queue->items[tail & queue->mask] = item;
+    // Release, so the slot is written before the consumer sees it
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+void * SimplePingDeliveryQueuePop(SimplePingDeliveryQueue * queue) {
+    size_t      head;
+    void *      item;
+
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == queue->cachedTail) {
+        queue->cachedTail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->cachedTail) {
+            return NULL;
+        }
+    }
+    item = queue->items[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return item;
+}
+
+size_t SimplePingDeliveryQueueCount(const SimplePingDeliveryQueue * queue) {
+    size_t      head;
+    size_t      tail;
+
+    head = atomic_load_explicit(&((SimplePingDeliveryQueue *) queue)->head, memory_order_acquire);
+    tail = atomic_load_explicit(&((SimplePingDeliveryQueue *) queue)->tail, memory_order_acquire);
+    return tail - head;
+}
@@ -0,0 +1,701 @@
+/*
+    Abstract:
+    Multiplexes many SimplePing instances over a single ICMPv4 and a single ICMPv6 socket.
+ */
+
+#import "SimplePingEngine.h"
+#import "SimplePingEngineInternal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
+#include <errno.h>
+
+#pragma mark * Demultiplexing Table
+
+/*! Identifies the client a packet belongs to.
+ *  \details `address` holds the 4 or 16 byte raw address, zero padded.
+ */
+
+struct SimplePingDemuxKey {
+    sa_family_t     family;
+    uint16_t        identifier;
+    uint8_t         address[16];
+};
+typedef struct SimplePingDemuxKey SimplePingDemuxKey;
+
+/*! One slot in the open addressing hash table; a `family` of AF_UNSPEC marks an empty slot.
+ */
+
+struct SimplePingDemuxEntry {
+    SimplePingDemuxKey  key;
+    void *              client;             // an unretained id<SimplePingEngineClient>
+};
+typedef struct SimplePingDemuxEntry SimplePingDemuxEntry;
+
+/*! Fills in a demux key from a socket address.
+ *  \param address The (struct sockaddr) to use.
+ *  \param addressLen The length of that address.
+ *  \param identifier The ICMP identifier, in host byte order.
+ *  \param keyPtr The key to fill in.
+ *  \returns true if the address is a usable IPv4 or IPv6 address.
+ */
+
+static bool SimplePingDemuxKeyFromAddress(const struct sockaddr * address, size_t addressLen, uint16_t identifier, SimplePingDemuxKey * keyPtr) {
+    memset(keyPtr, 0, sizeof(*keyPtr));
+    keyPtr->identifier = identifier;
+    if ( (address->sa_family == AF_INET) && (addressLen >= sizeof(struct sockaddr_in)) ) {
+        keyPtr->family = AF_INET;
+        memcpy(keyPtr->address, &((const struct sockaddr_in *) address)->sin_addr, 4);
+        return true;
+    }
+    if ( (address->sa_family == AF_INET6) && (addressLen >= sizeof(struct sockaddr_in6)) ) {
+        keyPtr->family = AF_INET6;
+        memcpy(keyPtr->address, &((const struct sockaddr_in6 *) address)->sin6_addr, 16);
+        return true;
+    }
+    return false;
+}
+
+/*! Works out which (address, identifier) pair a received ICMP packet belongs to.
+ *  \details Echo replies belong to their source address.  ICMP error messages quote the
+ *      start of the request that triggered them, so they belong to the destination and
+ *      identifier of that quoted echo request.
+ *  \param bytes The packet as returned by the kernel (with the IP header for IPv4).
+ *  \param length The length of that packet.
+ *  \param fromAddress The source address of the packet.
+ *  \param fromAddressLen The length of that address.
+ *  \param keyPtr The key to fill in.
+ *  \returns true if the packet could belong to one of our clients.
+ */
+
+static bool SimplePingDemuxKeyForPacket(const uint8_t * bytes, size_t length, const struct sockaddr * fromAddress, size_t fromAddressLen, SimplePingDemuxKey * keyPtr) {
+    const uint8_t *     icmp;
+    const uint8_t *     inner;
+    size_t              headerLength;
+    size_t              innerHeaderLength;
+
+    if (fromAddress->sa_family == AF_INET) {
+        if ( (length < 20) || ((bytes[0] & 0xF0) != 0x40) || (bytes[9] != IPPROTO_ICMP) ) {
+            return false;
+        }
+        headerLength = (bytes[0] & 0x0F) * sizeof(uint32_t);
+        if ( (headerLength < 20) || (length < headerLength + sizeof(ICMPHeader)) ) {
+            return false;
+        }
+        icmp = bytes + headerLength;
+        switch (icmp[0]) {
+            case ICMPv4TypeEchoReply: {
+                return SimplePingDemuxKeyFromAddress(fromAddress, fromAddressLen, (uint16_t) ((icmp[4] << 8) | icmp[5]), keyPtr);
+            } break;
+            case ICMP_UNREACH:
+            case ICMP_SOURCEQUENCH:
+            case ICMP_REDIRECT:
+            case ICMP_TIMXCEED:
+            case ICMP_PARAMPROB: {
+                inner = icmp + sizeof(ICMPHeader);
+                if ( (length < headerLength + sizeof(ICMPHeader) + 20) || ((inner[0] & 0xF0) != 0x40) || (inner[9] != IPPROTO_ICMP) ) {
+                    return false;
+                }
+                innerHeaderLength = (inner[0] & 0x0F) * sizeof(uint32_t);
+                if ( (innerHeaderLength < 20) || (length < headerLength + sizeof(ICMPHeader) + innerHeaderLength + sizeof(ICMPHeader)) ) {
+                    return false;
+                }
+                if (inner[innerHeaderLength] != ICMPv4TypeEchoRequest) {
+                    return false;
+                }
+                memset(keyPtr, 0, sizeof(*keyPtr));
+                keyPtr->family     = AF_INET;
+                keyPtr->identifier = (uint16_t) ((inner[innerHeaderLength + 4] << 8) | inner[innerHeaderLength + 5]);
+                memcpy(keyPtr->address, inner + 16, 4);             // quoted destination address
+                return true;
+            } break;
+        }
+    } else if (fromAddress->sa_family == AF_INET6) {
+        if (length < sizeof(ICMPHeader)) {
+            return false;
+        }
+        icmp = bytes;
+        switch (icmp[0]) {
+            case ICMPv6TypeEchoReply: {
+                return SimplePingDemuxKeyFromAddress(fromAddress, fromAddressLen, (uint16_t) ((icmp[4] << 8) | icmp[5]), keyPtr);
+            } break;
+            case ICMP6_DST_UNREACH:
+            case ICMP6_PACKET_TOO_BIG:
+            case ICMP6_TIME_EXCEEDED:
+            case ICMP6_PARAM_PROB: {
+                // We assume the quoted request has no extension headers, which is true
+                // for the echo requests we send.
+                inner = icmp + sizeof(ICMPHeader);
+                if ( (length < sizeof(ICMPHeader) + 40 + sizeof(ICMPHeader)) || ((inner[0] & 0xF0) != 0x60) || (inner[6] != IPPROTO_ICMPV6) ) {
+                    return false;
+                }
+                if (inner[40] != ICMPv6TypeEchoRequest) {
+                    return false;
+                }
+                memset(keyPtr, 0, sizeof(*keyPtr));
+                keyPtr->family     = AF_INET6;
+                keyPtr->identifier = (uint16_t) ((inner[40 + 4] << 8) | inner[40 + 5]);
+                memcpy(keyPtr->address, inner + 24, 16);            // quoted destination address
+                return true;
+            } break;
+        }
+    }
+    return false;
+}
+
+/*! Hashes a demux key (FNV-1a).
+ */
+
+static size_t SimplePingDemuxKeyHash(const SimplePingDemuxKey * keyPtr) {
+    uint64_t        hash;
+    size_t          addressLen;
+    size_t          i;
+
+    hash = 14695981039346656037ULL;
+    hash = (hash ^ keyPtr->family) * 1099511628211ULL;
+    hash = (hash ^ (keyPtr->identifier & 0xFF)) * 1099511628211ULL;
+    hash = (hash ^ (keyPtr->identifier >> 8)) * 1099511628211ULL;
+    addressLen = (keyPtr->family == AF_INET) ? 4 : 16;
+    for (i = 0; i < addressLen; i++) {
+        hash = (hash ^ keyPtr->address[i]) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+static bool SimplePingDemuxKeyEqual(const SimplePingDemuxKey * key1, const SimplePingDemuxKey * key2) {
+    return (key1->family == key2->family)
+        && (key1->identifier == key2->identifier)
+        && (memcmp(key1->address, key2->address, sizeof(key1->address)) == 0);
+}
+
+#pragma mark * SimplePingEngine
+
+@interface SimplePingEngine ()
+
+// read/write versions of public properties
+
+@property (nonatomic, assign, readwrite) NSUInteger     pingerCount;
+
+// private properties
+
+/*! The read source for the shared ICMPv4 socket, or nil if no IPv4 client is running.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingReadSource *   readSource4;
+
+/*! The read source for the shared ICMPv6 socket, or nil if no IPv6 client is running.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingReadSource *   readSource6;
+
+/*! The number of clients using readSource4 and readSource6 respectively.
+ */
+
+@property (nonatomic, assign, readwrite) NSUInteger     pingerCount4;
+@property (nonatomic, assign, readwrite) NSUInteger     pingerCount6;
+
+/*! The default hop limit of each socket, and the hop limit it's currently set to.
+ *  \details See -sendPacket:length:toAddress:hopLimit:.
+ */
+
+@property (nonatomic, assign, readwrite) int            defaultHopLimit4;
+@property (nonatomic, assign, readwrite) int            defaultHopLimit6;
+@property (nonatomic, assign, readwrite) int            currentHopLimit4;
+@property (nonatomic, assign, readwrite) int            currentHopLimit6;
+
+/*! A reusable receive buffer, so that we don't allocate per packet.
+ */
+
+@property (nonatomic, strong, readonly ) NSMutableData *    receiveBuffer;
+
+@end
+
+@implementation SimplePingEngine {
+    SimplePingDemuxEntry *      _entries;           // open addressing with linear probing
+    size_t                      _entryCapacity;     // always a power of two
+    SimplePingTimeoutWheel *    _timeoutWheel;      // created lazily, see -timeoutWheel
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self != nil) {
+        // 65535 is the maximum IP packet size; see -[SimplePing readData].
+        self->_receiveBuffer = [NSMutableData dataWithLength:65535];
+        self->_receiveBatchLimit = 32;
+        self->_entryCapacity = 64;
+        self->_entries = calloc(self->_entryCapacity, sizeof(SimplePingDemuxEntry));
+        if (self->_entries == NULL) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (SimplePingTimeoutWheel *)timeoutWheel {
+    if (self->_timeoutWheel == nil) {
+        self->_timeoutWheel = [[SimplePingTimeoutWheel alloc] initWithTickInterval:0.01 queue:self.dispatchQueue];
+    }
+    return self->_timeoutWheel;
+}
+
+- (void)dealloc {
+    // Every client holds a strong reference to us until it stops, so by now no one is using us.
+    assert(self->_pingerCount == 0);
+    [self closeSocketForAddressFamily:AF_INET];
+    [self closeSocketForAddressFamily:AF_INET6];
+    free(self->_entries);
+}
+
+#pragma mark * Table Management
+
+/*! Looks up a key in the table.
+ *  \param keyPtr The key to find.
+ *  \returns The index of the matching entry, or the index of the empty slot where it would go.
+ */
+
+- (size_t)indexForKey:(const SimplePingDemuxKey *)keyPtr {
+    size_t      mask;
+    size_t      index;
+
+    mask = self->_entryCapacity - 1;
+    index = SimplePingDemuxKeyHash(keyPtr) & mask;
+    while ( (self->_entries[index].key.family != AF_UNSPEC) && ! SimplePingDemuxKeyEqual(&self->_entries[index].key, keyPtr) ) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+/*! Doubles the table size, rehashing every entry.
+ *  \returns YES on success, NO if there isn't the memory, in which case the table is 
+ *      left as it was.
+ */
+
+- (BOOL)growTable {
+    SimplePingDemuxEntry *  newEntries;
+    SimplePingDemuxEntry *  oldEntries;
+    size_t                  oldCapacity;
+    size_t                  i;
+
+    newEntries = calloc(self->_entryCapacity * 2, sizeof(SimplePingDemuxEntry));
+    if (newEntries == NULL) {
+        return NO;
+    }
+    oldEntries  = self->_entries;
+    oldCapacity = self->_entryCapacity;
+    self->_entryCapacity = oldCapacity * 2;
+    self->_entries = newEntries;
+
+    for (i = 0; i < oldCapacity; i++) {
+        if (oldEntries[i].key.family != AF_UNSPEC) {
+            self->_entries[[self indexForKey:&oldEntries[i].key]] = oldEntries[i];
+        }
+    }
+    free(oldEntries);
+    return YES;
+}
+
+/*! Removes the entry at the specified index.
+ *  \details Uses backward shift deletion so that lookups never need tombstones.
+ *  \param index The index of an occupied slot.
+ */
+
+- (void)removeEntryAtIndex:(size_t)index {
+    size_t      mask;
+    size_t      hole;
+    size_t      next;
+    size_t      home;
+
+    mask = self->_entryCapacity - 1;
+    hole = index;
+    next = (hole + 1) & mask;
+    while (self->_entries[next].key.family != AF_UNSPEC) {
+        home = SimplePingDemuxKeyHash(&self->_entries[next].key) & mask;
+        // Move the entry into the hole unless its home slot lies cyclically in (hole, next].
+        if ( ((next - home) & mask) >= ((next - hole) & mask) ) {
+            self->_entries[hole] = self->_entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    memset(&self->_entries[hole], 0, sizeof(self->_entries[hole]));
+}
+
+#pragma mark * Socket Management
+
+- (int)socketForAddressFamily:(sa_family_t)addressFamily {
+    SimplePingReadSource *  source;
+
+    source = (addressFamily == AF_INET) ? self.readSource4 : (addressFamily == AF_INET6) ? self.readSource6 : nil;
+    return (source != nil) ? source.nativeSocket : -1;
+}
+
+/*! Opens the shared socket for an address family, if it isn't open already.
+ *  \param addressFamily AF_INET or AF_INET6.
+ *  \param errorPtr If not NULL, set to the error on failure.
+ *  \returns YES on success.
+ */
+
+- (BOOL)openSocketForAddressFamily:(sa_family_t)addressFamily error:(NSError **)errorPtr {
+    int                         err;
+    int                         fd;
+    int                         hopLimit;
+    socklen_t                   hopLimitLen;
+    SimplePingReadSource *      source;
+    __weak SimplePingEngine *   weakSelf;
+
+    if ([self socketForAddressFamily:addressFamily] >= 0) {
+        return YES;
+    }
+
+    fd = -1;
+    err = 0;
+    switch (addressFamily) {
+        case AF_INET: {
+            fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+            if (fd < 0) {
+                err = errno;
+            }
+        } break;
+        case AF_INET6: {
+            fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_ICMPV6);
+            if (fd < 0) {
+                err = errno;
+            }
+        } break;
+        default: {
+            err = EPROTONOSUPPORT;
+        } break;
+    }
+    if (err != 0) {
+        if (errorPtr != NULL) {
+            *errorPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil];
+        }
+        return NO;
+    }
+    (void) SimplePingEnableReceiveTimestamps(fd);
+
+    // On IPv6, only take the messages some client could want: echo replies for pingers, 
+    // errors for traceroutes.  The rest, mostly Neighbor Discovery, never wakes us up.
+
+    (void) SimplePingInstallICMPFilter(fd, addressFamily, SimplePingICMPFilterEchoReplies | SimplePingICMPFilterAllErrors);
+
+    // Remember the default hop limit, so that sends can go back to it after a client 
+    // asked for another.  For IPv6, -1 means the system default anyway.
+
+    hopLimit = -1;
+    hopLimitLen = (socklen_t) sizeof(hopLimit);
+    if (addressFamily == AF_INET) {
+        if (getsockopt(fd, IPPROTO_IP, IP_TTL, &hopLimit, &hopLimitLen) != 0) {
+            hopLimit = 64;
+        }
+        self.defaultHopLimit4 = hopLimit;
+        self.currentHopLimit4 = hopLimit;
+    } else {
+        if (getsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hopLimit, &hopLimitLen) != 0) {
+            hopLimit = -1;
+        }
+        self.defaultHopLimit6 = hopLimit;
+        self.currentHopLimit6 = hopLimit;
+    }
+
+    // Watch it with a read source, on the run loop or on our queue, just like SimplePing does.
+
+    weakSelf = self;
+    source = [[SimplePingReadSource alloc] initWithSocket:fd queue:self.dispatchQueue handler:^{
+        [weakSelf readDataForAddressFamily:addressFamily];
+    }];
+
+    if (addressFamily == AF_INET) {
+        self.readSource4 = source;
+    } else {
+        self.readSource6 = source;
+    }
+    return YES;
+}
+
+/*! Closes the shared socket for an address family.
+ *  \param addressFamily AF_INET or AF_INET6.
+ */
+
+- (void)closeSocketForAddressFamily:(sa_family_t)addressFamily {
+    if ( (addressFamily == AF_INET) && (self.readSource4 != nil) ) {
+        [self.readSource4 invalidate];
+        self.readSource4 = nil;
+    } else if ( (addressFamily == AF_INET6) && (self.readSource6 != nil) ) {
+        [self.readSource6 invalidate];
+        self.readSource6 = nil;
+    }
+}
+
+#pragma mark * Clients
+
+- (BOOL)addClient:(id<SimplePingEngineClient>)client error:(NSError **)errorPtr {
+    SimplePingDemuxKey      key;
+    size_t                  index;
+    uint32_t                attempts;
+
+    NSParameterAssert(client.hostAddress != nil);
+
+    if ( ! SimplePingDemuxKeyFromAddress(client.hostAddress.bytes, client.hostAddress.length, client.identifier, &key) ) {
+        if (errorPtr != NULL) {
+            *errorPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:EAFNOSUPPORT userInfo:nil];
+        }
+        return NO;
+    }
+
+    // Keep the table at most half full so that probe sequences stay short.
+
+    if ( ((self.pingerCount + 1) * 2 > self->_entryCapacity) && ! [self growTable] ) {
+        if (errorPtr != NULL) {
+            *errorPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:nil];
+        }
+        return NO;
+    }
+    if ( ! [self openSocketForAddressFamily:key.family error:errorPtr] ) {
+        return NO;
+    }
+
+    // Find an identifier no other client of this address is using.  This walks all
+    // 65536 identifiers at worst, which only fails if every one of them is taken.
+
+    index = [self indexForKey:&key];
+    attempts = 0;
+    while (self->_entries[index].key.family != AF_UNSPEC) {
+        attempts += 1;
+        if (attempts > UINT16_MAX) {
+            if (errorPtr != NULL) {
+                *errorPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:EADDRINUSE userInfo:nil];
+            }
+            return NO;
+        }
+        key.identifier += 1;
+        index = [self indexForKey:&key];
+    }
+    client.identifier = key.identifier;
+
+    self->_entries[index].key    = key;
+    self->_entries[index].client = (__bridge void *) client;
+
+    self.pingerCount += 1;
+    if (key.family == AF_INET) {
+        self.pingerCount4 += 1;
+    } else {
+        self.pingerCount6 += 1;
+    }
+    return YES;
+}
+
+- (void)removeClient:(id<SimplePingEngineClient>)client {
+    SimplePingDemuxKey      key;
+    size_t                  index;
+
+    if ( (client.hostAddress == nil) || ! SimplePingDemuxKeyFromAddress(client.hostAddress.bytes, client.hostAddress.length, client.identifier, &key) ) {
+        return;
+    }
+    index = [self indexForKey:&key];
+    if ( (self->_entries[index].key.family == AF_UNSPEC) || (self->_entries[index].client != (__bridge void *) client) ) {
+        return;
+    }
+    [self removeEntryAtIndex:index];
+
+    self.pingerCount -= 1;
+    if (key.family == AF_INET) {
+        self.pingerCount4 -= 1;
+        if (self.pingerCount4 == 0) {
+            [self closeSocketForAddressFamily:AF_INET];
+        }
+    } else {
+        self.pingerCount6 -= 1;
+        if (self.pingerCount6 == 0) {
+            [self closeSocketForAddressFamily:AF_INET6];
+        }
+    }
+}
+
+/*! Fails every client of an address family.
+ *  \details Called when the shared socket for that family fails.
+ *  \param addressFamily AF_INET or AF_INET6.
+ *  \param error Describes the failure.
+ */
+
+- (void)failClientsWithAddressFamily:(sa_family_t)addressFamily error:(NSError *)error {
+    NSMutableArray<id<SimplePingEngineClient>> *    clients;
+    size_t                                          i;
+
+    // Collect (and retain) the clients first, because failing a client stops it, which
+    // removes it from the table.
+
+    clients = [NSMutableArray array];
+    for (i = 0; i < self->_entryCapacity; i++) {
+        if (self->_entries[i].key.family == addressFamily) {
+            [clients addObject:(__bridge id<SimplePingEngineClient>) self->_entries[i].client];
+        }
+    }
+    [self closeSocketForAddressFamily:addressFamily];
+
+    for (id<SimplePingEngineClient> client in clients) {
+        [client simplePingEngine:self didFailWithError:error];
+    }
+}
+
+#pragma mark * Send
+
+- (ssize_t)sendPacket:(const void *)bytes length:(size_t)length toAddress:(NSData *)address hopLimit:(uint8_t)hopLimit {
+    sa_family_t     addressFamily;
+    int             fd;
+    int             wanted;
+    int             current;
+    int             level;
+    int             option;
+
+    NSParameterAssert(address.length >= sizeof(struct sockaddr));
+
+    addressFamily = ((const struct sockaddr *) address.bytes)->sa_family;
+    fd = [self socketForAddressFamily:addressFamily];
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Only touch the socket option when the hop limit actually changes, which for a 
+    // traceroute means once per hop rather than once per probe.
+
+    if (addressFamily == AF_INET) {
+        wanted  = (hopLimit != 0) ? hopLimit : self.defaultHopLimit4;
+        current = self.currentHopLimit4;
+        level   = IPPROTO_IP;
+        option  = IP_TTL;
+    } else {
+        wanted  = (hopLimit != 0) ? hopLimit : self.defaultHopLimit6;
+        current = self.currentHopLimit6;
+        level   = IPPROTO_IPV6;
+        option  = IPV6_UNICAST_HOPS;
+    }
+    if (wanted != current) {
+        if (setsockopt(fd, level, option, &wanted, (socklen_t) sizeof(wanted)) != 0) {
+            return -1;
+        }
+        if (addressFamily == AF_INET) {
+            self.currentHopLimit4 = wanted;
+        } else {
+            self.currentHopLimit6 = wanted;
+        }
+    }
+
+    return sendto(fd, bytes, length, 0, address.bytes, (socklen_t) address.length);
+}
+
+#pragma mark * Receive
+
+/*! Reads one packet from one of the shared ICMP sockets and routes it.
+ *  \details The packet is read into our reusable buffer and only copied if a client 
+ *      (or our delegate) actually wants it.
+ *  \param fd The socket to read from.
+ *  \param clients Receives each client that was given a packet, once.
+ *  \param errPtr Set to the error if the read failed other than by the socket being drained.
+ *  \returns YES if a packet was read.
+ */
+
+- (BOOL)readPacketFromSocket:(int)fd clients:(NSMutableOrderedSet<id<SimplePingEngineClient>> *)clients error:(int *)errPtr {
+    struct sockaddr_storage addr;
+    socklen_t               addrLen;
+    ssize_t                 bytesRead;
+    SimplePingDemuxKey      key;
+    size_t                  index;
+    uint64_t                kernelReceiveTime;
+    uint64_t                userReceiveTime;
+    id<SimplePingEngineClient>  client;
+
+    *errPtr = 0;
+    addrLen = sizeof(addr);
+    bytesRead = SimplePingReceiveFrom(fd, self.receiveBuffer.mutableBytes, self.receiveBuffer.length, MSG_DONTWAIT, (struct sockaddr *) &addr, &addrLen, &kernelReceiveTime, &userReceiveTime);
+    if (bytesRead < 0) {
+        if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) ) {
+            *errPtr = errno;
+        }
+        return NO;
+    }
+    if (bytesRead == 0) {
+        *errPtr = EPIPE;
+        return NO;
+    }
+
+    client = nil;
+    if ( SimplePingDemuxKeyForPacket(self.receiveBuffer.bytes, (size_t) bytesRead, (const struct sockaddr *) &addr, addrLen, &key) ) {
+        index = [self indexForKey:&key];
+        if (self->_entries[index].key.family != AF_UNSPEC) {
+            client = (__bridge id<SimplePingEngineClient>) self->_entries[index].client;
+        }
+    }
+
+    if (client != nil) {
+        [clients addObject:client];
+        [client simplePingEngine:self
+                didReceivePacket:[NSMutableData dataWithBytes:self.receiveBuffer.bytes length:(NSUInteger) bytesRead]
+                     fromAddress:(const struct sockaddr *) &addr
+                   addressLength:addrLen
+               kernelReceiveTime:kernelReceiveTime
+                 userReceiveTime:userReceiveTime];
+    } else {
+        id<SimplePingEngineDelegate>    strongDelegate;
+
+        strongDelegate = self.delegate;
+        if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(simplePingEngine:didReceiveUnexpectedPacket:fromAddress:)] ) {
+            [strongDelegate simplePingEngine:self
+                  didReceiveUnexpectedPacket:[NSData dataWithBytes:self.receiveBuffer.bytes length:(NSUInteger) bytesRead]
+                                 fromAddress:[NSData dataWithBytes:&addr length:addrLen]];
+        }
+    }
+    return YES;
+}
+
+/*! Reads data from one of the shared ICMP sockets.
+ *  \details Called by the read source of the socket to process the 
+ *      ICMP messages waiting on the socket.  We read until the socket is drained or we've 
+ *      read `receiveBatchLimit` packets, then give each client its batch.
+ *  \param addressFamily The address family of the socket that's readable.
+ */
+
+- (void)readDataForAddressFamily:(sa_family_t)addressFamily {
+    int                                 err;
+    int                                 fd;
+    NSUInteger                          packetCount;
+    NSUInteger                          packetLimit;
+    NSMutableOrderedSet<id<SimplePingEngineClient>> *   clients;
+
+    // The set retains the clients, so they survive being stopped mid-batch.
+
+    clients = [NSMutableOrderedSet orderedSet];
+    packetLimit = MAX(self.receiveBatchLimit, (NSUInteger) 1);
+    err = 0;
+    for (packetCount = 0; packetCount < packetLimit; packetCount++) {
+
+        // A delegate may have stopped the last client, closing the socket.
+
+        fd = [self socketForAddressFamily:addressFamily];
+        if (fd < 0) {
+            break;
+        }
+        if ( ! [self readPacketFromSocket:fd clients:clients error:&err] ) {
+            break;
+        }
+    }
+
+    for (id<SimplePingEngineClient> client in clients) {
+        if ([client respondsToSelector:@selector(simplePingEngineDidDrainSocket:)]) {
+            [client simplePingEngineDidDrainSocket:self];
+        }
+    }
+
+    if ( (err != 0) && ([self socketForAddressFamily:addressFamily] >= 0) ) {
+
+        // We failed to read the data, so shut down everyone using this socket.
+
+        [self failClientsWithAddressFamily:addressFamily error:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil]];
+    }
+}
+
+@end
@@ -0,0 +1,48 @@
+/*
+    Abstract:
+    Interfaces shared between SimplePing and SimplePingEngine within the SimplePing target.
+ */
+
+#import "SimplePingEngine.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SimplePingEngine ()
+
+/*! Returns the shared socket for an address family.
+ *  \param addressFamily AF_INET or AF_INET6.
+ *  \returns The native socket, or -1 if that socket isn't open.
+ */
+
+- (int)socketForAddressFamily:(sa_family_t)addressFamily;
+
+@end
+
+// A pinger is just another client of the engine.
+
+@interface SimplePing () <SimplePingEngineClient>
+
+// Read/write version of the public property; the engine may re-pick it on start.
+
+@property (nonatomic, assign, readwrite) uint16_t identifier;
+
+/*! Processes a packet that belongs to this pinger.
+ *  \param packet The packet, exactly as returned by the kernel; ownership passes to the pinger.
+ *  \param address The address the packet came from.
+ *  \param addressLength The length of that address.
+ *  \param kernelReceiveTime When the kernel received the packet; see `SimplePingTiming`.
+ *  \param userReceiveTime When the packet was read from the socket.
+ */
+
+- (void)processReceivedPacket:(NSMutableData *)packet fromAddress:(const struct sockaddr *)address addressLength:(socklen_t)addressLength kernelReceiveTime:(uint64_t)kernelReceiveTime userReceiveTime:(uint64_t)userReceiveTime;
+
+/*! Delivers the ping responses collected by `-processReceivedPacket:fromAddress:addressLength:kernelReceiveTime:userReceiveTime:`.
+ *  \details Called once the socket has been drained.  Does nothing unless the delegate 
+ *      takes batches.
+ */
+
+- (void)flushReceivedPackets;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,372 @@
+/*
+    Abstract:
+    Socket read and timer event sources that run either on a run loop or on a dispatch queue.
+ */
+
+#import "SimplePingEventSources.h"
+#import "SimplePingTiming.h"
+
+#include <unistd.h>
+
+#pragma mark * SimplePingReadSource
+
+@interface SimplePingReadSource ()
+
+@property (nonatomic, assign, readwrite) int                        nativeSocket;
+@property (nonatomic, copy,   readwrite, nullable) dispatch_block_t handler;
+
+- (void)socketReadable;
+
+@end
+
+/*! The callback for our CFSocket object.
+ *  \details This simply routes the call to our `-socketReadable` method.
+ *  \param s See the documentation for CFSocketCallBack.
+ *  \param type See the documentation for CFSocketCallBack.
+ *  \param address See the documentation for CFSocketCallBack.
+ *  \param data See the documentation for CFSocketCallBack.
+ *  \param info See the documentation for CFSocketCallBack; this is actually a pointer to the 
+ *      'owning' object.
+ */
+
+static void ReadSourceSocketCallback(CFSocketRef s, CFSocketCallBackType type, CFDataRef address, const void *data, void *info) {
+    SimplePingReadSource *  obj;
+    
+    obj = (__bridge SimplePingReadSource *) info;
+    assert([obj isKindOfClass:[SimplePingReadSource class]]);
+    
+    #pragma unused(s)
+    #pragma unused(type)
+    assert(type == kCFSocketReadCallBack);
+    #pragma unused(address)
+    assert(address == nil);
+    #pragma unused(data)
+    assert(data == nil);
+    
+    [obj socketReadable];
+}
+
+@implementation SimplePingReadSource {
+    CFSocketRef         _socket;            ///< run loop mode only; we hold a reference
+    dispatch_source_t   _source;            ///< queue mode only
+}
+
+- (instancetype)initWithSocket:(int)fd queue:(dispatch_queue_t)queue handler:(dispatch_block_t)handler {
+    NSParameterAssert(fd >= 0);
+    NSParameterAssert(handler != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_nativeSocket = fd;
+        self->_handler      = [handler copy];
+        
+        if (queue == nil) {
+            CFSocketContext     context = {0, (__bridge void *)(self), NULL, NULL, NULL};
+            CFRunLoopSourceRef  rls;
+            
+            // Wrap it in a CFSocket and schedule it on the runloop.  The socket will 
+            // now take care of cleaning up our file descriptor.
+            
+            self->_socket = CFSocketCreateWithNative(NULL, fd, kCFSocketReadCallBack, ReadSourceSocketCallback, &context);
+            assert(self->_socket != NULL);
+            assert( CFSocketGetSocketFlags(self->_socket) & kCFSocketCloseOnInvalidate );
+            
+            rls = CFSocketCreateRunLoopSource(NULL, self->_socket, 0);
+            assert(rls != NULL);
+            
+            CFRunLoopAddSource(CFRunLoopGetCurrent(), rls, kCFRunLoopDefaultMode);
+            
+            CFRelease(rls);
+        } else {
+            dispatch_source_t               source;
+            __weak SimplePingReadSource *   weakSelf;
+            
+            // A read source on the queue; its cancel handler closes the file descriptor, 
+            // which is the only safe time to do so.
+            
+            source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t) fd, 0, queue);
+            assert(source != nil);
+            
+            weakSelf = self;
+            dispatch_source_set_event_handler(source, ^{
+                [weakSelf socketReadable];
+            });
+            dispatch_source_set_cancel_handler(source, ^{
+                (void) close(fd);
+            });
+            dispatch_resume(source);
+            
+            self->_source = source;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self invalidate];
+}
+
+- (void)socketReadable {
+    dispatch_block_t    handler;
+    
+    // Hold on to the handler; it may well invalidate us.
+    
+    handler = self.handler;
+    if (handler != nil) {
+        handler();
+    }
+}
+
+- (void)invalidate {
+    self.handler = nil;
+    if (self->_socket != NULL) {
+        CFSocketInvalidate(self->_socket);
+        CFRelease(self->_socket);
+        self->_socket = NULL;
+    }
+    if (self->_source != nil) {
+        dispatch_source_cancel(self->_source);
+        self->_source = nil;
+    }
+    self.nativeSocket = -1;
+}
+
+@end
+
+#pragma mark * SimplePingTimerSource
+
+@interface SimplePingTimerSource ()
+
+@property (nonatomic, assign, readonly ) BOOL                       repeats;
+@property (nonatomic, copy,   readwrite, nullable) dispatch_block_t handler;
+
+- (void)timerFired;
+
+@end
+
+@implementation SimplePingTimerSource {
+    NSTimer *           _timer;             ///< run loop mode only
+    dispatch_source_t   _source;            ///< queue mode only
+}
+
+- (instancetype)initWithInterval:(NSTimeInterval)interval leeway:(NSTimeInterval)leeway repeats:(BOOL)repeats queue:(dispatch_queue_t)queue handler:(dispatch_block_t)handler {
+    __weak SimplePingTimerSource *  weakSelf;
+    
+    NSParameterAssert(interval >= 0.0);
+    NSParameterAssert(leeway >= 0.0);
+    NSParameterAssert(handler != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_repeats = repeats;
+        self->_handler = [handler copy];
+        
+        weakSelf = self;
+        if (queue == nil) {
+            self->_timer = [NSTimer timerWithTimeInterval:interval repeats:repeats block:^(NSTimer * timer) {
+                #pragma unused(timer)
+                [weakSelf timerFired];
+            }];
+            self->_timer.tolerance = leeway;
+            [[NSRunLoop currentRunLoop] addTimer:self->_timer forMode:NSDefaultRunLoopMode];
+        } else {
+            dispatch_source_t   source;
+            uint64_t            intervalNanoseconds;
+            
+            intervalNanoseconds = (uint64_t) (interval * NSEC_PER_SEC);
+            
+            source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+            assert(source != nil);
+            
+            dispatch_source_set_timer(
+                source, 
+                dispatch_time(DISPATCH_TIME_NOW, (int64_t) intervalNanoseconds), 
+                repeats ? intervalNanoseconds : DISPATCH_TIME_FOREVER, 
+                (uint64_t) (leeway * NSEC_PER_SEC)
+            );
+            dispatch_source_set_event_handler(source, ^{
+                [weakSelf timerFired];
+            });
+            dispatch_resume(source);
+            
+            self->_source = source;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self invalidate];
+}
+
+- (BOOL)isValid {
+    return self.handler != nil;
+}
+
+- (void)timerFired {
+    dispatch_block_t    handler;
+    
+    // Hold on to the handler; a one-shot timer is done once it fires, and the handler 
+    // may well invalidate or release us.
+    
+    handler = self.handler;
+    if ( ! self.repeats ) {
+        [self invalidate];
+    }
+    if (handler != nil) {
+        handler();
+    }
+}
+
+- (void)invalidate {
+    self.handler = nil;
+    if (self->_timer != nil) {
+        [self->_timer invalidate];
+        self->_timer = nil;
+    }
+    if (self->_source != nil) {
+        dispatch_source_cancel(self->_source);
+        self->_source = nil;
+    }
+}
+
+@end
+
+#pragma mark * SimplePingSendScheduler
+
+@interface SimplePingSendScheduler ()
+
+@property (nonatomic, copy,   readwrite, nullable) void (^handler)(NSUInteger count);
+@property (nonatomic, assign, readwrite) uint64_t   handledDeadlineCount;
+@property (nonatomic, assign, readwrite) uint64_t   missedDeadlineCount;
+
+- (void)wake;
+
+@end
+
+@implementation SimplePingSendScheduler {
+    NSTimer *           _timer;             ///< run loop mode only
+    dispatch_source_t   _source;            ///< queue mode only
+    uint64_t            _startTime;         ///< deadline 0, on the SimplePingMonotonicNanoseconds() clock
+    double              _period;            ///< nanoseconds between deadlines
+    uint64_t            _lastWakeTime;
+}
+
+- (instancetype)initWithRate:(double)packetsPerSecond queue:(dispatch_queue_t)queue handler:(void (^)(NSUInteger count))handler {
+    __weak SimplePingSendScheduler *    weakSelf;
+    
+    NSParameterAssert(packetsPerSecond > 0.0);
+    NSParameterAssert(handler != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_packetsPerSecond    = packetsPerSecond;
+        self->_handler             = [handler copy];
+        self->_maximumBatch        = 64;
+        self->_minimumWakeInterval = 0.001;
+        self->_period              = NSEC_PER_SEC / packetsPerSecond;
+        self->_startTime           = SimplePingMonotonicNanoseconds();
+        
+        // Both timers start out firing straight away, for deadline 0, and are re-armed 
+        // for the next deadline by each wakeup.  The NSTimer repeats, with an interval 
+        // that never comes round, only so that firing doesn't invalidate it.
+        
+        weakSelf = self;
+        if (queue == nil) {
+            self->_timer = [NSTimer timerWithTimeInterval:1.0e9 repeats:YES block:^(NSTimer * timer) {
+                #pragma unused(timer)
+                [weakSelf wake];
+            }];
+            self->_timer.tolerance = 0.0;
+            self->_timer.fireDate = [NSDate date];
+            [[NSRunLoop currentRunLoop] addTimer:self->_timer forMode:NSDefaultRunLoopMode];
+        } else {
+            dispatch_source_t   source;
+            
+            source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, DISPATCH_TIMER_STRICT, queue);
+            assert(source != nil);
+            
+            dispatch_source_set_timer(source, DISPATCH_TIME_NOW, DISPATCH_TIME_FOREVER, 0);
+            dispatch_source_set_event_handler(source, ^{
+                [weakSelf wake];
+            });
+            dispatch_resume(source);
+            
+            self->_source = source;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self invalidate];
+}
+
+- (BOOL)isValid {
+    return self.handler != nil;
+}
+
+- (void)setMaximumBatch:(NSUInteger)maximumBatch {
+    NSParameterAssert(maximumBatch >= 1);
+    self->_maximumBatch = MAX(maximumBatch, (NSUInteger) 1);
+}
+
+/*! Hands the handler the deadlines that have passed and re-arms the timer.
+ */
+
+- (void)wake {
+    void (^handler)(NSUInteger count);
+    uint64_t    now;
+    uint64_t    due;
+    uint64_t    backlog;
+    uint64_t    nextDeadline;
+    uint64_t    nextWake;
+    
+    handler = self.handler;
+    if (handler == nil) {
+        return;
+    }
+    
+    // Count the deadlines up to now, skipping those we're too far behind to send.
+    
+    now = SimplePingMonotonicNanoseconds();
+    due = (uint64_t) ((double) (now - self->_startTime) / self->_period) + 1;
+    backlog = (due > self.handledDeadlineCount) ? due - self.handledDeadlineCount : 0;
+    if (backlog > self.maximumBatch) {
+        self.missedDeadlineCount += backlog - self.maximumBatch;
+        self.handledDeadlineCount += backlog - self.maximumBatch;
+        backlog = self.maximumBatch;
+    }
+    self->_lastWakeTime = now;
+    
+    if (backlog != 0) {
+        self.handledDeadlineCount += backlog;
+        handler((NSUInteger) backlog);
+        if ( ! self.isValid ) {
+            return;
+        }
+    }
+    
+    // Sleep until the next deadline, but no less than the minimum wake interval.
+    
+    nextDeadline = self->_startTime + (uint64_t) ((double) self.handledDeadlineCount * self->_period);
+    nextWake = MAX(nextDeadline, self->_lastWakeTime + (uint64_t) (self.minimumWakeInterval * NSEC_PER_SEC));
+    now = SimplePingMonotonicNanoseconds();
+    if (self->_timer != nil) {
+        self->_timer.fireDate = [NSDate dateWithTimeIntervalSinceNow:(nextWake > now) ? (NSTimeInterval) (nextWake - now) / NSEC_PER_SEC : 0.0];
+    }
+    if (self->_source != nil) {
+        dispatch_source_set_timer(self->_source, dispatch_time(DISPATCH_TIME_NOW, (nextWake > now) ? (int64_t) (nextWake - now) : 0), DISPATCH_TIME_FOREVER, 0);
+    }
+}
+
+- (void)invalidate {
+    self.handler = nil;
+    if (self->_timer != nil) {
+        [self->_timer invalidate];
+        self->_timer = nil;
+    }
+    if (self->_source != nil) {
+        dispatch_source_cancel(self->_source);
+        self->_source = nil;
+    }
+}
+
+@end
@@ -0,0 +1,161 @@
+/*
+    Abstract:
+    A process-wide cache of resolved host addresses that honours DNS record TTLs.
+ */
+
+#import "SimplePingHostCache.h"
+#import "SimplePingTiming.h"
+
+#include <os/lock.h>
+
+/*! One cached resolution.
+ */
+
+@interface SimplePingHostCacheEntry : NSObject
+
+@property (nonatomic, copy,   readonly ) NSArray<NSData *> *    addresses;
+@property (nonatomic, assign, readonly ) uint64_t               expiryTime;     ///< on the SimplePingMonotonicNanoseconds() clock
+
+@end
+
+@implementation SimplePingHostCacheEntry
+
+- (instancetype)initWithAddresses:(NSArray<NSData *> *)addresses expiryTime:(uint64_t)expiryTime {
+    self = [super init];
+    if (self != nil) {
+        self->_addresses  = [addresses copy];
+        self->_expiryTime = expiryTime;
+    }
+    return self;
+}
+
+@end
+
+/*! Returns the key of an entry.
+ *  \param hostName The host name.
+ *  \param addressFamily The address family asked for.
+ *  \returns The key.
+ */
+
+static NSString * HostCacheKey(NSString * hostName, sa_family_t addressFamily) {
+    return [NSString stringWithFormat:@"%u/%@", (unsigned) addressFamily, hostName.lowercaseString];
+}
+
+@implementation SimplePingHostCache {
+    os_unfair_lock                                                  _lock;
+    NSMutableDictionary<NSString *, SimplePingHostCacheEntry *> *   _entries;               ///< protected by _lock
+    NSTimeInterval                                                  _maximumTimeToLive;     ///< protected by _lock
+}
+
++ (SimplePingHostCache *)sharedCache {
+    static SimplePingHostCache *    sSharedCache;
+    static dispatch_once_t          sOnceToken;
+
+    dispatch_once(&sOnceToken, ^{
+        sSharedCache = [[SimplePingHostCache alloc] init];
+    });
+    return sSharedCache;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self != nil) {
+        self->_lock              = OS_UNFAIR_LOCK_INIT;
+        self->_entries           = [[NSMutableDictionary alloc] init];
+        self->_maximumTimeToLive = 300.0;
+    }
+    return self;
+}
+
+- (NSTimeInterval)maximumTimeToLive {
+    NSTimeInterval  result;
+
+    os_unfair_lock_lock(&self->_lock);
+    result = self->_maximumTimeToLive;
+    os_unfair_lock_unlock(&self->_lock);
+    return result;
+}
+
+- (void)setMaximumTimeToLive:(NSTimeInterval)maximumTimeToLive {
+    os_unfair_lock_lock(&self->_lock);
+    self->_maximumTimeToLive = MAX(maximumTimeToLive, 0.0);
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+- (NSUInteger)count {
+    NSUInteger  result;
+
+    os_unfair_lock_lock(&self->_lock);
+    result = self->_entries.count;
+    os_unfair_lock_unlock(&self->_lock);
+    return result;
+}
+
+- (NSArray<NSData *> *)addressesForHostName:(NSString *)hostName addressFamily:(sa_family_t)addressFamily {
+    NSString *                  key;
+    SimplePingHostCacheEntry *  entry;
+    NSArray<NSData *> *         result;
+
+    NSParameterAssert(hostName != nil);
+    key = HostCacheKey(hostName, addressFamily);
+
+    result = nil;
+    os_unfair_lock_lock(&self->_lock);
+    entry = self->_entries[key];
+    if (entry != nil) {
+        if (entry.expiryTime > SimplePingMonotonicNanoseconds()) {
+            result = entry.addresses;
+        } else {
+            [self->_entries removeObjectForKey:key];
+        }
+    }
+    os_unfair_lock_unlock(&self->_lock);
+    return result;
+}
+
+- (void)setAddresses:(NSArray<NSData *> *)addresses forHostName:(NSString *)hostName addressFamily:(sa_family_t)addressFamily timeToLive:(NSTimeInterval)timeToLive {
+    NSString *                  key;
+    SimplePingHostCacheEntry *  entry;
+    uint64_t                    now;
+
+    NSParameterAssert(addresses.count != 0);
+    NSParameterAssert(hostName != nil);
+    key = HostCacheKey(hostName, addressFamily);
+
+    now = SimplePingMonotonicNanoseconds();
+    os_unfair_lock_lock(&self->_lock);
+    timeToLive = MIN(timeToLive, self->_maximumTimeToLive);
+    if (timeToLive > 0.0) {
+        entry = [[SimplePingHostCacheEntry alloc] initWithAddresses:addresses expiryTime:now + (uint64_t) (timeToLive * NSEC_PER_SEC)];
+        self->_entries[key] = entry;
+
+        // Every so often drop whatever has expired, so hosts that are never asked for
+        // again don't pile up.
+
+        if ( (self->_entries.count % 64) == 0 ) {
+            for (NSString * otherKey in self->_entries.allKeys) {
+                if (self->_entries[otherKey].expiryTime <= now) {
+                    [self->_entries removeObjectForKey:otherKey];
+                }
+            }
+        }
+    }
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+- (void)removeAddressesForHostName:(NSString *)hostName {
+    NSParameterAssert(hostName != nil);
+    os_unfair_lock_lock(&self->_lock);
+    [self->_entries removeObjectForKey:HostCacheKey(hostName, AF_UNSPEC)];
+    [self->_entries removeObjectForKey:HostCacheKey(hostName, AF_INET)];
+    [self->_entries removeObjectForKey:HostCacheKey(hostName, AF_INET6)];
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+- (void)removeAllAddresses {
+    os_unfair_lock_lock(&self->_lock);
+    [self->_entries removeAllObjects];
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+@end
@@ -0,0 +1,462 @@
+/*
+    Abstract:
+    Resolves a host name to its addresses, either on a run loop or on a dispatch queue.
+ */
+
+#import "SimplePingHostResolver.h"
+#import "SimplePingEventSources.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <string.h>
+#include <dns_sd.h>
+
+/*! How long to wait for AAAA records once A records have arrived, in seconds.
+ *  \details This is the Resolution Delay of Happy Eyeballs (RFC 8305, section 3).
+ */
+
+static const NSTimeInterval kHostResolverResolutionDelay = 0.05;
+
+@interface SimplePingHostResolver ()
+
+@property (nonatomic, strong, readonly, nullable) dispatch_queue_t  queue;
+
+/*! The run loop our DNS-SD socket is scheduled on, in run loop mode.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) NSRunLoop *  runLoop;
+
+/*! Fires the Resolution Delay after A records arrive ahead of AAAA ones.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingTimerSource *  resolutionDelayTimer;
+
+/*! The addresses found so far, by family.
+ */
+
+@property (nonatomic, strong, readonly ) NSMutableArray<NSData *> *  addresses4;
+@property (nonatomic, strong, readonly ) NSMutableArray<NSData *> *  addresses6;
+
+/*! Whether each family has been answered, with addresses or with no such record.
+ */
+
+@property (nonatomic, assign, readwrite) BOOL       answered4;
+@property (nonatomic, assign, readwrite) BOOL       answered6;
+
+/*! The smallest TTL of the records found so far, in seconds.
+ */
+
+@property (nonatomic, assign, readwrite) uint32_t   minimumTimeToLive;
+
+/*! The completion handler, cleared once it's been called or the resolver is cancelled.
+ */
+
+@property (nonatomic, copy,   readwrite, nullable) void (^completionHandler)(NSArray<NSData *> * _Nullable addresses, NSError * _Nullable error);
+
+- (void)processServiceResult;
+- (void)receivedAddress:(const struct sockaddr *)address timeToLive:(uint32_t)timeToLive flags:(DNSServiceFlags)flags error:(DNSServiceErrorType)errorCode;
+
+@end
+
+/*! Returns the error CFHost reports for a getaddrinfo() failure.
+ *  \param gaiError The getaddrinfo() error.
+ *  \returns The error.
+ */
+
+static NSError * HostResolverErrorWithGetAddrInfoError(int gaiError) {
+    return [NSError errorWithDomain:(NSString *) kCFErrorDomainCFNetwork code:kCFHostErrorUnknown userInfo:@{(id) kCFGetAddrInfoFailureKey: @(gaiError)}];
+}
+
+/*! Converts a DNS-SD error to the error CFHost would have reported.
+ *  \param serviceError Describes the failure.
+ *  \returns The error.
+ */
+
+static NSError * HostResolverErrorWithServiceError(DNSServiceErrorType serviceError) {
+    int     gaiError;
+
+    switch (serviceError) {
+        case kDNSServiceErr_NoSuchName:
+        case kDNSServiceErr_NoSuchRecord: {
+            gaiError = EAI_NONAME;
+        } break;
+        case kDNSServiceErr_Timeout: {
+            gaiError = EAI_AGAIN;
+        } break;
+        case kDNSServiceErr_NoMemory: {
+            gaiError = EAI_MEMORY;
+        } break;
+        default: {
+            gaiError = EAI_FAIL;
+        } break;
+    }
+    return HostResolverErrorWithGetAddrInfoError(gaiError);
+}
+
+/*! Returns whether an address is of a family.
+ *  \param address A (struct sockaddr) of some form.
+ *  \param addressFamily `AF_INET`, `AF_INET6`, or `AF_UNSPEC` to match either.
+ *  \returns YES if it is.
+ */
+
+static BOOL HostResolverAddressMatchesFamily(NSData * address, sa_family_t addressFamily) {
+    sa_family_t     family;
+
+    if (address.length < sizeof(struct sockaddr)) {
+        return NO;
+    }
+    family = ((const struct sockaddr *) address.bytes)->sa_family;
+    if ( (family != AF_INET) && (family != AF_INET6) ) {
+        return NO;
+    }
+    return (addressFamily == AF_UNSPEC) || (family == addressFamily);
+}
+
+@implementation SimplePingHostResolver {
+    DNSServiceRef   _service;           ///< while the query is in progress
+    CFSocketRef     _socket;            ///< run loop mode only; wraps the service's socket
+}
+
+- (instancetype)initWithHostName:(NSString *)hostName queue:(dispatch_queue_t)queue {
+    NSParameterAssert(hostName != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_hostName      = [hostName copy];
+        self->_queue         = queue;
+        self->_addressFamily = AF_UNSPEC;
+        self->_cache         = SimplePingHostCache.sharedCache;
+        self->_addresses4    = [[NSMutableArray alloc] init];
+        self->_addresses6    = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self cancel];
+}
+
+/*! Calls the completion handler, unless we were cancelled, and stops resolving.
+ *  \param addresses The addresses found, or nil on error.
+ *  \param error The error, or nil on success.
+ */
+
+- (void)finishWithAddresses:(NSArray<NSData *> *)addresses error:(NSError *)error {
+    void (^completionHandler)(NSArray<NSData *> * _Nullable addresses, NSError * _Nullable error);
+
+    completionHandler = self.completionHandler;
+    [self cancel];
+    if (completionHandler != nil) {
+        completionHandler(addresses, error);
+    }
+}
+
+/*! Calls `-finishWithAddresses:error:` later, on our queue or run loop.
+ *  \details Used when the answer is known without asking DNS, so that the completion
+ *      handler still runs after `-startWithCompletionHandler:` returns, as it always has.
+ *  \param addresses The addresses found.
+ */
+
+- (void)finishSoonWithAddresses:(NSArray<NSData *> *)addresses {
+    __weak SimplePingHostResolver *     weakSelf;
+    dispatch_block_t                    block;
+
+    weakSelf = self;
+    block = ^{
+        [weakSelf finishWithAddresses:addresses error:nil];
+    };
+    if (self.queue != nil) {
+        dispatch_async(self.queue, block);
+    } else {
+        CFRunLoopPerformBlock(CFRunLoopGetCurrent(), kCFRunLoopDefaultMode, block);
+        CFRunLoopWakeUp(CFRunLoopGetCurrent());
+    }
+}
+
+/*! The callback for our DNS-SD query.
+ *  \details This simply routes the call to our `-receivedAddress:timeToLive:flags:error:`
+ *      method.
+ *  \param sdRef See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param flags See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param interfaceIndex See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param errorCode See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param hostname See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param address See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param ttl See the documentation for DNSServiceGetAddrInfoReply.
+ *  \param context See the documentation for DNSServiceGetAddrInfoReply; this is actually a
+ *      pointer to the 'owning' object.
+ */
+
+static void HostResolverAddrInfoCallback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex, DNSServiceErrorType errorCode, const char * hostname, const struct sockaddr * address, uint32_t ttl, void * context) {
+    SimplePingHostResolver *    obj;
+
+    obj = (__bridge SimplePingHostResolver *) context;
+    assert([obj isKindOfClass:[SimplePingHostResolver class]]);
+
+    #pragma unused(sdRef)
+    #pragma unused(interfaceIndex)
+    #pragma unused(hostname)
+
+    [obj receivedAddress:address timeToLive:ttl flags:flags error:errorCode];
+}
+
+/*! The callback for the CFSocket wrapping our DNS-SD socket, in run loop mode.
+ *  \details This simply routes the call to our `-processServiceResult` method.
+ *  \param s See the documentation for CFSocketCallBack.
+ *  \param type See the documentation for CFSocketCallBack.
+ *  \param address See the documentation for CFSocketCallBack.
+ *  \param data See the documentation for CFSocketCallBack.
+ *  \param info See the documentation for CFSocketCallBack; this is actually a pointer to the
+ *      'owning' object.
+ */
+
+static void HostResolverSocketCallback(CFSocketRef s, CFSocketCallBackType type, CFDataRef address, const void *data, void *info) {
+    SimplePingHostResolver *    obj;
+
+    obj = (__bridge SimplePingHostResolver *) info;
+    assert([obj isKindOfClass:[SimplePingHostResolver class]]);
+
+    #pragma unused(s)
+    #pragma unused(type)
+    assert(type == kCFSocketReadCallBack);
+    #pragma unused(address)
+    #pragma unused(data)
+
+    [obj processServiceResult];
+}
+
+/*! Reads whatever the DNS-SD daemon has sent us, which calls our query callback.
+ */
+
+- (void)processServiceResult {
+    DNSServiceErrorType     err;
+
+    err = DNSServiceProcessResult(self->_service);
+    if (err != kDNSServiceErr_NoError) {
+        [self finishWithAddresses:nil error:HostResolverErrorWithServiceError(err)];
+    }
+}
+
+/*! Handles one answer to our query.
+ *  \param address The address, or the family answered with no records.
+ *  \param timeToLive The TTL of the record, in seconds.
+ *  \param flags The DNS-SD flags of the answer.
+ *  \param errorCode `kDNSServiceErr_NoError` for an address, `kDNSServiceErr_NoSuchRecord`
+ *      for a family with no records, or some failure.
+ */
+
+- (void)receivedAddress:(const struct sockaddr *)address timeToLive:(uint32_t)timeToLive flags:(DNSServiceFlags)flags error:(DNSServiceErrorType)errorCode {
+    sa_family_t     family;
+
+    family = (address != NULL) ? address->sa_family : AF_UNSPEC;
+    if ( (errorCode == kDNSServiceErr_NoError) || (errorCode == kDNSServiceErr_NoSuchRecord) ) {
+        switch (family) {
+            case AF_INET: {
+                self.answered4 = YES;
+                if ( (errorCode == kDNSServiceErr_NoError) && (flags & kDNSServiceFlagsAdd) ) {
+                    [self.addresses4 addObject:[NSData dataWithBytes:address length:sizeof(struct sockaddr_in)]];
+                    self.minimumTimeToLive = MIN(self.minimumTimeToLive, timeToLive);
+                }
+            } break;
+            case AF_INET6: {
+                self.answered6 = YES;
+                if ( (errorCode == kDNSServiceErr_NoError) && (flags & kDNSServiceFlagsAdd) ) {
+                    [self.addresses6 addObject:[NSData dataWithBytes:address length:sizeof(struct sockaddr_in6)]];
+                    self.minimumTimeToLive = MIN(self.minimumTimeToLive, timeToLive);
+                }
+            } break;
+            default: {
+                // Neither family; nothing we can use.
+            } break;
+        }
+        if ( ! (flags & kDNSServiceFlagsMoreComing) ) {
+            [self answersChanged];
+        }
+    } else if ( (errorCode == kDNSServiceErr_Timeout) && ( (self.addresses4.count != 0) || (self.addresses6.count != 0) ) ) {
+        // One family timed out but the other answered; go with what we have.
+        [self completeResolution];
+    } else {
+        [self finishWithAddresses:nil error:HostResolverErrorWithServiceError(errorCode)];
+    }
+}
+
+/*! Decides, after a batch of answers, whether we have enough to finish.
+ *  \details Of the two families, waits for the ones `addressFamily` wants.  When it wants
+ *      both, AAAA records are good enough on their own, while A records wait up to the
+ *      Resolution Delay for AAAA ones, so that IPv6 is preferred whenever it answers
+ *      about as promptly.
+ */
+
+- (void)answersChanged {
+    BOOL    want4;
+    BOOL    want6;
+
+    want4 = (self.addressFamily != AF_INET6);
+    want6 = (self.addressFamily != AF_INET);
+
+    if ( ( ! want4 || self.answered4 ) && ( ! want6 || self.answered6 ) ) {
+        [self completeResolution];
+    } else if (want4 && want6) {
+        if (self.addresses6.count != 0) {
+            [self completeResolution];
+        } else if ( (self.addresses4.count != 0) && (self.resolutionDelayTimer == nil) ) {
+            __weak SimplePingHostResolver *     weakSelf;
+
+            weakSelf = self;
+            self.resolutionDelayTimer = [[SimplePingTimerSource alloc] initWithInterval:kHostResolverResolutionDelay leeway:0.0 repeats:NO queue:self.queue handler:^{
+                [weakSelf completeResolution];
+            }];
+        }
+    }
+}
+
+/*! Finishes with the addresses found, IPv6 first, and caches them.
+ */
+
+- (void)completeResolution {
+    NSMutableArray<NSData *> *  addresses;
+
+    addresses = [[NSMutableArray alloc] init];
+    if (self.addressFamily != AF_INET) {
+        [addresses addObjectsFromArray:self.addresses6];
+    }
+    if (self.addressFamily != AF_INET6) {
+        [addresses addObjectsFromArray:self.addresses4];
+    }
+    if (addresses.count == 0) {
+        [self finishWithAddresses:nil error:HostResolverErrorWithGetAddrInfoError(EAI_NONAME)];
+    } else {
+        [self.cache setAddresses:addresses forHostName:self.hostName addressFamily:self.addressFamily timeToLive:self.minimumTimeToLive];
+        [self finishWithAddresses:addresses error:nil];
+    }
+}
+
+/*! Returns the addresses of `hostName` if it's an address in string form.
+ *  \returns Its addresses of the wanted family, possibly none, or nil if `hostName` isn't
+ *      an address.
+ */
+
+- (nullable NSArray<NSData *> *)numericAddresses {
+    struct addrinfo             hints;
+    struct addrinfo *           list;
+    NSMutableArray<NSData *> *  addresses;
+
+    // AI_NUMERICHOST never touches the network, so this is safe to do right here.
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_NUMERICHOST;
+
+    list = NULL;
+    if (getaddrinfo(self.hostName.UTF8String, NULL, &hints, &list) != 0) {
+        return nil;
+    }
+    addresses = [[NSMutableArray alloc] init];
+    for (const struct addrinfo * cursor = list; cursor != NULL; cursor = cursor->ai_next) {
+        NSData *    address;
+
+        if ( (cursor->ai_addr != NULL) && (cursor->ai_addrlen != 0) ) {
+            address = [NSData dataWithBytes:cursor->ai_addr length:cursor->ai_addrlen];
+            if (HostResolverAddressMatchesFamily(address, self.addressFamily)) {
+                [addresses addObject:address];
+            }
+        }
+    }
+    freeaddrinfo(list);
+    return addresses;
+}
+
+/*! Starts the DNS-SD query for `hostName`, on our run loop or queue.
+ */
+
+- (void)startQuery {
+    DNSServiceErrorType     err;
+    DNSServiceProtocol      protocols;
+
+    switch (self.addressFamily) {
+        case AF_INET:  { protocols = kDNSServiceProtocol_IPv4; } break;
+        case AF_INET6: { protocols = kDNSServiceProtocol_IPv6; } break;
+        default:       { protocols = kDNSServiceProtocol_IPv4 | kDNSServiceProtocol_IPv6; } break;
+    }
+    [self.addresses4 removeAllObjects];
+    [self.addresses6 removeAllObjects];
+    self.answered4 = NO;
+    self.answered6 = NO;
+    self.minimumTimeToLive = UINT32_MAX;
+
+    // ReturnIntermediates gets us an answer for a family with no records, rather than
+    // nothing at all, so that we know when to stop waiting for it.
+
+    err = DNSServiceGetAddrInfo(&self->_service, kDNSServiceFlagsReturnIntermediates | kDNSServiceFlagsTimeout, kDNSServiceInterfaceIndexAny, protocols, self.hostName.UTF8String, HostResolverAddrInfoCallback, (__bridge void *) self);
+    if (err != kDNSServiceErr_NoError) {
+        self->_service = NULL;
+        [self finishWithAddresses:nil error:HostResolverErrorWithServiceError(err)];
+        return;
+    }
+
+    if (self.queue != nil) {
+        err = DNSServiceSetDispatchQueue(self->_service, self.queue);
+        if (err != kDNSServiceErr_NoError) {
+            [self finishWithAddresses:nil error:HostResolverErrorWithServiceError(err)];
+        }
+    } else {
+        CFSocketContext     context = {0, (__bridge void *)(self), NULL, NULL, NULL};
+        CFRunLoopSourceRef  rls;
+
+        // Wrap the service's socket in a CFSocket and schedule it on the run loop.  The
+        // socket belongs to the service, so the CFSocket mustn't close it.
+
+        self->_socket = CFSocketCreateWithNative(NULL, DNSServiceRefSockFD(self->_service), kCFSocketReadCallBack, HostResolverSocketCallback, &context);
+        assert(self->_socket != NULL);
+        CFSocketSetSocketFlags(self->_socket, CFSocketGetSocketFlags(self->_socket) & ~ (CFOptionFlags) kCFSocketCloseOnInvalidate);
+
+        self.runLoop = [NSRunLoop currentRunLoop];
+        rls = CFSocketCreateRunLoopSource(NULL, self->_socket, 0);
+        assert(rls != NULL);
+        CFRunLoopAddSource(self.runLoop.getCFRunLoop, rls, kCFRunLoopDefaultMode);
+        CFRelease(rls);
+    }
+}
+
+- (void)startWithCompletionHandler:(void (^)(NSArray<NSData *> * _Nullable addresses, NSError * _Nullable error))completionHandler {
+    NSArray<NSData *> *     addresses;
+
+    NSParameterAssert(completionHandler != nil);
+    assert(self.completionHandler == nil);
+    assert(self->_service == NULL);
+
+    self.completionHandler = completionHandler;
+
+    // An address in string form needs no lookup, and a cached name needs no new one.
+
+    addresses = [self numericAddresses];
+    if (addresses == nil) {
+        addresses = [self.cache addressesForHostName:self.hostName addressFamily:self.addressFamily];
+    }
+    if (addresses != nil) {
+        [self finishSoonWithAddresses:addresses];
+    } else {
+        [self startQuery];
+    }
+}
+
+- (void)cancel {
+    self.completionHandler = nil;
+    if (self.resolutionDelayTimer != nil) {
+        [self.resolutionDelayTimer invalidate];
+        self.resolutionDelayTimer = nil;
+    }
+    if (self->_socket != NULL) {
+        CFSocketInvalidate(self->_socket);
+        CFRelease(self->_socket);
+        self->_socket = NULL;
+        self.runLoop = nil;
+    }
+    if (self->_service != NULL) {
+        DNSServiceRefDeallocate(self->_service);
+        self->_service = NULL;
+    }
+}
+
+@end
@@ -0,0 +1,52 @@
+/*
+    Abstract:
+    Levelled logging to the unified log, and signposts for profiling probes in Instruments.
+ */
+
+#import "SimplePingLog.h"
+
+#include <stdlib.h>
+#include <strings.h>
+
+SimplePingLogLevel _SimplePingLogLevel = SimplePingLogLevelInfo;
+
+/*! Sets the initial level from the SIMPLEPING_LOG_LEVEL environment variable.
+ */
+
+__attribute__((constructor))
+static void SimplePingLogReadEnvironment(void) {
+    static const char * const   names[] = { "off", "error", "info", "debug" };
+    const char *                value;
+
+    value = getenv("SIMPLEPING_LOG_LEVEL");
+    if (value != NULL) {
+        for (size_t level = 0; level < sizeof(names) / sizeof(names[0]); level++) {
+            if (strcasecmp(value, names[level]) == 0) {
+                _SimplePingLogLevel = (SimplePingLogLevel) level;
+            }
+        }
+    }
+}
+
+void SimplePingLogSetLevel(SimplePingLogLevel level) {
+    __atomic_store_n(&_SimplePingLogLevel, level, __ATOMIC_RELAXED);
+}
+
+SimplePingLogLevel SimplePingLogGetLevel(void) {
+    return __atomic_load_n(&_SimplePingLogLevel, __ATOMIC_RELAXED);
+}
+
+os_log_t SimplePingLogHandle(SimplePingLogCategory category) {
+    static os_log_t         handles[3];
+    static dispatch_once_t  onceToken;
+
+    dispatch_once(&onceToken, ^{
+        handles[SimplePingLogCategoryPing]       = os_log_create(kSimplePingLogSubsystem, "Ping");
+        handles[SimplePingLogCategoryTraceroute] = os_log_create(kSimplePingLogSubsystem, "Traceroute");
+        handles[SimplePingLogCategoryEngine]     = os_log_create(kSimplePingLogSubsystem, "Engine");
+    });
+    if ( (category < 0) || ((size_t) category >= sizeof(handles) / sizeof(handles[0])) ) {
+        return OS_LOG_DEFAULT;
+    }
+    return handles[category];
+}
@@ -0,0 +1,161 @@
+/*
+    Abstract:
+    Lock-free counters and a callback latency histogram, per prober and for the whole process.
+ */
+
+#import "SimplePingMetrics.h"
+
+SimplePingMetrics _SimplePingProcessMetrics;
+
+/*! Returns the histogram bucket of a latency.
+ */
+
+static NSUInteger SimplePingMetricsBucketForNanoseconds(uint64_t nanoseconds) {
+    NSUInteger      bucket;
+
+    bucket = (nanoseconds == 0) ? 0 : (NSUInteger) (63 - __builtin_clzll(nanoseconds));
+    return MIN(bucket, (NSUInteger) (kSimplePingMetricsLatencyBucketCount - 1));
+}
+
+static void SimplePingMetricsRecordCallbackInto(SimplePingMetrics * metrics, NSUInteger bucket, uint64_t nanoseconds) {
+    __atomic_fetch_add(&metrics->callbackCount, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics->callbackNanoseconds, nanoseconds, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics->callbackLatencyBuckets[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void SimplePingMetricsRecordCallback(SimplePingMetrics * metrics, uint64_t nanoseconds) {
+    NSUInteger      bucket;
+
+    bucket = SimplePingMetricsBucketForNanoseconds(nanoseconds);
+    SimplePingMetricsRecordCallbackInto(metrics, bucket, nanoseconds);
+    SimplePingMetricsRecordCallbackInto(&_SimplePingProcessMetrics, bucket, nanoseconds);
+}
+
+@interface SimplePingMetricsSnapshot () {
+    SimplePingMetrics   _values;
+}
+
+@end
+
+@implementation SimplePingMetricsSnapshot
+
+- (instancetype)initWithMetrics:(const SimplePingMetrics *)metrics {
+    NSParameterAssert(metrics != NULL);
+    self = [super init];
+    if (self != nil) {
+        for (NSUInteger counter = 0; counter < SimplePingMetricsCounterCount; counter++) {
+            self->_values.counters[counter] = __atomic_load_n(&metrics->counters[counter], __ATOMIC_RELAXED);
+        }
+        self->_values.callbackCount = __atomic_load_n(&metrics->callbackCount, __ATOMIC_RELAXED);
+        self->_values.callbackNanoseconds = __atomic_load_n(&metrics->callbackNanoseconds, __ATOMIC_RELAXED);
+        for (NSUInteger bucket = 0; bucket < kSimplePingMetricsLatencyBucketCount; bucket++) {
+            self->_values.callbackLatencyBuckets[bucket] = __atomic_load_n(&metrics->callbackLatencyBuckets[bucket], __ATOMIC_RELAXED);
+        }
+    }
+    return self;
+}
+
++ (SimplePingMetricsSnapshot *)processSnapshot {
+    return [[SimplePingMetricsSnapshot alloc] initWithMetrics:&_SimplePingProcessMetrics];
+}
+
+- (uint64_t)packetsSent {
+    return self->_values.counters[SimplePingMetricsCounterPacketsSent];
+}
+
+- (uint64_t)sendFailures {
+    return self->_values.counters[SimplePingMetricsCounterSendFailures];
+}
+
+- (uint64_t)packetsReceived {
+    return self->_values.counters[SimplePingMetricsCounterPacketsReceived];
+}
+
+- (uint64_t)validationFailures {
+    return self->_values.counters[SimplePingMetricsCounterValidationFailures];
+}
+
+- (uint64_t)unexpectedPackets {
+    return self->_values.counters[SimplePingMetricsCounterUnexpectedPackets];
+}
+
+- (uint64_t)expiredProbes {
+    return self->_values.counters[SimplePingMetricsCounterExpiredProbes];
+}
+
+- (uint64_t)timeouts {
+    return self->_values.counters[SimplePingMetricsCounterTimeouts];
+}
+
+- (NSTimeInterval)filteringTime {
+    return (NSTimeInterval) self->_values.counters[SimplePingMetricsCounterFilteringNanoseconds] / 1e9;
+}
+
+- (uint64_t)callbackCount {
+    return self->_values.callbackCount;
+}
+
+- (NSTimeInterval)averageCallbackLatency {
+    if (self->_values.callbackCount == 0) {
+        return 0.0;
+    }
+    return (NSTimeInterval) self->_values.callbackNanoseconds / (NSTimeInterval) self->_values.callbackCount / 1e9;
+}
+
+- (NSArray<NSNumber *> *)callbackLatencyBuckets {
+    NSMutableArray<NSNumber *> *    buckets;
+
+    buckets = [NSMutableArray arrayWithCapacity:kSimplePingMetricsLatencyBucketCount];
+    for (NSUInteger bucket = 0; bucket < kSimplePingMetricsLatencyBucketCount; bucket++) {
+        [buckets addObject:@(self->_values.callbackLatencyBuckets[bucket])];
+    }
+    return buckets;
+}
+
+- (NSTimeInterval)callbackLatencyAtQuantile:(double)quantile {
+    uint64_t        total;
+    uint64_t        rank;
+    uint64_t        seen;
+
+    total = 0;
+    for (NSUInteger bucket = 0; bucket < kSimplePingMetricsLatencyBucketCount; bucket++) {
+        total += self->_values.callbackLatencyBuckets[bucket];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+
+    // The rank of the quantile, 1-based, so that quantile 0 is the first sample and 1 the last.
+
+    quantile = MAX(0.0, MIN(1.0, quantile));
+    rank = MAX((uint64_t) 1, (uint64_t) ceil(quantile * (double) total));
+    seen = 0;
+    for (NSUInteger bucket = 0; bucket < kSimplePingMetricsLatencyBucketCount; bucket++) {
+        seen += self->_values.callbackLatencyBuckets[bucket];
+        if (seen >= rank) {
+            return ldexp(1.0, (int) bucket + 1) / 1e9;
+        }
+    }
+    return ldexp(1.0, kSimplePingMetricsLatencyBucketCount) / 1e9;
+}
+
+static uint64_t SimplePingMetricsDifference(uint64_t later, uint64_t earlier) {
+    return (later > earlier) ? later - earlier : 0;
+}
+
+- (SimplePingMetricsSnapshot *)snapshotBySubtracting:(SimplePingMetricsSnapshot *)earlier {
+    SimplePingMetrics       difference;
+
+    NSParameterAssert(earlier != nil);
+    for (NSUInteger counter = 0; counter < SimplePingMetricsCounterCount; counter++) {
+        difference.counters[counter] = SimplePingMetricsDifference(self->_values.counters[counter], earlier->_values.counters[counter]);
+    }
+    difference.callbackCount = SimplePingMetricsDifference(self->_values.callbackCount, earlier->_values.callbackCount);
+    difference.callbackNanoseconds = SimplePingMetricsDifference(self->_values.callbackNanoseconds, earlier->_values.callbackNanoseconds);
+    for (NSUInteger bucket = 0; bucket < kSimplePingMetricsLatencyBucketCount; bucket++) {
+        difference.callbackLatencyBuckets[bucket] = SimplePingMetricsDifference(self->_values.callbackLatencyBuckets[bucket], earlier->_values.callbackLatencyBuckets[bucket]);
+    }
+    return [[SimplePingMetricsSnapshot alloc] initWithMetrics:&difference];
+}
+
+@end
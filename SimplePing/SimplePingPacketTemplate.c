@@ -0,0 +1,171 @@
+/*
+    Abstract:
+    Preformatted ICMP echo request packets, patched in place for each send.
+ */
+
+#include "SimplePingPacketTemplate.h"
+#include "SimplePingChecksum.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libkern/OSByteOrder.h>
+
+// These match the ICMPHeader layout in SimplePing.h.
+
+enum {
+    kSimplePingPacketTemplateHeaderLength = 8,
+    kSimplePingPacketTemplateChecksumOffset = 2,
+    kSimplePingPacketTemplateIdentifierOffset = 4,
+    kSimplePingPacketTemplateSequenceNumberOffset = 6
+};
+
+/*! Loads the 16-bit word at an even offset, padding an odd last byte with zero as the 
+ *  IP checksum does.
+ */
+
+static uint16_t SimplePingPacketTemplateWordAtOffset(const SimplePingPacketTemplate * packetTemplate, size_t offset) {
+    union {
+        uint16_t    us;
+        uint8_t     uc[2];
+    } word;
+
+    word.uc[0] = packetTemplate->bytes[offset];
+    word.uc[1] = (offset + 1 < packetTemplate->length) ? packetTemplate->bytes[offset + 1] : 0;
+    return word.us;
+}
+
+bool SimplePingPacketTemplateInit(SimplePingPacketTemplate * packetTemplate, uint8_t type, uint16_t identifier, const void * payload, size_t payloadLength, bool requiresChecksum) {
+    uint16_t    field;
+    uint8_t *   bytes;
+
+    assert( (payload != NULL) || (payloadLength == 0) );
+
+    SimplePingPacketTemplateDestroy(packetTemplate);
+
+    bytes = calloc(1, kSimplePingPacketTemplateHeaderLength + payloadLength);
+    if (bytes == NULL) {
+        return false;
+    }
+    packetTemplate->bytes            = bytes;
+    packetTemplate->length           = kSimplePingPacketTemplateHeaderLength + payloadLength;
+    packetTemplate->type             = type;
+    packetTemplate->identifier       = identifier;
+    packetTemplate->requiresChecksum = requiresChecksum;
+
+    // The code, checksum and sequence number start out as zero.
+
+    bytes[0] = type;
+    field = OSSwapHostToBigInt16(identifier);
+    memcpy(&bytes[kSimplePingPacketTemplateIdentifierOffset], &field, sizeof(field));
+    if (payloadLength != 0) {
+        memcpy(&bytes[kSimplePingPacketTemplateHeaderLength], payload, payloadLength);
+    }
+
+    // The checksum routine returns a 16-bit number that's already in correct byte order, 
+    // so we just put it into the packet as a 16-bit unit.
+
+    if (requiresChecksum) {
+        field = SimplePingChecksum(packetTemplate->bytes, packetTemplate->length);
+        memcpy(&bytes[kSimplePingPacketTemplateChecksumOffset], &field, sizeof(field));
+    }
+    return true;
+}
+
+void SimplePingPacketTemplateDestroy(SimplePingPacketTemplate * packetTemplate) {
+    free(packetTemplate->bytes);
+    packetTemplate->bytes  = NULL;
+    packetTemplate->length = 0;
+}
+
+void SimplePingPacketTemplatePatch(SimplePingPacketTemplate * packetTemplate, size_t offset, const void * bytes, size_t length) {
+    uint16_t    checksum;
+    size_t      wordOffset;
+    size_t      end;
+
+    assert(packetTemplate->bytes != NULL);
+    assert( (offset <= packetTemplate->length) && (length <= packetTemplate->length - offset) );
+    assert( (length == 0) || (offset + length <= kSimplePingPacketTemplateChecksumOffset) || (offset >= kSimplePingPacketTemplateChecksumOffset + 2) );   // not the checksum itself
+
+    if ( ! packetTemplate->requiresChecksum ) {
+        memcpy(&packetTemplate->bytes[offset], bytes, length);
+        return;
+    }
+
+    // For each 16-bit word touched, fold the change into the checksum with 
+    // RFC 1624 equation 3: HC' = ~(~HC + ~m + m').  The sum is byte order independent, 
+    // so working on words as they sit in memory is fine.
+
+    memcpy(&checksum, &packetTemplate->bytes[kSimplePingPacketTemplateChecksumOffset], sizeof(checksum));
+    end = offset + length;
+    for (wordOffset = offset & ~(size_t) 1; wordOffset < end; wordOffset += 2) {
+        uint16_t    oldWord;
+        uint16_t    newWord;
+        uint32_t    sum;
+        size_t      byteOffset;
+
+        oldWord = SimplePingPacketTemplateWordAtOffset(packetTemplate, wordOffset);
+        for (byteOffset = wordOffset; (byteOffset < wordOffset + 2) && (byteOffset < packetTemplate->length); byteOffset++) {
+            if ( (byteOffset >= offset) && (byteOffset < end) ) {
+                packetTemplate->bytes[byteOffset] = ((const uint8_t *) bytes)[byteOffset - offset];
+            }
+        }
+        newWord = SimplePingPacketTemplateWordAtOffset(packetTemplate, wordOffset);
+
+        sum = (uint32_t) (uint16_t) ~checksum + (uint32_t) (uint16_t) ~oldWord + newWord;
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum += (sum >> 16);
+        checksum = (uint16_t) ~sum;
+    }
+    memcpy(&packetTemplate->bytes[kSimplePingPacketTemplateChecksumOffset], &checksum, sizeof(checksum));
+}
+
+void SimplePingPacketTemplateSetSequenceNumber(SimplePingPacketTemplate * packetTemplate, uint16_t sequenceNumber) {
+    uint16_t    field;
+
+    field = OSSwapHostToBigInt16(sequenceNumber);
+    SimplePingPacketTemplatePatch(packetTemplate, kSimplePingPacketTemplateSequenceNumberOffset, &field, sizeof(field));
+}
+
+/*! Sums every word of the packet but the checksum, as the checksum algorithm does.
+ */
+
+static uint64_t SimplePingPacketTemplateSum(const SimplePingPacketTemplate * packetTemplate) {
+    uint64_t    sum;
+
+    sum = SimplePingChecksumAccumulate(0, packetTemplate->bytes, kSimplePingPacketTemplateChecksumOffset);
+    return SimplePingChecksumAccumulate(sum, &packetTemplate->bytes[kSimplePingPacketTemplateChecksumOffset + 2], packetTemplate->length - (kSimplePingPacketTemplateChecksumOffset + 2));
+}
+
+uint16_t SimplePingPacketTemplateChecksum(const SimplePingPacketTemplate * packetTemplate) {
+    assert(packetTemplate->bytes != NULL);
+
+    return SimplePingChecksumFinish(SimplePingPacketTemplateSum(packetTemplate));
+}
+
+void SimplePingPacketTemplateFixChecksum(SimplePingPacketTemplate * packetTemplate, size_t offset, uint16_t checksum) {
+    uint16_t    current;
+    uint16_t    oldWord;
+    uint16_t    newWord;
+    uint32_t    sum;
+
+    assert(packetTemplate->bytes != NULL);
+    assert( ((offset & 1) == 0) && (offset >= kSimplePingPacketTemplateHeaderLength) && (offset + 2 <= packetTemplate->length) );
+
+    // The word has to make up the difference between the sum the packet has and the one 
+    // the checksum calls for: m' = ~HC' - (~HC - m), in ones' complement arithmetic, 
+    // where subtracting is adding the complement.  As in the Patch routine the words 
+    // are used as they sit in memory.
+
+    current = SimplePingPacketTemplateChecksum(packetTemplate);
+    memcpy(&oldWord, &packetTemplate->bytes[offset], sizeof(oldWord));
+    sum = (uint32_t) (uint16_t) ~checksum + current + oldWord;
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    newWord = (uint16_t) sum;
+    memcpy(&packetTemplate->bytes[offset], &newWord, sizeof(newWord));
+
+    if (packetTemplate->requiresChecksum) {
+        memcpy(&packetTemplate->bytes[kSimplePingPacketTemplateChecksumOffset], &checksum, sizeof(checksum));
+    }
+}
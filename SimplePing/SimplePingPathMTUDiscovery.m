@@ -0,0 +1,570 @@
+/*
+    Abstract:
+    Finds the path MTU to a host by pinging with the don't fragment bit set, several sizes at a time.
+ */
+
+#import "SimplePingPathMTUDiscovery.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kPathMTUMinimum4        = 68,           ///< The MTU every IPv4 path must carry (RFC 791).
+    kPathMTUMinimum6        = 1280,         ///< The MTU every IPv6 path must carry (RFC 8200).
+    kPathMTUHeaderLength4   = 20 + 8,       ///< An IPv4 header and an ICMP header.
+    kPathMTUHeaderLength6   = 40 + 8        ///< An IPv6 header and an ICMPv6 header.
+};
+
+/*! Reads a big endian 16-bit value, at any alignment.
+ */
+
+static uint32_t PathMTUReadBigEndian16(const uint8_t * bytes) {
+    return ((uint32_t) bytes[0] << 8) | bytes[1];
+}
+
+/*! Decodes a "fragmentation needed" or "packet too big" error about one of our pings.
+ *  \param bytes The packet, as the kernel returned it: with the IP header for ICMPv4,
+ *      without it for ICMPv6.
+ *  \param length The length of that packet.
+ *  \param family AF_INET or AF_INET6.
+ *  \param identifier Our ICMP identifier, in host byte order.
+ *  \param sequenceNumberPtr Receives the sequence number of the ping the error quotes.
+ *  \param mtuPtr Receives the MTU of the next hop, or 0 if the router didn't say.
+ *  \returns true if the packet is such an error and quotes an echo request with our identifier.
+ */
+
+static bool PathMTUParseTooBig(const uint8_t * bytes, size_t length, sa_family_t family, uint16_t identifier, uint16_t * sequenceNumberPtr, uint32_t * mtuPtr) {
+    const uint8_t *     icmp;
+    const uint8_t *     quoted;
+    size_t              headerLength;
+    size_t              quotedHeaderLength;
+    uint32_t            mtu;
+
+    if (family == AF_INET) {
+
+        // IP header, ICMP header (type 3, code 4, next-hop MTU in the second half of the
+        // unused word, RFC 1191), then the quoted IP header and ICMP header of our ping.
+
+        if ( (length < 20) || ((bytes[0] & 0xF0) != 0x40) || (bytes[9] != IPPROTO_ICMP) ) {
+            return false;
+        }
+        headerLength = (size_t) (bytes[0] & 0x0F) * 4;
+        if (length < (headerLength + 8 + 20)) {
+            return false;
+        }
+        icmp = bytes + headerLength;
+        if ( (icmp[0] != 3) || (icmp[1] != 4) ) {
+            return false;
+        }
+        mtu = PathMTUReadBigEndian16(icmp + 6);
+        quoted = icmp + 8;
+        if ( ((quoted[0] & 0xF0) != 0x40) || (quoted[9] != IPPROTO_ICMP) ) {
+            return false;
+        }
+        quotedHeaderLength = (size_t) (quoted[0] & 0x0F) * 4;
+        if (length < (headerLength + 8 + quotedHeaderLength + 8)) {
+            return false;
+        }
+        quoted += quotedHeaderLength;
+        if (quoted[0] != ICMPv4TypeEchoRequest) {
+            return false;
+        }
+    } else if (family == AF_INET6) {
+
+        // ICMPv6 header (type 2, code 0, MTU in the 32-bit word after the checksum), then
+        // the quoted IPv6 header and ICMPv6 header of our ping.
+
+        if ( (length < (8 + 40 + 8)) || (bytes[0] != 2) || (bytes[1] != 0) ) {
+            return false;
+        }
+        mtu = (PathMTUReadBigEndian16(bytes + 4) << 16) | PathMTUReadBigEndian16(bytes + 6);
+        quoted = bytes + 8;
+        if ( ((quoted[0] & 0xF0) != 0x60) || (quoted[6] != IPPROTO_ICMPV6) ) {
+            return false;
+        }
+        quoted += 40;
+        if (quoted[0] != ICMPv6TypeEchoRequest) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (PathMTUReadBigEndian16(quoted + 4) != identifier) {
+        return false;
+    }
+    *sequenceNumberPtr = (uint16_t) PathMTUReadBigEndian16(quoted + 6);
+    *mtuPtr = mtu;
+    return true;
+}
+
+/*! A probe in flight.
+ */
+
+struct PathMTUProbe {
+    SimplePingTimeoutToken  token;          ///< The probe's timeout, or 0 if the slot is free.
+    NSUInteger              size;           ///< The size of the probe, IP header included.
+    uint16_t                sequenceNumber; ///< The sequence number it was last sent with.
+    NSUInteger              attemptCount;   ///< The number of times it's been sent.
+};
+typedef struct PathMTUProbe PathMTUProbe;
+
+@interface SimplePingPathMTUDiscovery () <SimplePingDelegate>
+
+// read/write versions of public properties
+
+@property (nonatomic, copy,   readwrite, nullable) NSData *     hostAddress;
+@property (nonatomic, assign, readwrite)           NSUInteger   pathMTU;
+@property (nonatomic, assign, readwrite)           NSUInteger   probeCount;
+@property (nonatomic, assign, readwrite)           NSUInteger   roundCount;
+
+// private properties
+
+/*! The address passed to `-initWithHostAddress:`, which `-start` uses rather than resolving.
+ */
+
+@property (nonatomic, copy,   readonly,  nullable) NSData *     initialHostAddress;
+
+/*! The pinger that sends our probes, or nil while we're stopped.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePing *     pinger;
+
+/*! The wheel our probes' timeouts are kept on, and our identifier on it.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) SimplePingTimeoutWheel *     timeoutWheel;
+@property (nonatomic, assign, readwrite)           NSUInteger                   timeoutWheelClient;
+
+/*! Zeros, enough for the payload of the biggest probe.
+ */
+
+@property (nonatomic, strong, readwrite, nullable) NSMutableData *  payloadBuffer;
+
+/*! True while `-sendRound` or `-probesTimedOut:count:` is sending, so that probes resolved synchronously don't start another round.
+ */
+
+@property (nonatomic, assign, readwrite)           BOOL         sending;
+
+@end
+
+@implementation SimplePingPathMTUDiscovery {
+    PathMTUProbe *  _probes;                ///< probesPerRound slots, see PathMTUProbe
+    NSUInteger      _probeSlotCount;
+    NSUInteger      _minimumMTU;            ///< of the address family
+    NSUInteger      _headerLength;          ///< of a probe, before its payload
+    NSUInteger      _lowMTU;                ///< the biggest size known to fit, or _minimumMTU - 1
+    NSUInteger      _highMTU;               ///< the biggest size not known to be too big
+}
+
+- (instancetype)initWithHostName:(NSString *)hostName {
+    NSParameterAssert(hostName != nil);
+    self = [super init];
+    if (self != nil) {
+        self->_hostName       = [hostName copy];
+        self->_maximumMTU     = 1500;
+        self->_probesPerRound = 4;
+        self->_timeout        = 1.0;
+    }
+    return self;
+}
+
+- (instancetype)initWithHostAddress:(NSData *)hostAddress {
+    char    hostStr[NI_MAXHOST];
+
+    NSParameterAssert(hostAddress.length >= sizeof(struct sockaddr));
+    if (getnameinfo(hostAddress.bytes, (socklen_t) hostAddress.length, hostStr, sizeof(hostStr), NULL, 0, NI_NUMERICHOST) != 0) {
+        (void) strlcpy(hostStr, "?", sizeof(hostStr));
+    }
+    self = [self initWithHostName:@(hostStr)];
+    if (self != nil) {
+        self->_initialHostAddress = [hostAddress copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+    assert(self->_pinger == nil);
+    assert(self->_probes == NULL);
+}
+
+- (void)start {
+    SimplePing *                        pinger;
+    __weak SimplePingPathMTUDiscovery * weakSelf;
+
+    NSParameterAssert(self.pinger == nil);
+
+    self.hostAddress = nil;
+    self.pathMTU     = 0;
+    self.probeCount  = 0;
+    self.roundCount  = 0;
+
+    self->_probeSlotCount = MAX(self.probesPerRound, (NSUInteger) 1);
+    self->_probes = calloc(self->_probeSlotCount, sizeof(*self->_probes));
+    assert(self->_probes != NULL);
+
+    weakSelf = self;
+    self.timeoutWheel = [[SimplePingTimeoutWheel alloc] initWithTickInterval:MIN(MAX(self.timeout / 10.0, 0.001), 0.05) queue:self.dispatchQueue];
+    self.timeoutWheelClient = [self.timeoutWheel addClientWithHandler:^(const uint64_t * keys, NSUInteger count) {
+        [weakSelf probesTimedOut:keys count:count];
+    }];
+
+    // Our errors are never foreign, so we can let the pinger drop everyone else's traffic.
+
+    if (self.initialHostAddress != nil) {
+        pinger = [[SimplePing alloc] initWithHostAddress:self.initialHostAddress];
+    } else {
+        pinger = [[SimplePing alloc] initWithHostName:self.hostName];
+    }
+    pinger.delegate              = self;
+    pinger.dispatchQueue         = self.dispatchQueue;
+    pinger.addressStyle          = self.addressStyle;
+    pinger.dontFragment          = YES;
+    pinger.ignoresForeignPackets = YES;
+    self.pinger = pinger;
+    [pinger start];
+}
+
+- (void)stop {
+    if (self.pinger != nil) {
+        self.pinger.delegate = nil;
+        [self.pinger stop];
+        self.pinger = nil;
+    }
+    if (self.timeoutWheel != nil) {
+        [self.timeoutWheel removeClient:self.timeoutWheelClient];
+        self.timeoutWheel = nil;
+        self.timeoutWheelClient = 0;
+    }
+    free(self->_probes);
+    self->_probes = NULL;
+    self->_probeSlotCount = 0;
+    self.payloadBuffer = nil;
+}
+
+/*! Stops the object and tells the delegate about the error.
+ *  \param error Describes the failure.
+ */
+
+- (void)didFailWithError:(NSError *)error {
+    id<SimplePingPathMTUDiscoveryDelegate>  strongDelegate;
+
+    // Retain ourselves in case the delegate releases us.
+
+    CFAutorelease(CFBridgingRetain(self));
+
+    [self stop];
+    strongDelegate = self.delegate;
+    if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(pathMTUDiscovery:didFailWithError:)] ) {
+        [strongDelegate pathMTUDiscovery:self didFailWithError:error];
+    }
+}
+
+/*! Stops the object and tells the delegate the path MTU.
+ *  \details Called once the range of sizes in doubt is empty.  If nothing at all was
+ *      answered, not even the minimum MTU, the host just doesn't answer pings.
+ */
+
+- (void)finish {
+    id<SimplePingPathMTUDiscoveryDelegate>  strongDelegate;
+
+    if (self->_lowMTU < self->_minimumMTU) {
+        [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:ETIMEDOUT userInfo:nil]];
+        return;
+    }
+
+    CFAutorelease(CFBridgingRetain(self));
+
+    self.pathMTU = self->_lowMTU;
+    [self stop];
+    strongDelegate = self.delegate;
+    if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(pathMTUDiscovery:didFindPathMTU:)] ) {
+        [strongDelegate pathMTUDiscovery:self didFindPathMTU:self.pathMTU];
+    }
+}
+
+#pragma mark * Probes
+
+/*! Returns the slot of the probe in flight with a sequence number.
+ *  \param sequenceNumber The sequence number.
+ *  \returns The slot, or NULL if no such probe is in flight.
+ */
+
+- (nullable PathMTUProbe *)probeWithSequenceNumber:(uint16_t)sequenceNumber {
+    NSUInteger      slotIndex;
+
+    for (slotIndex = 0; slotIndex < self->_probeSlotCount; slotIndex++) {
+        if ( (self->_probes[slotIndex].token != 0) && (self->_probes[slotIndex].sequenceNumber == sequenceNumber) ) {
+            return &self->_probes[slotIndex];
+        }
+    }
+    return NULL;
+}
+
+/*! Returns the number of probes in flight.
+ */
+
+- (NSUInteger)activeProbeCount {
+    NSUInteger      slotIndex;
+    NSUInteger      result;
+
+    result = 0;
+    for (slotIndex = 0; slotIndex < self->_probeSlotCount; slotIndex++) {
+        if (self->_probes[slotIndex].token != 0) {
+            result += 1;
+        }
+    }
+    return result;
+}
+
+/*! Sends, or sends again, the probe in a slot.
+ *  \details The slot is filled in before the ping is sent, since a send that fails calls
+ *      back before `-sendPingWithData:` returns.  A reply to an earlier attempt, arriving
+ *      after this one is sent, is ignored.
+ *  \param probe The probe's slot, with its size set.
+ */
+
+- (void)sendProbe:(PathMTUProbe *)probe {
+    SimplePing *    pinger;
+
+    pinger = self.pinger;
+    probe->sequenceNumber = pinger.nextSequenceNumber;
+    probe->token          = [self.timeoutWheel addTimeoutForKey:probe->sequenceNumber client:self.timeoutWheelClient afterInterval:self.timeout];
+    probe->attemptCount  += 1;
+    self.probeCount += 1;
+
+    [pinger sendPingWithData:[NSData dataWithBytesNoCopy:self.payloadBuffer.mutableBytes length:probe->size - self->_headerLength freeWhenDone:NO]];
+}
+
+/*! Sends a probe of a new size.
+ *  \param size The size of the probe, IP header included.
+ */
+
+- (void)sendProbeOfSize:(NSUInteger)size {
+    PathMTUProbe *  probe;
+    NSUInteger      slotIndex;
+
+    probe = NULL;
+    for (slotIndex = 0; slotIndex < self->_probeSlotCount; slotIndex++) {
+        if (self->_probes[slotIndex].token == 0) {
+            probe = &self->_probes[slotIndex];
+            break;
+        }
+    }
+    assert(probe != NULL);
+
+    probe->size         = size;
+    probe->attemptCount = 0;
+    [self sendProbe:probe];
+}
+
+/*! Sends a round of probes, spread evenly over the sizes still in doubt.
+ *  \details The sizes are `_lowMTU + ceil((_highMTU - _lowMTU) * i / n)` for i from n down
+ *      to 1, so the largest always goes first and is `_highMTU` itself.  A probe that fails
+ *      to send narrows the range straight away, so the rest are checked against it as they
+ *      go.
+ */
+
+- (void)sendRound {
+    NSUInteger      sizeCount;
+    NSUInteger      sizeIndex;
+    NSUInteger      range;
+    NSUInteger      size;
+
+    range = self->_highMTU - self->_lowMTU;
+    sizeCount = MIN(self->_probeSlotCount, range);
+    self.roundCount += 1;
+
+    self.sending = YES;
+    for (sizeIndex = sizeCount; sizeIndex >= 1; sizeIndex--) {
+        if (self.pinger == nil) {
+            break;
+        }
+        size = self->_lowMTU + ((range * sizeIndex) + sizeCount - 1) / sizeCount;
+        if ( (size > self->_lowMTU) && (size <= self->_highMTU) && ([self activeProbeCount] < self->_probeSlotCount) ) {
+            [self sendProbeOfSize:size];
+        }
+    }
+    self.sending = NO;
+}
+
+/*! Starts the next round, or finishes, once no probe in flight can narrow the range.
+ */
+
+- (void)advance {
+    if (self.sending) {
+        return;
+    }
+    while ( (self.pinger != nil) && ([self activeProbeCount] == 0) ) {
+        if (self->_lowMTU >= self->_highMTU) {
+            [self finish];
+            return;
+        }
+        [self sendRound];
+    }
+}
+
+/*! Records the result of a probe and narrows the range of sizes in doubt.
+ *  \details Probes still in flight whose sizes fall outside the new range can no longer
+ *      tell us anything, so they're forgotten.
+ *  \param probe The probe's slot; it's freed.
+ *  \param fits YES if it was answered.
+ *  \param reportedMTU The next-hop MTU from a router's error, or 0.
+ */
+
+- (void)resolveProbe:(PathMTUProbe *)probe fits:(BOOL)fits reportedMTU:(NSUInteger)reportedMTU {
+    id<SimplePingPathMTUDiscoveryDelegate>  strongDelegate;
+    NSUInteger                              size;
+    NSUInteger                              slotIndex;
+
+    size = probe->size;
+    (void) [self.timeoutWheel cancelTimeout:probe->token];
+    probe->token = 0;
+
+    if (fits) {
+        self->_lowMTU = MAX(self->_lowMTU, size);
+    } else {
+        self->_highMTU = MIN(self->_highMTU, size - 1);
+
+        // A router that says how big its next hop is saves us searching for it, unless
+        // what it says contradicts a reply we already have.
+
+        if ( (reportedMTU > self->_lowMTU) && (reportedMTU < self->_highMTU) ) {
+            self->_highMTU = reportedMTU;
+        }
+    }
+    self->_highMTU = MAX(self->_highMTU, self->_lowMTU);
+
+    for (slotIndex = 0; slotIndex < self->_probeSlotCount; slotIndex++) {
+        if ( (self->_probes[slotIndex].token != 0) && ((self->_probes[slotIndex].size <= self->_lowMTU) || (self->_probes[slotIndex].size > self->_highMTU)) ) {
+            (void) [self.timeoutWheel cancelTimeout:self->_probes[slotIndex].token];
+            self->_probes[slotIndex].token = 0;
+        }
+    }
+
+    strongDelegate = self.delegate;
+    if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(pathMTUDiscovery:didProbeSize:fits:reportedMTU:)] ) {
+        [strongDelegate pathMTUDiscovery:self didProbeSize:size fits:fits reportedMTU:reportedMTU];
+    }
+}
+
+/*! Timer wheel callback; a probe that isn't answered in time is sent again, and counts as
+ *  too big once `kSimplePingPathMTUMaximumAttempts` have gone unanswered.
+ *  \details Resends are covered by `sending`, as a send that fails resolves its probe
+ *      before we're done with the keys.
+ *  \param keys The sequence numbers of the probes.
+ *  \param count The number of keys.
+ */
+
+- (void)probesTimedOut:(const uint64_t *)keys count:(NSUInteger)count {
+    NSUInteger      keyIndex;
+    PathMTUProbe *  probe;
+
+    self.sending = YES;
+    for (keyIndex = 0; keyIndex < count; keyIndex++) {
+        if (self.pinger == nil) {
+            break;
+        }
+        probe = [self probeWithSequenceNumber:(uint16_t) keys[keyIndex]];
+        if (probe == NULL) {
+            continue;
+        }
+        if (probe->attemptCount < kSimplePingPathMTUMaximumAttempts) {
+            [self sendProbe:probe];
+        } else {
+            [self resolveProbe:probe fits:NO reportedMTU:0];
+        }
+    }
+    self.sending = NO;
+    [self advance];
+}
+
+#pragma mark * SimplePingDelegate
+
+- (void)simplePing:(SimplePing *)pinger didStartWithAddress:(NSData *)address {
+    id<SimplePingPathMTUDiscoveryDelegate>  strongDelegate;
+
+    // Nothing is known to fit yet, not even the minimum.
+
+    if (pinger.hostAddressFamily == AF_INET) {
+        self->_minimumMTU   = kPathMTUMinimum4;
+        self->_headerLength = kPathMTUHeaderLength4;
+    } else {
+        self->_minimumMTU   = kPathMTUMinimum6;
+        self->_headerLength = kPathMTUHeaderLength6;
+    }
+    self->_lowMTU  = self->_minimumMTU - 1;
+    self->_highMTU = MAX(self.maximumMTU, self->_minimumMTU);
+    self.payloadBuffer = [NSMutableData dataWithLength:self->_highMTU - self->_headerLength];
+    assert(self.payloadBuffer != nil);
+    self.hostAddress = address;
+
+    strongDelegate = self.delegate;
+    if ( (strongDelegate != nil) && [strongDelegate respondsToSelector:@selector(pathMTUDiscovery:didStartWithAddress:)] ) {
+        [strongDelegate pathMTUDiscovery:self didStartWithAddress:address];
+    }
+    [self advance];
+}
+
+- (void)simplePing:(SimplePing *)pinger didFailWithError:(NSError *)error {
+    #pragma unused(pinger)
+    [self didFailWithError:error];
+}
+
+- (void)simplePing:(SimplePing *)pinger didSendPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber {
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    #pragma unused(sequenceNumber)
+}
+
+- (void)simplePing:(SimplePing *)pinger didFailToSendPacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber error:(NSError *)error {
+    PathMTUProbe *  probe;
+
+    #pragma unused(pinger)
+    #pragma unused(packet)
+
+    // EMSGSIZE means it's too big for our own interface, which is as good an answer as
+    // any router's.  Anything else means we can't probe at all.
+
+    if ( [error.domain isEqual:NSPOSIXErrorDomain] && (error.code == EMSGSIZE) ) {
+        probe = [self probeWithSequenceNumber:sequenceNumber];
+        if (probe != NULL) {
+            [self resolveProbe:probe fits:NO reportedMTU:0];
+        }
+        [self advance];
+    } else {
+        [self didFailWithError:error];
+    }
+}
+
+- (void)simplePing:(SimplePing *)pinger didReceivePingResponsePacket:(NSData *)packet sequenceNumber:(uint16_t)sequenceNumber {
+    PathMTUProbe *  probe;
+
+    #pragma unused(pinger)
+    #pragma unused(packet)
+    probe = [self probeWithSequenceNumber:sequenceNumber];
+    if (probe != NULL) {
+        [self resolveProbe:probe fits:YES reportedMTU:0];
+        [self advance];
+    }
+}
+
+- (void)simplePing:(SimplePing *)pinger didReceiveUnexpectedPacket:(NSData *)packet {
+    uint16_t        sequenceNumber;
+    uint32_t        reportedMTU;
+    PathMTUProbe *  probe;
+
+    if ( PathMTUParseTooBig(packet.bytes, packet.length, pinger.hostAddressFamily, pinger.identifier, &sequenceNumber, &reportedMTU) ) {
+        probe = [self probeWithSequenceNumber:sequenceNumber];
+        if (probe != NULL) {
+            [self resolveProbe:probe fits:NO reportedMTU:reportedMTU];
+            [self advance];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,51 @@
+/*
+    Abstract:
+    A token bucket that paces ICMP sends, shareable across instances and threads.
+ */
+
+#import "SimplePingRateLimiter.h"
+#import "SimplePingTiming.h"
+
+#include <os/lock.h>
+
+@implementation SimplePingRateLimiter {
+    os_unfair_lock  _lock;
+    uint64_t        _emissionInterval;      ///< nanoseconds per token
+    uint64_t        _burstTolerance;        ///< how far ahead of the rate a burst may run, in nanoseconds
+    uint64_t        _theoreticalArrivalTime;    ///< when the bucket will next be full; protected by _lock
+}
+
+- (instancetype)initWithRate:(double)packetsPerSecond burst:(NSUInteger)burst {
+    NSParameterAssert(packetsPerSecond > 0.0);
+    NSParameterAssert(burst >= 1);
+    self = [super init];
+    if (self != nil) {
+        self->_packetsPerSecond = packetsPerSecond;
+        self->_burst            = MAX(burst, (NSUInteger) 1);
+        self->_lock             = OS_UNFAIR_LOCK_INIT;
+        self->_emissionInterval = (uint64_t) (NSEC_PER_SEC / packetsPerSecond);
+        self->_burstTolerance   = (uint64_t) (self->_burst - 1) * self->_emissionInterval;
+    }
+    return self;
+}
+
+- (NSTimeInterval)reservePacket {
+    uint64_t    now;
+    uint64_t    arrival;
+    uint64_t    sendTime;
+
+    // This is the token bucket expressed as a virtual schedule (GCRA): the bucket is 
+    // empty once the schedule runs more than a burst ahead of now.  Each reservation 
+    // pushes the schedule one emission interval further out.
+    
+    now = SimplePingMonotonicNanoseconds();
+    os_unfair_lock_lock(&self->_lock);
+    arrival = MAX(self->_theoreticalArrivalTime, now);
+    sendTime = (arrival - now > self->_burstTolerance) ? arrival - self->_burstTolerance : now;
+    self->_theoreticalArrivalTime = arrival + self->_emissionInterval;
+    os_unfair_lock_unlock(&self->_lock);
+    
+    return (NSTimeInterval) (sendTime - now) / NSEC_PER_SEC;
+}
+
+@end
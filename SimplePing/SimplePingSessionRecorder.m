@@ -0,0 +1,116 @@
+/*
+    Abstract:
+    Records every probe of the pingers and traceroutes given it to a compact binary file, shareable across instances and threads.
+ */
+
+#import "SimplePingSessionRecorder.h"
+#import "SimplePingLog.h"
+
+#include <os/lock.h>
+#include <string.h>
+
+@interface SimplePingSessionRecorder ()
+
+@property (atomic, copy, readwrite, nullable) NSError * error;
+
+@end
+
+@implementation SimplePingSessionRecorder {
+    os_unfair_lock              _lock;
+    SimplePingSessionWriter *   _writer;            ///< NULL once closed, or after an error; protected by _lock
+    uint64_t                    _recordCount;       ///< protected by _lock
+}
+
+- (nullable instancetype)initWithPath:(NSString *)path error:(NSError **)errorPtr {
+    SimplePingSessionWriter *   writer;
+    int                         err;
+
+    err = SimplePingSessionWriterOpen(path.fileSystemRepresentation, &writer);
+    if (err != 0) {
+        if (errorPtr != NULL) {
+            *errorPtr = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{ NSFilePathErrorKey : path }];
+        }
+        return nil;
+    }
+    self = [super init];
+    if (self != nil) {
+        self->_path   = [path copy];
+        self->_lock   = OS_UNFAIR_LOCK_INIT;
+        self->_writer = writer;
+    } else {
+        (void) SimplePingSessionWriterClose(writer);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    (void) SimplePingSessionWriterClose(self->_writer);
+}
+
+- (uint64_t)recordCount {
+    uint64_t    result;
+
+    os_unfair_lock_lock(&self->_lock);
+    result = self->_recordCount;
+    os_unfair_lock_unlock(&self->_lock);
+    return result;
+}
+
+/*! Gives up on the file after an error.
+ *  \details Called with the lock held.
+ */
+
+- (void)failWithError:(int)err {
+    (void) SimplePingSessionWriterClose(self->_writer);
+    self->_writer = NULL;
+    self.error = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{ NSFilePathErrorKey : self.path }];
+    SimplePingLogError(SimplePingLogCategoryPing, "Session recording to %{public}s stopped: %{public}s", self.path.fileSystemRepresentation, strerror(err));
+}
+
+- (BOOL)appendRecord:(const SimplePingSessionRecord *)record {
+    BOOL    result;
+    int     err;
+
+    result = NO;
+    os_unfair_lock_lock(&self->_lock);
+    if (self->_writer != NULL) {
+        err = SimplePingSessionWriterAppend(self->_writer, record);
+        if (err == 0) {
+            self->_recordCount += 1;
+            result = YES;
+        } else {
+            [self failWithError:err];
+        }
+    }
+    os_unfair_lock_unlock(&self->_lock);
+    return result;
+}
+
+- (void)synchronize {
+    int     err;
+
+    os_unfair_lock_lock(&self->_lock);
+    if (self->_writer != NULL) {
+        err = SimplePingSessionWriterSync(self->_writer);
+        if (err != 0) {
+            [self failWithError:err];
+        }
+    }
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+- (void)close {
+    int     err;
+
+    os_unfair_lock_lock(&self->_lock);
+    if (self->_writer != NULL) {
+        err = SimplePingSessionWriterClose(self->_writer);
+        self->_writer = NULL;
+        if (err != 0) {
+            self.error = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{ NSFilePathErrorKey : self.path }];
+        }
+    }
+    os_unfair_lock_unlock(&self->_lock);
+}
+
+@end
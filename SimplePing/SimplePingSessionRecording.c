@@ -0,0 +1,462 @@
+/*
+    Abstract:
+    A compact binary recording of ping and traceroute probes, written to a memory-mapped, append-only file and read back for replay.
+ */
+
+#include "SimplePingSessionRecording.h"
+#include "SimplePingTiming.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+_Static_assert(sizeof(SimplePingSessionRecord) == 256, "records are 256 bytes");
+_Static_assert(offsetof(SimplePingSessionRecord, kind) == 24, "the index block's kind is at the same offset");
+
+/*
+    A recording is a sequence of 256 byte slots.  The first holds the header; after it come
+    groups of kSimplePingSessionIndexInterval records, each followed by an index block
+    describing it.  Record N is therefore always at slot 1 + N + N / interval.  Slots past
+    the last record, up to the end of the file, are zero until a record fills them.
+ */
+
+enum {
+    kSimplePingSessionSlotSize      = 256,
+    kSimplePingSessionIndexInterval = 1023,
+    kSimplePingSessionVersion       = 1,
+    kSimplePingSessionRecordKindIndex = 0xFF
+};
+
+/*! How much of the file a writer maps at once; a multiple of every page size.
+ */
+
+static const size_t kSimplePingSessionChunkSize = 1024 * 1024;
+
+static const uint8_t kSimplePingSessionMagic[8] = { 'S', 'P', 'S', 'E', 'S', 'S', 'N', '\n' };
+
+/*! The first slot of a recording.
+ */
+
+struct SimplePingSessionHeader {
+    uint8_t     magic[8];
+    uint32_t    version;
+    uint32_t    slotSize;
+    uint32_t    indexInterval;
+    uint32_t    reserved;
+    uint64_t    recordCount;                    ///< Records known to be complete; a reader looks for more after them.
+    uint64_t    startMonotonicNanoseconds;
+    uint64_t    startWallNanoseconds;
+};
+typedef struct SimplePingSessionHeader SimplePingSessionHeader;
+
+/*! The slot after each group of records.
+ */
+
+struct SimplePingSessionIndexBlock {
+    uint64_t    firstTimestamp;
+    uint64_t    lastTimestamp;                  ///< The latest timestamp in the group, which a search compares against.
+    uint32_t    recordCount;
+    uint32_t    reserved0;
+    uint8_t     kind;                           ///< kSimplePingSessionRecordKindIndex, where a record has its kind.
+    uint8_t     reserved1[7];
+    uint64_t    firstRecordIndex;
+};
+typedef struct SimplePingSessionIndexBlock SimplePingSessionIndexBlock;
+
+_Static_assert(offsetof(SimplePingSessionIndexBlock, kind) == offsetof(SimplePingSessionRecord, kind), "index blocks and records share a kind field");
+
+/*! Returns the slot of a record.
+ */
+
+static uint64_t SimplePingSessionSlotOfRecord(uint64_t index) {
+    return 1 + index + (index / kSimplePingSessionIndexInterval);
+}
+
+#pragma mark * Records
+
+void SimplePingSessionRecordInit(SimplePingSessionRecord * record, uint8_t kind, uint32_t targetIdentifier, uint64_t timestamp) {
+    memset(record, 0, sizeof(*record));
+    record->kind = kind;
+    record->targetIdentifier = targetIdentifier;
+    record->timestamp = timestamp;
+}
+
+void SimplePingSessionRecordSetPacket(SimplePingSessionRecord * record, const void * bytes, size_t length, int family) {
+    const uint8_t * packet;
+    size_t          icmpOffset;
+
+    packet = bytes;
+    record->packetLength = (uint16_t) ((length > UINT16_MAX) ? UINT16_MAX : length);
+    record->capturedLength = (uint8_t) ((length > kSimplePingSessionRecordPacketCapacity) ? kSimplePingSessionRecordPacketCapacity : length);
+    memcpy(record->packet, packet, record->capturedLength);
+
+    // ICMPv4 comes with its IP header in front
+    icmpOffset = 0;
+    if ( (family == AF_INET) && (length > 0) && ((packet[0] & 0xF0) == 0x40) ) {
+        icmpOffset = (size_t) (packet[0] & 0x0F) * sizeof(uint32_t);
+    }
+    if (length >= (icmpOffset + 2)) {
+        record->icmpType = packet[icmpOffset];
+        record->icmpCode = packet[icmpOffset + 1];
+    }
+}
+
+void SimplePingSessionRecordSetResponder(SimplePingSessionRecord * record, const struct sockaddr * address, socklen_t addressLength) {
+    if ( (address->sa_family == AF_INET) && (addressLength >= sizeof(struct sockaddr_in)) ) {
+        memcpy(record->responderAddress, &((const struct sockaddr_in *) address)->sin_addr, sizeof(struct in_addr));
+        record->addressFamily = AF_INET;
+    } else if ( (address->sa_family == AF_INET6) && (addressLength >= sizeof(struct sockaddr_in6)) ) {
+        memcpy(record->responderAddress, &((const struct sockaddr_in6 *) address)->sin6_addr, sizeof(struct in6_addr));
+        record->addressFamily = AF_INET6;
+    }
+}
+
+socklen_t SimplePingSessionRecordGetResponder(const SimplePingSessionRecord * record, struct sockaddr_storage * address) {
+    memset(address, 0, sizeof(*address));
+    switch (record->addressFamily) {
+        case AF_INET: {
+            struct sockaddr_in *    address4;
+
+            address4 = (struct sockaddr_in *) address;
+            #if defined(__APPLE__)
+                address4->sin_len = sizeof(*address4);
+            #endif
+            address4->sin_family = AF_INET;
+            memcpy(&address4->sin_addr, record->responderAddress, sizeof(struct in_addr));
+            return sizeof(*address4);
+        }
+        case AF_INET6: {
+            struct sockaddr_in6 *   address6;
+
+            address6 = (struct sockaddr_in6 *) address;
+            #if defined(__APPLE__)
+                address6->sin6_len = sizeof(*address6);
+            #endif
+            address6->sin6_family = AF_INET6;
+            memcpy(&address6->sin6_addr, record->responderAddress, sizeof(struct in6_addr));
+            return sizeof(*address6);
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+#pragma mark * Writing
+
+struct SimplePingSessionWriter {
+    int                     fd;
+    uint8_t *               chunk;                  ///< The mapped chunk, or NULL.
+    uint64_t                chunkIndex;             ///< Which chunk of the file that is.
+    uint64_t                nextSlot;
+    uint64_t                recordCount;
+    SimplePingSessionHeader header;
+    SimplePingSessionIndexBlock index;              ///< The group being filled.
+};
+
+/*! Writes the header, with the current record count.
+ */
+
+static int SimplePingSessionWriterWriteHeader(SimplePingSessionWriter * writer) {
+    writer->header.recordCount = writer->recordCount;
+    if (pwrite(writer->fd, &writer->header, sizeof(writer->header), 0) != (ssize_t) sizeof(writer->header)) {
+        return (errno != 0) ? errno : EIO;
+    }
+    return 0;
+}
+
+/*! Returns where a slot is in memory, mapping its chunk, and growing the file, as needed.
+ */
+
+static uint8_t * SimplePingSessionWriterSlot(SimplePingSessionWriter * writer, uint64_t slot, int * errorPtr) {
+    uint64_t    offset;
+    uint64_t    chunkIndex;
+    void *      chunk;
+
+    offset = slot * kSimplePingSessionSlotSize;
+    chunkIndex = offset / kSimplePingSessionChunkSize;
+    if ( (writer->chunk == NULL) || (chunkIndex != writer->chunkIndex) ) {
+        if (writer->chunk != NULL) {
+            (void) munmap(writer->chunk, kSimplePingSessionChunkSize);
+            writer->chunk = NULL;
+        }
+
+        // Slots are only ever appended, so the file only grows here
+        if (ftruncate(writer->fd, (off_t) ((chunkIndex + 1) * kSimplePingSessionChunkSize)) != 0) {
+            *errorPtr = errno;
+            return NULL;
+        }
+        chunk = mmap(NULL, kSimplePingSessionChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, (off_t) (chunkIndex * kSimplePingSessionChunkSize));
+        if (chunk == MAP_FAILED) {
+            *errorPtr = errno;
+            return NULL;
+        }
+        writer->chunk = chunk;
+        writer->chunkIndex = chunkIndex;
+    }
+    return writer->chunk + (offset - (chunkIndex * kSimplePingSessionChunkSize));
+}
+
+int SimplePingSessionWriterOpen(const char * path, SimplePingSessionWriter ** writerPtr) {
+    SimplePingSessionWriter *   writer;
+    struct timespec             now;
+    int                         err;
+
+    *writerPtr = NULL;
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        return ENOMEM;
+    }
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        err = errno;
+        free(writer);
+        return err;
+    }
+
+    memcpy(writer->header.magic, kSimplePingSessionMagic, sizeof(writer->header.magic));
+    writer->header.version = kSimplePingSessionVersion;
+    writer->header.slotSize = kSimplePingSessionSlotSize;
+    writer->header.indexInterval = kSimplePingSessionIndexInterval;
+    writer->header.startMonotonicNanoseconds = SimplePingMonotonicNanoseconds();
+    if (clock_gettime(CLOCK_REALTIME, &now) == 0) {
+        writer->header.startWallNanoseconds = ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+    }
+    writer->nextSlot = 1;
+
+    // Map the first chunk now, so that a bad path or a full disk shows up here
+    err = 0;
+    if ( (SimplePingSessionWriterSlot(writer, 0, &err) == NULL) || ((err = SimplePingSessionWriterWriteHeader(writer)) != 0) ) {
+        (void) SimplePingSessionWriterClose(writer);
+        return err;
+    }
+    *writerPtr = writer;
+    return 0;
+}
+
+int SimplePingSessionWriterAppend(SimplePingSessionWriter * writer, const SimplePingSessionRecord * record) {
+    uint8_t *   slot;
+    int         err;
+
+    assert( (record->kind == SimplePingSessionRecordKindPing) || (record->kind == SimplePingSessionRecordKindTraceroute) );
+
+    // 1. Copy the record in
+    err = 0;
+    slot = SimplePingSessionWriterSlot(writer, writer->nextSlot, &err);
+    if (slot == NULL) {
+        return err;
+    }
+    memcpy(slot, record, sizeof(*record));
+    writer->nextSlot += 1;
+
+    if (writer->index.recordCount == 0) {
+        writer->index.firstTimestamp = record->timestamp;
+        writer->index.firstRecordIndex = writer->recordCount;
+        writer->index.lastTimestamp = record->timestamp;
+    } else if (record->timestamp > writer->index.lastTimestamp) {
+        writer->index.lastTimestamp = record->timestamp;
+    }
+    writer->index.recordCount += 1;
+    writer->recordCount += 1;
+
+    // 2. Close a full group with its index block, and bring the header up to date
+    if (writer->index.recordCount == kSimplePingSessionIndexInterval) {
+        slot = SimplePingSessionWriterSlot(writer, writer->nextSlot, &err);
+        if (slot == NULL) {
+            return err;
+        }
+        writer->index.kind = kSimplePingSessionRecordKindIndex;
+        memcpy(slot, &writer->index, sizeof(writer->index));
+        writer->nextSlot += 1;
+        memset(&writer->index, 0, sizeof(writer->index));
+        return SimplePingSessionWriterWriteHeader(writer);
+    }
+    return 0;
+}
+
+uint64_t SimplePingSessionWriterRecordCount(const SimplePingSessionWriter * writer) {
+    return writer->recordCount;
+}
+
+int SimplePingSessionWriterSync(SimplePingSessionWriter * writer) {
+    int     err;
+
+    if ( (writer->chunk != NULL) && (msync(writer->chunk, kSimplePingSessionChunkSize, MS_SYNC) != 0) ) {
+        return errno;
+    }
+    err = SimplePingSessionWriterWriteHeader(writer);
+    if ( (err == 0) && (fsync(writer->fd) != 0) ) {
+        err = errno;
+    }
+    return err;
+}
+
+int SimplePingSessionWriterClose(SimplePingSessionWriter * writer) {
+    int     err;
+
+    if (writer == NULL) {
+        return 0;
+    }
+    err = 0;
+    if (writer->chunk != NULL) {
+        (void) munmap(writer->chunk, kSimplePingSessionChunkSize);
+    }
+    if (writer->fd >= 0) {
+        if (writer->nextSlot > 0) {
+            if (ftruncate(writer->fd, (off_t) (writer->nextSlot * kSimplePingSessionSlotSize)) != 0) {
+                err = errno;
+            }
+            if (err == 0) {
+                err = SimplePingSessionWriterWriteHeader(writer);
+            }
+        }
+        if ( (close(writer->fd) != 0) && (err == 0) ) {
+            err = errno;
+        }
+    }
+    free(writer);
+    return err;
+}
+
+#pragma mark * Reading
+
+struct SimplePingSessionReader {
+    const uint8_t *         bytes;
+    size_t                  length;
+    uint64_t                recordCount;
+    SimplePingSessionHeader header;
+};
+
+int SimplePingSessionReaderOpen(const char * path, SimplePingSessionReader ** readerPtr) {
+    SimplePingSessionReader *   reader;
+    struct stat                 status;
+    void *                      bytes;
+    uint64_t                    slotCount;
+    uint64_t                    maximumCount;
+    uint64_t                    slot;
+    uint8_t                     kind;
+    int                         fd;
+    int                         err;
+
+    *readerPtr = NULL;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &status) != 0) {
+        err = errno;
+        (void) close(fd);
+        return err;
+    }
+    if ((size_t) status.st_size < kSimplePingSessionSlotSize) {
+        (void) close(fd);
+        return EFTYPE;
+    }
+
+    // The mapping lasts after the descriptor is closed
+    bytes = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    (void) close(fd);
+    if (bytes == MAP_FAILED) {
+        return err;
+    }
+    reader = calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        (void) munmap(bytes, (size_t) status.st_size);
+        return ENOMEM;
+    }
+    reader->bytes = bytes;
+    reader->length = (size_t) status.st_size;
+    memcpy(&reader->header, bytes, sizeof(reader->header));
+    if ( (memcmp(reader->header.magic, kSimplePingSessionMagic, sizeof(kSimplePingSessionMagic)) != 0)
+      || (reader->header.version != kSimplePingSessionVersion)
+      || (reader->header.slotSize != kSimplePingSessionSlotSize)
+      || (reader->header.indexInterval != kSimplePingSessionIndexInterval) ) {
+        SimplePingSessionReaderClose(reader);
+        return EFTYPE;
+    }
+
+    // The header is only brought up to date at each index block, so look for records
+    // after the ones it counts, up to the first empty slot.  A header that claims more
+    // than the file can hold is from a copy cut short.
+    slotCount = reader->length / kSimplePingSessionSlotSize;
+    maximumCount = (slotCount - 1) - ((slotCount - 1) / (kSimplePingSessionIndexInterval + 1));
+    reader->recordCount = (reader->header.recordCount < maximumCount) ? reader->header.recordCount : maximumCount;
+    while (reader->recordCount < maximumCount) {
+        slot = SimplePingSessionSlotOfRecord(reader->recordCount);
+        kind = ((const SimplePingSessionRecord *) (reader->bytes + (slot * kSimplePingSessionSlotSize)))->kind;
+        if ( (kind != SimplePingSessionRecordKindPing) && (kind != SimplePingSessionRecordKindTraceroute) ) {
+            break;
+        }
+        reader->recordCount += 1;
+    }
+
+    *readerPtr = reader;
+    return 0;
+}
+
+uint64_t SimplePingSessionReaderRecordCount(const SimplePingSessionReader * reader) {
+    return reader->recordCount;
+}
+
+const SimplePingSessionRecord * SimplePingSessionReaderRecordAtIndex(const SimplePingSessionReader * reader, uint64_t index) {
+    assert(index < reader->recordCount);
+    return (const SimplePingSessionRecord *) (reader->bytes + (SimplePingSessionSlotOfRecord(index) * kSimplePingSessionSlotSize));
+}
+
+uint64_t SimplePingSessionReaderIndexOfTimestamp(const SimplePingSessionReader * reader, uint64_t timestamp) {
+    uint64_t    groupCount;
+    uint64_t    low;
+    uint64_t    high;
+    uint64_t    index;
+
+    // 1. Find the first full group that reaches the time; every group after the last
+    // full one is the partial group at the end.
+    groupCount = reader->recordCount / kSimplePingSessionIndexInterval;
+    low = 0;
+    high = groupCount;
+    while (low < high) {
+        uint64_t                                middle;
+        const SimplePingSessionIndexBlock *     block;
+
+        middle = low + ((high - low) / 2);
+        block = (const SimplePingSessionIndexBlock *) (reader->bytes + (((middle + 1) * (kSimplePingSessionIndexInterval + 1)) * kSimplePingSessionSlotSize));
+        if (block->lastTimestamp < timestamp) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    // 2. Then look through it
+    for (index = low * kSimplePingSessionIndexInterval; index < reader->recordCount; index++) {
+        if (SimplePingSessionReaderRecordAtIndex(reader, index)->timestamp >= timestamp) {
+            return index;
+        }
+    }
+    return reader->recordCount;
+}
+
+void SimplePingSessionReaderGetStartTime(const SimplePingSessionReader * reader, uint64_t * monotonicNanoseconds, uint64_t * wallNanoseconds) {
+    if (monotonicNanoseconds != NULL) {
+        *monotonicNanoseconds = reader->header.startMonotonicNanoseconds;
+    }
+    if (wallNanoseconds != NULL) {
+        *wallNanoseconds = reader->header.startWallNanoseconds;
+    }
+}
+
+void SimplePingSessionReaderClose(SimplePingSessionReader * reader) {
+    if (reader == NULL) {
+        return;
+    }
+    (void) munmap((void *) reader->bytes, reader->length);
+    free(reader);
+}
@@ -0,0 +1,174 @@
+/*
+    Abstract:
+    Cheap rejection of other processes' ICMP traffic, in the kernel where possible and on the raw bytes otherwise.
+ */
+
+#include "SimplePingSocketFilter.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
+
+int SimplePingInstallICMPFilter(int fd, int family, unsigned int messages) {
+    struct icmp6_filter     filter;
+
+    if (family != AF_INET6) {
+        return EPROTONOSUPPORT;
+    }
+
+    ICMP6_FILTER_SETBLOCKALL(&filter);
+    if (messages & SimplePingICMPFilterEchoReplies) {
+        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+    }
+    if (messages & SimplePingICMPFilterTimeExceeded) {
+        ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED, &filter);
+    }
+    if (messages & SimplePingICMPFilterUnreachable) {
+        ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH, &filter);
+    }
+    if (messages & SimplePingICMPFilterOtherErrors) {
+        ICMP6_FILTER_SETPASS(ICMP6_PACKET_TOO_BIG, &filter);
+        ICMP6_FILTER_SETPASS(ICMP6_PARAM_PROB, &filter);
+    }
+    if (setsockopt(fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) != 0) {
+        return errno;
+    }
+    return 0;
+}
+
+/*! Reads a big endian 16-bit value, at any alignment.
+ */
+
+static uint16_t SimplePingReadBigEndian16(const uint8_t * bytes) {
+    return (uint16_t) ((bytes[0] << 8) | bytes[1]);
+}
+
+/*! Checks whether the packet quoted by an ICMPv4 error is certainly not one of our pings.
+ *  \param quoted The quoted IPv4 header and whatever of the datagram follows it.
+ *  \param length The length of that.
+ *  \param identifier Our ICMP identifier, in host byte order.
+ *  \returns true if the error can be discarded.
+ */
+
+static bool SimplePingQuoted4IsForeign(const uint8_t * quoted, size_t length, uint16_t identifier) {
+    size_t      headerLength;
+
+    if ( (length < sizeof(struct ip)) || ((quoted[0] & 0xF0) != 0x40) ) {
+        return false;
+    }
+    if (quoted[offsetof(struct ip, ip_p)] != IPPROTO_ICMP) {
+        return true;                                    // about someone's TCP or UDP
+    }
+    headerLength = (size_t) (quoted[0] & 0x0F) * sizeof(uint32_t);
+    if (length < (headerLength + 6)) {                  // type, code, checksum and identifier
+        return false;
+    }
+    return (quoted[headerLength] != ICMP_ECHO) || (SimplePingReadBigEndian16(quoted + headerLength + 4) != identifier);
+}
+
+/*! Checks whether an ICMPv4 packet, with its IP header, is certainly not about one of our pings.
+ */
+
+static bool SimplePingPacket4IsForeign(const uint8_t * bytes, size_t length, uint16_t identifier) {
+    size_t          headerLength;
+    const uint8_t * icmp;
+
+    if ( (length < sizeof(struct ip)) || ((bytes[0] & 0xF0) != 0x40) || (bytes[offsetof(struct ip, ip_p)] != IPPROTO_ICMP) ) {
+        return false;
+    }
+    headerLength = (size_t) (bytes[0] & 0x0F) * sizeof(uint32_t);
+    if (length < (headerLength + ICMP_MINLEN)) {
+        return false;
+    }
+    icmp = bytes + headerLength;
+    switch (icmp[0]) {
+        case ICMP_ECHOREPLY: {
+            return SimplePingReadBigEndian16(icmp + 4) != identifier;
+        }
+        case ICMP_UNREACH:
+        case ICMP_SOURCEQUENCH:
+        case ICMP_REDIRECT:
+        case ICMP_TIMXCEED:
+        case ICMP_PARAMPROB: {
+            return SimplePingQuoted4IsForeign(icmp + ICMP_MINLEN, length - headerLength - ICMP_MINLEN, identifier);
+        }
+        default: {
+            return true;
+        }
+    }
+}
+
+/*! Checks whether the packet quoted by an ICMPv6 error is certainly not one of our pings.
+ *  \param quoted The quoted IPv6 header and whatever of the datagram follows it.
+ *  \param length The length of that.
+ *  \param identifier Our ICMP identifier, in host byte order.
+ *  \returns true if the error can be discarded.
+ */
+
+static bool SimplePingQuoted6IsForeign(const uint8_t * quoted, size_t length, uint16_t identifier) {
+    const uint8_t * icmp;
+
+    if ( (length < sizeof(struct ip6_hdr)) || ((quoted[0] & 0xF0) != 0x60) ) {
+        return false;
+    }
+    switch (quoted[offsetof(struct ip6_hdr, ip6_nxt)]) {
+        case IPPROTO_ICMPV6: {
+            // handled below
+        } break;
+        case IPPROTO_HOPOPTS:
+        case IPPROTO_ROUTING:
+        case IPPROTO_FRAGMENT:
+        case IPPROTO_DSTOPTS: {
+            return false;                               // too odd to tell; leave it to validation
+        }
+        default: {
+            return true;                                // about someone's TCP or UDP
+        }
+    }
+    if (length < (sizeof(struct ip6_hdr) + 6)) {
+        return false;
+    }
+    icmp = quoted + sizeof(struct ip6_hdr);
+    return (icmp[0] != ICMP6_ECHO_REQUEST) || (SimplePingReadBigEndian16(icmp + 4) != identifier);
+}
+
+/*! Checks whether an ICMPv6 packet is certainly not about one of our pings.
+ */
+
+static bool SimplePingPacket6IsForeign(const uint8_t * bytes, size_t length, uint16_t identifier) {
+    if (length < sizeof(struct icmp6_hdr)) {
+        return false;
+    }
+    switch (bytes[0]) {
+        case ICMP6_ECHO_REPLY: {
+            return SimplePingReadBigEndian16(bytes + 4) != identifier;
+        }
+        case ICMP6_DST_UNREACH:
+        case ICMP6_PACKET_TOO_BIG:
+        case ICMP6_TIME_EXCEEDED:
+        case ICMP6_PARAM_PROB: {
+            return SimplePingQuoted6IsForeign(bytes + sizeof(struct icmp6_hdr), length - sizeof(struct icmp6_hdr), identifier);
+        }
+        default: {
+            return true;
+        }
+    }
+}
+
+bool SimplePingPacketIsForeign(const uint8_t * bytes, size_t length, int family, uint16_t identifier) {
+    switch (family) {
+        case AF_INET: {
+            return SimplePingPacket4IsForeign(bytes, length, identifier);
+        }
+        case AF_INET6: {
+            return SimplePingPacket6IsForeign(bytes, length, identifier);
+        }
+        default: {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,470 @@
+/*
+    Abstract:
+    A hashed timer wheel that tracks a deadline per outstanding probe for many clients at once.
+ */
+
+#import "SimplePingTimeoutWheel.h"
+#import "SimplePingEventSources.h"
+#import "SimplePingTiming.h"
+
+#include <stdlib.h>
+
+enum {
+    kTimeoutWheelSlotCount      = 256,                  ///< must be a power of two
+    kTimeoutWheelSlotMask       = kTimeoutWheelSlotCount - 1,
+    kTimeoutWheelMinimumEntries = 64
+};
+
+static const uint32_t kTimeoutWheelNoEntry = UINT32_MAX;
+
+/*! One scheduled timeout, or a free entry.
+ *  \details Entries live in one array and are linked into the list of their slot, or into
+ *      the free list, by index, so that growing the array doesn't invalidate the links.
+ */
+
+typedef struct TimeoutWheelEntry {
+    uint64_t    deadline;
+    uint64_t    key;
+    uint32_t    client;             ///< 0 while the entry is free
+    uint32_t    generation;         ///< bumped each time the entry is freed, so stale tokens miss
+    uint32_t    slot;
+    uint32_t    prev;               ///< previous entry in the slot
+    uint32_t    next;               ///< next entry in the slot, or in the free list
+} TimeoutWheelEntry;
+
+/*! A timeout that expired during a tick, waiting to be passed to its client.
+ */
+
+typedef struct TimeoutWheelExpiry {
+    uint32_t    client;
+    uint32_t    order;              ///< position in the tick, to keep each client's keys in order
+    uint64_t    key;
+} TimeoutWheelExpiry;
+
+/*! Orders expiries by client, then by the order they expired in.
+ */
+
+static int TimeoutWheelExpiryCompare(const void * lhs, const void * rhs) {
+    const TimeoutWheelExpiry *  a = lhs;
+    const TimeoutWheelExpiry *  b = rhs;
+
+    if (a->client != b->client) {
+        return (a->client < b->client) ? -1 : 1;
+    }
+    return (a->order < b->order) ? -1 : (a->order > b->order);
+}
+
+@interface SimplePingTimeoutWheel ()
+
+@property (nonatomic, assign, readwrite) NSUInteger     count;
+
+- (void)tick;
+
+@end
+
+@implementation SimplePingTimeoutWheel {
+    dispatch_queue_t                                                _queue;
+    uint64_t                                                        _tickNanoseconds;
+    uint64_t                                                        _lastTick;              ///< last tick expired, valid while there are timeouts
+    uint64_t                                                        _armedTick;             ///< the tick _timer fires at, valid while it's running
+    SimplePingTimerSource *                                         _timer;                 ///< one-shot; nil while there are no timeouts
+
+    TimeoutWheelEntry *                                             _entries;
+    uint32_t                                                        _capacity;
+    uint32_t                                                        _freeHead;
+    uint32_t                                                        _slotHeads[kTimeoutWheelSlotCount];
+    uint32_t                                                        _slotTails[kTimeoutWheelSlotCount];
+
+    TimeoutWheelExpiry *                                            _expiries;              ///< scratch space for -tick
+    uint64_t *                                                      _expiredKeys;           ///< likewise
+    uint32_t                                                        _expiryCapacity;
+
+    NSMutableDictionary<NSNumber *, SimplePingTimeoutWheelHandler> * _handlers;             ///< by client identifier
+    uint32_t                                                        _lastClient;
+}
+
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval queue:(dispatch_queue_t)queue {
+    NSParameterAssert(tickInterval > 0.0);
+    self = [super init];
+    if (self != nil) {
+        self->_tickInterval    = tickInterval;
+        self->_queue           = queue;
+        self->_tickNanoseconds = MAX((uint64_t) (tickInterval * NSEC_PER_SEC), (uint64_t) 1);
+        self->_freeHead        = kTimeoutWheelNoEntry;
+        for (NSUInteger slot = 0; slot < kTimeoutWheelSlotCount; slot++) {
+            self->_slotHeads[slot] = kTimeoutWheelNoEntry;
+            self->_slotTails[slot] = kTimeoutWheelNoEntry;
+        }
+        self->_handlers        = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self->_timer invalidate];
+    free(self->_entries);
+    free(self->_expiries);
+    free(self->_expiredKeys);
+}
+
+#pragma mark * Clients
+
+- (NSUInteger)addClientWithHandler:(SimplePingTimeoutWheelHandler)handler {
+    NSParameterAssert(handler != nil);
+
+    // Identifiers aren't reused, so expiries collected for a client that's since gone can
+    // never reach a newer one.
+
+    self->_lastClient += 1;
+    if (self->_lastClient == 0) {
+        self->_lastClient = 1;
+    }
+    self->_handlers[@(self->_lastClient)] = [handler copy];
+    return self->_lastClient;
+}
+
+- (void)removeClient:(NSUInteger)client {
+    if (self->_handlers[@(client)] != nil) {
+        [self removeTimeoutsForClient:client];
+        [self->_handlers removeObjectForKey:@(client)];
+    }
+}
+
+#pragma mark * Entries
+
+/*! Takes an entry off the free list, growing the array if there are none.
+ *  \returns The index of the entry, or kTimeoutWheelNoEntry if memory ran out.
+ */
+
+- (uint32_t)allocateEntry {
+    uint32_t    index;
+
+    if (self->_freeHead == kTimeoutWheelNoEntry) {
+        TimeoutWheelEntry * entries;
+        uint32_t            newCapacity;
+
+        newCapacity = (self->_capacity == 0) ? kTimeoutWheelMinimumEntries : self->_capacity * 2;
+        if (newCapacity >= kTimeoutWheelNoEntry) {
+            return kTimeoutWheelNoEntry;
+        }
+        entries = realloc(self->_entries, newCapacity * sizeof(*entries));
+        if (entries == NULL) {
+            return kTimeoutWheelNoEntry;
+        }
+
+        // Thread the new entries onto the free list, lowest index first.
+
+        for (uint32_t i = newCapacity; i > self->_capacity; i--) {
+            entries[i - 1].client     = 0;
+            entries[i - 1].generation = 1;
+            entries[i - 1].next       = self->_freeHead;
+            self->_freeHead = i - 1;
+        }
+        self->_entries  = entries;
+        self->_capacity = newCapacity;
+    }
+
+    index = self->_freeHead;
+    self->_freeHead = self->_entries[index].next;
+    return index;
+}
+
+/*! Unlinks an entry from its slot and puts it back on the free list.
+ *  \param index The index of an entry that's in use.
+ */
+
+- (void)freeEntry:(uint32_t)index {
+    TimeoutWheelEntry * entry;
+
+    entry = &self->_entries[index];
+    assert(entry->client != 0);
+
+    if (entry->prev == kTimeoutWheelNoEntry) {
+        self->_slotHeads[entry->slot] = entry->next;
+    } else {
+        self->_entries[entry->prev].next = entry->next;
+    }
+    if (entry->next == kTimeoutWheelNoEntry) {
+        self->_slotTails[entry->slot] = entry->prev;
+    } else {
+        self->_entries[entry->next].prev = entry->prev;
+    }
+
+    entry->client      = 0;
+    entry->generation += 1;
+    if (entry->generation == 0) {
+        entry->generation = 1;
+    }
+    entry->next        = self->_freeHead;
+    self->_freeHead    = index;
+    self.count        -= 1;
+}
+
+#pragma mark * Timeouts
+
+/*! Returns the tick a deadline expires on.
+ *  \details That's the first tick at or after the deadline, but never one that's already
+ *      been expired.
+ */
+
+- (uint64_t)tickForDeadline:(uint64_t)deadline {
+    uint64_t    tick;
+
+    tick = (deadline / self->_tickNanoseconds) + ((deadline % self->_tickNanoseconds) != 0);
+    return MAX(tick, self->_lastTick + 1);
+}
+
+/*! Arms the timer to fire at a tick, replacing any timer already armed.
+ *  \details The timer may fire up to a tick late, so that the system can coalesce its
+ *      wakeup with others.
+ */
+
+- (void)armTimerForTick:(uint64_t)tick {
+    __weak SimplePingTimeoutWheel * weakSelf;
+    uint64_t                        now;
+    uint64_t                        fireTime;
+
+    [self->_timer invalidate];
+    now      = SimplePingMonotonicNanoseconds();
+    fireTime = tick * self->_tickNanoseconds;
+    weakSelf = self;
+    self->_armedTick = tick;
+    self->_timer = [[SimplePingTimerSource alloc] initWithInterval:(fireTime > now) ? (NSTimeInterval) (fireTime - now) / NSEC_PER_SEC : 0.0 leeway:self.tickInterval repeats:NO queue:self->_queue handler:^{
+        [weakSelf tick];
+    }];
+}
+
+- (SimplePingTimeoutToken)addTimeoutForKey:(uint64_t)key client:(NSUInteger)client deadline:(uint64_t)deadline {
+    TimeoutWheelEntry *             entry;
+    uint32_t                        index;
+    uint64_t                        tick;
+
+    NSParameterAssert(self->_handlers[@(client)] != nil);
+
+    // Ticks are counted from the epoch of the clock, so a deadline always lands in the
+    // same slot however long the wheel has been idle.
+
+    if (self.count == 0) {
+        self->_lastTick = SimplePingMonotonicNanoseconds() / self->_tickNanoseconds;
+    }
+
+    index = [self allocateEntry];
+    if (index == kTimeoutWheelNoEntry) {
+        return 0;
+    }
+    tick = [self tickForDeadline:deadline];
+
+    entry = &self->_entries[index];
+    entry->deadline = deadline;
+    entry->key      = key;
+    entry->client   = (uint32_t) client;
+    entry->slot     = (uint32_t) (tick & kTimeoutWheelSlotMask);
+    entry->prev     = self->_slotTails[entry->slot];
+    entry->next     = kTimeoutWheelNoEntry;
+    if (entry->prev == kTimeoutWheelNoEntry) {
+        self->_slotHeads[entry->slot] = index;
+    } else {
+        self->_entries[entry->prev].next = index;
+    }
+    self->_slotTails[entry->slot] = index;
+    self.count += 1;
+
+    // Wake for this one if it's due before whatever we were going to wake for.
+
+    if ( (self->_timer == nil) || (tick < self->_armedTick) ) {
+        [self armTimerForTick:tick];
+    }
+
+    return ((uint64_t) entry->generation << 32) | index;
+}
+
+- (SimplePingTimeoutToken)addTimeoutForKey:(uint64_t)key client:(NSUInteger)client afterInterval:(NSTimeInterval)interval {
+    return [self addTimeoutForKey:key client:client deadline:SimplePingMonotonicNanoseconds() + (uint64_t) (MAX(interval, 0.0) * NSEC_PER_SEC)];
+}
+
+- (BOOL)cancelTimeout:(SimplePingTimeoutToken)token {
+    uint32_t    index;
+    uint32_t    generation;
+
+    index      = (uint32_t) (token & UINT32_MAX);
+    generation = (uint32_t) (token >> 32);
+    if ( (token == 0) || (index >= self->_capacity) ) {
+        return NO;
+    }
+    if ( (self->_entries[index].client == 0) || (self->_entries[index].generation != generation) ) {
+        return NO;
+    }
+    [self freeEntry:index];
+    [self stopTimerIfIdle];
+    return YES;
+}
+
+- (void)removeTimeoutsForClient:(NSUInteger)client {
+    for (uint32_t index = 0; index < self->_capacity; index++) {
+        if (self->_entries[index].client == client) {
+            [self freeEntry:index];
+        }
+    }
+    [self stopTimerIfIdle];
+}
+
+/*! Stops the timer once there's nothing left to time out.
+ *  \details Cancelling the earliest timeout leaves the timer armed for it; the wakeup
+ *      then finds nothing due and re-arms for the next.  That costs at most one wakeup
+ *      per cancelled timeout, which is cheaper than finding the next one on every cancel.
+ */
+
+- (void)stopTimerIfIdle {
+    if ( (self.count == 0) && (self->_timer != nil) ) {
+        [self->_timer invalidate];
+        self->_timer = nil;
+    }
+}
+
+#pragma mark * Expiry
+
+/*! Returns the tick the earliest remaining timeout expires on.
+ *  \details Walks the slots in tick order from the last tick expired.  The first entry
+ *      due in the first revolution is the answer; failing that, the earliest of the
+ *      entries due in later revolutions is.  Call this only with timeouts outstanding.
+ */
+
+- (uint64_t)nextTimeoutTick {
+    uint64_t    result;
+
+    result = UINT64_MAX;
+    for (uint64_t i = 1; i <= kTimeoutWheelSlotCount; i++) {
+        uint32_t    index;
+
+        index = self->_slotHeads[(self->_lastTick + i) & kTimeoutWheelSlotMask];
+        while (index != kTimeoutWheelNoEntry) {
+            uint64_t    tick;
+
+            tick = [self tickForDeadline:self->_entries[index].deadline];
+            if (tick == self->_lastTick + i) {
+                return tick;
+            }
+            result = MIN(result, tick);
+            index = self->_entries[index].next;
+        }
+    }
+    return result;
+}
+
+/*! Makes room for one more expiry in the scratch space.
+ *  \param needed The number of expiries that must fit.
+ *  \returns NO if memory ran out.
+ */
+
+- (BOOL)reserveExpiries:(uint32_t)needed {
+    TimeoutWheelExpiry *    expiries;
+    uint64_t *              keys;
+    uint32_t                newCapacity;
+
+    if (needed <= self->_expiryCapacity) {
+        return YES;
+    }
+    newCapacity = MAX(self->_expiryCapacity * 2, (uint32_t) kTimeoutWheelMinimumEntries);
+    expiries = realloc(self->_expiries, newCapacity * sizeof(*expiries));
+    if (expiries == NULL) {
+        return NO;
+    }
+    self->_expiries = expiries;
+    keys = realloc(self->_expiredKeys, newCapacity * sizeof(*keys));
+    if (keys == NULL) {
+        return NO;
+    }
+    self->_expiredKeys    = keys;
+    self->_expiryCapacity = newCapacity;
+    return YES;
+}
+
+/*! Expires the slots of every tick since the last one, then calls each client once.
+ *  \details Called when the timer fires, at the tick of the earliest timeout.
+ */
+
+- (void)tick {
+    uint64_t    now;
+    uint64_t    currentTick;
+    uint64_t    ticks;
+    uint32_t    expiredCount;
+    uint32_t    runStart;
+
+    // 1. Walk the slots passed since the last tick.  If we're more than a revolution
+    //    behind, one pass over every slot catches everything.  Entries due on a later
+    //    revolution stay where they are.
+
+    now = SimplePingMonotonicNanoseconds();
+    currentTick = now / self->_tickNanoseconds;
+    ticks = MIN(currentTick - self->_lastTick, (uint64_t) kTimeoutWheelSlotCount);
+    expiredCount = 0;
+    for (uint64_t i = 1; i <= ticks; i++) {
+        uint32_t    slot;
+        uint32_t    index;
+
+        slot = (uint32_t) ((self->_lastTick + i) & kTimeoutWheelSlotMask);
+        index = self->_slotHeads[slot];
+        while (index != kTimeoutWheelNoEntry) {
+            TimeoutWheelEntry * entry;
+            uint32_t            next;
+
+            entry = &self->_entries[index];
+            next = entry->next;
+            if ( (entry->deadline <= now) && [self reserveExpiries:expiredCount + 1] ) {
+                self->_expiries[expiredCount].client = entry->client;
+                self->_expiries[expiredCount].order  = expiredCount;
+                self->_expiries[expiredCount].key    = entry->key;
+                expiredCount += 1;
+                [self freeEntry:index];
+            }
+            index = next;
+        }
+    }
+    self->_lastTick = currentTick;
+
+    // The timer has fired; handlers that schedule timeouts arm a new one.
+
+    [self->_timer invalidate];
+    self->_timer = nil;
+
+    // 2. Group the expiries by client and hand each client its keys in one call.  The
+    //    handlers are looked up as we go, as an earlier one may remove a later client.
+
+    if (expiredCount > 1) {
+        qsort(self->_expiries, expiredCount, sizeof(*self->_expiries), TimeoutWheelExpiryCompare);
+    }
+    for (uint32_t i = 0; i < expiredCount; i++) {
+        self->_expiredKeys[i] = self->_expiries[i].key;
+    }
+    runStart = 0;
+    while (runStart < expiredCount) {
+        SimplePingTimeoutWheelHandler   handler;
+        uint32_t                        client;
+        uint32_t                        runEnd;
+
+        client = self->_expiries[runStart].client;
+        runEnd = runStart + 1;
+        while ( (runEnd < expiredCount) && (self->_expiries[runEnd].client == client) ) {
+            runEnd += 1;
+        }
+        handler = self->_handlers[@(client)];
+        if (handler != nil) {
+            handler(&self->_expiredKeys[runStart], runEnd - runStart);
+        }
+        runStart = runEnd;
+    }
+
+    // 3. Wake for the next timeout, unless a handler already armed the timer for one
+    //    that's due sooner.
+
+    if (self.count != 0) {
+        uint64_t    nextTick;
+
+        nextTick = [self nextTimeoutTick];
+        if ( (self->_timer == nil) || (nextTick < self->_armedTick) ) {
+            [self armTimerForTick:nextTick];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,145 @@
+/*
+    Abstract:
+    Monotonic send and kernel receive timestamps for ping round trip times.
+ */
+
+#include "SimplePingTiming.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <mach/mach_time.h>
+
+/*! Converts mach_absolute_time ticks to nanoseconds.
+ */
+
+static uint64_t SimplePingNanosecondsFromMachTicks(uint64_t ticks) {
+    static mach_timebase_info_data_t    sTimebase;
+
+    // Racing initialisations all store the same value, so no locking is needed.
+
+    if (sTimebase.denom == 0) {
+        mach_timebase_info_data_t   timebase;
+
+        (void) mach_timebase_info(&timebase);
+        sTimebase = timebase;
+    }
+    if (sTimebase.numer == sTimebase.denom) {
+        return ticks;                                   // the common case on Intel
+    }
+    return (uint64_t) (((__uint128_t) ticks * sTimebase.numer) / sTimebase.denom);
+}
+
+uint64_t SimplePingMonotonicNanoseconds(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+uint64_t SimplePingTimingRoundTripNanoseconds(SimplePingTiming timing) {
+    if ( (timing.sendTime == 0) || (timing.kernelReceiveTime < timing.sendTime) ) {
+        return 0;
+    }
+    return timing.kernelReceiveTime - timing.sendTime;
+}
+
+uint64_t SimplePingTimingDeliveryDelayNanoseconds(SimplePingTiming timing) {
+    if (timing.userReceiveTime < timing.kernelReceiveTime) {
+        return 0;
+    }
+    return timing.userReceiveTime - timing.kernelReceiveTime;
+}
+
+int SimplePingEnableReceiveTimestamps(int fd) {
+    int     on;
+
+    on = 1;
+    #if defined(SO_TIMESTAMP_MONOTONIC)
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP_MONOTONIC, &on, sizeof(on)) == 0) {
+            return 0;
+        }
+    #endif
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) != 0) {
+        return errno;
+    }
+    return 0;
+}
+
+ssize_t SimplePingReceiveFrom(int fd, void * buffer, size_t bufferLength, int flags, struct sockaddr * address, socklen_t * addressLength, uint64_t * kernelReceiveTimePtr, uint64_t * userReceiveTimePtr) {
+    ssize_t             bytesRead;
+    struct iovec        iov;
+    struct msghdr       msg;
+    struct cmsghdr *    cmsg;
+    uint64_t            userReceiveTime;
+    uint64_t            kernelReceiveTime;
+    union {
+        struct cmsghdr  align;
+        uint8_t         bytes[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint64_t))];
+    }                   control;
+
+    iov.iov_base = buffer;
+    iov.iov_len  = bufferLength;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name       = address;
+    msg.msg_namelen    = (address != NULL) ? *addressLength : 0;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.bytes;
+    msg.msg_controllen = sizeof(control.bytes);
+
+    bytesRead = recvmsg(fd, &msg, flags);
+    userReceiveTime = SimplePingMonotonicNanoseconds();
+    if (bytesRead < 0) {
+        return bytesRead;
+    }
+    if (address != NULL) {
+        *addressLength = msg.msg_namelen;
+    }
+
+    // Find the kernel timestamp, if any.
+
+    kernelReceiveTime = userReceiveTime;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        #if defined(SCM_TIMESTAMP_MONOTONIC)
+            if ( (cmsg->cmsg_type == SCM_TIMESTAMP_MONOTONIC) && (cmsg->cmsg_len >= CMSG_LEN(sizeof(uint64_t))) ) {
+                uint64_t    ticks;
+
+                memcpy(&ticks, CMSG_DATA(cmsg), sizeof(ticks));
+                kernelReceiveTime = SimplePingNanosecondsFromMachTicks(ticks);
+                break;
+            }
+        #endif
+        if ( (cmsg->cmsg_type == SCM_TIMESTAMP) && (cmsg->cmsg_len >= CMSG_LEN(sizeof(struct timeval))) ) {
+            struct timeval  stamp;
+            struct timeval  now;
+            int64_t         ageNanoseconds;
+
+            // A wall clock stamp; it's only trustworthy as an age relative to the wall
+            // clock now, which we then apply to the monotonic clock.
+
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            (void) gettimeofday(&now, NULL);
+            ageNanoseconds = ((int64_t) now.tv_sec - (int64_t) stamp.tv_sec) * 1000000000 + ((int64_t) now.tv_usec - (int64_t) stamp.tv_usec) * 1000;
+            if ( (ageNanoseconds > 0) && ((uint64_t) ageNanoseconds < userReceiveTime) ) {
+                kernelReceiveTime = userReceiveTime - (uint64_t) ageNanoseconds;
+            }
+            break;
+        }
+    }
+
+    // Never report a kernel time after the user time, whatever the clocks say.
+
+    if (kernelReceiveTime > userReceiveTime) {
+        kernelReceiveTime = userReceiveTime;
+    }
+    if (kernelReceiveTimePtr != NULL) {
+        *kernelReceiveTimePtr = kernelReceiveTime;
+    }
+    if (userReceiveTimePtr != NULL) {
+        *userReceiveTimePtr = userReceiveTime;
+    }
+    return bytesRead;
+}
@@ -6,12 +6,22 @@
 @import Foundation;
 #import <sys/socket.h>
 #import "TracerouteTypes.h"
+#import "TracerouteInterfaceCache.h"
+#import "TracerouteReverseResolver.h"
 #import "../../SimplePing/Public/SimplePing.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @protocol SimpleTracerouteDelegate;
 
+/*! Controls how SimpleTraceroute walks the path to the target.
+ */
+typedef NS_ENUM(NSInteger, SimpleTracerouteProbeMode) {
+  SimpleTracerouteProbeModeSequential, ///< Probe one TTL at a time, waiting for each hop; the default.
+  SimpleTracerouteProbeModeParallel,   ///< Probe a window of TTLs at once, mtr-style.
+  SimpleTracerouteProbeModeMultipath   ///< Find every path through load balancers, see `TracerouteResult.pathGraph`.
+};
+
 /*! An object wrapper around the low-level BSD Sockets traceroute function.
  *  \details This class extends the functionality of SimplePing to provide
  *      traceroute capabilities. It sends ICMP packets with incrementing TTL
@@ -23,6 +33,12 @@ NS_ASSUME_NONNULL_BEGIN
  *
  *      The class can be used from any thread but the use of any single instance
  *      must be confined to a specific thread and that thread must run its run loop.
+ *      Alternatively, set `dispatchQueue` and the instance runs on that serial
+ *      queue instead, with no run loop involved.
+ *
+ *      Each instance normally opens its own ICMP socket. To run many traceroutes
+ *      at once, create them with `-initWithHostName:engine:` so that they share
+ *      the engine's sockets; see also TracerouteBatch.
  */
 @interface SimpleTraceroute : NSObject
 
@@ -33,7 +49,20 @@ NS_ASSUME_NONNULL_BEGIN
  *      in string form will work here.
  *  \returns The initialized object.
  */
-- (instancetype)initWithHostName:(NSString *)hostName NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithHostName:(NSString *)hostName;
+
+/*! Initialize the object to traceroute to the specified host through a shared engine.
+ *  \details The traceroute sends and receives through the engine's sockets instead
+ *      of opening its own, and the engine sets the hop limit of each probe as it
+ *      sends it. The engine's `dispatchQueue` must match the traceroute's.
+ *  \param hostName The DNS name of the host to traceroute; an IPv4 or IPv6 address
+ *      in string form will work here.
+ *  \param engine The engine to use, or nil to use a private socket.
+ *  \returns The initialized object.
+ */
+- (instancetype)initWithHostName:(NSString *)hostName
+                          engine:(nullable SimplePingEngine *)engine
+    NS_DESIGNATED_INITIALIZER;
 
 #pragma mark * Basic Properties
 
@@ -41,12 +70,25 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property(nonatomic, copy, readonly) NSString *hostName;
 
+/*! The engine passed to `-initWithHostName:engine:`, if any.
+ */
+@property(nonatomic, strong, readonly, nullable) SimplePingEngine *engine;
+
 /*! The delegate for this object.
  *  \details Delegate callbacks are scheduled in the default run loop mode of the run loop
- *      of the thread that calls `-start`.
+ *      of the thread that calls `-start`, or on `dispatchQueue` if that's set.
  */
 @property(nonatomic, weak, readwrite, nullable) id<SimpleTracerouteDelegate> delegate;
 
+/*! The serial queue the object runs on, or nil to use the run loop of the thread
+ *  that calls `-start`.
+ *  \details With a queue, name resolution, socket reads, probe timers and delegate
+ *      callbacks all happen on that queue, using dispatch sources, so tracing can be
+ *      pinned to a dedicated high-QoS queue. You must then call `-start` and `-stop`
+ *      on that queue. You should set this before calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) dispatch_queue_t dispatchQueue;
+
 /*! Controls the IP address version used by the object.
  *  \details You should set this value before starting the object.
  */
@@ -65,7 +107,8 @@ NS_ASSUME_NONNULL_BEGIN
 
 /*! The identifier used by this traceroute object.
  *  \details When you create an instance of this object it generates a random identifier
- *      that it uses to identify its own packets.
+ *      that it uses to identify its own packets. If the object uses an engine, the
+ *      engine may change it on start.
  */
 @property(nonatomic, assign, readonly) uint16_t identifier;
 
@@ -82,12 +125,210 @@ NS_ASSUME_NONNULL_BEGIN
 @property(nonatomic, assign, readwrite) NSTimeInterval timeout;
 
 /*! Number of probe packets to send per hop.
- *  \details Default value is 3. You should set this before calling `-start`.
+ *  \details Must be between 1 and `kTracerouteMaxProbesPerHop`. Default value is
+ *      3. You should set this before calling `-start`.
  */
 @property(nonatomic, assign, readwrite) uint8_t probesPerHop;
 
+/*! Whether a hop waits for all of its probes.
+ *  \details By default the first answer settles a hop and the rest of its probes
+ *      are dropped, which is quickest. Set this to collect every probe's latency,
+ *      for per-hop jitter and loss in `TracerouteResult.hopSamples`: each hop then
+ *      moves on once all of its probes have answered or timed out. Ignored in
+ *      parallel and multipath modes. Default value is NO. You should set this before calling
+ *      `-start`.
+ */
+@property(nonatomic, assign, readwrite) BOOL waitsForAllProbes;
+
+/*! How the path is probed.
+ *  \details Default value is `SimpleTracerouteProbeModeSequential`. In parallel mode
+ *      the first probe of every TTL in a window is sent in one burst, each hop's
+ *      further probes following `probeInterval` apart, each probe gets its own
+ *      deadline, and hops are still reported to the delegate in order. The
+ *      traceroute finishes once the destination hop and every hop below it have
+ *      either answered or timed out.
+ *
+ *      In multipath mode each hop is probed with as many flows as
+ *      `multipathConfidence` calls for, `probesPerHop` being ignored, and any flow
+ *      the hop before didn't get is sent to it as well, so every answer can be
+ *      linked to the interface before it. Every probe is reported to the delegate,
+ *      its `probeIndex` being its flow less `flowIdentifier`, and the traceroute
+ *      finishes after the first hop the destination answers at. The interfaces
+ *      and links found are in `TracerouteResult.pathGraph`. You should set this
+ *      before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) SimpleTracerouteProbeMode probeMode;
+
+/*! Whether every probe takes the same path through load balancers, as in Paris traceroute.
+ *  \details Routers that spread traffic over equal cost paths pick the path by
+ *      hashing the first words of the transport header, which for ICMP are the
+ *      type, code and checksum. Every probe has its own sequence number and send
+ *      time, so by default their checksums differ and, on such paths, probes to
+ *      one hop can be answered by different routers, mixing their latencies in
+ *      one hop's samples. With this set, a word of the payload is chosen for
+ *      each probe to keep the checksum at the value of `flowIdentifier`, so
+ *      every probe follows one path. Multipath mode always does this. Default
+ *      value is NO. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) BOOL keepsFlowStable;
+
+/*! The flow probed when `keepsFlowStable` is set.
+ *  \details Each value holds the probes at another checksum, so a load balancer
+ *      may send them down another path; trace again with another value to see
+ *      another one. In multipath mode this is the first of the flows used.
+ *      Default value is 0. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) uint16_t flowIdentifier;
+
+/*! How sure multipath mode is to have found every interface of a hop, 0 to 1.
+ *  \details Multipath mode probes each hop with one flow after another. With
+ *      `k` interfaces found so far it stops once it has tried enough flows that,
+ *      were there `k + 1` interfaces sharing the flows evenly, the chance of one
+ *      having gone unseen is below `1 - multipathConfidence`; this is the
+ *      stopping rule of the Multipath Detection Algorithm (MDA). At the default
+ *      value of 0.95 that's 6 flows for one interface, 11 for two, 16 for three
+ *      and so on, up to `kTracerouteMaxMultipathFlows`. Ignored in the other
+ *      modes. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) double multipathConfidence;
+
+/*! Whether the traceroute keeps watching the path, mtr-style, until it's stopped.
+ *  \details The path is first traced as `probeMode` says, with the usual
+ *      callbacks, except that `-simpleTraceroute:didFinishWithResult:` is not
+ *      called. The traceroute then keeps its socket and sends one probe to each
+ *      hop up to the destination every `cycleInterval`, each with its own
+ *      timeout, and keeps rolling statistics of each hop's latest
+ *      `statisticsWindow` probes. Every probe that's answered or times out is
+ *      reported through `-simpleTraceroute:didUpdateHopStatistics:`, with no
+ *      new TracerouteResult and nothing added to the probe results. Only while
+ *      the destination stops answering are hops beyond it probed, up to
+ *      `maxHops`, in case the path has grown. Default value is NO. You should
+ *      set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) BOOL continuous;
+
+/*! Seconds between the rounds of probes of a continuous traceroute.
+ *  \details Probes are still paced by `probeInterval` and `rateLimiter`; a round
+ *      whose hops are still queued when the next is due is skipped. Ignored
+ *      unless `continuous` is set. Default value is 1.0. You should set this
+ *      before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSTimeInterval cycleInterval;
+
+/*! Number of each hop's most recent probes the rolling statistics cover.
+ *  \details Must be between 1 and 65535. Default value is
+ *      `kTracerouteDefaultStatisticsWindow`. Ignored unless `continuous` is
+ *      set. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSUInteger statisticsWindow;
+
+/*! The rolling statistics of every hop a continuous traceroute probes, in hop order.
+ *  \details Empty until the path has first been traced, and for traceroutes
+ *      that aren't continuous.
+ */
+@property(nonatomic, copy, readonly) NSArray<TracerouteHopStatistics *> *hopStatistics;
+
+/*! The number of rounds a continuous traceroute has started.
+ */
+@property(nonatomic, assign, readonly) NSUInteger cycleCount;
+
+/*! Number of TTLs kept in flight at once in parallel mode.
+ *  \details A value of 0 probes every TTL from 1 to `maxHops` in a single burst,
+ *      `probeInterval` only spacing the probes of each TTL. Default value is 0.
+ *      Ignored in sequential mode. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) uint8_t parallelWindow;
+
+/*! Maximum number of responses read per socket readiness callback.
+ *  \details The socket is drained without blocking until it is empty or this
+ *      many responses have been read, instead of returning to the run loop after
+ *      every response. Default value is 32; 1 reads one response per callback.
+ *      Traceroutes that use an engine are governed by the engine's
+ *      `receiveBatchLimit` instead. A delegate that implements
+ *      `-simpleTraceroute:didReceiveResponses:` gets each batch in one call.
+ */
+@property(nonatomic, assign, readwrite) NSUInteger receiveBatchLimit;
+
+/*! How late, in seconds, probe timeouts and pacing timers may fire.
+ *  \details A little leeway lets the system coalesce timer wakeups, at the cost of
+ *      timeouts being reported up to that much late. Timeouts are kept on a
+ *      SimplePingTimeoutWheel: the engine's `timeoutWheel` if there is an engine,
+ *      which has its own tick, otherwise a private wheel that ticks every
+ *      `timerLeeway`, but no more often than every 10 ms. Default value is 0, which
+ *      asks for the least delay the system allows. You should set this before
+ *      calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSTimeInterval timerLeeway;
+
+/*! Interval between consecutive probes, in seconds.
+ *  \details Probes are paced with timers on the run loop or `dispatchQueue`, never
+ *      by blocking the thread. In parallel mode only the probes of one hop are
+ *      spaced, so a window's hops are still probed at once; 0 sends every probe of
+ *      a window in one burst. Default value is 0.01. You should set this before
+ *      calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSTimeInterval probeInterval;
+
+/*! A rate limit shared with other objects, or nil for none.
+ *  \details Every probe takes a token from the limiter first, waiting on a timer
+ *      if there is none. Give every traceroute in the process the same limiter to
+ *      keep their combined probe rate under the ICMP rate limits of the routers
+ *      they cross. Default value is nil. You should set this before calling
+ *      `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) SimplePingRateLimiter *rateLimiter;
+
+/*! The first hop probed.
+ *  \details Hops below it are only probed afterwards, working back towards the
+ *      source, see `interfaceCache`. Must be between 1 and `maxHops`. Default
+ *      value is 1. Ignored in parallel and multipath modes. You should set this before calling
+ *      `-start`.
+ */
+@property(nonatomic, assign, readwrite) uint8_t firstHop;
+
+/*! Interfaces already seen by other traceroutes from this host, or nil.
+ *  \details Every interface that answers is added to the cache. If `firstHop`
+ *      is above 1, once the forward probes from `firstHop` are done the
+ *      traceroute probes `firstHop - 1`, `firstHop - 2` and so on, and stops at
+ *      the first hop whose interface the cache already held: the path below it
+ *      is the one an earlier traceroute found. Those backward hops are reported
+ *      after the forward ones, in descending order, and the hops below the
+ *      stopping point are not reported at all. Default value is nil. Ignored in
+ *      parallel and multipath modes. You should set this before calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) TracerouteInterfaceCache *interfaceCache;
+
+/*! Looks up the names of the routers that answer, or nil not to.
+ *  \details Each hop is reported as soon as its answer arrives, without a name.
+ *      Its router address is then handed to the resolver, off the probe path,
+ *      and if it has a name `hostName` is set on the hop result and
+ *      `-simpleTraceroute:didResolveHostName:forHop:` is called. That's often
+ *      after the traceroute has finished; names for a run are not delivered
+ *      once the traceroute has been started again. Share one resolver between
+ *      traceroutes to share its cache. Default value is nil. You should set
+ *      this before calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) TracerouteReverseResolver *reverseResolver;
+
+/*! Where to record every response and probe timeout, or nil not to.
+ *  \details Each response read, answering one of our probes or not, is appended
+ *      as a `SimplePingSessionRecordKindTraceroute` record with its raw bytes,
+ *      hop, sequence number and round trip time, as is each probe timeout. A
+ *      recorder may be shared by any number of traceroutes and pingers. Default
+ *      value is nil. You should set this before calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingSessionRecorder *sessionRecorder;
+
+/*! The `targetIdentifier` of the traceroute's records, to tell targets apart in
+ *  a shared recording.
+ *  \details Default value is 0.
+ */
+@property(nonatomic, assign, readwrite) uint32_t sessionTargetIdentifier;
+
 /*! Current hop number being traced.
  *  \details This value starts at 1 and increments as the traceroute progresses.
+ *      In parallel mode it is the lowest hop that has not been reported yet.
  *      It's 0 when the traceroute is not running.
  */
 @property(nonatomic, assign, readonly) uint8_t currentHop;
@@ -96,6 +337,16 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property(nonatomic, assign, readonly) BOOL isRunning;
 
+/*! A snapshot of the traceroute's metrics: probes sent, responses received,
+ *      probes that timed out, and so on.
+ *  \details Kept for the object's whole life, across runs, and also added to
+ *      `+[SimplePingMetricsSnapshot processSnapshot]`. `timeouts` counts probes,
+ *      not hops, and the callbacks timed are `-simpleTraceroute:didCompleteHop:`
+ *      and `-simpleTraceroute:didReceiveResponseFromHop:latency:`. You may read
+ *      this from any thread.
+ */
+@property(nonatomic, strong, readonly) SimplePingMetricsSnapshot *metrics;
+
 #pragma mark * Control Methods
 
 /*! Starts the traceroute.
@@ -111,6 +362,15 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)start;
 
+/*! Starts the traceroute to an address that has already been resolved.
+ *  \details Like `-start`, but skips resolving `hostName`, which then only labels
+ *      the result; `addressStyle` is not consulted either. This is what
+ *      TracerouteBatch uses, having resolved and deduplicated its targets itself.
+ *  \param address The address to trace; the contents of the NSData is a
+ *      (struct sockaddr) of some form.
+ */
+- (void)startWithAddress:(NSData *)address;
+
 /*! Stops the traceroute.
  *  \details You should call this when you're done with the traceroute.
  *
@@ -188,6 +448,41 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)simpleTraceroute:(SimpleTraceroute *)traceroute didTimeoutForHop:(uint8_t)hopNumber;
 
+@optional
+
+/*! A SimpleTraceroute delegate callback, called when a hop's router name is found.
+ *  \details Only called with a `reverseResolver`, and only for routers that have
+ *      a name. It may come after `-simpleTraceroute:didFinishWithResult:`.
+ *  \param traceroute The object issuing the callback.
+ *  \param hostName The name of the router.
+ *  \param hopResult The hop result passed to `-simpleTraceroute:didCompleteHop:`;
+ *      its `hostName` is now set.
+ */
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didResolveHostName:(NSString *)hostName forHop:(TracerouteHopResult *)hopResult;
+
+/*! A SimpleTraceroute delegate callback, called as each probe of a continuous traceroute settles.
+ *  \details Only called once the path has first been traced, see `continuous`.
+ *  \param traceroute The object issuing the callback.
+ *  \param statistics The hop's statistics, including the probe that answered or
+ *      timed out.
+ */
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didUpdateHopStatistics:(TracerouteHopStatistics *)statistics;
+
+/*! A SimpleTraceroute delegate callback, called with all the responses read in one go.
+ *  \details If the delegate implements this callback the object collects the
+ *      responses to its probes that it reads from one socket readiness callback
+ *      (see `receiveBatchLimit`), or one drain of the engine's socket, and
+ *      delivers them here, in the order received, instead of calling
+ *      `-simpleTraceroute:didReceiveResponseFromHop:latency:` per response. Hops
+ *      the responses complete are still reported as they are read, so this comes
+ *      after their `-simpleTraceroute:didCompleteHop:`, but before
+ *      `-simpleTraceroute:didFinishWithResult:`.
+ *  \param traceroute The object issuing the callback.
+ *  \param responses The responses, with their hop and round trip time; never
+ *      empty.
+ */
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute didReceiveResponses:(NSArray<TracerouteHopResult *> *)responses;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -0,0 +1,185 @@
+/*
+    Abstract:
+    Runs traceroutes to many destinations over a shared socket pool.
+ */
+
+@import Foundation;
+#import "SimpleTraceroute.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@protocol TracerouteBatchDelegate;
+
+/*! Aggregate throughput of a TracerouteBatch.
+ *  \details A snapshot; get a fresh one from the batch's `metrics` property.
+ */
+@interface TracerouteBatchMetrics : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property(nonatomic, assign, readonly) NSUInteger targetCount;       ///< Host names passed to the batch
+@property(nonatomic, assign, readonly) NSUInteger finishedCount;     ///< Targets with a result
+@property(nonatomic, assign, readonly) NSUInteger failedCount;       ///< Targets that failed to resolve or trace
+@property(nonatomic, assign, readonly) NSUInteger deduplicatedCount; ///< Targets that shared another target's traceroute
+@property(nonatomic, assign, readonly) NSUInteger tracerouteCount;   ///< Traceroutes actually started
+@property(nonatomic, assign, readonly) NSUInteger activeCount;       ///< Targets resolving or tracing right now
+@property(nonatomic, assign, readonly) NSUInteger probesSent;        ///< Probes sent by every traceroute
+@property(nonatomic, assign, readonly) NSUInteger responsesReceived; ///< Responses matched to a probe
+@property(nonatomic, assign, readonly) NSTimeInterval elapsedTime;   ///< Seconds since start, frozen on completion
+@property(nonatomic, assign, readonly) double probesPerSecond;       ///< probesSent over elapsedTime
+@property(nonatomic, assign, readonly) double targetsPerSecond;      ///< Finished and failed targets over elapsedTime
+
+@end
+
+/*! Runs traceroutes to many destinations over a shared socket pool.
+ *  \details Give the batch a list of host names and call `-start`. It resolves
+ *      them, keeping at most `maxConcurrentTraceroutes` targets resolving or
+ *      tracing at once, and runs their traceroutes through a small pool of
+ *      SimplePingEngine instances, so thousands of targets cost a handful of
+ *      sockets. Every probe of every traceroute takes a token from one shared
+ *      SimplePingRateLimiter, which keeps the whole batch under
+ *      `packetsPerSecond`.
+ *
+ *      Host names that are equal ignoring case, and names that resolve to an
+ *      address that's already being traced or has been traced, share one
+ *      traceroute; each still gets its own result, labelled with its own name.
+ *      With `firstHop` above 1 the traceroutes also skip the hops they share,
+ *      through `interfaceCache`.
+ *
+ *      Like SimpleTraceroute, the batch must be used from one thread that runs
+ *      its run loop, or from `dispatchQueue`.
+ */
+@interface TracerouteBatch : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*! Initialize the batch.
+ *  \param hostNames The hosts to trace; DNS names or IPv4 or IPv6 addresses in
+ *      string form.
+ *  \returns The initialized object.
+ */
+- (instancetype)initWithHostNames:(NSArray<NSString *> *)hostNames NS_DESIGNATED_INITIALIZER;
+
+/*! A copy of the value passed to `-initWithHostNames:`.
+ */
+@property(nonatomic, copy, readonly) NSArray<NSString *> *hostNames;
+
+/*! The delegate for this object.
+ */
+@property(nonatomic, weak, readwrite, nullable) id<TracerouteBatchDelegate> delegate;
+
+/*! The serial queue the batch and all of its traceroutes run on, or nil to use
+ *  the run loop of the thread that calls `-start`.
+ *  \details You should set this before calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) dispatch_queue_t dispatchQueue;
+
+/*! Controls the IP address version each host name is resolved to.
+ *  \details Default value is `SimplePingAddressStyleAny`. You should set this
+ *      before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) SimplePingAddressStyle addressStyle;
+
+/*! Most targets resolving or tracing at once.
+ *  \details Default value is 64. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSUInteger maxConcurrentTraceroutes;
+
+/*! Probe budget of the whole batch, in packets per second, or 0 for none.
+ *  \details Up to 50 ms worth of probes may go out back-to-back after an idle
+ *      period. Default value is 500. You should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) double packetsPerSecond;
+
+/*! Number of engines, and so sockets per address family, traceroutes are spread over.
+ *  \details Traceroutes are assigned to engines in turn. More than one spreads
+ *      the receive load over several socket buffers. Default value is 4. You
+ *      should set this before calling `-start`.
+ */
+@property(nonatomic, assign, readwrite) NSUInteger socketPoolSize;
+
+/*! The first hop each traceroute probes, see `-[SimpleTraceroute firstHop]`.
+ *  \details Together with `interfaceCache` this is Doubletree: each traceroute
+ *      probes forward from here, then back towards this host only until it meets
+ *      an interface an earlier traceroute of the batch already found, so the
+ *      hops every path shares are probed about once rather than once per target.
+ *      Pick a hop a little before paths start to diverge. Default value is 1,
+ *      which probes every path in full. You should set this before calling
+ *      `-start`.
+ */
+@property(nonatomic, assign, readwrite) uint8_t firstHop;
+
+/*! The interfaces seen so far, shared by every traceroute of the batch.
+ *  \details Default value is a new, empty cache. Keep it, or share one between
+ *      batches, to have later batches stop at interfaces found by earlier ones.
+ *      Set it to nil to not share interfaces at all. You should set this before
+ *      calling `-start`.
+ */
+@property(nonatomic, strong, readwrite, nullable) TracerouteInterfaceCache *interfaceCache;
+
+/*! Called with every traceroute the batch creates, just before it starts.
+ *  \details Use it to set `maxHops`, `timeout`, `probeMode` and so on. It's
+ *      called after `firstHop` and `interfaceCache` have been applied, so it may
+ *      change those. The batch sets the delegate, `dispatchQueue` and
+ *      `rateLimiter` itself, so don't change those. Default value is nil,
+ *      which leaves SimpleTraceroute's defaults.
+ */
+@property(nonatomic, copy, readwrite, nullable) void (^tracerouteConfigurationHandler)(SimpleTraceroute *traceroute);
+
+/*! Results so far, keyed by host name as passed to `-initWithHostNames:`.
+ */
+@property(nonatomic, copy, readonly) NSDictionary<NSString *, TracerouteResult *> *results;
+
+/*! Aggregate throughput so far.
+ */
+@property(nonatomic, strong, readonly) TracerouteBatchMetrics *metrics;
+
+/*! Whether the batch is currently running.
+ */
+@property(nonatomic, assign, readonly) BOOL isRunning;
+
+/*! Starts the batch.
+ *  \details It is not correct to start an already started object.
+ */
+- (void)start;
+
+/*! Stops the batch and every traceroute it is running.
+ *  \details Targets that haven't finished get no callback. It's safe to call
+ *      this on an object that's stopped.
+ */
+- (void)stop;
+
+@end
+
+#pragma mark * Delegate Protocol
+
+/*! A delegate protocol for the TracerouteBatch class.
+ */
+@protocol TracerouteBatchDelegate <NSObject>
+
+@optional
+
+/*! Called when a target's traceroute finishes.
+ *  \param batch The object issuing the callback.
+ *  \param hostName The target, as passed to `-initWithHostNames:`.
+ *  \param result The result; its `targetHostname` is hostName.
+ */
+- (void)tracerouteBatch:(TracerouteBatch *)batch didFinishHostName:(NSString *)hostName withResult:(TracerouteResult *)result;
+
+/*! Called when a target fails to resolve, or its traceroute fails.
+ *  \param batch The object issuing the callback.
+ *  \param hostName The target, as passed to `-initWithHostNames:`.
+ *  \param error Describes the failure.
+ */
+- (void)tracerouteBatch:(TracerouteBatch *)batch didFailHostName:(NSString *)hostName withError:(NSError *)error;
+
+/*! Called once every target has either finished or failed.
+ *  \details The batch has stopped by the time this is called.
+ *  \param batch The object issuing the callback.
+ *  \param metrics The final metrics.
+ */
+- (void)tracerouteBatch:(TracerouteBatch *)batch didCompleteWithMetrics:(TracerouteBatchMetrics *)metrics;
+
+@end
+
+NS_ASSUME_NONNULL_END
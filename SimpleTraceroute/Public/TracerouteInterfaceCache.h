@@ -0,0 +1,57 @@
+/*
+    Abstract:
+    A shared set of router interfaces already seen at each hop.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! A shared set of router interfaces already seen at each hop.
+ *  \details Traces from one vantage point share their first hops, so once an
+ *      interface has been seen at some hop, the path from there back to the
+ *      source is known. A SimpleTraceroute with an interface cache and a
+ *      `firstHop` above 1 probes forward from `firstHop`, then back towards the
+ *      source, and stops probing backward at the first interface the cache
+ *      already holds (Doubletree's local stop set). Every interface it hears
+ *      from is added to the cache.
+ *
+ *      Give every traceroute from the same vantage point the same cache; the
+ *      object is thread safe.
+ */
+@interface TracerouteInterfaceCache : NSObject
+
+/*! Number of (hop, interface) pairs in the cache.
+ */
+@property(nonatomic, assign, readonly) NSUInteger count;
+
+/*! Records that an interface answered at a hop.
+ *  \param routerAddress The interface address, as in
+ *      `TracerouteHopResult.routerAddress`.
+ *  \param hop The hop number (1-255).
+ */
+- (void)addInterface:(NSString *)routerAddress atHop:(uint8_t)hop;
+
+/*! Tells whether an interface has already answered at a hop.
+ *  \param routerAddress The interface address.
+ *  \param hop The hop number (1-255).
+ *  \returns YES if the cache holds that pair.
+ */
+- (BOOL)containsInterface:(NSString *)routerAddress atHop:(uint8_t)hop;
+
+/*! Records an interface, and tells whether it was already there.
+ *  \details Equivalent to `-containsInterface:atHop:` then
+ *      `-addInterface:atHop:`, but atomic.
+ *  \param routerAddress The interface address.
+ *  \param hop The hop number (1-255).
+ *  \returns YES if the cache already held that pair.
+ */
+- (BOOL)addInterfaceReturningWasKnown:(NSString *)routerAddress atHop:(uint8_t)hop;
+
+/*! Empties the cache, for example after the vantage point has moved.
+ */
+- (void)removeAllInterfaces;
+
+@end
+
+NS_ASSUME_NONNULL_END
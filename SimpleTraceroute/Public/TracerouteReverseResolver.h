@@ -0,0 +1,74 @@
+/*
+    Abstract:
+    A shared, caching reverse DNS resolver for the router addresses of hops.
+ */
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*! A shared, caching reverse DNS resolver for the router addresses of hops.
+ *  \details `getnameinfo()` blocks, often for seconds when a router has no PTR
+ *      record, so the resolver runs it on a global queue, at most
+ *      `maxConcurrentLookups` at a time, and never on the thread probing. Asking
+ *      for an address that's already being looked up waits for that lookup
+ *      rather than starting another one. Names are cached for `cacheLifetime`
+ *      seconds, and addresses with no name for `negativeCacheLifetime` seconds.
+ *
+ *      Give every traceroute from the same process the same resolver to share
+ *      its cache; the object is thread safe.
+ */
+@interface TracerouteReverseResolver : NSObject
+
+/*! How long a name that was found stays cached, in seconds.
+ *  \details Default value is 3600. Changes apply to lookups that finish later.
+ */
+@property(nonatomic, assign, readwrite) NSTimeInterval cacheLifetime;
+
+/*! How long an address with no name stays cached, in seconds.
+ *  \details Lookups that fail, for example because the DNS server can't be
+ *      reached, are cached for this long too. Default value is 300. Changes
+ *      apply to lookups that finish later.
+ */
+@property(nonatomic, assign, readwrite) NSTimeInterval negativeCacheLifetime;
+
+/*! Most lookups running at once; later ones wait for a free slot.
+ *  \details Each running lookup ties up a thread. Default value is 4. Must be
+ *      at least 1.
+ */
+@property(nonatomic, assign, readwrite) NSUInteger maxConcurrentLookups;
+
+/*! Number of addresses cached, expired or not, including those with no name.
+ */
+@property(nonatomic, assign, readonly) NSUInteger count;
+
+/*! Looks up the name of an address.
+ *  \details The completion handler is always called asynchronously, even when
+ *      the answer is cached, and exactly once.
+ *  \param routerAddress The address in numeric form, as in
+ *      `TracerouteHopResult.routerAddress`.
+ *  \param queue The queue to call the completion handler on, or nil to call it
+ *      on the run loop of the current thread, in the default mode.
+ *  \param completionHandler Called with the name, or nil if the address has none.
+ */
+- (void)resolveAddress:(NSString *)routerAddress
+                 queue:(nullable dispatch_queue_t)queue
+     completionHandler:(void (^)(NSString *_Nullable hostName))completionHandler;
+
+/*! Returns a cached name without looking anything up.
+ *  \param routerAddress The address in numeric form.
+ *  \param found Set to YES if the address is cached and hasn't expired, whether
+ *      or not it has a name; may be NULL.
+ *  \returns The cached name, or nil.
+ */
+- (nullable NSString *)cachedHostNameForAddress:(NSString *)routerAddress
+                                          found:(nullable BOOL *)found;
+
+/*! Empties the cache.
+ *  \details Lookups in progress still complete, and cache their answer.
+ */
+- (void)removeAllHostNames;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -24,7 +24,16 @@ typedef struct TracerouteHop
     NSError *_Nullable error;           ///< Error information (if any)
 } TracerouteHop;
 
+@class TracerouteHopResult;
+@class TracerouteHopSamples;
+@class TraceroutePathGraph;
+
 /*! Complete traceroute result.
+ *  \details Results made by SimpleTraceroute keep their probe results packed, a
+ *      few dozen bytes per probe with each distinct router address stored once,
+ *      and only build `hops` and `hopResults` the first time they're asked for.
+ *      A monitor that keeps many results, or only looks at a few fields, doesn't
+ *      pay for objects it never uses. The object is thread safe.
  */
 @interface TracerouteResult : NSObject
 @property(nonatomic, copy, readonly) NSString *targetHostname; ///< Target hostname
@@ -32,9 +41,46 @@ typedef struct TracerouteHop
 @property(nonatomic, assign, readonly) uint8_t maxHops;        ///< Maximum number of hops
 @property(nonatomic, assign, readonly) uint8_t actualHops;     ///< Actual number of hops reached
 @property(nonatomic, assign, readonly) double totalTime;       ///< Total time in seconds
-@property(nonatomic, copy, readonly) NSArray *hops;            ///< Array of TracerouteHop wrapped in NSValue (max 30)
 @property(nonatomic, assign, readonly) BOOL reachedTarget;     ///< Whether target was reached
 
+/*! One TracerouteHop per hop that reported, in hop order, wrapped in NSValue.
+ *  \details Each hop lists the latencies of its first three probes. The objects a
+ *      TracerouteHop points to belong to the result, so keep the result while
+ *      using them.
+ */
+@property(nonatomic, copy, readonly) NSArray<NSValue *> *hops;
+
+/*! Every probe result, in the order they were reported.
+ *  \details Built on first access; each distinct router address is one string
+ *      shared by all of its results. Empty for results made with the initializer
+ *      below.
+ */
+@property(nonatomic, copy, readonly) NSArray<TracerouteHopResult *> *hopResults;
+
+/*! Number of entries in `hopResults`, without building them.
+ */
+@property(nonatomic, assign, readonly) NSUInteger hopResultCount;
+
+/*! Number of distinct router addresses among the probe results.
+ */
+@property(nonatomic, assign, readonly) NSUInteger routerAddressCount;
+
+/*! Latency samples and statistics of every hop that reported, in hop order.
+ *  \details Unlike `hops` these cover every probe, however many `probesPerHop`
+ *      asks for. Empty for results made with the initializer below.
+ */
+@property(nonatomic, copy, readonly) NSArray<TracerouteHopSamples *> *hopSamples;
+
+/*! Returns the samples of one hop, or nil if it has none.
+ *  \details Doesn't build the other hops' samples.
+ */
+- (nullable TracerouteHopSamples *)samplesForHop:(uint8_t)hopNumber;
+
+/*! Every interface and link a multipath traceroute found, or nil for the other modes.
+ *  \details Built on first access, see `SimpleTracerouteProbeModeMultipath`.
+ */
+@property(nonatomic, strong, readonly, nullable) TraceroutePathGraph *pathGraph;
+
 - (instancetype)initWithTargetHostname:(NSString *)targetHostname
                          targetAddress:(NSData *)targetAddress
                                maxHops:(uint8_t)maxHops
@@ -82,12 +128,89 @@ enum
 @interface TracerouteHopResult : NSObject
 @property(nonatomic, assign) uint8_t hopNumber;
 @property(nonatomic, copy, nullable) NSString *routerAddress;
+@property(nonatomic, copy, nullable) NSString *hostName; ///< Reverse DNS name of routerAddress, once resolved, see SimpleTraceroute.reverseResolver
 @property(nonatomic, assign) NSTimeInterval roundTripTime;
 @property(nonatomic, assign) BOOL isDestination;
 @property(nonatomic, assign) BOOL isTimeout;
 @property(nonatomic, strong, nullable) NSDate *timestamp;
 @property(nonatomic, assign) uint16_t sequenceNumber;
 @property(nonatomic, assign) uint8_t probeIndex;
+@property(nonatomic, assign) uint8_t probeCount;                ///< Probes this result stands for: 1, or every probe a timeout gave up on
+@property(nonatomic, assign) uint64_t roundTripNanoseconds;     ///< Monotonic send stamp to kernel receive stamp, 0 for timeouts
+@property(nonatomic, assign) uint64_t deliveryDelayNanoseconds; ///< Time between kernel receive and us reading the response
+@end
+
+/*! The latency samples of one hop, with statistics kept as they were added.
+ *  \details Latencies are in seconds. Statistics cover replies only, and are 0
+ *      if the hop had none. Timeouts count as lost probes. Loss is a fraction;
+ *      the Swift wrapper's `lossPercentage` is the same loss times 100.
+ */
+@interface TracerouteHopSamples : NSObject
+@property(nonatomic, assign, readonly) uint8_t hopNumber;                  ///< Hop number (1-based)
+@property(nonatomic, assign, readonly) NSUInteger probeCount;              ///< Probes answered or given up on
+@property(nonatomic, assign, readonly) NSUInteger replyCount;              ///< Probes answered
+@property(nonatomic, assign, readonly) double lossRatio;                   ///< Unanswered fraction of probeCount, 0 to 1, not a percentage
+@property(nonatomic, assign, readonly) NSTimeInterval minimumLatency;      ///< Fastest reply
+@property(nonatomic, assign, readonly) NSTimeInterval averageLatency;      ///< Mean reply
+@property(nonatomic, assign, readonly) NSTimeInterval maximumLatency;      ///< Slowest reply
+@property(nonatomic, assign, readonly) NSTimeInterval standardDeviation;   ///< Population deviation of the replies, as ping's mdev
+@property(nonatomic, copy, readonly) NSArray<NSNumber *> *latencies;       ///< Every reply, in the order they arrived
+
+- (instancetype)init NS_UNAVAILABLE;
+@end
+
+/*! Rolling statistics of one hop of a continuous traceroute.
+ *  \details Latencies are in seconds and cover the replies among the hop's most
+ *      recent `SimpleTraceroute.statisticsWindow` probes; they are 0 if there
+ *      were none. Loss is a fraction; the Swift wrapper's `lossPercentage` is
+ *      the same loss times 100. The object is a snapshot and never changes.
+ */
+@interface TracerouteHopStatistics : NSObject
+@property(nonatomic, assign, readonly) uint8_t hopNumber;                  ///< Hop number (1-based)
+@property(nonatomic, copy, readonly, nullable) NSString *routerAddress;    ///< Router that answered last, nil if none has
+@property(nonatomic, assign, readonly) BOOL isDestination;                 ///< Whether the target answered at this hop last
+@property(nonatomic, assign, readonly) NSUInteger sentCount;               ///< Probes settled since the traceroute started
+@property(nonatomic, assign, readonly) NSUInteger windowCount;             ///< Probes in the window
+@property(nonatomic, assign, readonly) NSUInteger replyCount;              ///< Replies in the window
+@property(nonatomic, assign, readonly) double lossRatio;                   ///< Unanswered fraction of the window, 0 to 1, not a percentage
+@property(nonatomic, assign, readonly) NSTimeInterval lastLatency;         ///< Latest reply, 0 if none yet
+@property(nonatomic, assign, readonly) NSTimeInterval minimumLatency;      ///< Fastest reply in the window
+@property(nonatomic, assign, readonly) NSTimeInterval averageLatency;      ///< Mean reply in the window
+@property(nonatomic, assign, readonly) NSTimeInterval maximumLatency;      ///< Slowest reply in the window
+@property(nonatomic, assign, readonly) NSTimeInterval standardDeviation;   ///< Population deviation of the replies in the window
+
+- (instancetype)init NS_UNAVAILABLE;
+@end
+
+/*! One link of a TraceroutePathGraph.
+ *  \details Some flow that reached `fromAddress` at `hopNumber` reached
+ *      `toAddress` at the next hop.
+ */
+@interface TraceroutePathLink : NSObject
+@property(nonatomic, assign, readonly) uint8_t hopNumber;    ///< Hop of fromAddress; toAddress is at the next one
+@property(nonatomic, copy, readonly) NSString *fromAddress;  ///< Interface the link leaves
+@property(nonatomic, copy, readonly) NSString *toAddress;    ///< Interface the link reaches
+@property(nonatomic, assign, readonly) NSUInteger flowCount; ///< Flows seen taking the link
+
+- (instancetype)init NS_UNAVAILABLE;
+@end
+
+/*! The paths to a target through load balancers, as a directed acyclic graph.
+ *  \details Interfaces are the vertices and links the edges, each from one hop to
+ *      the next. A hop where a flow went unanswered breaks that flow's path, so
+ *      routers that never answer leave gaps. Interfaces are listed in the order
+ *      they answered, and links in the order of their first flow.
+ */
+@interface TraceroutePathGraph : NSObject
+@property(nonatomic, copy, readonly) NSArray<NSArray<NSString *> *> *interfacesByHop; ///< Element n is hop n + 1; empty for hops nothing answered
+@property(nonatomic, copy, readonly) NSArray<TraceroutePathLink *> *links;            ///< Every link, in hop order
+@property(nonatomic, assign, readonly) NSUInteger flowCount;                          ///< Most flows any hop was probed with
+
+/*! Returns the interfaces of one hop, empty if it has none.
+ */
+- (NSArray<NSString *> *)interfacesAtHop:(uint8_t)hopNumber;
+
+- (instancetype)init NS_UNAVAILABLE;
 @end
 
 /*! ICMP response analysis result.
@@ -111,7 +234,16 @@ enum
 {
     kTracerouteDefaultMaxHops = 30,     ///< Default maximum hops
     kTracerouteDefaultProbesPerHop = 3, ///< Default probes per hop
-    kTracerouteDefaultTimeout = 5       ///< Default timeout in seconds
+    kTracerouteMaxProbesPerHop = 32,    ///< Most probes per hop
+    kTracerouteMaxMultipathFlows = 128, ///< Most flows a multipath hop is probed with
+    kTracerouteDefaultStatisticsWindow = 100, ///< Default probes per hop in continuous statistics
+    kTracerouteDefaultTimeout = 5,      ///< Default timeout in seconds
+    kTracerouteDefaultProbeIntervalMilliseconds = 10 ///< Default probe interval
 };
 
+/*! Default interval between probes, in seconds.
+ */
+static const NSTimeInterval kTracerouteDefaultProbeInterval =
+    kTracerouteDefaultProbeIntervalMilliseconds / 1000.0;
+
 NS_ASSUME_NONNULL_END
@@ -4,6 +4,10 @@
  */
 
 #import "Public/SimpleTraceroute.h"
+#import "TracerouteHopWindows.h"
+#import "TracerouteProbeTable.h"
+#import "TracerouteResponseParser.h"
+#import "TracerouteResultInternal.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -12,56 +16,74 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/ip_icmp.h>
+#include <os/lock.h>
 #include <sys/socket.h>
 
-#pragma mark * TracerouteResult Implementation
-
-@implementation TracerouteResult
-
-- (instancetype)initWithTargetHostname:(NSString *)targetHostname
-                         targetAddress:(NSData *)targetAddress
-                               maxHops:(uint8_t)maxHops
-                            actualHops:(uint8_t)actualHops
-                             totalTime:(double)totalTime
-                                  hops:(NSArray<NSValue *> *)hops
-                         reachedTarget:(BOOL)reachedTarget {
-  if ((self = [super init])) {
-    _targetHostname = [targetHostname copy];
-    _targetAddress = [targetAddress copy];
-    _maxHops = maxHops;
-    _actualHops = actualHops;
-    _totalTime = totalTime;
-    _hops = [hops copy];
-    _reachedTarget = reachedTarget;
-  }
-  return self;
-}
-
-@end
-
 #pragma mark * Private Interface
 
-@interface SimpleTraceroute ()
+@interface SimpleTraceroute () <SimplePingEngineClient>
 
 // Read/write versions of public properties
 @property(nonatomic, copy, readwrite, nullable) NSData *hostAddress;
+@property(nonatomic, assign, readwrite) uint16_t identifier;
 @property(nonatomic, assign, readwrite) uint8_t currentHop;
 @property(nonatomic, assign, readwrite) BOOL isRunning;
 
 // Private properties for traceroute functionality
-@property(nonatomic, strong, readwrite, nullable) CFHostRef host
-    __attribute__((NSObject));
-@property(nonatomic, strong, readwrite, nullable) CFSocketRef socket
-    __attribute__((NSObject));
-@property(nonatomic, strong, readwrite, nullable) NSTimer *timeoutTimer;
 @property(nonatomic, strong, readwrite, nullable)
-    NSMutableDictionary *pendingProbes;
+    SimplePingHostResolver *resolver;
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingReadSource *readSource;
+// YES once added to engine, whose socket is then used instead of readSource
+@property(nonatomic, assign, readwrite) BOOL addedToEngine;
+// Sequential mode hop timeout, see -startTimeoutTimerForHop:
+@property(nonatomic, assign, readwrite) SimplePingTimeoutToken hopTimeoutToken;
+@property(nonatomic, assign, readwrite) uint8_t hopTimeoutHop;
+@property(nonatomic, assign, readwrite) NSTimeInterval hopTimeoutStartTime;
 @property(nonatomic, assign, readwrite) uint16_t nextSequenceNumber;
 @property(nonatomic, assign, readwrite) BOOL nextSequenceNumberHasWrapped;
 
 // Traceroute state
 @property(nonatomic, assign, readwrite) NSTimeInterval startTime;
-@property(nonatomic, strong, readwrite, nullable) NSMutableArray *completedHops;
+// Names of routers that have been looked up, keyed by numeric address
+@property(nonatomic, strong, readwrite, nullable)
+    NSMutableDictionary<NSString *, NSString *> *routerHostNames;
+
+// Parallel probing state
+@property(nonatomic, assign, readwrite) SimplePingTimeoutToken probeDeadlineToken;
+@property(nonatomic, strong, readwrite, nullable)
+    NSMutableDictionary *parallelHopResults;
+@property(nonatomic, assign, readwrite) NSUInteger nextParallelHopToSend;
+@property(nonatomic, assign, readwrite) NSUInteger nextParallelHopToReport;
+@property(nonatomic, assign, readwrite) uint8_t destinationHop;
+
+// Multipath probing state: the interfaces the current hop's flows found
+@property(nonatomic, strong, readwrite, nullable)
+    NSMutableSet<NSString *> *multipathInterfaces;
+
+// Continuous probing state, see -startContinuousProbing
+@property(nonatomic, assign, readwrite) NSUInteger cycleCount;
+@property(nonatomic, assign, readwrite) SimplePingTimeoutToken cycleToken;
+// The router that last answered each hop, keyed by hop number
+@property(nonatomic, strong, readwrite, nullable)
+    NSMutableDictionary<NSNumber *, NSString *> *continuousRouterAddresses;
+
+// The timer wheel both kinds of timeout are kept on, see
+// -addTimeoutForKey:deadline:
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingTimeoutWheel *timeoutWheel;
+@property(nonatomic, assign, readwrite) NSUInteger timeoutWheelClient;
+
+// Probe pacing state, see -sendPacedProbes
+@property(nonatomic, strong, readwrite, nullable)
+    NSMutableArray<NSNumber *> *pacedProbes;
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingTimerSource *pacerTimer;
+
+// Responses read since the socket was last drained, for
+// -simpleTraceroute:didReceiveResponses:, see -flushReceivedResponses
+@property(nonatomic, strong, readonly)
+    NSMutableArray<TracerouteHopResult *> *pendingResponses;
 
 @end
 
@@ -74,12 +96,16 @@
   if (self != nil) {
     self.hopNumber = 0;
     self.routerAddress = nil;
+    self.hostName = nil;
     self.roundTripTime = 0.0;
     self.isDestination = NO;
     self.isTimeout = NO;
     self.timestamp = nil;
     self.sequenceNumber = 0;
     self.probeIndex = 0;
+    self.probeCount = 1;
+    self.roundTripNanoseconds = 0;
+    self.deliveryDelayNanoseconds = 0;
   }
   return self;
 }
@@ -98,740 +124,1463 @@
 
 @end
 
-@implementation SimpleTraceroute
+#pragma mark * Probe Timing
 
-#pragma mark * Initialization and Deallocation
+// Probe times are nanoseconds on the SimplePingMonotonicNanoseconds() clock,
+// see SimplePingTiming.h
 
-- (instancetype)initWithHostName:(NSString *)hostName {
-  NSParameterAssert(hostName != nil);
+/*! Converts an interval in seconds to nanoseconds
+ */
+static uint64_t TracerouteNanosecondsFromSeconds(NSTimeInterval seconds) {
+  return (uint64_t)(seconds * NSEC_PER_SEC);
+}
+
+/*! Converts nanoseconds to an interval in seconds
+ */
+static NSTimeInterval TracerouteSecondsFromNanoseconds(uint64_t nanoseconds) {
+  return (NSTimeInterval)nanoseconds / NSEC_PER_SEC;
+}
+
+/*! Keys of our timeouts on the timer wheel
+ */
+enum {
+  kTracerouteHopTimeoutKey = 1,    // sequential mode, the current hop
+  kTracerouteProbeDeadlineKey = 2, // parallel mode, the oldest pending probe
+  kTracerouteCycleKey = 3,         // continuous mode, the next round
+};
+
+/*! Shortest tick of a private timer wheel, in seconds
+ *  \details With an engine the engine's wheel is used instead.
+ */
+static const NSTimeInterval kTracerouteMinimumTimeoutTick = 0.01;
+
+#pragma mark * TracerouteHopStorage
+
+/*! Probe results shared by the results that differ only in their labels, see
+ *  -[TracerouteResult resultWithTargetHostname:]
+ */
+@interface TracerouteHopStorage : NSObject {
+@public
+  TracerouteHopStore _store;
+}
+@property(nonatomic, copy, readonly)
+    NSDictionary<NSString *, NSString *> *routerHostNames;
+@end
+
+@implementation TracerouteHopStorage
+
+/*! Initialize storage with a copy of a store
+ *  \returns nil if memory ran out
+ */
+- (nullable instancetype)initWithHopStore:(const TracerouteHopStore *)hopStore
+                          routerHostNames:
+                              (NSDictionary<NSString *, NSString *> *)
+                                  routerHostNames {
   self = [super init];
   if (self != nil) {
-    self->_hostName = [hostName copy];
-    self->_identifier = (uint16_t)arc4random();
-    self->_maxHops = kTracerouteDefaultMaxHops;
-    self->_timeout = kTracerouteDefaultTimeout;
-    self->_probesPerHop = kTracerouteDefaultProbesPerHop;
-    self->_addressStyle = SimplePingAddressStyleAny;
-
-    // Initialize private properties
-    self->_pendingProbes = [[NSMutableDictionary alloc] init];
-    self->_completedHops = [[NSMutableArray alloc] init];
-    self->_nextSequenceNumber = 0;
-    self->_nextSequenceNumberHasWrapped = NO;
-    self->_currentHop = 0;
-    self->_isRunning = NO;
+    TracerouteHopStoreInit(&self->_store);
+    if (!TracerouteHopStoreCopy(&self->_store, hopStore)) {
+      return nil;
+    }
+    self->_routerHostNames = [routerHostNames copy];
   }
   return self;
 }
 
 - (void)dealloc {
-  [self stop];
-  // Double check that -stop took care of _host and _socket
-  assert(self->_host == NULL);
-  assert(self->_socket == NULL);
+  TracerouteHopStoreDestroy(&self->_store);
 }
 
-#pragma mark * Property Access
-
-- (sa_family_t)hostAddressFamily {
-  sa_family_t result;
+@end
 
-  result = AF_UNSPEC;
-  if ((self.hostAddress != nil) &&
-      (self.hostAddress.length >= sizeof(struct sockaddr))) {
-    result = ((const struct sockaddr *)self.hostAddress.bytes)->sa_family;
-  }
-  return result;
-}
+#pragma mark * TracerouteHopSamples Implementation
 
-#pragma mark * Error Handling
+@interface TracerouteHopSamples ()
 
-/*! Shuts down the traceroute object and tells the delegate about the error.
- *  \param error Describes the failure.
- */
-/*! Shuts down the traceroute object and tells the delegate about the error.
- *  \param error Describes the failure.
+/*! Initialize samples from a hop's statistics
+ *  \param latencies every reply, in seconds
  */
-- (void)didFailWithError:(NSError *)error {
-  id<SimpleTracerouteDelegate> strongDelegate;
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                      accumulator:(const TracerouteHopAccumulator *)accumulator
+                        latencies:(NSArray<NSNumber *> *)latencies;
 
-  assert(error != nil);
+@end
 
-  // Ensure delegate is called on main thread
-  if (![NSThread isMainThread]) {
-    [self ensureMainThread:^{
-      [self didFailWithError:error];
-    }];
-    return;
-  }
+@implementation TracerouteHopSamples
 
-  // Prevent duplicate calls
-  if (!self.isRunning && self.host == NULL && self.socket == NULL) {
-    return;
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                      accumulator:(const TracerouteHopAccumulator *)accumulator
+                        latencies:(NSArray<NSNumber *> *)latencies {
+  self = [super init];
+  if (self != nil) {
+    self->_hopNumber = hopNumber;
+    self->_probeCount = accumulator->probeCount;
+    self->_replyCount = accumulator->replyCount;
+    self->_lossRatio = TracerouteHopAccumulatorLossRatio(accumulator);
+    self->_minimumLatency =
+        TracerouteSecondsFromNanoseconds(accumulator->minimumNanoseconds);
+    self->_averageLatency = accumulator->meanNanoseconds / NSEC_PER_SEC;
+    self->_maximumLatency =
+        TracerouteSecondsFromNanoseconds(accumulator->maximumNanoseconds);
+    self->_standardDeviation =
+        TracerouteHopAccumulatorStandardDeviation(accumulator) / NSEC_PER_SEC;
+    self->_latencies = [latencies copy];
   }
+  return self;
+}
 
-  // Log detailed error information for debugging
-  NSLog(@"SimpleTraceroute failed with error: %@", error.localizedDescription);
+- (NSString *)description {
+  return [NSString
+      stringWithFormat:@"Hop %d: %lu/%lu replies, %.3f/%.3f/%.3f/%.3f ms",
+                       self.hopNumber, (unsigned long)self.replyCount,
+                       (unsigned long)self.probeCount,
+                       self.minimumLatency * 1000.0,
+                       self.averageLatency * 1000.0,
+                       self.maximumLatency * 1000.0,
+                       self.standardDeviation * 1000.0];
+}
 
-  // Retain ourselves temporarily to prevent dealloc during delegate callback
-  CFAutorelease(CFBridgingRetain(self));
+@end
 
-  [self stop];
+#pragma mark * TracerouteHopStatistics Implementation
 
-  strongDelegate = self.delegate;
-  if ((strongDelegate != nil) &&
-      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
-                                                   didFailWithError:)]) {
-    [strongDelegate simpleTraceroute:self didFailWithError:error];
-  }
-}
+@interface TracerouteHopStatistics ()
 
-/*! Converts CFStreamError to NSError and calls -didFailWithError:.
- *  \param streamError Describes the failure.
+/*! Initialize statistics from a hop's window
  */
-- (void)didFailWithHostStreamError:(CFStreamError)streamError {
-  NSDictionary *userInfo;
-  NSError *error;
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                    routerAddress:(nullable NSString *)routerAddress
+                    isDestination:(BOOL)isDestination
+                          summary:(const TracerouteHopWindowSummary *)summary;
 
-  if (streamError.domain == kCFStreamErrorDomainNetDB) {
-    userInfo = @{(id)kCFGetAddrInfoFailureKey : @(streamError.error)};
-  } else {
-    userInfo = nil;
+@end
+
+@implementation TracerouteHopStatistics
+
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                    routerAddress:(nullable NSString *)routerAddress
+                    isDestination:(BOOL)isDestination
+                          summary:(const TracerouteHopWindowSummary *)summary {
+  self = [super init];
+  if (self != nil) {
+    self->_hopNumber = hopNumber;
+    self->_routerAddress = [routerAddress copy];
+    self->_isDestination = isDestination;
+    self->_sentCount = (NSUInteger)summary->probeCount;
+    self->_windowCount = summary->windowCount;
+    self->_replyCount = summary->replyCount;
+    self->_lossRatio =
+        (summary->windowCount != 0)
+            ? (double)(summary->windowCount - summary->replyCount) /
+                  summary->windowCount
+            : 0;
+    self->_lastLatency =
+        TracerouteSecondsFromNanoseconds(summary->lastNanoseconds);
+    self->_minimumLatency =
+        TracerouteSecondsFromNanoseconds(summary->minimumNanoseconds);
+    self->_averageLatency = summary->meanNanoseconds / NSEC_PER_SEC;
+    self->_maximumLatency =
+        TracerouteSecondsFromNanoseconds(summary->maximumNanoseconds);
+    self->_standardDeviation = summary->standardDeviation / NSEC_PER_SEC;
   }
-  error = [NSError errorWithDomain:(NSString *)kCFErrorDomainCFNetwork
-                              code:kCFHostErrorUnknown
-                          userInfo:userInfo];
+  return self;
+}
 
-  [self didFailWithError:error];
+- (NSString *)description {
+  return [NSString
+      stringWithFormat:@"Hop %d: %@ %.0f%% loss of %lu, last %.3f ms, "
+                       @"%.3f/%.3f/%.3f/%.3f ms",
+                       self.hopNumber, self.routerAddress ?: @"???",
+                       self.lossRatio * 100.0, (unsigned long)self.windowCount,
+                       self.lastLatency * 1000.0, self.minimumLatency * 1000.0,
+                       self.averageLatency * 1000.0,
+                       self.maximumLatency * 1000.0,
+                       self.standardDeviation * 1000.0];
 }
 
-#pragma mark * Host Resolution
+@end
+
+#pragma mark * TraceroutePathGraph Implementation
+
+@interface TraceroutePathLink ()
 
-/*! The callback for our CFHost object.
+/*! Initialize a link
  */
-static void HostResolveCallback(CFHostRef theHost, CFHostInfoType typeInfo,
-                                const CFStreamError *error, void *info) {
-  SimpleTraceroute *obj;
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                      fromAddress:(NSString *)fromAddress
+                        toAddress:(NSString *)toAddress
+                        flowCount:(NSUInteger)flowCount;
 
-  obj = (__bridge SimpleTraceroute *)info;
-  assert([obj isKindOfClass:[SimpleTraceroute class]]);
+@end
 
-#pragma unused(theHost)
-  assert(theHost == obj.host);
-#pragma unused(typeInfo)
-  assert(typeInfo == kCFHostAddresses);
+@implementation TraceroutePathLink
 
-  if ((error != NULL) && (error->domain != 0)) {
-    [obj didFailWithHostStreamError:*error];
-  } else {
-    [obj hostResolutionDone];
+- (instancetype)initWithHopNumber:(uint8_t)hopNumber
+                      fromAddress:(NSString *)fromAddress
+                        toAddress:(NSString *)toAddress
+                        flowCount:(NSUInteger)flowCount {
+  self = [super init];
+  if (self != nil) {
+    self->_hopNumber = hopNumber;
+    self->_fromAddress = [fromAddress copy];
+    self->_toAddress = [toAddress copy];
+    self->_flowCount = flowCount;
   }
+  return self;
 }
 
-/*! Processes the results of name-to-address resolution.
+- (NSString *)description {
+  return [NSString stringWithFormat:@"Hop %d: %@ -> %@ (%lu flows)",
+                                    self.hopNumber, self.fromAddress,
+                                    self.toAddress,
+                                    (unsigned long)self.flowCount];
+}
+
+@end
+
+@interface TraceroutePathGraph ()
+
+/*! Initialize a graph
+ *  \param interfacesByHop interfaces of each hop, starting at hop 1
  */
-- (void)hostResolutionDone {
-  Boolean resolved;
-  NSArray *addresses;
+- (instancetype)initWithInterfacesByHop:
+                    (NSArray<NSArray<NSString *> *> *)interfacesByHop
+                                  links:(NSArray<TraceroutePathLink *> *)links
+                              flowCount:(NSUInteger)flowCount;
 
-  // Find the first appropriate address
-  addresses = (__bridge NSArray *)CFHostGetAddressing(self.host, &resolved);
-  if (resolved && (addresses != nil)) {
-    resolved = false;
-    for (NSData *address in addresses) {
-      const struct sockaddr *addrPtr;
-
-      addrPtr = (const struct sockaddr *)address.bytes;
-      if (address.length >= sizeof(struct sockaddr)) {
-        switch (addrPtr->sa_family) {
-        case AF_INET: {
-          if (self.addressStyle != SimplePingAddressStyleICMPv6) {
-            self.hostAddress = address;
-            resolved = true;
-          }
-        } break;
-        case AF_INET6: {
-          if (self.addressStyle != SimplePingAddressStyleICMPv4) {
-            self.hostAddress = address;
-            resolved = true;
-          }
-        } break;
-        }
-      }
-      if (resolved) {
-        break;
-      }
-    }
-  }
+@end
 
-  // We're done resolving, so shut that down
-  [self stopHostResolution];
+@implementation TraceroutePathGraph
 
-  // If all is OK, start the traceroute, otherwise stop
-  if (resolved) {
-    [self startTracerouteWithHostAddress];
-  } else {
-    [self
-        didFailWithError:[NSError
-                             errorWithDomain:(NSString *)kCFErrorDomainCFNetwork
-                                        code:kCFHostErrorHostNotFound
-                                    userInfo:nil]];
+- (instancetype)initWithInterfacesByHop:
+                    (NSArray<NSArray<NSString *> *> *)interfacesByHop
+                                  links:(NSArray<TraceroutePathLink *> *)links
+                              flowCount:(NSUInteger)flowCount {
+  self = [super init];
+  if (self != nil) {
+    self->_interfacesByHop = [interfacesByHop copy];
+    self->_links = [links copy];
+    self->_flowCount = flowCount;
   }
+  return self;
 }
 
-/*! Stops the name-to-address resolution infrastructure.
- */
-- (void)stopHostResolution {
-  if (self.host != NULL) {
-    CFHostSetClient(self.host, NULL, NULL);
-    CFHostUnscheduleFromRunLoop(self.host, CFRunLoopGetCurrent(),
-                                kCFRunLoopDefaultMode);
-    self.host = NULL;
+- (NSArray<NSString *> *)interfacesAtHop:(uint8_t)hopNumber {
+  if (hopNumber == 0 || hopNumber > self.interfacesByHop.count) {
+    return @[];
   }
+  return self.interfacesByHop[hopNumber - 1];
 }
 
-#pragma mark * Socket Management
-
-/*! Starts the traceroute after successful host resolution.
- */
-- (void)startTracerouteWithHostAddress {
-  int err;
-  int fd;
+- (NSString *)description {
+  NSUInteger interfaceCount = 0;
+  for (NSArray<NSString *> *interfaces in self.interfacesByHop) {
+    interfaceCount += interfaces.count;
+  }
+  return [NSString
+      stringWithFormat:@"%lu hops, %lu interfaces, %lu links, %lu flows",
+                       (unsigned long)self.interfacesByHop.count,
+                       (unsigned long)interfaceCount,
+                       (unsigned long)self.links.count,
+                       (unsigned long)self.flowCount];
+}
 
-  assert(self.hostAddress != nil);
+@end
 
-  // Open the socket
-  fd = -1;
-  err = 0;
-  switch (self.hostAddressFamily) {
-  case AF_INET: {
-    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
-    if (fd < 0) {
-      err = errno;
-    }
-  } break;
-  case AF_INET6: {
-    fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_ICMPV6);
-    if (fd < 0) {
-      err = errno;
-    }
-  } break;
-  default: {
-    err = EPROTONOSUPPORT;
-  } break;
-  }
+#pragma mark * TracerouteResult Implementation
 
-  if (err != 0) {
-    [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain
-                                               code:err
-                                           userInfo:nil]];
-  } else {
-    CFSocketContext context = {0, (__bridge void *)(self), NULL, NULL, NULL};
-    CFRunLoopSourceRef rls;
-    id<SimpleTracerouteDelegate> strongDelegate;
+/*! What one hop's probe results add up to, see -[TracerouteResult buildHops]
+ */
+typedef struct TracerouteHopSummary {
+  uint32_t addressIndex; // of the first probe that has one
+  uint8_t probeCount;
+  double latencies[3];
+  BOOL timeout[3];
+} TracerouteHopSummary;
+
+@implementation TracerouteResult {
+  // Probe results, nil for results made with explicit hops
+  TracerouteHopStorage *_hopStorage;
+  // Guards the lazily built ivars below
+  os_unfair_lock _lock;
+  NSArray<NSValue *> *_hops;
+  NSArray<TracerouteHopResult *> *_hopResults;
+  NSArray<TracerouteHopSamples *> *_hopSamples;
+  TraceroutePathGraph *_pathGraph;
+  // One per interned address, shared by every result that has it
+  NSArray<NSString *> *_routerAddressStrings;
+  // One sockaddr per interned address, pointed to by the structs in _hops
+  NSArray<NSData *> *_routerAddressData;
+}
 
-    // Wrap it in a CFSocket and schedule it on the runloop
-    self.socket = (CFSocketRef)CFAutorelease(CFSocketCreateWithNative(
-        NULL, fd, kCFSocketReadCallBack, SocketReadCallback, &context));
-    assert(self.socket != NULL);
+- (instancetype)initWithTargetHostname:(NSString *)targetHostname
+                         targetAddress:(NSData *)targetAddress
+                               maxHops:(uint8_t)maxHops
+                            actualHops:(uint8_t)actualHops
+                             totalTime:(double)totalTime
+                                  hops:(NSArray<NSValue *> *)hops
+                         reachedTarget:(BOOL)reachedTarget {
+  if ((self = [super init])) {
+    _targetHostname = [targetHostname copy];
+    _targetAddress = [targetAddress copy];
+    _maxHops = maxHops;
+    _actualHops = actualHops;
+    _totalTime = totalTime;
+    _hops = [hops copy];
+    _hopResults = @[];
+    _hopSamples = @[];
+    _reachedTarget = reachedTarget;
+    _lock = OS_UNFAIR_LOCK_INIT;
+  }
+  return self;
+}
 
-    // The socket will now take care of cleaning up our file descriptor
-    assert(CFSocketGetSocketFlags(self.socket) & kCFSocketCloseOnInvalidate);
-    fd = -1;
+- (instancetype)initWithTargetHostname:(NSString *)targetHostname
+                         targetAddress:(NSData *)targetAddress
+                               maxHops:(uint8_t)maxHops
+                            actualHops:(uint8_t)actualHops
+                             totalTime:(double)totalTime
+                              hopStore:(const TracerouteHopStore *)hopStore
+                       routerHostNames:
+                           (NSDictionary<NSString *, NSString *> *)
+                               routerHostNames
+                         reachedTarget:(BOOL)reachedTarget {
+  TracerouteHopStorage *storage =
+      [[TracerouteHopStorage alloc] initWithHopStore:hopStore
+                                     routerHostNames:routerHostNames];
+  if (storage == nil) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Out of memory copying %u probe results",
+                       hopStore->count);
+  }
+  self = [self initWithTargetHostname:targetHostname
+                        targetAddress:targetAddress
+                              maxHops:maxHops
+                           actualHops:actualHops
+                            totalTime:totalTime
+                                 hops:@[]
+                        reachedTarget:reachedTarget];
+  if (self != nil && storage != nil) {
+    _hopStorage = storage;
+    _hops = nil;
+    _hopResults = nil;
+    _hopSamples = nil;
+  }
+  return self;
+}
 
-    // Verify TTL functionality with initial test
-    if (![self setTTLForSocket:CFSocketGetNative(self.socket)
-                           ttl:1
-                 addressFamily:self.hostAddressFamily]) {
-      NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                           code:errno
-                                       userInfo:@{
-                                         NSLocalizedDescriptionKey :
-                                             @"Failed to initialize TTL control"
-                                       }];
-      [self didFailWithError:error];
-      return;
-    }
+- (TracerouteResult *)resultWithTargetHostname:(NSString *)targetHostname {
+  if ([self.targetHostname isEqualToString:targetHostname]) {
+    return self;
+  }
+  TracerouteResult *result =
+      [[TracerouteResult alloc] initWithTargetHostname:targetHostname
+                                         targetAddress:self.targetAddress
+                                               maxHops:self.maxHops
+                                            actualHops:self.actualHops
+                                             totalTime:self.totalTime
+                                                  hops:@[]
+                                         reachedTarget:self.reachedTarget];
+  if (result != nil && self->_hopStorage != nil) {
+    result->_hopStorage = self->_hopStorage;
+    result->_hops = nil;
+    result->_hopResults = nil;
+    result->_hopSamples = nil;
+  } else if (result != nil) {
+    result->_hops = self->_hops;
+  }
+  result.hasFlows = self.hasFlows;
+  return result;
+}
 
-    rls = CFSocketCreateRunLoopSource(NULL, self.socket, 0);
-    assert(rls != NULL);
+#pragma mark * Lazy Conversion
 
-    CFRunLoopAddSource(CFRunLoopGetCurrent(), rls, kCFRunLoopDefaultMode);
-    CFRelease(rls);
+- (NSArray<NSValue *> *)hops {
+  NSArray<NSValue *> *hops;
 
-    // Mark as running and notify delegate
-    self.isRunning = YES;
-    self.startTime = [NSDate timeIntervalSinceReferenceDate];
+  os_unfair_lock_lock(&self->_lock);
+  if (self->_hops == nil) {
+    self->_hops = [self buildHops];
+  }
+  hops = self->_hops;
+  os_unfair_lock_unlock(&self->_lock);
+  return hops;
+}
 
-    strongDelegate = self.delegate;
-    if ((strongDelegate != nil) &&
-        [strongDelegate respondsToSelector:@selector(simpleTraceroute:
-                                                  didStartWithAddress:)]) {
-      [strongDelegate simpleTraceroute:self
-                   didStartWithAddress:self.hostAddress];
-    }
+- (NSArray<TracerouteHopResult *> *)hopResults {
+  NSArray<TracerouteHopResult *> *hopResults;
 
-    // Start the first hop
-    [self startNextHop];
+  os_unfair_lock_lock(&self->_lock);
+  if (self->_hopResults == nil) {
+    self->_hopResults = [self buildHopResults];
   }
-  assert(fd == -1);
+  hopResults = self->_hopResults;
+  os_unfair_lock_unlock(&self->_lock);
+  return hopResults;
 }
 
-/*! The callback for our CFSocket object.
- */
-static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
-                               CFDataRef address, const void *data,
-                               void *info) {
-  SimpleTraceroute *obj;
+- (NSArray<TracerouteHopSamples *> *)hopSamples {
+  NSArray<TracerouteHopSamples *> *hopSamples;
+
+  os_unfair_lock_lock(&self->_lock);
+  if (self->_hopSamples == nil) {
+    NSMutableArray<TracerouteHopSamples *> *allSamples =
+        [NSMutableArray array];
+    uint32_t hopCount = self->_hopStorage->_store.hopCount;
+    for (uint32_t hopNumber = 0; hopNumber < hopCount; hopNumber++) {
+      TracerouteHopSamples *samples =
+          [self buildSamplesForHop:(uint8_t)hopNumber];
+      if (samples != nil) {
+        [allSamples addObject:samples];
+      }
+    }
+    self->_hopSamples = [allSamples copy];
+  }
+  hopSamples = self->_hopSamples;
+  os_unfair_lock_unlock(&self->_lock);
+  return hopSamples;
+}
 
-  obj = (__bridge SimpleTraceroute *)info;
-  assert([obj isKindOfClass:[SimpleTraceroute class]]);
+- (nullable TracerouteHopSamples *)samplesForHop:(uint8_t)hopNumber {
+  // The store is never changed, so this needs no lock
+  if (self->_hopStorage == nil) {
+    return nil;
+  }
+  return [self buildSamplesForHop:hopNumber];
+}
 
-#pragma unused(s)
-  assert(s == obj.socket);
-#pragma unused(type)
-  assert(type == kCFSocketReadCallBack);
-#pragma unused(address)
-  assert(address == nil);
-#pragma unused(data)
-  assert(data == nil);
+- (nullable TraceroutePathGraph *)pathGraph {
+  TraceroutePathGraph *pathGraph;
 
-  [obj readData];
+  if (!self.hasFlows || self->_hopStorage == nil) {
+    return nil;
+  }
+  os_unfair_lock_lock(&self->_lock);
+  if (self->_pathGraph == nil) {
+    self->_pathGraph = [self buildPathGraph];
+  }
+  pathGraph = self->_pathGraph;
+  os_unfair_lock_unlock(&self->_lock);
+  return pathGraph;
 }
 
-/*! Stops the socket infrastructure.
- */
-- (void)stopSocket {
-  if (self.socket != NULL) {
-    CFSocketInvalidate(self.socket);
-    self.socket = NULL;
-  }
+- (NSUInteger)hopResultCount {
+  return (self->_hopStorage != nil) ? self->_hopStorage->_store.count : 0;
 }
 
-#pragma mark * TTL Control Methods
+- (NSUInteger)routerAddressCount {
+  return (self->_hopStorage != nil) ? self->_hopStorage->_store.addressCount
+                                    : 0;
+}
 
-/*! Validate the validity of TTL value
- *  \param ttl The TTL value to validate
- *  \returns Returns YES if valid, NO if invalid
+/*! Returns the numeric form of every interned address; called with _lock held
  */
-- (BOOL)isValidTTL:(uint8_t)ttl {
-  // TTL value must be in the range 1-255
-  // 0 is invalid (will cause packet to expire immediately)
-  return (ttl >= 1 && ttl <= 255);
+- (NSArray<NSString *> *)routerAddressStrings {
+  if (self->_routerAddressStrings == nil) {
+    const TracerouteHopStore *store = &self->_hopStorage->_store;
+    NSMutableArray<NSString *> *strings =
+        [NSMutableArray arrayWithCapacity:store->addressCount];
+    char buffer[INET6_ADDRSTRLEN];
+
+    for (uint32_t index = 0; index < store->addressCount; index++) {
+      BOOL formatted = TracerouteHopStoreFormatAddress(store, index, buffer,
+                                                       sizeof(buffer));
+      [strings addObject:formatted ? @(buffer) : @""];
+    }
+    self->_routerAddressStrings = [strings copy];
+  }
+  return self->_routerAddressStrings;
 }
 
-/*! Get the protocol level corresponding to the current address family
- *  \param addressFamily Address family
- *  \returns Protocol level constant, returns -1 on failure
+/*! Returns a sockaddr for every interned address; called with _lock held
  */
-- (int)getProtocolLevelForAddressFamily:(sa_family_t)addressFamily {
-  switch (addressFamily) {
-  case AF_INET:
-    return IPPROTO_IP;
-  case AF_INET6:
-    return IPPROTO_IPV6;
-  default:
-    return -1;
+- (NSArray<NSData *> *)routerAddressData {
+  if (self->_routerAddressData == nil) {
+    const TracerouteHopStore *store = &self->_hopStorage->_store;
+    NSMutableArray<NSData *> *addresses =
+        [NSMutableArray arrayWithCapacity:store->addressCount];
+    struct sockaddr_storage address;
+
+    for (uint32_t index = 0; index < store->addressCount; index++) {
+      socklen_t length =
+          TracerouteHopStoreGetSockaddr(store, index, &address);
+      [addresses addObject:[NSData dataWithBytes:&address length:length]];
+    }
+    self->_routerAddressData = [addresses copy];
   }
+  return self->_routerAddressData;
 }
 
-/*! Get the socket option corresponding to the current address family
- *  \param addressFamily Address family
- *  \returns Socket option constant, returns -1 on failure
+/*! Builds hopResults from the probe results; called with _lock held
  */
-- (int)getSocketOptionForAddressFamily:(sa_family_t)addressFamily {
-  switch (addressFamily) {
-  case AF_INET:
-    return IP_TTL;
-  case AF_INET6:
-    return IPV6_UNICAST_HOPS;
-  default:
-    return -1;
-  }
+- (NSArray<TracerouteHopResult *> *)buildHopResults {
+  const TracerouteHopStore *store = &self->_hopStorage->_store;
+  NSArray<NSString *> *addresses = [self routerAddressStrings];
+  NSDictionary<NSString *, NSString *> *hostNames =
+      self->_hopStorage.routerHostNames;
+  NSMutableArray<TracerouteHopResult *> *hopResults =
+      [NSMutableArray arrayWithCapacity:store->count];
+
+  for (uint32_t index = 0; index < store->count; index++) {
+    TracerouteHopRecord record;
+    TracerouteHopStoreGet(store, index, &record);
+
+    TracerouteHopResult *hopResult = [[TracerouteHopResult alloc] init];
+    hopResult.hopNumber = record.hopNumber;
+    if (record.addressIndex != kTracerouteHopStoreNoAddress) {
+      hopResult.routerAddress = addresses[record.addressIndex];
+      hopResult.hostName = hostNames[hopResult.routerAddress];
+    }
+    hopResult.roundTripTime =
+        TracerouteSecondsFromNanoseconds(record.roundTripNanoseconds);
+    hopResult.isDestination =
+        (record.flags & kTracerouteHopRecordDestination) != 0;
+    hopResult.isTimeout = (record.flags & kTracerouteHopRecordTimeout) != 0;
+    if (record.timestamp != 0) {
+      hopResult.timestamp =
+          [NSDate dateWithTimeIntervalSinceReferenceDate:record.timestamp];
+    }
+    hopResult.sequenceNumber = record.sequenceNumber;
+    hopResult.probeIndex = record.probeIndex;
+    hopResult.probeCount = record.probeCount;
+    hopResult.roundTripNanoseconds =
+        hopResult.isTimeout ? 0 : record.roundTripNanoseconds;
+    hopResult.deliveryDelayNanoseconds = record.deliveryDelayNanoseconds;
+    [hopResults addObject:hopResult];
+  }
+  return [hopResults copy];
 }
 
-/*! Set TTL value for the specified socket
- *  \param socketFD The socket file descriptor to set
- *  \param ttl TTL value (1-255)
- *  \param addressFamily Address family (AF_INET or AF_INET6)
- *  \returns Returns YES if successful, NO if failed
+/*! Builds pathGraph from the probe results; called with _lock held
+ *  \details A probe's index is its flow, and each flow takes one path, so
+ *  answers to the same flow at consecutive hops are a link.
  */
-- (BOOL)setTTLForSocket:(int)socketFD
-                    ttl:(uint8_t)ttl
-          addressFamily:(sa_family_t)addressFamily {
-  // 1. Parameter validation
-  if (socketFD < 0) {
-    NSLog(@"SimpleTraceroute: Invalid socket file descriptor: %d", socketFD);
-    return NO;
+- (TraceroutePathGraph *)buildPathGraph {
+  const TracerouteHopStore *store = &self->_hopStorage->_store;
+  NSArray<NSString *> *addresses = [self routerAddressStrings];
+  NSMutableArray<NSMutableOrderedSet<NSString *> *> *interfaces =
+      [NSMutableArray array];
+  NSMutableDictionary<NSNumber *, NSNumber *> *flowAddresses =
+      [NSMutableDictionary dictionary];
+  NSUInteger flowCount = 0;
+
+  // 1. Collect each hop's interfaces, and where each flow was at each hop
+  for (uint32_t index = 0; index < store->count; index++) {
+    uint8_t hopNumber = store->hopNumbers[index];
+    uint32_t addressIndex = store->addressIndices[index];
+
+    flowCount = MAX(flowCount, (NSUInteger)store->probeIndices[index] + 1);
+    if ((store->flags[index] & kTracerouteHopRecordTimeout) != 0 ||
+        addressIndex == kTracerouteHopStoreNoAddress || hopNumber == 0) {
+      continue;
+    }
+    while (interfaces.count < hopNumber) {
+      [interfaces addObject:[NSMutableOrderedSet orderedSet]];
+    }
+    [interfaces[hopNumber - 1] addObject:addresses[addressIndex]];
+    flowAddresses[@(((NSUInteger)hopNumber << 8) |
+                    store->probeIndices[index])] = @(addressIndex);
+  }
+
+  // 2. Link each answer to the same flow's answer at the next hop
+  NSMutableOrderedSet<NSArray<NSNumber *> *> *linkKeys =
+      [NSMutableOrderedSet orderedSet];
+  NSCountedSet<NSArray<NSNumber *> *> *linkFlows = [NSCountedSet set];
+  for (NSUInteger hopNumber = 1; hopNumber < interfaces.count; hopNumber++) {
+    for (NSUInteger flow = 0; flow < flowCount; flow++) {
+      NSNumber *from = flowAddresses[@((hopNumber << 8) | flow)];
+      NSNumber *to = flowAddresses[@(((hopNumber + 1) << 8) | flow)];
+      if (from == nil || to == nil) {
+        continue;
+      }
+      NSArray<NSNumber *> *key = @[ @(hopNumber), from, to ];
+      [linkKeys addObject:key];
+      [linkFlows addObject:key];
+    }
   }
 
-  if (![self isValidTTL:ttl]) {
-    NSLog(@"SimpleTraceroute: Invalid TTL value: %d", ttl);
-    return NO;
-  }
+  // 3. Box them
+  NSMutableArray<NSArray<NSString *> *> *interfacesByHop =
+      [NSMutableArray arrayWithCapacity:interfaces.count];
+  for (NSOrderedSet<NSString *> *hopInterfaces in interfaces) {
+    [interfacesByHop addObject:hopInterfaces.array];
+  }
+  NSMutableArray<TraceroutePathLink *> *links =
+      [NSMutableArray arrayWithCapacity:linkKeys.count];
+  for (NSArray<NSNumber *> *key in linkKeys) {
+    [links addObject:[[TraceroutePathLink alloc]
+                         initWithHopNumber:key[0].unsignedCharValue
+                               fromAddress:addresses[key[1].unsignedIntValue]
+                                 toAddress:addresses[key[2].unsignedIntValue]
+                                 flowCount:[linkFlows countForObject:key]]];
+  }
+  return [[TraceroutePathGraph alloc] initWithInterfacesByHop:interfacesByHop
+                                                        links:links
+                                                    flowCount:flowCount];
+}
 
-  // 2. Get the corresponding socket option
-  int level = [self getProtocolLevelForAddressFamily:addressFamily];
-  int option = [self getSocketOptionForAddressFamily:addressFamily];
+/*! Builds the samples of one hop from the probe results
+ *  \returns nil if the hop has no probe results
+ */
+- (nullable TracerouteHopSamples *)buildSamplesForHop:(uint8_t)hopNumber {
+  const TracerouteHopStore *store = &self->_hopStorage->_store;
+  TracerouteHopAccumulator accumulator;
 
-  if (level == -1 || option == -1) {
-    NSLog(@"SimpleTraceroute: Unsupported address family: %d", addressFamily);
-    return NO;
+  if (!TracerouteHopStoreGetAccumulator(store, hopNumber, &accumulator)) {
+    return nil;
   }
 
-  // 3. Set socket option
-  // Use int for setsockopt value
-  int hop = (int)ttl;
-  socklen_t hopLen = (socklen_t)sizeof(hop);
-  int result = setsockopt(socketFD, level, option, &hop, hopLen);
-  if (result != 0) {
-    NSLog(@"SimpleTraceroute: Failed to set TTL to %d: %s", ttl,
-          strerror(errno));
-    NSLog(@"SimpleTraceroute: Failed to set TTL to %d: %s (level=%d, opt=%d)",
-          hop, strerror(errno), level, option);
-    return NO;
+  NSMutableArray<NSNumber *> *latencies =
+      [NSMutableArray arrayWithCapacity:accumulator.replyCount];
+  for (uint32_t index = 0; index < store->count; index++) {
+    if (store->hopNumbers[index] == hopNumber &&
+        (store->flags[index] & kTracerouteHopRecordTimeout) == 0) {
+      [latencies addObject:@(TracerouteSecondsFromNanoseconds(
+                               store->roundTripNanoseconds[index]))];
+    }
   }
-
-  NSLog(@"SimpleTraceroute: Successfully set TTL to %d for address family %d",
-        ttl, addressFamily);
-  return YES;
+  return [[TracerouteHopSamples alloc] initWithHopNumber:hopNumber
+                                             accumulator:&accumulator
+                                               latencies:latencies];
 }
 
-/*! Get the current socket's TTL value
- *  \param socketFD Socket file descriptor
- *  \param addressFamily Address family
- *  \returns Current TTL value, returns 0 on failure
+/*! Builds hops from the probe results; called with _lock held
+ *  \details A timeout result stands for the rest of its hop's probes, so it
+ *  marks the probe it starts at.
  */
-- (uint8_t)getTTLForSocket:(int)socketFD
-             addressFamily:(sa_family_t)addressFamily {
-  // 1. Parameter validation
-  if (socketFD < 0) {
-    NSLog(@"SimpleTraceroute: Invalid socket file descriptor: %d", socketFD);
-    return 0;
+- (NSArray<NSValue *> *)buildHops {
+  const TracerouteHopStore *store = &self->_hopStorage->_store;
+  TracerouteHopSummary summaries[UINT8_MAX + 1];
+
+  // 1. Sum up each hop's probes
+  memset(summaries, 0, sizeof(summaries));
+  for (uint32_t index = 0; index < store->count; index++) {
+    TracerouteHopRecord record;
+    TracerouteHopStoreGet(store, index, &record);
+
+    TracerouteHopSummary *summary = &summaries[record.hopNumber];
+    if (summary->probeCount == 0) {
+      summary->addressIndex = kTracerouteHopStoreNoAddress;
+    }
+    if (summary->probeCount < UINT8_MAX) {
+      summary->probeCount += 1;
+    }
+    if (summary->addressIndex == kTracerouteHopStoreNoAddress) {
+      summary->addressIndex = record.addressIndex;
+    }
+    if (record.probeIndex < 3) {
+      if ((record.flags & kTracerouteHopRecordTimeout) != 0) {
+        summary->timeout[record.probeIndex] = YES;
+      } else {
+        summary->latencies[record.probeIndex] =
+            (double)record.roundTripNanoseconds / NSEC_PER_MSEC;
+      }
+    }
   }
 
-  // 2. Get the corresponding socket option
-  int level = [self getProtocolLevelForAddressFamily:addressFamily];
-  int option = [self getSocketOptionForAddressFamily:addressFamily];
-
-  if (level == -1 || option == -1) {
-    NSLog(@"SimpleTraceroute: Unsupported address family: %d", addressFamily);
-    return 0;
-  }
+  // 2. Box them, in hop order
+  NSArray<NSData *> *addresses = [self routerAddressData];
+  NSArray<NSString *> *addressStrings = [self routerAddressStrings];
+  NSDictionary<NSString *, NSString *> *hostNames =
+      self->_hopStorage.routerHostNames;
+  NSMutableArray<NSValue *> *hops = [NSMutableArray array];
 
-  // 3. Get socket option value
-  uint8_t ttl = 0;
-  socklen_t ttlSize = sizeof(ttl);
-  int result = getsockopt(socketFD, level, option, &ttl, &ttlSize);
+  for (NSUInteger hopNumber = 0; hopNumber <= UINT8_MAX; hopNumber++) {
+    const TracerouteHopSummary *summary = &summaries[hopNumber];
+    if (summary->probeCount == 0) {
+      continue;
+    }
 
-  if (result != 0) {
-    NSLog(@"SimpleTraceroute: Failed to get TTL: %s", strerror(errno));
-    return 0;
+    TracerouteHop hop = {0};
+    hop.hopNumber = (uint8_t)hopNumber;
+    hop.probeCount = summary->probeCount;
+    if (summary->addressIndex != kTracerouteHopStoreNoAddress) {
+      // Kept alive by _routerAddressData and _hopStorage, not by the NSValue
+      hop.routerAddress = addresses[summary->addressIndex];
+      hop.routerHostname = hostNames[addressStrings[summary->addressIndex]];
+    }
+    memcpy(hop.latencies, summary->latencies, sizeof(hop.latencies));
+    memcpy(hop.timeout, summary->timeout, sizeof(hop.timeout));
+    [hops addObject:[NSValue valueWithBytes:&hop
+                                   objCType:@encode(TracerouteHop)]];
   }
-
-  return ttl;
+  return [hops copy];
 }
 
-/*! Set TTL for the current hop and send probe packet
- *  \param hop Hop number (1-255)
- *  \returns Returns YES if successful, NO if failed
- */
-- (BOOL)setTTLForCurrentHop:(uint8_t)hop {
-  // Get socket file descriptor
-  if (self.socket == NULL) {
-    NSLog(@"SimpleTraceroute: No socket available for TTL setting");
-    return NO;
-  }
-
-  int socketFD = CFSocketGetNative(self.socket);
-  if (socketFD < 0) {
-    NSLog(@"SimpleTraceroute: Invalid socket for TTL setting");
-    return NO;
-  }
+@end
 
-  // Set TTL
-  return [self setTTLForSocket:socketFD
-                           ttl:hop
-                 addressFamily:self.hostAddressFamily];
+@implementation SimpleTraceroute {
+  // Outstanding probes, indexed by sequence number
+  TracerouteProbeTable _probeTable;
+  // The probe packet, see -prepareProbeTemplate
+  SimplePingPacketTemplate _probeTemplate;
+  // When the last probe was sent, 0 if none yet
+  uint64_t _lastProbeSendTime;
+  // Parallel mode: when each hop's last probe was sent, 0 if none yet
+  uint64_t _hopLastProbeSendTime[256];
+  // The TTL the socket is set to, 0 if unknown
+  uint8_t _socketTTL;
+  // YES if a rateLimiter token has been reserved for the next probe
+  BOOL _pacerHoldsToken;
+  // YES once probing from firstHop back towards the source, see
+  // -finishForwardProbing
+  BOOL _probingBackward;
+  // The hop the forward probes ended at, 0 while probing forward
+  uint8_t _forwardEndHop;
+  // Bumped on every start, so names looked up for an earlier run are dropped
+  NSUInteger _runGeneration;
+  // Every reported hop result, packed, see -reportHopResult:
+  TracerouteHopStore _hopStore;
+  // What the current hop's results so far found, for waitsForAllProbes
+  BOOL _hopReachedDestination;
+  BOOL _hopIsKnownInterface;
+  // The checksum of the unpatched probe, in host byte order, see
+  // -checksumForProbeIndex:
+  uint16_t _flowBaseChecksum;
+  // Multipath mode: the number of flows sent to each hop, see
+  // -sendMultipathFlows
+  uint8_t _multipathFlowsSent[256];
+  // Parallel mode: the number of each hop's probes that have expired, and the
+  // first of them, kept until the hop's last probe is sent and expires too
+  uint16_t _parallelExpiredCount[256];
+  TracerouteProbeSlot _parallelFirstExpired[256];
+  // Continuous mode: YES once the path has been traced, the rolling
+  // statistics (allocated then), the hop the destination last answered at (0
+  // if it hasn't) and the highest hop each round probes
+  BOOL _continuousPhase;
+  TracerouteHopWindows *_hopWindows;
+  uint8_t _continuousDestinationHop;
+  uint8_t _continuousHopLimit;
+  // Counters and callback latencies, see -metrics
+  SimplePingMetrics _metrics;
 }
 
-#pragma mark * Packet Sending Methods
+#pragma mark * Initialization and Deallocation
 
-/*! Sequence number management - get next sequence number
- *  \returns New sequence number
- */
-- (uint16_t)getNextSequenceNumber {
-  uint16_t current = self.nextSequenceNumber;
+- (instancetype)initWithHostName:(NSString *)hostName {
+  return [self initWithHostName:hostName engine:nil];
+}
 
-  // Increment sequence number
-  self.nextSequenceNumber++;
+- (instancetype)initWithHostName:(NSString *)hostName
+                          engine:(SimplePingEngine *)engine {
+  NSParameterAssert(hostName != nil);
+  self = [super init];
+  if (self != nil) {
+    self->_hostName = [hostName copy];
+    self->_engine = engine;
+    self->_identifier = (uint16_t)arc4random();
+    self->_maxHops = kTracerouteDefaultMaxHops;
+    self->_timeout = kTracerouteDefaultTimeout;
+    self->_probesPerHop = kTracerouteDefaultProbesPerHop;
+    self->_addressStyle = SimplePingAddressStyleAny;
+    self->_probeMode = SimpleTracerouteProbeModeSequential;
+    self->_parallelWindow = 0;
+    self->_receiveBatchLimit = 32;
+    self->_timerLeeway = 0.0;
+    self->_probeInterval = kTracerouteDefaultProbeInterval;
+    self->_firstHop = 1;
+    self->_multipathConfidence = 0.95;
+    self->_cycleInterval = 1.0;
+    self->_statisticsWindow = kTracerouteDefaultStatisticsWindow;
 
-  // Handle wraparound (from 65535 to 0)
-  if (self.nextSequenceNumber == 0) {
-    self.nextSequenceNumberHasWrapped = YES;
+    // Initialize private properties
+    TracerouteHopStoreInit(&self->_hopStore);
+    self->_routerHostNames = [[NSMutableDictionary alloc] init];
+    self->_parallelHopResults = [[NSMutableDictionary alloc] init];
+    self->_pendingResponses = [[NSMutableArray alloc] init];
+    self->_pacedProbes = [[NSMutableArray alloc] init];
+    self->_multipathInterfaces = [[NSMutableSet alloc] init];
+    self->_continuousRouterAddresses = [[NSMutableDictionary alloc] init];
+    self->_nextSequenceNumber = 0;
+    self->_nextSequenceNumberHasWrapped = NO;
+    self->_currentHop = 0;
+    self->_isRunning = NO;
   }
-
-  return current;
-}
-
-/*! Record probe packet information
- *  \param sequenceNumber Sequence number
- *  \param hop Hop number
- *  \param probeIndex Probe index
- *  \param timestamp Send timestamp
- */
-- (void)recordProbe:(uint16_t)sequenceNumber
-                hop:(uint8_t)hop
-         probeIndex:(uint8_t)probeIndex
-          timestamp:(NSTimeInterval)timestamp {
-  NSDictionary *probeInfo = @{
-    @"hop" : @(hop),
-    @"probeIndex" : @(probeIndex),
-    @"timestamp" : @(timestamp),
-    @"sequenceNumber" : @(sequenceNumber)
-  };
-
-  NSString *key = [NSString stringWithFormat:@"%d", sequenceNumber];
-  self.pendingProbes[key] = probeInfo;
-
-  // Clean up expired probe records (optional optimization)
-  [self cleanupExpiredProbes];
+  return self;
 }
 
-/*! Find probe information by sequence number
- *  \param sequenceNumber Sequence number
- *  \returns Probe information dictionary, returns nil if not found
- */
-- (nullable NSDictionary *)probeInfoForSequenceNumber:(uint16_t)sequenceNumber {
-  NSString *key = [NSString stringWithFormat:@"%d", sequenceNumber];
-  return self.pendingProbes[key];
+- (void)dealloc {
+  [self stop];
+  // Double check that -stop took care of _resolver and _readSource
+  assert(self->_resolver == nil);
+  assert(self->_readSource == nil);
+  assert(!self->_addedToEngine);
+  TracerouteProbeTableDestroy(&self->_probeTable);
+  SimplePingPacketTemplateDestroy(&self->_probeTemplate);
+  TracerouteHopStoreDestroy(&self->_hopStore);
+  if (self->_hopWindows != NULL) {
+    TracerouteHopWindowsDestroy(self->_hopWindows);
+    free(self->_hopWindows);
+  }
 }
 
-/*! Clean up expired probe records
- */
-- (void)cleanupExpiredProbes {
-  // Clean up probe records that exceed a certain time to prevent memory leaks
-  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
-  NSTimeInterval maxAge =
-      self.timeout * 2; // Double timeout as cleanup threshold
-
-  NSMutableArray *keysToRemove = [NSMutableArray array];
-
-  for (NSString *key in self.pendingProbes) {
-    NSDictionary *probeInfo = self.pendingProbes[key];
-    NSTimeInterval timestamp = [probeInfo[@"timestamp"] doubleValue];
-
-    if (now - timestamp > maxAge) {
-      [keysToRemove addObject:key];
-    }
-  }
+#pragma mark * Property Access
 
-  for (NSString *key in keysToRemove) {
-    [self.pendingProbes removeObjectForKey:key];
-  }
+- (sa_family_t)hostAddressFamily {
+  sa_family_t result;
 
-  if (keysToRemove.count > 0) {
-    NSLog(@"Cleaned up %lu expired probe records",
-          (unsigned long)keysToRemove.count);
+  result = AF_UNSPEC;
+  if ((self.hostAddress != nil) &&
+      (self.hostAddress.length >= sizeof(struct sockaddr))) {
+    result = ((const struct sockaddr *)self.hostAddress.bytes)->sa_family;
   }
+  return result;
 }
 
-/*! Calculate ICMP checksum
- *  \param data ICMP packet data
- *  \returns Calculated checksum
- */
-- (uint16_t)calculateICMPChecksum:(NSData *)data {
-  const uint16_t *words = (const uint16_t *)data.bytes;
-  size_t wordCount = data.length / 2;
-  uint32_t sum = 0;
-
-  // Calculate the sum of all 16-bit words
-  for (size_t i = 0; i < wordCount; i++) {
-    sum += ntohs(words[i]);
-  }
+- (NSArray<TracerouteHopStatistics *> *)hopStatistics {
+  NSMutableArray<TracerouteHopStatistics *> *hopStatistics =
+      [NSMutableArray array];
 
-  // Handle odd bytes
-  if (data.length % 2 == 1) {
-    uint8_t lastByte = ((const uint8_t *)data.bytes)[data.length - 1];
-    sum += lastByte << 8;
+  if (!self->_continuousPhase) {
+    return @[];
   }
-
-  // Handle carry
-  while (sum >> 16) {
-    sum = (sum & 0xFFFF) + (sum >> 16);
+  for (NSUInteger hop = 1; hop <= self->_continuousHopLimit; hop++) {
+    TracerouteHopStatistics *statistics =
+        [self statisticsForHop:(uint8_t)hop];
+    if (statistics != nil) {
+      [hopStatistics addObject:statistics];
+    }
   }
-
-  // Invert to get checksum
-  return htons(~sum);
+  return [hopStatistics copy];
 }
 
-/*! Create payload data for probe packet
- *  \param timestamp Timestamp
- *  \param hop Hop number
- *  \param probeIndex Probe index
- *  \returns Payload data
- */
-- (NSData *)createProbePayload:(NSTimeInterval)timestamp
-                           hop:(uint8_t)hop
-                    probeIndex:(uint8_t)probeIndex {
-  // Create payload containing timestamp and probe information
-  NSMutableData *payload = [NSMutableData dataWithCapacity:32];
+- (SimplePingMetricsSnapshot *)metrics {
+  return [[SimplePingMetricsSnapshot alloc] initWithMetrics:&self->_metrics];
+}
 
-  // Add timestamp (8 bytes)
-  [payload appendBytes:&timestamp length:sizeof(timestamp)];
+#pragma mark * Error Handling
 
-  // Add hop information (1 byte)
-  [payload appendBytes:&hop length:sizeof(hop)];
+/*! Shuts down the traceroute object and tells the delegate about the error.
+ *  \param error Describes the failure.
+ */
+/*! Shuts down the traceroute object and tells the delegate about the error.
+ *  \param error Describes the failure.
+ */
+- (void)didFailWithError:(NSError *)error {
+  id<SimpleTracerouteDelegate> strongDelegate;
 
-  // Add probe index (1 byte)
-  [payload appendBytes:&probeIndex length:sizeof(probeIndex)];
+  assert(error != nil);
 
-  // Add padding data to reach minimum size (optional)
-  const size_t minPayloadSize = 16;
-  while (payload.length < minPayloadSize) {
-    uint8_t padding = 0x00;
-    [payload appendBytes:&padding length:1];
+  // Ensure delegate is called on main thread (or on our queue)
+  if (self.dispatchQueue == nil && ![NSThread isMainThread]) {
+    [self ensureMainThread:^{
+      [self didFailWithError:error];
+    }];
+    return;
   }
 
-  return payload;
-}
+  // Prevent duplicate calls
+  if (!self.isRunning && self.resolver == nil && self.readSource == nil &&
+      !self.addedToEngine) {
+    return;
+  }
 
-/*! Create IPv4 ICMP Echo Request packet
- *  \param identifier Identifier
- *  \param sequenceNumber Sequence number
- *  \param payload Payload data
- *  \returns ICMP packet data
- */
-- (NSData *)createIPv4ICMPPacket:(uint16_t)identifier
-                  sequenceNumber:(uint16_t)sequenceNumber
-                         payload:(NSData *)payload {
-  // ICMP header size
-  const size_t headerSize = 8;
-  const size_t totalSize = headerSize + payload.length;
+  // Log detailed error information for debugging
+  SimplePingLogError(SimplePingLogCategoryTraceroute,
+                     "Failed with error: %{public}@",
+                     error.localizedDescription);
 
-  // Create packet buffer
-  NSMutableData *packet = [NSMutableData dataWithLength:totalSize];
-  uint8_t *bytes = (uint8_t *)packet.mutableBytes;
+  // Retain ourselves temporarily to prevent dealloc during delegate callback
+  CFAutorelease(CFBridgingRetain(self));
 
-  // Fill ICMP header
-  bytes[0] = ICMP_ECHO;                             // Type: Echo Request (8)
-  bytes[1] = 0;                                     // Code: 0
-  *(uint16_t *)(bytes + 2) = 0;                     // Checksum: set to 0 first
-  *(uint16_t *)(bytes + 4) = htons(identifier);     // Identifier
-  *(uint16_t *)(bytes + 6) = htons(sequenceNumber); // Sequence Number
+  [self stop];
 
-  // Copy payload data
-  if (payload.length > 0) {
-    memcpy(bytes + headerSize, payload.bytes, payload.length);
+  strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                                   didFailWithError:)]) {
+    [strongDelegate simpleTraceroute:self didFailWithError:error];
   }
-
-  // Calculate and set checksum
-  uint16_t checksum = [self calculateICMPChecksum:packet];
-  *(uint16_t *)(bytes + 2) = checksum;
-
-  return packet;
 }
 
-/*! Create IPv6 ICMPv6 Echo Request packet
- *  \param identifier Identifier
- *  \param sequenceNumber Sequence number
- *  \param payload Payload data
- *  \returns ICMPv6 packet data
- */
-- (NSData *)createIPv6ICMPPacket:(uint16_t)identifier
-                  sequenceNumber:(uint16_t)sequenceNumber
-                         payload:(NSData *)payload {
-  // ICMPv6 header size
-  const size_t headerSize = 8;
-  const size_t totalSize = headerSize + payload.length;
-
-  // Create packet buffer
-  NSMutableData *packet = [NSMutableData dataWithLength:totalSize];
-  uint8_t *bytes = (uint8_t *)packet.mutableBytes;
+#pragma mark * Host Resolution
 
-  // Fill ICMPv6 header
-  bytes[0] = ICMP6_ECHO_REQUEST; // Type: Echo Request (128)
-  bytes[1] = 0;                  // Code: 0
-  *(uint16_t *)(bytes + 2) = 0;  // Checksum: IPv6 calculated by kernel
-  *(uint16_t *)(bytes + 4) = htons(identifier);     // Identifier
-  *(uint16_t *)(bytes + 6) = htons(sequenceNumber); // Sequence Number
+/*! Processes the results of name-to-address resolution.
+ *  \param addresses The addresses the host name resolved to
+ */
+- (void)hostResolutionDoneWithAddresses:(NSArray<NSData *> *)addresses {
+  Boolean resolved;
 
-  // Copy payload data
-  if (payload.length > 0) {
-    memcpy(bytes + headerSize, payload.bytes, payload.length);
+  // Find the first appropriate address
+  resolved = false;
+  for (NSData *address in addresses) {
+    const struct sockaddr *addrPtr;
+
+    addrPtr = (const struct sockaddr *)address.bytes;
+    if (address.length >= sizeof(struct sockaddr)) {
+      switch (addrPtr->sa_family) {
+      case AF_INET: {
+        if (self.addressStyle != SimplePingAddressStyleICMPv6) {
+          self.hostAddress = address;
+          resolved = true;
+        }
+      } break;
+      case AF_INET6: {
+        if (self.addressStyle != SimplePingAddressStyleICMPv4) {
+          self.hostAddress = address;
+          resolved = true;
+        }
+      } break;
+      }
+    }
+    if (resolved) {
+      break;
+    }
   }
 
-  // IPv6 checksum is automatically calculated by the kernel, no need to set
-  // manually here
+  // We're done resolving, so shut that down
+  [self stopHostResolution];
 
-  return packet;
-}
+  // If all is OK, start the traceroute, otherwise stop
+  if (resolved) {
+    [self startTracerouteWithHostAddress];
+  } else {
+    [self
+        didFailWithError:[NSError
+                             errorWithDomain:(NSString *)kCFErrorDomainCFNetwork
+                                        code:kCFHostErrorHostNotFound
+                                    userInfo:nil]];
+  }
+}
 
-/*! Create ICMP probe packet
- *  \param ttl TTL value
- *  \param sequenceNumber Sequence number
- *  \param addressFamily Address family (AF_INET or AF_INET6)
- *  \returns Constructed ICMP packet data, returns nil on failure
+/*! Stops the name-to-address resolution infrastructure.
  */
-- (nullable NSData *)createICMPPacketWithTTL:(uint8_t)ttl
-                              sequenceNumber:(uint16_t)sequenceNumber
-                               addressFamily:(sa_family_t)addressFamily {
-  // Create payload data (containing timestamp, etc.)
-  NSTimeInterval timestamp = [NSDate timeIntervalSinceReferenceDate];
-  NSData *payload = [self createProbePayload:timestamp hop:ttl probeIndex:0];
+- (void)stopHostResolution {
+  if (self.resolver != nil) {
+    [self.resolver cancel];
+    self.resolver = nil;
+  }
+}
+
+#pragma mark * Socket Management
+
+/*! Starts the traceroute after successful host resolution.
+ */
+- (void)startTracerouteWithHostAddress {
+  int err;
+  int fd;
+
+  assert(self.hostAddress != nil);
+
+  // With an engine, join it instead; it owns the socket and sets the TTL of
+  // each probe as it sends it
+  if (self.engine != nil) {
+    NSError *error = nil;
+    if (![self.engine addClient:self error:&error]) {
+      [self didFailWithError:error];
+      return;
+    }
+    self.addedToEngine = YES;
+    [self startProbingWithHostAddress];
+    return;
+  }
+
+  // Open the socket
+  fd = -1;
+  err = 0;
+  switch (self.hostAddressFamily) {
+  case AF_INET: {
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+    if (fd < 0) {
+      err = errno;
+    }
+  } break;
+  case AF_INET6: {
+    fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_ICMPV6);
+    if (fd < 0) {
+      err = errno;
+    }
+  } break;
+  default: {
+    err = EPROTONOSUPPORT;
+  } break;
+  }
+
+  // Ask for kernel receive timestamps; without them responses are stamped
+  // when read
+  if (err == 0) {
+    (void)SimplePingEnableReceiveTimestamps(fd);
+  }
+
+  // On IPv6 have the kernel pass only the responses we parse, so Neighbor
+  // Discovery and the like never wake us up; there's no such filter for IPv4
+  if (err == 0) {
+    (void)SimplePingInstallICMPFilter(fd, self.hostAddressFamily,
+                                      SimplePingICMPFilterEchoReplies |
+                                          SimplePingICMPFilterTimeExceeded);
+  }
+
+  if (err != 0) {
+    [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain
+                                               code:err
+                                           userInfo:nil]];
+  } else {
+    __weak SimpleTraceroute *weakSelf = self;
+
+    // Watch it with a read source, on the run loop or on our queue. The
+    // source will now take care of cleaning up our file descriptor
+    self.readSource =
+        [[SimplePingReadSource alloc] initWithSocket:fd
+                                               queue:self.dispatchQueue
+                                             handler:^{
+                                               [weakSelf readData];
+                                             }];
+    fd = -1;
+
+    // Verify TTL functionality with initial test
+    if (![self setTTLForSocket:self.readSource.nativeSocket
+                           ttl:1
+                 addressFamily:self.hostAddressFamily]) {
+      NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                           code:errno
+                                       userInfo:@{
+                                         NSLocalizedDescriptionKey :
+                                             @"Failed to initialize TTL control"
+                                       }];
+      [self didFailWithError:error];
+      return;
+    }
+    [self startProbingWithHostAddress];
+  }
+  assert(fd == -1);
+}
+
+/*! Builds the probe packet, tells the delegate and sends the first probes
+ *  \details Called once the socket is open, or the engine has been joined.
+ */
+- (void)startProbingWithHostAddress {
+  id<SimpleTracerouteDelegate> strongDelegate;
+
+  // Build the probe packet once; each probe only patches it. This comes after
+  // joining the engine, which may have changed the identifier
+  if (![self prepareProbeTemplate]) {
+    [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain
+                                               code:ENOMEM
+                                           userInfo:nil]];
+    return;
+  }
+
+  // Mark as running and notify delegate
+  self.isRunning = YES;
+  self.startTime = [NSDate timeIntervalSinceReferenceDate];
+
+  strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                                didStartWithAddress:)]) {
+    [strongDelegate simpleTraceroute:self didStartWithAddress:self.hostAddress];
+  }
+
+  // Start the first hop (or the first window of hops)
+  switch (self.probeMode) {
+  case SimpleTracerouteProbeModeParallel:
+    [self startParallelProbing];
+    break;
+  case SimpleTracerouteProbeModeMultipath:
+    [self startMultipathProbing];
+    break;
+  default:
+    [self startNextHop];
+    break;
+  }
+}
+
+/*! Stops the socket infrastructure.
+ */
+- (void)stopSocket {
+  if (self.addedToEngine) {
+    [self.engine removeClient:self];
+    self.addedToEngine = NO;
+  }
+  if (self.readSource != nil) {
+    [self.readSource invalidate];
+    self.readSource = nil;
+  }
+}
 
-  // Create corresponding ICMP packet based on address family
+#pragma mark * TTL Control Methods
+
+/*! Validate the validity of TTL value
+ *  \param ttl The TTL value to validate
+ *  \returns Returns YES if valid, NO if invalid
+ */
+- (BOOL)isValidTTL:(uint8_t)ttl {
+  // TTL value must be in the range 1-255
+  // 0 is invalid (will cause packet to expire immediately)
+  return (ttl >= 1 && ttl <= 255);
+}
+
+/*! Get the protocol level corresponding to the current address family
+ *  \param addressFamily Address family
+ *  \returns Protocol level constant, returns -1 on failure
+ */
+- (int)getProtocolLevelForAddressFamily:(sa_family_t)addressFamily {
   switch (addressFamily) {
   case AF_INET:
-    return [self createIPv4ICMPPacket:self.identifier
-                       sequenceNumber:sequenceNumber
-                              payload:payload];
+    return IPPROTO_IP;
   case AF_INET6:
-    return [self createIPv6ICMPPacket:self.identifier
-                       sequenceNumber:sequenceNumber
-                              payload:payload];
+    return IPPROTO_IPV6;
   default:
-    NSLog(@"SimpleTraceroute: Unsupported address family for ICMP packet: %d",
-          addressFamily);
-    return nil;
+    return -1;
+  }
+}
+
+/*! Get the socket option corresponding to the current address family
+ *  \param addressFamily Address family
+ *  \returns Socket option constant, returns -1 on failure
+ */
+- (int)getSocketOptionForAddressFamily:(sa_family_t)addressFamily {
+  switch (addressFamily) {
+  case AF_INET:
+    return IP_TTL;
+  case AF_INET6:
+    return IPV6_UNICAST_HOPS;
+  default:
+    return -1;
   }
 }
 
+/*! Set TTL value for the specified socket
+ *  \param socketFD The socket file descriptor to set
+ *  \param ttl TTL value (1-255)
+ *  \param addressFamily Address family (AF_INET or AF_INET6)
+ *  \returns Returns YES if successful, NO if failed
+ */
+- (BOOL)setTTLForSocket:(int)socketFD
+                    ttl:(uint8_t)ttl
+          addressFamily:(sa_family_t)addressFamily {
+  // 1. Parameter validation
+  if (socketFD < 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Invalid socket file descriptor: %d", socketFD);
+    return NO;
+  }
+
+  if (![self isValidTTL:ttl]) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute, "Invalid TTL value: %d",
+                       ttl);
+    return NO;
+  }
+
+  // 2. Get the corresponding socket option
+  int level = [self getProtocolLevelForAddressFamily:addressFamily];
+  int option = [self getSocketOptionForAddressFamily:addressFamily];
+
+  if (level == -1 || option == -1) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Unsupported address family: %d", addressFamily);
+    return NO;
+  }
+
+  // 3. Set socket option
+  // Use int for setsockopt value
+  int hop = (int)ttl;
+  socklen_t hopLen = (socklen_t)sizeof(hop);
+  int result = setsockopt(socketFD, level, option, &hop, hopLen);
+  if (result != 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to set TTL to %d: %{public}s", ttl,
+                       strerror(errno));
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to set TTL to %d: %{public}s (level=%d, opt=%d)",
+                       hop, strerror(errno), level, option);
+    return NO;
+  }
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Successfully set TTL to %d for address family %d", ttl,
+                     addressFamily);
+  return YES;
+}
+
+/*! Get the current socket's TTL value
+ *  \param socketFD Socket file descriptor
+ *  \param addressFamily Address family
+ *  \returns Current TTL value, returns 0 on failure
+ */
+- (uint8_t)getTTLForSocket:(int)socketFD
+             addressFamily:(sa_family_t)addressFamily {
+  // 1. Parameter validation
+  if (socketFD < 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Invalid socket file descriptor: %d", socketFD);
+    return 0;
+  }
+
+  // 2. Get the corresponding socket option
+  int level = [self getProtocolLevelForAddressFamily:addressFamily];
+  int option = [self getSocketOptionForAddressFamily:addressFamily];
+
+  if (level == -1 || option == -1) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Unsupported address family: %d", addressFamily);
+    return 0;
+  }
+
+  // 3. Get socket option value
+  uint8_t ttl = 0;
+  socklen_t ttlSize = sizeof(ttl);
+  int result = getsockopt(socketFD, level, option, &ttl, &ttlSize);
+
+  if (result != 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to get TTL: %{public}s", strerror(errno));
+    return 0;
+  }
+
+  return ttl;
+}
+
+/*! Set TTL for the current hop and send probe packet
+ *  \param hop Hop number (1-255)
+ *  \returns Returns YES if successful, NO if failed
+ */
+- (BOOL)setTTLForCurrentHop:(uint8_t)hop {
+  // Get socket file descriptor
+  if (self.readSource == nil) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "No socket available for TTL setting");
+    return NO;
+  }
+
+  int socketFD = self.readSource.nativeSocket;
+  if (socketFD < 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Invalid socket for TTL setting");
+    return NO;
+  }
+
+  // Set TTL
+  return [self setTTLForSocket:socketFD
+                           ttl:hop
+                 addressFamily:self.hostAddressFamily];
+}
+
+#pragma mark * Packet Sending Methods
+
+/*! Sequence number management - get next sequence number
+ *  \returns New sequence number, never 0
+ *  \details 0 is what the extract methods return on failure, so it is never
+ * used for a probe.
+ */
+- (uint16_t)getNextSequenceNumber {
+  // Skip 0, both initially and on wraparound
+  if (self.nextSequenceNumber == 0) {
+    self.nextSequenceNumber = 1;
+  }
+
+  uint16_t current = self.nextSequenceNumber;
+
+  // Increment sequence number
+  self.nextSequenceNumber++;
+
+  // Handle wraparound (from 65535 to 0)
+  if (self.nextSequenceNumber == 0) {
+    self.nextSequenceNumberHasWrapped = YES;
+  }
+
+  return current;
+}
+
+/*! Make sure the probe table can hold every probe of a traceroute
+ *  \returns Returns YES on success, NO if the table could not be allocated
+ *  \details Called on start, so that recording probes never allocates.
+ */
+- (BOOL)prepareProbeTable {
+  uint32_t needed = (uint32_t)self.maxHops * self.probesPerHop;
+
+  // Multipath flies a hop's flows and the hop before's at once
+  if (self.probeMode == SimpleTracerouteProbeModeMultipath) {
+    needed = 2 * kTracerouteMaxMultipathFlows;
+  }
+
+  // Continuous rounds overlap when they come quicker than the timeout
+  if (self.continuous) {
+    double rounds = MIN(ceil(self.timeout / self.cycleInterval) + 1, 1024.0);
+    needed = MAX(needed, (uint32_t)self.maxHops * (uint32_t)rounds);
+  }
+
+  if (TracerouteProbeTableCapacity(&self->_probeTable) >= needed) {
+    return YES;
+  }
+  return TracerouteProbeTableInit(&self->_probeTable, needed);
+}
+
+/*! Record probe packet information
+ *  \param sequenceNumber Sequence number
+ *  \param hop Hop number
+ *  \param probeIndex Probe index
+ *  \param sendTime Send time in nanoseconds, see SimplePingMonotonicNanoseconds()
+ */
+- (void)recordProbe:(uint16_t)sequenceNumber
+                hop:(uint8_t)hop
+         probeIndex:(uint8_t)probeIndex
+           sendTime:(uint64_t)sendTime {
+  // Clean up expired probe records first so their slots are free
+  [self cleanupExpiredProbes];
+
+  TracerouteProbeTableRecord(&self->_probeTable, sequenceNumber, hop,
+                             probeIndex, sendTime,
+                             sendTime +
+                                 TracerouteNanosecondsFromSeconds(self.timeout));
+}
+
+/*! Clean up expired probe records
+ *  \details Only probes older than twice the timeout are dropped; in
+ * sequential mode the hop timeout timer settles the rest. Expiry only looks
+ * at the oldest outstanding probe, so this is O(1) per dropped probe.
+ */
+- (void)cleanupExpiredProbes {
+  uint64_t now = SimplePingMonotonicNanoseconds();
+  uint64_t timeoutNanoseconds = TracerouteNanosecondsFromSeconds(self.timeout);
+  NSUInteger removed = 0;
+
+  // Deadlines are send time + timeout, so this drops probes older than
+  // double the timeout
+  if (now < timeoutNanoseconds) {
+    return;
+  }
+  while (TracerouteProbeTableExpireOldest(&self->_probeTable,
+                                          now - timeoutNanoseconds, NULL)) {
+    removed++;
+  }
+
+  if (removed > 0) {
+    SimplePingMetricsAdd(&self->_metrics,
+                         SimplePingMetricsCounterExpiredProbes, removed);
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Cleaned up %lu expired probe records",
+                       (unsigned long)removed);
+  }
+}
+
+/*! Build the probe packet template for the current address family
+ *  \returns Returns YES if successful, NO if failed
+ *  \details Every probe is this packet with its sequence number, send time,
+ * hop and probe index patched in, see -sendProbeForHop:probeIndex:
+ */
+- (BOOL)prepareProbeTemplate {
+  uint8_t payload[kTracerouteProbePayloadLength] = {0};
+  BOOL built;
+
+  switch (self.hostAddressFamily) {
+  case AF_INET:
+    built = SimplePingPacketTemplateInit(&self->_probeTemplate, ICMP_ECHO,
+                                         self.identifier, payload,
+                                         sizeof(payload), true);
+    break;
+  case AF_INET6:
+    // IPv6 checksum is calculated by the kernel
+    built = SimplePingPacketTemplateInit(&self->_probeTemplate,
+                                         ICMP6_ECHO_REQUEST, self.identifier,
+                                         payload, sizeof(payload), false);
+    break;
+  default:
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Unsupported address family for ICMP packet: %d",
+                       self.hostAddressFamily);
+    return NO;
+  }
+
+  // Flows are numbered from the checksum the probe starts out with
+  if (built) {
+    self->_flowBaseChecksum =
+        ntohs(SimplePingPacketTemplateChecksum(&self->_probeTemplate));
+  }
+  return built;
+}
+
+/*! Whether probes hold their checksum steady, see keepsFlowStable
+ */
+- (BOOL)usesStableFlows {
+  return self.keepsFlowStable ||
+         self.probeMode == SimpleTracerouteProbeModeMultipath;
+}
+
+/*! The checksum that puts a probe in a flow
+ *  \param probeIndex the probe's index; in multipath mode that's its flow
+ *  \returns The checksum, in network byte order
+ */
+- (uint16_t)checksumForProbeIndex:(uint8_t)probeIndex {
+  uint16_t flow = self.flowIdentifier;
+  if (self.probeMode == SimpleTracerouteProbeModeMultipath) {
+    flow = (uint16_t)(flow + probeIndex);
+  }
+  return htons((uint16_t)(self->_flowBaseChecksum + flow));
+}
+
 /*! Send ICMP packet to target address
- *  \param packet ICMP packet data
+ *  \param bytes ICMP packet data
+ *  \param length ICMP packet length
  *  \param address Target address
+ *  \param hop TTL to send with; only used with an engine, our own socket has
+ * already been set to it, see -sendPacedProbes
  *  \returns Returns YES if successful, NO if failed
  */
-- (BOOL)sendICMPPacket:(NSData *)packet toAddress:(NSData *)address {
-  if (self.socket == NULL) {
-    NSLog(@"SimpleTraceroute: No socket available for sending");
+- (BOOL)sendICMPPacket:(const void *)bytes
+                length:(size_t)length
+             toAddress:(NSData *)address
+                   hop:(uint8_t)hop {
+  ssize_t bytesSent;
+
+  // The engine's socket is shared, so it sets the TTL per send
+  if (self.addedToEngine) {
+    bytesSent = [self.engine sendPacket:bytes
+                                 length:length
+                              toAddress:address
+                               hopLimit:hop];
+    if (bytesSent < 0) {
+      SimplePingLogError(SimplePingLogCategoryTraceroute,
+                         "Failed to send ICMP packet: %{public}s",
+                         strerror(errno));
+    }
+    return [self countSendOfLength:length bytesSent:bytesSent];
+  }
+
+  if (self.readSource == nil) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "No socket available for sending");
     return NO;
   }
 
   // Get socket file descriptor
-  int socketFD = CFSocketGetNative(self.socket);
+  int socketFD = self.readSource.nativeSocket;
   if (socketFD < 0) {
-    NSLog(@"SimpleTraceroute: Invalid socket file descriptor");
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Invalid socket file descriptor");
     return NO;
   }
 
   // Send packet
   const struct sockaddr *addr = (const struct sockaddr *)address.bytes;
-  ssize_t bytesSent = sendto(socketFD, packet.bytes, packet.length, 0, addr,
-                             (socklen_t)address.length);
+  bytesSent =
+      sendto(socketFD, bytes, length, 0, addr, (socklen_t)address.length);
 
   if (bytesSent < 0) {
-    NSLog(@"SimpleTraceroute: Failed to send ICMP packet: %s", strerror(errno));
-    return NO;
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to send ICMP packet: %{public}s",
+                       strerror(errno));
+  } else if (bytesSent != (ssize_t)length) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Partial send: %zd of %zu bytes", bytesSent, length);
   }
 
-  if (bytesSent != (ssize_t)packet.length) {
-    NSLog(@"SimpleTraceroute: Partial send: %zd of %zu bytes", bytesSent,
-          packet.length);
-    return NO;
-  }
+  return [self countSendOfLength:length bytesSent:bytesSent];
+}
 
-  return YES;
+/*! Count a send in the metrics
+ *  \param length ICMP packet length
+ *  \param bytesSent what the send returned
+ *  \returns YES if the whole packet was sent
+ */
+- (BOOL)countSendOfLength:(size_t)length bytesSent:(ssize_t)bytesSent {
+  BOOL sent = (bytesSent == (ssize_t)length);
+
+  SimplePingMetricsAdd(&self->_metrics,
+                       sent ? SimplePingMetricsCounterPacketsSent
+                            : SimplePingMetricsCounterSendFailures,
+                       1);
+  return sent;
 }
 
 /*! Send single probe packet
@@ -843,24 +1592,41 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
   // 1. Get next sequence number
   uint16_t sequenceNumber = [self getNextSequenceNumber];
 
-  // 2. Record send time
-  NSTimeInterval timestamp = [NSDate timeIntervalSinceReferenceDate];
-
-  // 3. Create ICMP packet
-  NSData *packet = [self createICMPPacketWithTTL:hop
-                                  sequenceNumber:sequenceNumber
-                                   addressFamily:self.hostAddressFamily];
-  if (packet == nil) {
-    NSLog(
-        @"SimpleTraceroute: Failed to create ICMP packet for hop %d, probe %d",
-        hop, probeIndex);
+  // 2. Patch the probe into the packet template; only the changed words of
+  // the checksum are updated
+  SimplePingPacketTemplate *probe = &self->_probeTemplate;
+  if (probe->bytes == NULL) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to create ICMP packet for hop %d, probe %d", hop,
+                       probeIndex);
     return NO;
   }
+  uint8_t hopAndIndex[2] = {hop, probeIndex};
+  SimplePingPacketTemplateSetSequenceNumber(probe, sequenceNumber);
+  SimplePingPacketTemplatePatch(probe, kTracerouteProbeHopOffset, hopAndIndex,
+                                sizeof(hopAndIndex));
+
+  // 3. Record send time, as close to the send as possible
+  uint64_t sendTime = SimplePingMonotonicNanoseconds();
+  SimplePingPacketTemplatePatch(probe, kTracerouteProbeSendTimeOffset,
+                                &sendTime, sizeof(sendTime));
+
+  // 3a. Undo what that did to the checksum, which load balancers hash, so the
+  // probe follows its flow's path
+  if ([self usesStableFlows]) {
+    SimplePingPacketTemplateFixChecksum(
+        probe, kTracerouteProbeFlowOffset,
+        [self checksumForProbeIndex:probeIndex]);
+  }
 
   // 4. Send packet
-  if (![self sendICMPPacket:packet toAddress:self.hostAddress]) {
-    NSLog(@"SimpleTraceroute: Failed to send ICMP packet for hop %d, probe %d",
-          hop, probeIndex);
+  if (![self sendICMPPacket:probe->bytes
+                     length:probe->length
+                  toAddress:self.hostAddress
+                        hop:hop]) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Failed to send ICMP packet for hop %d, probe %d", hop,
+                       probeIndex);
     return NO;
   }
 
@@ -868,10 +1634,27 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
   [self recordProbe:sequenceNumber
                 hop:hop
          probeIndex:probeIndex
-          timestamp:timestamp];
-
-  NSLog(@"SimpleTraceroute: Sent probe: hop=%d, index=%d, seq=%d", hop,
-        probeIndex, sequenceNumber);
+           sendTime:sendTime];
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Sent probe: hop=%d, index=%d, seq=%d", hop, probeIndex,
+                     sequenceNumber);
+  // Ended by the response; a probe that times out gets a Timeout event instead
+  SimplePingSignpostBegin(
+      SimplePingLogCategoryTraceroute,
+      SimplePingSignpostProbeID(self.identifier, sequenceNumber), "Probe",
+      "hop=%d index=%d", hop, probeIndex);
+
+  // 6. Notify delegate
+  id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                              didSendProbeToHop:
+                                                 sequenceNumber:)]) {
+    [strongDelegate simpleTraceroute:self
+                   didSendProbeToHop:hop
+                      sequenceNumber:sequenceNumber];
+  }
   return YES;
 }
 
@@ -880,41 +1663,188 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
  *  \details Send multiple probe packets according to probesPerHop setting
  */
 - (void)sendProbesForHop:(uint8_t)hop {
-  NSLog(@"SimpleTraceroute: Sending %d probes for hop %d", self.probesPerHop,
-        hop);
-
-  // Ensure TTL is set correctly
-  if (![self setTTLForCurrentHop:hop]) {
-    NSError *error = [NSError
-        errorWithDomain:NSPOSIXErrorDomain
-                   code:errno
-               userInfo:@{
-                 NSLocalizedDescriptionKey : [NSString
-                     stringWithFormat:@"Failed to set TTL for hop %d", hop]
-               }];
-    [self didFailWithError:error];
-    return;
-  }
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Sending %d probes for hop %d", self.probesPerHop, hop);
+
+  // Probes go out probeInterval apart (to avoid network congestion); the
+  // timeout timer starts once the last one is sent, see -sendPacedProbes
+  [self enqueueProbesForHop:hop];
+}
 
-  // Send multiple probe packets
+#pragma mark * Probe Pacing Methods
+
+/*! Queue every probe of a hop for sending
+ *  \param hop Hop number (1-255)
+ */
+- (void)enqueueProbesForHop:(uint8_t)hop {
   for (uint8_t probeIndex = 0; probeIndex < self.probesPerHop; probeIndex++) {
+    [self.pacedProbes addObject:@(((NSUInteger)hop << 8) | probeIndex)];
+  }
+  [self sendPacedProbes];
+}
+
+/*! Work out which queued probe goes next, and how long it has to wait
+ *  \param indexOut Receives the index in pacedProbes of the probe to send
+ *  \returns Seconds to wait, 0 to send now
+ *  \details Honours probeInterval first, then reserves a rateLimiter token
+ * (once per probe, however long it then waits). The next probe is the first
+ * queued, except while tracing in parallel mode, where probeInterval only
+ * spaces the probes of one hop: the next probe is then the first whose hop
+ * hasn't had a probe sent in the last probeInterval.
+ */
+- (NSTimeInterval)delayBeforeNextProbe:(NSUInteger *)indexOut {
+  uint64_t now = SimplePingMonotonicNanoseconds();
+  uint64_t interval = (self.probeInterval > 0)
+                          ? TracerouteNanosecondsFromSeconds(self.probeInterval)
+                          : 0;
+
+  *indexOut = 0;
+  if (interval != 0 && self.probeMode == SimpleTracerouteProbeModeParallel &&
+      !self->_continuousPhase) {
+    uint64_t earliestDue = UINT64_MAX;
+    NSUInteger index = 0;
+    for (NSNumber *item in self.pacedProbes) {
+      uint8_t hop = (uint8_t)(item.unsignedIntegerValue >> 8);
+      uint64_t lastSendTime = self->_hopLastProbeSendTime[hop];
+      uint64_t due = (lastSendTime == 0) ? 0 : lastSendTime + interval;
+      if (due <= now) {
+        break;
+      }
+      earliestDue = MIN(earliestDue, due);
+      index++;
+    }
+    if (index == self.pacedProbes.count) {
+      return TracerouteSecondsFromNanoseconds(earliestDue - now);
+    }
+    *indexOut = index;
+  } else if (interval != 0 && self->_lastProbeSendTime != 0) {
+    uint64_t due = self->_lastProbeSendTime + interval;
+    if (due > now) {
+      return TracerouteSecondsFromNanoseconds(due - now);
+    }
+  }
+
+  if (self.rateLimiter != nil && !self->_pacerHoldsToken) {
+    self->_pacerHoldsToken = YES;
+    return [self.rateLimiter reservePacket];
+  }
+  return 0;
+}
+
+/*! Send queued probes until the queue is empty or the next one has to wait
+ *  \details Waiting is done with pacerTimer on the I/O backend, so the thread
+ * is never blocked. The sequential timeout timer starts once the last probe of
+ * the hop is out; in parallel mode every probe gets its own deadline.
+ */
+- (void)sendPacedProbes {
+  while (self.isRunning && self.pacerTimer == nil &&
+         self.pacedProbes.count != 0) {
+    // 1. Wait for the interval or the rate limiter if necessary
+    NSUInteger index;
+    NSTimeInterval delay = [self delayBeforeNextProbe:&index];
+    if (delay > 0) {
+      __weak SimpleTraceroute *weakSelf = self;
+      self.pacerTimer =
+          [[SimplePingTimerSource alloc] initWithInterval:delay
+                                                   leeway:self.timerLeeway
+                                                  repeats:NO
+                                                    queue:self.dispatchQueue
+                                                  handler:^{
+                                                    [weakSelf pacerTimerFired];
+                                                  }];
+      return;
+    }
+
+    // 2. Dequeue the next probe
+    NSUInteger item = self.pacedProbes[index].unsignedIntegerValue;
+    [self.pacedProbes removeObjectAtIndex:index];
+    uint8_t hop = (uint8_t)(item >> 8);
+    uint8_t probeIndex = (uint8_t)(item & 0xff);
+
+    // 3. The TTL is a socket property, so set it whenever the hop changes;
+    // the engine does that itself when sending on its shared socket
+    if (!self.addedToEngine && hop != self->_socketTTL) {
+      if (![self setTTLForCurrentHop:hop]) {
+        NSError *error = [NSError
+            errorWithDomain:NSPOSIXErrorDomain
+                       code:errno
+                   userInfo:@{
+                     NSLocalizedDescriptionKey : [NSString
+                         stringWithFormat:@"Failed to set TTL for hop %d", hop]
+                   }];
+        [self didFailWithError:error];
+        return;
+      }
+      self->_socketTTL = hop;
+    }
+
+    // 4. Send it
+    self->_pacerHoldsToken = NO;
+    self->_lastProbeSendTime = SimplePingMonotonicNanoseconds();
+    self->_hopLastProbeSendTime[hop] = self->_lastProbeSendTime;
     if (![self sendProbeForHop:hop probeIndex:probeIndex]) {
-      NSLog(@"SimpleTraceroute: Failed to send probe %d for hop %d", probeIndex,
-            hop);
+      SimplePingLogError(SimplePingLogCategoryTraceroute,
+                         "Failed to send probe %d for hop %d", probeIndex, hop);
       // Continue sending other probes without interrupting the entire process
     }
 
-    // Small interval between probes (to avoid network congestion)
-    if (probeIndex < self.probesPerHop - 1) {
-      usleep(10000); // 10ms interval
+    // 5. Start waiting for responses
+    if (self.probeMode != SimpleTracerouteProbeModeSequential ||
+        self->_continuousPhase) {
+      if (self.isRunning && self.probeDeadlineToken == 0) {
+        [self armProbeDeadlineTimer];
+      }
+    } else if (probeIndex + 1 == self.probesPerHop) {
+      [self startTimeoutTimerForHop:hop];
+      SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                         "All probes sent for hop %d, waiting for responses...",
+                         hop);
+    }
+  }
+}
+
+/*! Pacer timer callback
+ */
+- (void)pacerTimerFired {
+  self.pacerTimer = nil;
+  [self sendPacedProbes];
+}
+
+/*! Drop queued probes that have not been sent yet
+ *  \param hop hop number
+ *  \param above YES to drop the probes of every hop above hop instead
+ */
+- (void)discardPacedProbesForHop:(uint8_t)hop above:(BOOL)above {
+  NSIndexSet *indexes = [self.pacedProbes
+      indexesOfObjectsPassingTest:^BOOL(NSNumber *item, NSUInteger idx,
+                                        BOOL *stop) {
+#pragma unused(idx, stop)
+        uint8_t itemHop = (uint8_t)(item.unsignedIntegerValue >> 8);
+        return above ? (itemHop > hop) : (itemHop == hop);
+      }];
+  [self.pacedProbes removeObjectsAtIndexes:indexes];
+}
+
+/*! Check whether a hop has probes queued that have not been sent yet
+ *  \param hop hop number
+ *  \returns Returns YES if any of the hop's probes is still queued
+ */
+- (BOOL)hasPacedProbesForHop:(uint8_t)hop {
+  for (NSNumber *item in self.pacedProbes) {
+    if ((uint8_t)(item.unsignedIntegerValue >> 8) == hop) {
+      return YES;
     }
   }
+  return NO;
+}
 
-  // Start timeout timer
-  [self startTimeoutTimerForHop:hop];
-  NSLog(
-      @"SimpleTraceroute: All probes sent for hop %d, waiting for responses...",
-      hop);
+/*! Stops the pacer timer.
+ */
+- (void)stopPacerTimer {
+  if (self.pacerTimer != nil) {
+    [self.pacerTimer invalidate];
+    self.pacerTimer = nil;
+  }
 }
 
 #pragma mark * Control Methods
@@ -926,16 +1856,43 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
   self.currentHop = 0;
   self.nextSequenceNumber = 0;
   self.nextSequenceNumberHasWrapped = NO;
-  [self.pendingProbes removeAllObjects];
-  [self.completedHops removeAllObjects];
+  TracerouteProbeTableReset(&self->_probeTable);
+  TracerouteHopStoreReset(&self->_hopStore);
+  [self.routerHostNames removeAllObjects];
+  [self.parallelHopResults removeAllObjects];
+  self.nextParallelHopToSend = 0;
+  self.nextParallelHopToReport = 0;
+  self.destinationHop = 0;
   self.startTime = 0;
+  [self.pacedProbes removeAllObjects];
+  [self.pendingResponses removeAllObjects];
+  self->_lastProbeSendTime = 0;
+  memset(self->_hopLastProbeSendTime, 0, sizeof(self->_hopLastProbeSendTime));
+  self->_socketTTL = 0;
+  self->_pacerHoldsToken = NO;
+  self->_probingBackward = NO;
+  self->_forwardEndHop = 0;
+  self->_hopReachedDestination = NO;
+  self->_hopIsKnownInterface = NO;
+  [self.multipathInterfaces removeAllObjects];
+  memset(self->_multipathFlowsSent, 0, sizeof(self->_multipathFlowsSent));
+  memset(self->_parallelExpiredCount, 0, sizeof(self->_parallelExpiredCount));
+  self->_continuousPhase = NO;
+  self->_continuousDestinationHop = 0;
+  self->_continuousHopLimit = 0;
+  self.cycleCount = 0;
+  [self.continuousRouterAddresses removeAllObjects];
+  if (self->_hopWindows != NULL) {
+    TracerouteHopWindowsReset(self->_hopWindows);
+  }
 }
 
 /*! Check if current object state allows starting
  *  \returns If can start returns YES, otherwise returns NO
  */
 - (BOOL)canStart {
-  return !self.isRunning && self.host == NULL && self.socket == NULL &&
+  return !self.isRunning && self.resolver == nil && self.readSource == nil &&
+         !self.addedToEngine &&
          self.hostAddress == nil;
 }
 
@@ -971,12 +1928,62 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
                            }];
   }
 
-  if (self.probesPerHop < 1 || self.probesPerHop > 10) {
+  if (self.probesPerHop < 1 ||
+      self.probesPerHop > kTracerouteMaxProbesPerHop) {
+    NSString *description =
+        [NSString stringWithFormat:@"Probes per hop must be between 1 and %d",
+                                   kTracerouteMaxProbesPerHop];
     return [NSError errorWithDomain:NSInvalidArgumentException
                                code:-4
+                           userInfo:@{NSLocalizedDescriptionKey : description}];
+  }
+
+  if (self.firstHop < 1 || self.firstHop > self.maxHops) {
+    return [NSError errorWithDomain:NSInvalidArgumentException
+                               code:-7
+                           userInfo:@{
+                             NSLocalizedDescriptionKey :
+                                 @"First hop must be between 1 and max hops"
+                           }];
+  }
+
+  if (self.probeInterval < 0 || self.probeInterval > self.timeout) {
+    return [NSError errorWithDomain:NSInvalidArgumentException
+                               code:-6
+                           userInfo:@{
+                             NSLocalizedDescriptionKey :
+                                 @"Probe interval must be between 0 and the "
+                                 @"timeout"
+                           }];
+  }
+
+  if (!(self.multipathConfidence > 0 && self.multipathConfidence < 1)) {
+    return [NSError errorWithDomain:NSInvalidArgumentException
+                               code:-8
+                           userInfo:@{
+                             NSLocalizedDescriptionKey :
+                                 @"Multipath confidence must be between 0 and "
+                                 @"1"
+                           }];
+  }
+
+  if (self.continuous && !(self.cycleInterval > 0)) {
+    return [NSError errorWithDomain:NSInvalidArgumentException
+                               code:-9
                            userInfo:@{
                              NSLocalizedDescriptionKey :
-                                 @"Probes per hop must be between 1 and 10"
+                                 @"Cycle interval must be positive"
+                           }];
+  }
+
+  if (self.continuous &&
+      (self.statisticsWindow < 1 || self.statisticsWindow > UINT16_MAX)) {
+    return [NSError errorWithDomain:NSInvalidArgumentException
+                               code:-10
+                           userInfo:@{
+                             NSLocalizedDescriptionKey :
+                                 @"Statistics window must be between 1 and "
+                                 @"65535 probes"
                            }];
   }
 
@@ -984,31 +1991,35 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 }
 
 /*! Ensure operations are performed on the correct thread
+ *  \details That's dispatchQueue if set, the main thread otherwise
  */
 - (void)ensureMainThread:(void (^)(void))block {
-  if ([NSThread isMainThread]) {
+  if (self.dispatchQueue != nil) {
+    dispatch_async(self.dispatchQueue, block);
+  } else if ([NSThread isMainThread]) {
     block();
   } else {
     dispatch_async(dispatch_get_main_queue(), block);
   }
 }
 
-- (void)start {
-  Boolean success;
-  CFHostClientContext context = {0, (__bridge void *)(self), NULL, NULL, NULL};
-  CFStreamError streamError;
+/*! Validate the parameters and reset state for a new traceroute
+ *  \returns Returns YES if the traceroute can go ahead, NO if it failed
+ */
+- (BOOL)prepareToStart {
   NSError *validationError;
 
   // 1. Input validation and state checking
   if (self.isRunning) {
-    NSLog(@"SimpleTraceroute: Cannot start - already running");
-    return;
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Cannot start - already running");
+    return NO;
   }
 
   validationError = [self validateTracerouteParameters];
   if (validationError != nil) {
     [self didFailWithError:validationError];
-    return;
+    return NO;
   }
 
   if (![self canStart]) {
@@ -1020,35 +2031,68 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
                               NSLocalizedDescriptionKey :
                                   @"Object is in an invalid state for starting"
                             }]];
-    return;
+    return NO;
   }
 
   // 2. Reset state
   [self resetTracerouteState];
+  self->_runGeneration++;
+
+  if (![self prepareProbeTable]) {
+    [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain
+                                               code:ENOMEM
+                                           userInfo:nil]];
+    return NO;
+  }
+
+  assert(self.resolver == nil);
+  assert(self.hostAddress == nil);
+  assert(!self.isRunning);
+  assert((self.engine == nil) ||
+         (self.dispatchQueue == self.engine.dispatchQueue));
+  return YES;
+}
+
+- (void)start {
+  if (![self prepareToStart]) {
+    return;
+  }
 
-  assert(self.host == NULL);
-  assert(self.hostAddress == nil);
-  assert(!self.isRunning);
+  // 3. Resolve the host name, on the run loop or on our queue
+  self.resolver =
+      [[SimplePingHostResolver alloc] initWithHostName:self.hostName
+                                                 queue:self.dispatchQueue];
+  assert(self.resolver != nil);
+  self.resolver.addressFamily =
+      SimplePingAddressFamilyForAddressStyle(self.addressStyle);
 
-  // Create CFHost for name resolution
-  self.host = (CFHostRef)CFAutorelease(
-      CFHostCreateWithName(NULL, (__bridge CFStringRef)self.hostName));
-  assert(self.host != NULL);
+  __weak SimpleTraceroute *weakSelf = self;
+  [self.resolver startWithCompletionHandler:^(NSArray<NSData *> *addresses,
+                                              NSError *error) {
+    if (error != nil) {
+      [weakSelf didFailWithError:error];
+    } else {
+      [weakSelf hostResolutionDoneWithAddresses:addresses];
+    }
+  }];
+}
 
-  CFHostSetClient(self.host, HostResolveCallback, &context);
-  CFHostScheduleWithRunLoop(self.host, CFRunLoopGetCurrent(),
-                            kCFRunLoopDefaultMode);
+- (void)startWithAddress:(NSData *)address {
+  NSParameterAssert(address.length >= sizeof(struct sockaddr));
 
-  success =
-      CFHostStartInfoResolution(self.host, kCFHostAddresses, &streamError);
-  if (!success) {
-    [self didFailWithHostStreamError:streamError];
+  if (![self prepareToStart]) {
+    return;
   }
+
+  // 3. No resolution needed, go straight to the socket
+  self.hostAddress = address;
+  [self startTracerouteWithHostAddress];
 }
 
 - (void)stop {
   // 1. Thread safety check
-  if (!self.isRunning && self.host == NULL && self.socket == NULL) {
+  if (!self.isRunning && self.resolver == nil && self.readSource == nil &&
+      !self.addedToEngine) {
     return; // Already stopped, safe return
   }
 
@@ -1057,6 +2101,10 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 
   // 3. Clean up resources in order
   [self stopTimeoutTimer];   // Stop timer first
+  [self stopProbeDeadlineTimer];
+  [self stopCycleTimer];
+  [self leaveTimeoutWheel];
+  [self stopPacerTimer];
   [self stopHostResolution]; // Stop host resolution
   [self stopSocket];         // Stop socket
 
@@ -1069,18 +2117,27 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 /*! Starts tracing the next hop.
  */
 - (void)startNextHop {
-  // 1. Increment current hop
-  self.currentHop++;
+  // 1. Move to the next hop, down towards the source once probing backward
+  if (self->_probingBackward) {
+    self.currentHop--;
+    if (self.currentHop == 0) {
+      [self finishTraceroute];
+      return;
+    }
+  } else {
+    self.currentHop = (self.currentHop == 0) ? self.firstHop
+                                             : (uint8_t)(self.currentHop + 1);
 
-  // 2. Check if exceeds maximum hops
-  if (self.currentHop > self.maxHops) {
-    [self finishTraceroute];
-    return;
+    // 2. Check if exceeds maximum hops
+    if (self.currentHop > self.maxHops || self.currentHop == 0) {
+      [self finishForwardProbing];
+      return;
+    }
   }
 
-  NSLog(
-      @"SimpleTraceroute: Starting hop %d with TTL control and packet sending",
-      self.currentHop);
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Starting hop %d with TTL control and packet sending",
+                     self.currentHop);
 
   // 3. Set TTL for current hop (already handled in sendProbesForHop)
   // 4. Send probe packets (real implementation)
@@ -1090,25 +2147,68 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
   // timeout Next hop will be triggered after receiving response or timeout
 }
 
+/*! Ends the forward probes, at the destination or at maxHops
+ *  \details If the traceroute started above hop 1 it then probes back towards
+ * the source, see interfaceCache; otherwise it is done.
+ */
+- (void)finishForwardProbing {
+  if (self->_probingBackward || self.firstHop <= 1) {
+    [self finishTraceroute];
+    return;
+  }
+
+  SimplePingLogInfo(SimplePingLogCategoryTraceroute, "Probing back from hop %d",
+                    self.firstHop - 1);
+  self->_probingBackward = YES;
+  self->_forwardEndHop = (self.currentHop == 0 || self.currentHop > self.maxHops)
+                             ? self.maxHops
+                             : self.currentHop;
+  self.currentHop = self.firstHop;
+  [self startNextHop];
+}
+
 /*! Completes the traceroute.
  */
 - (void)finishTraceroute {
   id<SimpleTracerouteDelegate> strongDelegate;
 
-  // Create empty hops array for now - this would need to be populated with
-  // actual hop data
-  NSArray *hops = @[];
+  // A continuous traceroute goes on watching the path instead
+  if (self.continuous && !self->_continuousPhase) {
+    [self startContinuousProbing];
+    return;
+  }
+
+  // Responses read before the end come before it
+  [self flushReceivedResponses];
+  if (!self.isRunning) {
+    return; // The delegate stopped us
+  }
+
+  // Forward hops are reported in order, so the target was reached if the
+  // last of them is the destination; backward hops come after them
+  BOOL reachedTarget = NO;
+  for (uint32_t index = self->_hopStore.count; index > 0; index--) {
+    if ((self->_hopStore.flags[index - 1] & kTracerouteHopRecordDestination) !=
+        0) {
+      reachedTarget = YES;
+      break;
+    }
+  }
+  uint8_t actualHops =
+      (self->_forwardEndHop != 0) ? self->_forwardEndHop : self.currentHop;
 
   // Create result object
   TracerouteResult *result = [[TracerouteResult alloc]
       initWithTargetHostname:self.hostName
                targetAddress:self.hostAddress
                      maxHops:self.maxHops
-                  actualHops:self.currentHop
+                  actualHops:actualHops
                    totalTime:[NSDate timeIntervalSinceReferenceDate] -
                              self.startTime
-                        hops:hops
-               reachedTarget:NO]; // This would need proper logic
+                    hopStore:&self->_hopStore
+             routerHostNames:self.routerHostNames
+               reachedTarget:reachedTarget];
+  result.hasFlows = (self.probeMode == SimpleTracerouteProbeModeMultipath);
 
   strongDelegate = self.delegate;
   if ((strongDelegate != nil) &&
@@ -1122,601 +2222,1226 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 
 #pragma mark * Packet Parsing Methods
 
-// Locate the start of the ICMP header inside a received packet.
-// For IPv4, the kernel often includes the IP header; for IPv6 ping sockets,
-// ICMPv6 usually starts at 0.
-- (BOOL)locateICMPHeaderInPacket:(NSData *)packet
-                   addressFamily:(sa_family_t)addressFamily
-                      icmpOffset:(size_t *)icmpOffset {
-  const uint8_t *bytes = (const uint8_t *)packet.bytes;
-  size_t len = packet.length;
+/*! Read a response from the socket
+ *  \param socketFD socket file descriptor
+ *  \param buffer buffer to read into
+ *  \param capacity size of buffer
+ *  \param length output length of the response
+ *  \param sourceAddress output source address
+ *  \param sourceAddressLength output length of sourceAddress
+ *  \param timing output kernel and user receive times (sendTime is left 0)
+ *  \returns Returns YES if read successful, NO if failed or nothing is waiting
+ *  \details Never blocks, so it can be called until the socket is drained.
+ * Nothing is copied or allocated: the response is parsed where it lands.
+ */
+- (BOOL)readResponseFromSocket:(int)socketFD
+                        buffer:(uint8_t *)buffer
+                      capacity:(size_t)capacity
+                        length:(size_t *)length
+                 sourceAddress:(struct sockaddr_storage *)sourceAddress
+           sourceAddressLength:(socklen_t *)sourceAddressLength
+                        timing:(SimplePingTiming *)timing {
+  // Receive data, along with the kernel receive timestamp
+  memset(timing, 0, sizeof(*timing));
+  *sourceAddressLength = sizeof(*sourceAddress);
+  ssize_t bytesReceived = SimplePingReceiveFrom(
+      socketFD, buffer, capacity, MSG_DONTWAIT,
+      (struct sockaddr *)sourceAddress, sourceAddressLength,
+      &timing->kernelReceiveTime, &timing->userReceiveTime);
+
+  if (bytesReceived < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      SimplePingLogError(SimplePingLogCategoryTraceroute,
+                         "Failed to receive data: %{public}s", strerror(errno));
+    }
+    return NO;
+  }
 
-  if (len < 8) {
+  if (bytesReceived == 0) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Connection closed by peer");
     return NO;
   }
 
-  if (addressFamily == AF_INET) {
-    // If it looks like an IPv4 header (version nibble == 4), skip it.
-    if (len >= 20 && (bytes[0] >> 4) == 4) {
-      const struct ip *ipHeader = (const struct ip *)bytes;
-      size_t ipHeaderLen = (size_t)(ipHeader->ip_hl) * 4;
-      if (ipHeaderLen < 20 || ipHeaderLen > len || len < ipHeaderLen + 8) {
-        return NO;
-      }
-      *icmpOffset = ipHeaderLen;
-      return YES;
-    } else {
-      // Bare ICMP (no IP header)
-      *icmpOffset = 0;
-      return YES;
+  *length = (size_t)bytesReceived;
+  SimplePingLogDebug(
+      SimplePingLogCategoryTraceroute, "Received %zd bytes from %{public}@",
+      bytesReceived,
+      [self addressStringFromSockaddr:(const struct sockaddr *)sourceAddress
+                               length:*sourceAddressLength]);
+
+  return YES;
+}
+
+/*! Convert sockaddr structure to readable address string
+ *  \param addr sockaddr address
+ *  \param length length of addr
+ *  \returns Address string, returns nil on failure
+ */
+- (nullable NSString *)addressStringFromSockaddr:(const struct sockaddr *)addr
+                                          length:(socklen_t)length {
+  if (addr == NULL || length < sizeof(struct sockaddr)) {
+    return nil;
+  }
+
+  char addressString[INET6_ADDRSTRLEN];
+
+  switch (addr->sa_family) {
+  case AF_INET: {
+    const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+    if (inet_ntop(AF_INET, &addr4->sin_addr, addressString, INET_ADDRSTRLEN)) {
+      return [NSString stringWithUTF8String:addressString];
+    }
+    break;
+  }
+  case AF_INET6: {
+    const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+    if (inet_ntop(AF_INET6, &addr6->sin6_addr, addressString,
+                  INET6_ADDRSTRLEN)) {
+      return [NSString stringWithUTF8String:addressString];
+    }
+    break;
+  }
+  default:
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Unsupported address family: %d", addr->sa_family);
+    break;
+  }
+
+  return nil;
+}
+
+/*! Match corresponding probe packet by sequence number
+ *  \param sequenceNumber sequence number
+ *  \param probe output matched probe information
+ *  \returns Returns YES if a pending probe matched, NO if not found
+ */
+- (BOOL)matchProbeWithSequenceNumber:(uint16_t)sequenceNumber
+                               probe:(TracerouteProbeSlot *)probe {
+  // Removes the matched probe from the pending table
+  if (!TracerouteProbeTableTake(&self->_probeTable, sequenceNumber, probe)) {
+    return NO;
+  }
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Matched probe for sequence %d", sequenceNumber);
+  SimplePingSignpostEnd(
+      SimplePingLogCategoryTraceroute,
+      SimplePingSignpostProbeID(self.identifier, sequenceNumber), "Probe",
+      "hop=%d", probe->hop);
+  return YES;
+}
+
+/*! Create hop result structure
+ *  \param hopNumber hop number
+ *  \param routerAddress router address
+ *  \param roundTripTime round trip time
+ *  \param isDestination whether it's the destination host
+ *  \returns hop result structure
+ */
+- (TracerouteHopResult *)createHopResult:(uint8_t)hopNumber
+                           routerAddress:(nullable NSString *)routerAddress
+                           roundTripTime:(NSTimeInterval)roundTripTime
+                           isDestination:(BOOL)isDestination {
+  TracerouteHopResult *result = [[TracerouteHopResult alloc] init];
+  result.hopNumber = hopNumber;
+  result.routerAddress = routerAddress;
+  result.roundTripTime = roundTripTime;
+  result.isDestination = isDestination;
+  result.isTimeout = NO;
+  result.timestamp = [NSDate date];
+
+  return result;
+}
+
+/*! Match a decoded response to its probe and build its hop result
+ *  \param response the response, see TracerouteResponseParse()
+ *  \param sourceAddress response source address
+ *  \param sourceAddressLength length of sourceAddress
+ *  \param timing kernel and user receive times of the response
+ *  \returns Hop result, returns nil if the response is not for a pending
+ * probe
+ *  \details This is where the first object is allocated, so responses that
+ * aren't ours cost none.
+ */
+- (nullable TracerouteHopResult *)
+    hopResultForResponse:(const TracerouteResponse *)response
+             fromAddress:(const struct sockaddr *)sourceAddress
+           addressLength:(socklen_t)sourceAddressLength
+                  timing:(SimplePingTiming)timing {
+  // 1. Echo Reply is from the destination, Time Exceeded from a router
+  BOOL isDestination = (response->kind == kTracerouteResponseEchoReply);
+  uint16_t sequenceNumber = response->sequenceNumber;
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "%{public}s response, sequence %d",
+                     isDestination ? "Echo Reply" : "Time Exceeded",
+                     sequenceNumber);
+  if (sequenceNumber == 0) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Failed to extract sequence number");
+    return nil;
+  }
+
+  // 2. Match probe packet
+  TracerouteProbeSlot probe;
+  if (![self matchProbeWithSequenceNumber:sequenceNumber probe:&probe]) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "No matching probe for sequence %d", sequenceNumber);
+    return nil;
+  }
+
+  // 3. Calculate round trip time from the monotonic send stamp to the kernel
+  // receive stamp, so run loop latency doesn't count
+  timing.sendTime = probe.sendTime;
+  uint64_t roundTripNanoseconds = SimplePingTimingRoundTripNanoseconds(timing);
+  NSTimeInterval roundTripTime =
+      TracerouteSecondsFromNanoseconds(roundTripNanoseconds);
+
+  // 4. Get router address
+  NSString *routerAddress =
+      [self addressStringFromSockaddr:sourceAddress
+                               length:sourceAddressLength];
+
+  // 5. Create hop result
+  uint8_t hopNumber = probe.hop;
+  TracerouteHopResult *result = [self createHopResult:hopNumber
+                                        routerAddress:routerAddress
+                                        roundTripTime:roundTripTime
+                                        isDestination:isDestination];
+
+  result.sequenceNumber = sequenceNumber;
+  result.probeIndex = probe.probeIndex;
+  result.roundTripNanoseconds = roundTripNanoseconds;
+  result.deliveryDelayNanoseconds =
+      SimplePingTimingDeliveryDelayNanoseconds(timing);
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Parsed response - hop %d, RTT %.3fms, %{public}@",
+                     hopNumber, roundTripTime * 1000.0,
+                     isDestination ? @"destination" : @"intermediate");
+
+  return result;
+}
+
+/*! Process a received response
+ *  \param bytes the response, as read from the socket
+ *  \param length length of the response
+ *  \param sourceAddress response source address
+ *  \param sourceAddressLength length of sourceAddress
+ *  \param timing kernel and user receive times of the response
+ */
+- (void)processReceivedBytes:(const uint8_t *)bytes
+                      length:(size_t)length
+                 fromAddress:(const struct sockaddr *)sourceAddress
+               addressLength:(socklen_t)sourceAddressLength
+                      timing:(SimplePingTiming)timing {
+  SimplePingMetricsAdd(&self->_metrics,
+                       SimplePingMetricsCounterPacketsReceived, 1);
+
+  // 1. Decode the outer header, ICMP header, quoted request and probe
+  // payload in one pass, straight from the receive buffer
+  TracerouteResponse response;
+  if (!TracerouteResponseParse(bytes, length, self.hostAddressFamily,
+                               &response)) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Invalid ICMP response, ignoring");
+    SimplePingMetricsAdd(&self->_metrics,
+                         SimplePingMetricsCounterValidationFailures, 1);
+    [self countFilteringSince:timing.userReceiveTime];
+    [self recordReceivedBytes:bytes
+                       length:length
+                  fromAddress:sourceAddress
+                addressLength:sourceAddressLength
+                       timing:timing
+                    hopResult:nil];
+    return;
+  }
+
+  // 2. Drop other processes' pings and traceroutes, which every ICMP socket
+  // also receives, before looking for a probe
+  if (response.identifier != self.identifier) {
+    [self countFilteringSince:timing.userReceiveTime];
+    SimplePingMetricsAdd(&self->_metrics,
+                         SimplePingMetricsCounterUnexpectedPackets, 1);
+    [self recordReceivedBytes:bytes
+                       length:length
+                  fromAddress:sourceAddress
+                addressLength:sourceAddressLength
+                       timing:timing
+                    hopResult:nil];
+    return;
+  }
+
+  // 3. Match it to a probe
+  TracerouteHopResult *hopResult =
+      [self hopResultForResponse:&response
+                     fromAddress:sourceAddress
+                   addressLength:sourceAddressLength
+                          timing:timing];
+  uint64_t callbackStart = [self countFilteringSince:timing.userReceiveTime];
+  [self recordReceivedBytes:bytes
+                     length:length
+                fromAddress:sourceAddress
+              addressLength:sourceAddressLength
+                     timing:timing
+                  hopResult:hopResult];
+  if (hopResult == nil) {
+    SimplePingMetricsAdd(&self->_metrics,
+                         SimplePingMetricsCounterUnexpectedPackets, 1);
+    return;
+  }
+
+  id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                             didReceiveResponses:)]) {
+    // Held until -flushReceivedResponses
+    [self.pendingResponses addObject:hopResult];
+  } else if ((strongDelegate != nil) &&
+             [strongDelegate respondsToSelector:@selector
+                             (simpleTraceroute:
+                                 didReceiveResponseFromHop:latency:)]) {
+    [strongDelegate simpleTraceroute:self
+           didReceiveResponseFromHop:hopResult.hopNumber
+                             latency:hopResult.roundTripTime];
+    SimplePingMetricsRecordCallback(&self->_metrics,
+                                    SimplePingMonotonicNanoseconds() -
+                                        callbackStart);
+  }
+
+  // 4. Process hop completion
+  if (self->_continuousPhase) {
+    [self handleContinuousHopResult:hopResult];
+    return;
+  }
+  switch (self.probeMode) {
+  case SimpleTracerouteProbeModeParallel:
+    [self handleParallelHopResult:hopResult];
+    break;
+  case SimpleTracerouteProbeModeMultipath:
+    [self recordMultipathHopResult:hopResult];
+    [self advanceMultipathProbing];
+    break;
+  default:
+    [self handleHopCompletion:hopResult];
+    break;
+  }
+}
+
+/*! Append a response to sessionRecorder, if there is one
+ *  \param bytes the response, as read from the socket
+ *  \param length length of the response
+ *  \param sourceAddress response source address
+ *  \param sourceAddressLength length of sourceAddress
+ *  \param timing kernel and user receive times of the response
+ *  \param hopResult the hop result the response answered, or nil if it
+ *  answered none of our probes
+ */
+- (void)recordReceivedBytes:(const uint8_t *)bytes
+                     length:(size_t)length
+                fromAddress:(const struct sockaddr *)sourceAddress
+              addressLength:(socklen_t)sourceAddressLength
+                     timing:(SimplePingTiming)timing
+                  hopResult:(TracerouteHopResult *)hopResult {
+  SimplePingSessionRecorder *recorder = self.sessionRecorder;
+  if (recorder == nil) {
+    return;
+  }
+
+  SimplePingSessionRecord record;
+  SimplePingSessionRecordInit(&record, SimplePingSessionRecordKindTraceroute,
+                              self.sessionTargetIdentifier,
+                              timing.kernelReceiveTime);
+  SimplePingSessionRecordSetPacket(&record, bytes, length,
+                                   self.hostAddressFamily);
+  SimplePingSessionRecordSetResponder(&record, sourceAddress,
+                                      sourceAddressLength);
+  record.identifier = self.identifier;
+  if (hopResult != nil) {
+    record.flags = SimplePingSessionRecordFlagValid;
+    if (hopResult.isDestination) {
+      record.flags |= SimplePingSessionRecordFlagDestination;
     }
-  } else if (addressFamily == AF_INET6) {
-    // ICMPv6 from ping sockets is typically bare ICMPv6.
-    *icmpOffset = 0;
+    record.hopNumber = hopResult.hopNumber;
+    record.sequenceNumber = hopResult.sequenceNumber;
+    record.roundTripNanoseconds = hopResult.roundTripNanoseconds;
+  }
+  [recorder appendRecord:&record];
+}
+
+/*! Count the time spent validating and matching a response
+ *  \param userReceiveTime when the response was read
+ *  \returns The current time, see SimplePingMonotonicNanoseconds()
+ */
+- (uint64_t)countFilteringSince:(uint64_t)userReceiveTime {
+  uint64_t now = SimplePingMonotonicNanoseconds();
+
+  if (userReceiveTime != 0 && now > userReceiveTime) {
+    SimplePingMetricsAdd(&self->_metrics,
+                         SimplePingMetricsCounterFilteringNanoseconds,
+                         now - userReceiveTime);
+  }
+  return now;
+}
+
+/*! Record a finished hop and notify the delegate
+ *  \param hopResult hop result to report
+ */
+- (void)reportHopResult:(TracerouteHopResult *)hopResult {
+  // 1. Add to the packed results
+  [self storeHopResult:hopResult];
+
+  // 2. Notify delegate
+  id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                                     didCompleteHop:)]) {
+    uint64_t callbackStart = SimplePingMonotonicNanoseconds();
+    [strongDelegate simpleTraceroute:self didCompleteHop:hopResult];
+    SimplePingMetricsRecordCallback(&self->_metrics,
+                                    SimplePingMonotonicNanoseconds() -
+                                        callbackStart);
+  }
+  if (hopResult.isTimeout && (strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                                   didTimeoutForHop:)]) {
+    [strongDelegate simpleTraceroute:self didTimeoutForHop:hopResult.hopNumber];
+  }
+
+  // 3. Look up the router's name, reported separately once it's known
+  [self resolveHostNameOfHopResult:hopResult];
+}
+
+/*! Append a hop result to _hopStore, for the final TracerouteResult
+ *  \param hopResult hop result to store
+ */
+- (void)storeHopResult:(TracerouteHopResult *)hopResult {
+  TracerouteHopRecord record;
+
+  // Timeouts keep how long they waited in roundTripTime only
+  record.roundTripNanoseconds =
+      hopResult.isTimeout
+          ? TracerouteNanosecondsFromSeconds(hopResult.roundTripTime)
+          : hopResult.roundTripNanoseconds;
+  record.timestamp = hopResult.timestamp.timeIntervalSinceReferenceDate;
+  record.deliveryDelayNanoseconds =
+      (uint32_t)MIN(hopResult.deliveryDelayNanoseconds, (uint64_t)UINT32_MAX);
+  record.addressIndex = TracerouteHopStoreInternAddress(
+      &self->_hopStore, hopResult.routerAddress.UTF8String);
+  record.sequenceNumber = hopResult.sequenceNumber;
+  record.hopNumber = hopResult.hopNumber;
+  record.probeIndex = hopResult.probeIndex;
+  record.probeCount = hopResult.probeCount;
+  record.flags = 0;
+  if (hopResult.isDestination) {
+    record.flags |= kTracerouteHopRecordDestination;
+  }
+  if (hopResult.isTimeout) {
+    record.flags |= kTracerouteHopRecordTimeout;
+  }
+
+  if (!TracerouteHopStoreAppend(&self->_hopStore, &record)) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Out of memory storing hop %d result",
+                       hopResult.hopNumber);
+  }
+}
+
+/*! Look up the name of a hop's router with reverseResolver
+ *  \details The result is delivered later, on our queue or run loop, and never
+ *  holds up probing. The pending lookup keeps us alive until it completes.
+ *  \param hopResult hop result whose hostName to fill in
+ */
+- (void)resolveHostNameOfHopResult:(TracerouteHopResult *)hopResult {
+  TracerouteReverseResolver *resolver = self.reverseResolver;
+  if (resolver == nil || hopResult.isTimeout ||
+      hopResult.routerAddress == nil) {
+    return;
+  }
+
+  NSUInteger generation = self->_runGeneration;
+  [resolver resolveAddress:hopResult.routerAddress
+                     queue:self.dispatchQueue
+         completionHandler:^(NSString *hostName) {
+           if (hostName == nil || generation != self->_runGeneration) {
+             return;
+           }
+           hopResult.hostName = hostName;
+           self.routerHostNames[hopResult.routerAddress] = hostName;
+
+           id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
+           if ((strongDelegate != nil) &&
+               [strongDelegate
+                   respondsToSelector:@selector(simpleTraceroute:
+                                              didResolveHostName:forHop:)]) {
+             [strongDelegate simpleTraceroute:self
+                           didResolveHostName:hostName
+                                       forHop:hopResult];
+           }
+         }];
+}
+
+/*! Process hop completion and decide next action
+ *  \param hopResult current hop result
+ */
+- (void)handleHopCompletion:(TracerouteHopResult *)hopResult {
+  // 0. Late answers for an earlier hop must not advance the trace again
+  if (hopResult.hopNumber != self.currentHop) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Ignoring late response for hop %d (current %d)",
+                       hopResult.hopNumber, self.currentHop);
+    return;
+  }
+
+  // 1-2. Record and notify delegate
+  BOOL knownInterface = [self recordInterfaceOfHopResult:hopResult];
+  [self reportHopResult:hopResult];
+  if (!self.isRunning) {
+    return; // The delegate stopped us
+  }
+
+  // 2a. The hop may still be waiting for the rest of its probes; what this
+  // result found counts once it's done
+  self->_hopReachedDestination |= hopResult.isDestination;
+  self->_hopIsKnownInterface |= knownInterface;
+  if (![self shouldProceedToNextHop:hopResult.hopNumber]) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Waiting for more responses for hop %d",
+                       hopResult.hopNumber);
+    return; // Keep current timeout timer running
+  }
+  BOOL reachedDestination = self->_hopReachedDestination;
+  knownInterface = self->_hopIsKnownInterface;
+  self->_hopReachedDestination = NO;
+  self->_hopIsKnownInterface = NO;
+
+  // 3. Check if destination reached
+  if (reachedDestination && !self->_probingBackward) {
+    SimplePingLogInfo(SimplePingLogCategoryTraceroute,
+                      "Reached destination at hop %d", hopResult.hopNumber);
+    [self stopTimeoutTimer]; // Stop current timer
+    [self removePendingProbesForHop:hopResult.hopNumber];
+    [self finishForwardProbing];
+    return;
+  }
+
+  // 3a. Probing backward, an interface some earlier traceroute saw means the
+  // rest of the path is known
+  if (self->_probingBackward && knownInterface) {
+    SimplePingLogInfo(SimplePingLogCategoryTraceroute,
+                      "Hop %d is a known interface, stopping",
+                      hopResult.hopNumber);
+    [self stopTimeoutTimer];
+    [self finishTraceroute];
+    return;
+  }
+
+  // 4. Continue to next hop
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Proceeding to next hop after completing hop %d",
+                     hopResult.hopNumber);
+  [self stopTimeoutTimer]; // Stop current timer
+  [self removePendingProbesForHop:hopResult.hopNumber];
+  [self startNextHop];
+}
+
+/*! Add the interface of a hop to interfaceCache
+ *  \param hopResult hop result
+ *  \returns Returns YES if the cache already held the interface at that hop
+ *  \details Timeouts and the destination itself are not interfaces on the
+ * shared path, so they are neither added nor reported as known.
+ */
+- (BOOL)recordInterfaceOfHopResult:(TracerouteHopResult *)hopResult {
+  if (self.interfaceCache == nil || hopResult.isTimeout ||
+      hopResult.isDestination || hopResult.routerAddress == nil) {
+    return NO;
+  }
+  return [self.interfaceCache
+      addInterfaceReturningWasKnown:hopResult.routerAddress
+                              atHop:hopResult.hopNumber];
+}
+
+/*! Determine if should proceed to next hop
+ *  \param currentHop current hop number
+ *  \returns Returns YES if should proceed to next hop, otherwise returns NO
+ *  \details Decide whether to proceed to next hop based on received responses
+ * count and strategy
+ */
+- (BOOL)shouldProceedToNextHop:(uint8_t)currentHop {
+  // Strategy 1: Proceed to next hop after receiving first valid response (fast
+  // mode) This is traditional traceroute behavior - one response per hop is
+  // sufficient
+  if (!self.waitsForAllProbes) {
     return YES;
   }
-
-  return NO;
+
+  // Strategy 2: Wait for all probe responses or timeout (complete mode), see
+  // waitsForAllProbes. A timeout removes the hop's pending probes first.
+  NSUInteger pendingProbesForCurrentHop =
+      TracerouteProbeTablePendingCountForHop(&self->_probeTable, currentHop);
+  for (NSNumber *item in self.pacedProbes) {
+    if ((uint8_t)(item.unsignedIntegerValue >> 8) == currentHop) {
+      pendingProbesForCurrentHop++; // Not even sent yet
+    }
+  }
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Hop %d has %lu pending probes", currentHop,
+                     (unsigned long)pendingProbesForCurrentHop);
+
+  return (pendingProbesForCurrentHop == 0);
+}
+
+/*! Read and process ICMP response data
+ *  \details Drains the socket, then delivers what was read to
+ * -simpleTraceroute:didReceiveResponses:
+ */
+- (void)readData {
+  [self readResponses];
+  [self flushReceivedResponses];
+}
+
+/*! Deliver the responses held for -simpleTraceroute:didReceiveResponses:
+ *  \details Called once the socket is drained, and before the traceroute
+ * finishes.
+ */
+- (void)flushReceivedResponses {
+  if (self.pendingResponses.count == 0) {
+    return;
+  }
+  NSArray<TracerouteHopResult *> *responses = [self.pendingResponses copy];
+  [self.pendingResponses removeAllObjects];
+
+  id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(simpleTraceroute:
+                                             didReceiveResponses:)]) {
+    uint64_t callbackStart = SimplePingMonotonicNanoseconds();
+    [strongDelegate simpleTraceroute:self didReceiveResponses:responses];
+    SimplePingMetricsRecordCallback(&self->_metrics,
+                                    SimplePingMonotonicNanoseconds() -
+                                        callbackStart);
+  }
 }
 
-/*! Read response data from socket
- *  \param socketFD socket file descriptor
- *  \param responseData output response data
- *  \param sourceAddress output source address
- *  \returns Returns YES if read successful, NO if failed
+/*! Read and process responses until the socket is drained
+ *  \details Reads up to receiveBatchLimit responses, and triggers the parsing
+ * process for each
  */
-- (BOOL)readResponseFromSocket:(int)socketFD
-                  responseData:(NSData **)responseData
-                 sourceAddress:(NSData **)sourceAddress {
-  uint8_t buffer[1024]; // Response buffer
-  struct sockaddr_storage addr;
-  socklen_t addrLen = sizeof(addr);
+- (void)readResponses {
+  NSUInteger limit = MAX(self.receiveBatchLimit, (NSUInteger)1);
+
+  for (NSUInteger count = 0; count < limit; count++) {
+    // Processing a response may finish or stop the traceroute
+    if (self.readSource == nil) {
+      if (count == 0) {
+        SimplePingLogError(SimplePingLogCategoryTraceroute,
+                           "No socket available for reading");
+      }
+      return;
+    }
 
-  // Receive data
-  ssize_t bytesReceived = recvfrom(socketFD, buffer, sizeof(buffer), 0,
-                                   (struct sockaddr *)&addr, &addrLen);
+    int socketFD = self.readSource.nativeSocket;
+    if (socketFD < 0) {
+      SimplePingLogError(SimplePingLogCategoryTraceroute,
+                         "Invalid socket for reading");
+      return;
+    }
 
-  if (bytesReceived < 0) {
-    if (errno != EAGAIN && errno != EWOULDBLOCK) {
-      NSLog(@"SimpleTraceroute: Failed to receive data: %s", strerror(errno));
+    uint8_t buffer[1024];
+    size_t length = 0;
+    struct sockaddr_storage sourceAddress;
+    socklen_t sourceAddressLength = 0;
+    SimplePingTiming timing;
+
+    // Read response data, stopping once the socket is drained
+    if (![self readResponseFromSocket:socketFD
+                               buffer:buffer
+                             capacity:sizeof(buffer)
+                               length:&length
+                        sourceAddress:&sourceAddress
+                  sourceAddressLength:&sourceAddressLength
+                               timing:&timing]) {
+      return;
     }
-    return NO;
-  }
 
-  if (bytesReceived == 0) {
-    NSLog(@"SimpleTraceroute: Connection closed by peer");
-    return NO;
+    // Process received data
+    [self processReceivedBytes:buffer
+                        length:length
+                   fromAddress:(const struct sockaddr *)&sourceAddress
+                 addressLength:sourceAddressLength
+                        timing:timing];
   }
+}
 
-  // Create data object
-  *responseData = [NSData dataWithBytes:buffer length:bytesReceived];
-  *sourceAddress = [NSData dataWithBytes:&addr length:addrLen];
+#pragma mark * SimplePingEngineClient
+
+- (void)simplePingEngine:(SimplePingEngine *)engine
+        didReceivePacket:(NSMutableData *)packet
+             fromAddress:(const struct sockaddr *)address
+           addressLength:(socklen_t)addressLength
+       kernelReceiveTime:(uint64_t)kernelReceiveTime
+         userReceiveTime:(uint64_t)userReceiveTime {
+#pragma unused(engine)
+  SimplePingTiming timing;
+
+  // The engine has already matched the packet to our address and identifier
+  timing.sendTime = 0;
+  timing.kernelReceiveTime = kernelReceiveTime;
+  timing.userReceiveTime = userReceiveTime;
+  [self processReceivedBytes:packet.bytes
+                      length:packet.length
+                 fromAddress:address
+               addressLength:addressLength
+                      timing:timing];
+}
 
-  NSLog(@"SimpleTraceroute: Received %zd bytes from %@", bytesReceived,
-        [self addressStringFromSockaddr:*sourceAddress]);
+- (void)simplePingEngineDidDrainSocket:(SimplePingEngine *)engine {
+#pragma unused(engine)
+  [self flushReceivedResponses];
+}
 
-  return YES;
+- (void)simplePingEngine:(SimplePingEngine *)engine
+        didFailWithError:(NSError *)error {
+#pragma unused(engine)
+  [self didFailWithError:error];
 }
 
-/*! Validate ICMP response packet validity
- *  \param responseData ICMP response data
- *  \param addressFamily address family
- *  \returns Returns YES if validation passes, NO if fails
- */
-- (BOOL)validateICMPResponse:(NSData *)responseData
-               addressFamily:(sa_family_t)addressFamily {
-  // 1. Basic size check
-  size_t icmpOffset = 0;
-  if (![self locateICMPHeaderInPacket:responseData
-                        addressFamily:addressFamily
-                           icmpOffset:&icmpOffset]) {
-    NSLog(@"SimpleTraceroute: Cannot locate ICMP header");
-    return NO;
-  }
+#pragma mark * Parallel Probing Methods
 
-  // 2. Get ICMP type
-  const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  uint8_t icmpType = bytes[icmpOffset];
+/*! Start parallel probing by sending the first window of hops
+ *  \details Hops are probed in one burst (limited by parallelWindow), only
+ * each hop's own probes being spaced by probeInterval, and each probe carries
+ * its own deadline, see -probeDeadlineTimerFired
+ */
+- (void)startParallelProbing {
+  self.nextParallelHopToSend = 1;
+  self.nextParallelHopToReport = 1;
+  self.destinationHop = 0;
+  self.currentHop = 1;
 
-  // 3. Check if ICMP type is what we expect
-  BOOL isValidType = NO;
+  [self sendNextParallelHops];
+}
 
-  if (addressFamily == AF_INET) {
-    isValidType = (icmpType == ICMP_TIMXCEED || icmpType == ICMP_ECHOREPLY);
-  } else if (addressFamily == AF_INET6) {
-    isValidType =
-        (icmpType == ICMP6_TIME_EXCEEDED || icmpType == ICMP6_ECHO_REPLY);
-  }
+/*! Send probes for every hop that fits in the parallel window
+ *  \details The window is measured from the lowest hop that has not been
+ * reported yet. Once the destination hop is known nothing beyond it is sent.
+ */
+- (void)sendNextParallelHops {
+  NSUInteger lastHop =
+      (self.destinationHop != 0) ? self.destinationHop : self.maxHops;
+  NSUInteger window =
+      (self.parallelWindow != 0) ? self.parallelWindow : self.maxHops;
 
-  if (!isValidType) {
-    NSLog(@"SimpleTraceroute: Unexpected ICMP type: %d for address family %d",
-          icmpType, addressFamily);
-    return NO;
+  while (self.isRunning && self.nextParallelHopToSend <= lastHop &&
+         (self.nextParallelHopToSend - self.nextParallelHopToReport) < window) {
+    uint8_t hop = (uint8_t)self.nextParallelHopToSend;
+    self.nextParallelHopToSend++;
+    [self enqueueProbesForHop:hop];
   }
 
-  if (!isValidType) {
-    NSLog(@"SimpleTraceroute: Unexpected ICMP type: %d for address family %d",
-          icmpType, addressFamily);
-    return NO;
+  // Deadlines only ever grow, so an armed timer already covers the earliest
+  // pending probe
+  if (self.isRunning && self.probeDeadlineToken == 0) {
+    [self armProbeDeadlineTimer];
   }
-
-  NSLog(@"SimpleTraceroute: Valid ICMP response, type: %d", icmpType);
-  return YES;
 }
 
-/*! Identify ICMP response type
- *  \param responseData ICMP response data
- *  \param addressFamily address family
- *  \returns ICMP type, returns -1 if unknown
+/*! Collect a hop result in parallel mode and deliver what is ready
+ *  \param hopResult result for a response or a timed out hop
  */
-- (int)identifyICMPType:(NSData *)responseData
-          addressFamily:(sa_family_t)addressFamily {
-  //    if (responseData.length < 1) {
-  //        return -1;
-  //    }
-  //
-  //    const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  //    return bytes[0]; // ICMP type is in the first byte
-  size_t icmpOffset = 0;
-  if (![self locateICMPHeaderInPacket:responseData
-                        addressFamily:addressFamily
-                           icmpOffset:&icmpOffset]) {
-    return -1;
+- (void)handleParallelHopResult:(TracerouteHopResult *)hopResult {
+  uint8_t hop = hopResult.hopNumber;
+  NSNumber *key = @(hop);
+
+  // 1. Ignore late answers for hops that are already settled or beyond the
+  // destination
+  if (hop < self.nextParallelHopToReport ||
+      self.parallelHopResults[key] != nil ||
+      (self.destinationHop != 0 && hop > self.destinationHop)) {
+    return;
   }
-  const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  return bytes[icmpOffset];
-}
 
-/*! Check if it's a Time Exceeded response
- *  \param icmpType ICMP type
- *  \param addressFamily address family
- *  \returns Returns YES if it's Time Exceeded
- */
-- (BOOL)isTimeExceededResponse:(int)icmpType
-                 addressFamily:(sa_family_t)addressFamily {
-  switch (addressFamily) {
-  case AF_INET:
-    return (icmpType == ICMP_TIMXCEED); // Type 11
-  case AF_INET6:
-    return (icmpType == ICMP6_TIME_EXCEEDED); // Type 3
-  default:
-    return NO;
+  // 2. One answer settles the hop, the remaining probes are not needed
+  [self removePendingProbesForHop:hop];
+  self->_parallelExpiredCount[hop] = 0;
+  self.parallelHopResults[key] = hopResult;
+
+  // 3. The lowest hop answering with an Echo Reply is the destination
+  if (hopResult.isDestination &&
+      (self.destinationHop == 0 || hop < self.destinationHop)) {
+    self.destinationHop = hop;
+    [self discardParallelStateBeyondHop:hop];
   }
-}
 
-/*! Check if it's an Echo Reply response
- *  \param icmpType ICMP type
- *  \param addressFamily address family
- *  \returns Returns YES if it's Echo Reply
- */
-- (BOOL)isEchoReplyResponse:(int)icmpType
-              addressFamily:(sa_family_t)addressFamily {
-  switch (addressFamily) {
-  case AF_INET:
-    return (icmpType == ICMP_ECHOREPLY); // Type 0
-  case AF_INET6:
-    return (icmpType == ICMP6_ECHO_REPLY); // Type 129
-  default:
-    return NO;
+  // 4. Report contiguous hops and keep the window full
+  [self deliverParallelHopResults];
+  if (self.isRunning) {
+    [self sendNextParallelHops];
   }
 }
 
-/*! Extract original sequence number from Time Exceeded response
- *  \param responseData Time Exceeded response data
- *  \param addressFamily address family
- *  \returns Original sequence number, returns 0 on failure
+/*! Report settled hops to the delegate in hop order
+ *  \details Finishes the traceroute once the destination (or maxHops) has
+ * been reported.
  */
-- (uint16_t)extractSequenceNumberFromTimeExceeded:(NSData *)responseData
-                                    addressFamily:(sa_family_t)addressFamily {
-  // Time Exceeded contains original IP header + ICMP header
-  // Need to skip ICMP Time Exceeded header (8 bytes) and IP header to find
-  // original ICMP packet
+- (void)deliverParallelHopResults {
+  while (self.isRunning) {
+    NSNumber *key = @(self.nextParallelHopToReport);
+    TracerouteHopResult *hopResult = self.parallelHopResults[key];
+    if (hopResult == nil) {
+      break;
+    }
+    [self.parallelHopResults removeObjectForKey:key];
+    self.nextParallelHopToReport++;
 
-  const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  size_t len = responseData.length;
+    [self reportHopResult:hopResult];
+    if (!self.isRunning) {
+      return; // The delegate stopped us
+    }
 
-  size_t icmpOffset = 0;
-  if (![self locateICMPHeaderInPacket:responseData
-                        addressFamily:addressFamily
-                           icmpOffset:&icmpOffset]) {
-    return 0;
+    if (hopResult.isDestination ||
+        self.nextParallelHopToReport > self.maxHops) {
+      self.currentHop = hopResult.hopNumber;
+      [self finishTraceroute];
+      return;
+    }
+    self.currentHop = (uint8_t)self.nextParallelHopToReport;
   }
+}
 
-  size_t offset = icmpOffset + 8; // skip ICMP Time Exceeded header
+/*! Drop pending probes and buffered results beyond the destination hop
+ *  \param hop destination hop number
+ */
+- (void)discardParallelStateBeyondHop:(uint8_t)hop {
+  TracerouteProbeTableRemoveHopsAbove(&self->_probeTable, hop);
+  [self discardPacedProbesForHop:hop above:YES];
 
-  if (addressFamily == AF_INET) {
-    if (len < offset + 20) {
-      NSLog(@"SimpleTraceroute: Time Exceeded too small for IPv4 inner IP");
-      return 0;
+  for (NSNumber *resultHop in self.parallelHopResults.allKeys) {
+    if (resultHop.unsignedCharValue > hop) {
+      [self.parallelHopResults removeObjectForKey:resultHop];
     }
-    const struct ip *innerIP = (const struct ip *)(bytes + offset);
-    size_t innerIPLen = (size_t)(innerIP->ip_hl) * 4;
-    if (innerIPLen < 20 || len < offset + innerIPLen + 8) {
-      NSLog(@"SimpleTraceroute: Not enough data for inner ICMP header");
-      return 0;
-    }
-    offset += innerIPLen; // now at original ICMP header
-    uint16_t sequence = ntohs(*(const uint16_t *)(bytes + offset + 6));
-    return sequence;
-
-  } else if (addressFamily == AF_INET6) {
-    // Included invoking packet starts with IPv6 header (40 bytes)
-    if (len < offset + 40 + 8) {
-      NSLog(@"SimpleTraceroute: Time Exceeded too small for IPv6 inner ICMPv6");
-      return 0;
-    }
-    offset += 40; // skip inner IPv6 header
-    uint16_t sequence = ntohs(*(const uint16_t *)(bytes + offset + 6));
-    return sequence;
   }
+}
 
-  return 0;
+/*! Remove all pending probes of a hop, including those not sent yet
+ *  \param hop hop number
+ */
+- (void)removePendingProbesForHop:(uint8_t)hop {
+  TracerouteProbeTableRemoveHop(&self->_probeTable, hop, NULL, NULL);
+  [self discardPacedProbesForHop:hop above:NO];
 }
 
-/*! Extract sequence number from Echo Reply response
- *  \param responseData Echo Reply response data
- *  \param addressFamily address family
- *  \returns Sequence number, returns 0 on failure
+/*! Arm the deadline timer for the earliest pending probe
  */
-- (uint16_t)extractSequenceNumberFromEchoReply:(NSData *)responseData
-                                 addressFamily:(sa_family_t)addressFamily {
-  // Echo Reply sequence number is directly at offset 6 in ICMP header
-  size_t icmpOffset = 0;
-  if (![self locateICMPHeaderInPacket:responseData
-                        addressFamily:addressFamily
-                           icmpOffset:&icmpOffset]) {
-    NSLog(@"SimpleTraceroute: Echo Reply too small");
-    return 0;
-  }
+- (void)armProbeDeadlineTimer {
+  [self stopProbeDeadlineTimer];
 
-  const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  if (responseData.length < icmpOffset + 8) {
-    NSLog(@"SimpleTraceroute: Echo Reply response too small");
-    return 0;
+  // Deadlines grow with sequence numbers, so the oldest probe is due first
+  TracerouteProbeSlot oldest;
+  if (!TracerouteProbeTableOldest(&self->_probeTable, &oldest)) {
+    return; // Nothing outstanding
   }
 
-  uint16_t sequence = ntohs(*(const uint16_t *)(bytes + icmpOffset + 6));
-  NSLog(@"SimpleTraceroute: Extracted sequence %d from Echo Reply", sequence);
-  return sequence;
+  self.probeDeadlineToken =
+      [self addTimeoutForKey:kTracerouteProbeDeadlineKey
+                    deadline:oldest.deadline];
 }
 
-/*! Extract timestamp from response payload
- *  \param responseData response data
- *  \param addressFamily address family
- *  \returns Timestamp, returns 0 on failure
+/*! Deadline timer callback for parallel, multipath and continuous modes
+ *  \details Expires every probe whose deadline has passed. Each probe's
+ * deadline starts when it is sent, and a hop is settled as a timeout only once
+ * every one of its probes has been sent and expired without an answer; probes
+ * still waiting for the pacer keep the hop open.
  */
-- (NSTimeInterval)extractTimestampFromResponse:(NSData *)responseData
-                                 addressFamily:(sa_family_t)addressFamily {
-  // For Echo Reply, timestamp is at the beginning of payload
-  // For Time Exceeded, need to extract original payload
+- (void)probeDeadlineTimerFired {
+  self.probeDeadlineToken = 0;
+  if (!self.isRunning) {
+    return;
+  }
+  if (self->_continuousPhase) {
+    [self expireContinuousProbes];
+    return;
+  }
+  if (self.probeMode == SimpleTracerouteProbeModeMultipath) {
+    [self expireMultipathProbes];
+    return;
+  }
 
-  const uint8_t *bytes = (const uint8_t *)responseData.bytes;
-  size_t len = responseData.length;
+  // 1. Expire probes past their deadline, remembering the first probe and
+  // the number of expired probes of each hop
+  uint64_t now = SimplePingMonotonicNanoseconds();
+  BOOL expired[256] = {NO};
+  TracerouteProbeSlot probe;
 
-  size_t icmpOffset = 0;
-  if (![self locateICMPHeaderInPacket:responseData
-                        addressFamily:addressFamily
-                           icmpOffset:&icmpOffset]) {
-    return 0;
+  while (TracerouteProbeTableExpireOldest(&self->_probeTable, now, &probe)) {
+    if (self->_parallelExpiredCount[probe.hop] == 0) {
+      self->_parallelFirstExpired[probe.hop] = probe;
+    }
+    self->_parallelExpiredCount[probe.hop]++;
+    expired[probe.hop] = YES;
   }
 
-  int icmpType = [self identifyICMPType:responseData
-                          addressFamily:addressFamily];
-
-  if ((addressFamily == AF_INET && icmpType == ICMP_ECHOREPLY) ||
-      (addressFamily == AF_INET6 && icmpType == ICMP6_ECHO_REPLY)) {
-    size_t payloadOffset = icmpOffset + 8;
-    if (len < payloadOffset + sizeof(NSTimeInterval)) {
-      NSLog(@"SimpleTraceroute: Response too small to contain timestamp");
-      return 0;
+  // 2. Settle hops that have nothing left in flight or still to send, lowest
+  // first
+  for (NSUInteger hop = 1; hop < 256; hop++) {
+    if (!self.isRunning) {
+      return;
     }
-    NSTimeInterval ts = 0;
-    memcpy(&ts, bytes + payloadOffset, sizeof(ts));
-    return ts;
-  }
-
-  if ((addressFamily == AF_INET && icmpType == ICMP_TIMXCEED) ||
-      (addressFamily == AF_INET6 && icmpType == ICMP6_TIME_EXCEEDED)) {
-    // Locate original ICMP payload to read our timestamp (we put it first).
-    size_t offset = icmpOffset + 8;
-
-    if (addressFamily == AF_INET) {
-      if (len < offset + 20)
-        return 0;
-      const struct ip *innerIP = (const struct ip *)(bytes + offset);
-      size_t innerIPLen = (size_t)(innerIP->ip_hl) * 4;
-      if (innerIPLen < 20 ||
-          len < offset + innerIPLen + 8 + sizeof(NSTimeInterval))
-        return 0;
-      offset += innerIPLen; // inner ICMP header
-      offset += 8;          // inner ICMP header size
-    } else {
-      // IPv6: inner IPv6 header (40) + inner ICMPv6 header (8)
-      if (len < offset + 40 + 8 + sizeof(NSTimeInterval))
-        return 0;
-      offset += 40 + 8;
+    if (!expired[hop] ||
+        TracerouteProbeTablePendingCountForHop(&self->_probeTable,
+                                               (uint8_t)hop) != 0 ||
+        [self hasPacedProbesForHop:(uint8_t)hop]) {
+      continue;
     }
-
-    NSTimeInterval ts = 0;
-    memcpy(&ts, bytes + offset, sizeof(ts));
-    return ts;
+    TracerouteHopResult *timeoutResult = [self
+        createTimeoutResult:(uint8_t)hop
+             sequenceNumber:self->_parallelFirstExpired[hop].sequenceNumber
+                 probeIndex:self->_parallelFirstExpired[hop].probeIndex
+                 probeCount:self->_parallelExpiredCount[hop]
+              actualTimeout:self.timeout];
+    self->_parallelExpiredCount[hop] = 0;
+    [self handleParallelHopResult:timeoutResult];
   }
 
-  return 0;
+  // 3. Wait for the next deadline
+  if (self.isRunning && self.probeDeadlineToken == 0) {
+    [self armProbeDeadlineTimer];
+  }
 }
 
-/*! Convert sockaddr structure to readable address string
- *  \param address sockaddr address data
- *  \returns Address string, returns nil on failure
+/*! Stops the parallel mode deadline timer.
  */
-- (nullable NSString *)addressStringFromSockaddr:(NSData *)address {
-  if (address.length < sizeof(struct sockaddr)) {
-    return nil;
+- (void)stopProbeDeadlineTimer {
+  if (self.probeDeadlineToken != 0) {
+    [self.timeoutWheel cancelTimeout:self.probeDeadlineToken];
+    self.probeDeadlineToken = 0;
   }
+}
 
-  const struct sockaddr *addr = (const struct sockaddr *)address.bytes;
-  char addressString[INET6_ADDRSTRLEN];
-
-  switch (addr->sa_family) {
-  case AF_INET: {
-    const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
-    if (inet_ntop(AF_INET, &addr4->sin_addr, addressString, INET_ADDRSTRLEN)) {
-      return [NSString stringWithUTF8String:addressString];
-    }
-    break;
-  }
-  case AF_INET6: {
-    const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
-    if (inet_ntop(AF_INET6, &addr6->sin6_addr, addressString,
-                  INET6_ADDRSTRLEN)) {
-      return [NSString stringWithUTF8String:addressString];
-    }
-    break;
-  }
-  default:
-    NSLog(@"SimpleTraceroute: Unsupported address family: %d", addr->sa_family);
-    break;
-  }
+#pragma mark * Multipath Probing Methods
 
-  return nil;
+/*! Returns how many flows the MDA stopping rule probes a hop with
+ *  \param interfaceCount interfaces found at the hop so far
+ *  \param confidence see multipathConfidence
+ *  \details Enough that, were there interfaceCount + 1 interfaces sharing the
+ * flows evenly, the chance of one going unseen is under 1 - confidence. That
+ * chance is at most (k + 1) (k / (k + 1))^n after n flows, which at 95% gives
+ * 6, 11, 16, 21, 27..., within a flow of the published MDA table.
+ */
+static NSUInteger TracerouteMultipathFlowsNeeded(NSUInteger interfaceCount,
+                                                 double confidence) {
+  double alternatives = (double)MAX(interfaceCount, (NSUInteger)1) + 1;
+  double flows = ceil(log(alternatives / (1 - confidence)) /
+                      log(alternatives / (alternatives - 1)));
+  return (NSUInteger)MIN(flows, (double)kTracerouteMaxMultipathFlows);
 }
 
-/*! Match corresponding probe packet by sequence number
- *  \param sequenceNumber sequence number
- *  \returns Matched probe information, returns nil if not found
+/*! Start multipath probing at hop 1
  */
-- (nullable NSDictionary *)matchProbeWithSequenceNumber:
-    (uint16_t)sequenceNumber {
-  NSString *key = [NSString stringWithFormat:@"%d", sequenceNumber];
-  NSDictionary *probeInfo = self.pendingProbes[key];
+- (void)startMultipathProbing {
+  self.currentHop = 0;
+  [self startNextMultipathHop];
+}
 
-  if (probeInfo != nil) {
-    NSLog(@"SimpleTraceroute: Matched probe for sequence %d", sequenceNumber);
-    // Remove matched probe from pending list
-    [self.pendingProbes removeObjectForKey:key];
+/*! Move on to the next hop, or finish past maxHops
+ */
+- (void)startNextMultipathHop {
+  self.currentHop = (uint8_t)(self.currentHop + 1);
+  if (self.currentHop > self.maxHops || self.currentHop == 0) {
+    [self finishTraceroute];
+    return;
   }
-
-  return probeInfo;
+  [self.multipathInterfaces removeAllObjects];
+  self->_hopReachedDestination = NO;
+  [self sendMultipathFlows];
 }
 
-/*! Create hop result structure
- *  \param hopNumber hop number
- *  \param routerAddress router address
- *  \param roundTripTime round trip time
- *  \param isDestination whether it's the destination host
- *  \returns hop result structure
+/*! Send the current hop the flows the stopping rule calls for
+ *  \details Flows the hop before never got go to it first, so each answer
+ * here has one there to link to; those extra probes may find it more
+ * interfaces too.
  */
-- (TracerouteHopResult *)createHopResult:(uint8_t)hopNumber
-                           routerAddress:(nullable NSString *)routerAddress
-                           roundTripTime:(NSTimeInterval)roundTripTime
-                           isDestination:(BOOL)isDestination {
-  TracerouteHopResult *result = [[TracerouteHopResult alloc] init];
-  result.hopNumber = hopNumber;
-  result.routerAddress = routerAddress;
-  result.roundTripTime = roundTripTime;
-  result.isDestination = isDestination;
-  result.isTimeout = NO;
-  result.timestamp = [NSDate date];
+- (void)sendMultipathFlows {
+  uint8_t hop = self.currentHop;
+  NSUInteger needed = TracerouteMultipathFlowsNeeded(
+      self.multipathInterfaces.count, self.multipathConfidence);
+
+  // 1. Flows new to the hop before, so the TTL changes once
+  if (hop > 1) {
+    uint8_t previousHop = (uint8_t)(hop - 1);
+    for (NSUInteger flow = self->_multipathFlowsSent[previousHop];
+         flow < needed; flow++) {
+      [self.pacedProbes addObject:@(((NSUInteger)previousHop << 8) | flow)];
+    }
+    self->_multipathFlowsSent[previousHop] =
+        (uint8_t)MAX(self->_multipathFlowsSent[previousHop], needed);
+  }
 
-  return result;
+  // 2. Then this hop's
+  for (NSUInteger flow = self->_multipathFlowsSent[hop]; flow < needed;
+       flow++) {
+    [self.pacedProbes addObject:@(((NSUInteger)hop << 8) | flow)];
+  }
+  self->_multipathFlowsSent[hop] = (uint8_t)needed;
+  [self sendPacedProbes];
 }
 
-/*! Parse ICMP response packet
- *  \param responseData ICMP response data
- *  \param sourceAddress response source address
- *  \returns Parse result, returns nil on failure
- */
-- (nullable TracerouteHopResult *)parseICMPResponse:(NSData *)responseData
-                                        fromAddress:(NSData *)sourceAddress {
-  // 1. Identify ICMP type
-  int icmpType = [self identifyICMPType:responseData
-                          addressFamily:self.hostAddressFamily];
-
-  // 2. Extract sequence number
-  uint16_t sequenceNumber = 0;
-  BOOL isDestination = NO;
-
-  if ([self isTimeExceededResponse:icmpType
-                     addressFamily:self.hostAddressFamily]) {
-    // Time Exceeded - from intermediate router
-    sequenceNumber =
-        [self extractSequenceNumberFromTimeExceeded:responseData
-                                      addressFamily:self.hostAddressFamily];
-    isDestination = NO;
-    NSLog(@"SimpleTraceroute: Time Exceeded response from intermediate router");
-  } else if ([self isEchoReplyResponse:icmpType
-                         addressFamily:self.hostAddressFamily]) {
-    // Echo Reply - from destination host
-    sequenceNumber =
-        [self extractSequenceNumberFromEchoReply:responseData
-                                   addressFamily:self.hostAddressFamily];
-    isDestination = YES;
-    NSLog(@"SimpleTraceroute: Echo Reply response from destination");
-  } else {
-    NSLog(@"SimpleTraceroute: Unknown ICMP type: %d", icmpType);
-    return nil;
+/*! Record an answer, or a timeout, of one flow
+ *  \param hopResult result of one probe
+ */
+- (void)recordMultipathHopResult:(TracerouteHopResult *)hopResult {
+  if (hopResult.hopNumber == self.currentHop && !hopResult.isTimeout &&
+      hopResult.routerAddress != nil) {
+    [self.multipathInterfaces addObject:hopResult.routerAddress];
+    self->_hopReachedDestination |= hopResult.isDestination;
   }
+  [self reportHopResult:hopResult];
+}
 
-  if (sequenceNumber == 0) {
-    NSLog(@"SimpleTraceroute: Failed to extract sequence number");
-    return nil;
+/*! Decide what to do once the current hop's flows are all settled
+ *  \details The flows found more interfaces than the stopping rule allowed
+ * for, so more are sent; or the hop is done, and so is the trace if the
+ * destination answered there.
+ */
+- (void)advanceMultipathProbing {
+  uint8_t hop = self.currentHop;
+
+  // 1. Wait for every flow in flight, the hop before's included
+  if (!self.isRunning || self.pacedProbes.count != 0 ||
+      TracerouteProbeTablePendingCountForHop(&self->_probeTable, hop) != 0 ||
+      (hop > 1 && TracerouteProbeTablePendingCountForHop(
+                      &self->_probeTable, (uint8_t)(hop - 1)) != 0)) {
+    return;
   }
 
-  // 3. Match probe packet
-  NSDictionary *probeInfo = [self matchProbeWithSequenceNumber:sequenceNumber];
-  if (probeInfo == nil) {
-    NSLog(@"SimpleTraceroute: No matching probe for sequence %d",
-          sequenceNumber);
-    return nil;
+  // 2. Probe again if the rule wants more flows
+  NSUInteger needed = TracerouteMultipathFlowsNeeded(
+      self.multipathInterfaces.count, self.multipathConfidence);
+  if (self->_multipathFlowsSent[hop] < needed) {
+    [self sendMultipathFlows];
+    return;
   }
 
-  // 4. Calculate round trip time
-  NSTimeInterval sendTime = [probeInfo[@"timestamp"] doubleValue];
-  NSTimeInterval receiveTime = [NSDate timeIntervalSinceReferenceDate];
-  NSTimeInterval roundTripTime = receiveTime - sendTime;
+  // 3. The hop is done
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Hop %d has %lu interfaces after %d flows", hop,
+                     (unsigned long)self.multipathInterfaces.count,
+                     self->_multipathFlowsSent[hop]);
+  if (self->_hopReachedDestination) {
+    [self finishTraceroute];
+  } else {
+    [self startNextMultipathHop];
+  }
+}
 
-  // 5. Get router address
-  NSString *routerAddress = [self addressStringFromSockaddr:sourceAddress];
+/*! Report every probe past its deadline as a timeout, then move on
+ *  \details Each flow's timeout is its own result, so the graph knows which
+ * flows went unanswered.
+ */
+- (void)expireMultipathProbes {
+  uint64_t now = SimplePingMonotonicNanoseconds();
+  NSMutableArray<TracerouteHopResult *> *timeoutResults =
+      [NSMutableArray array];
+  TracerouteProbeSlot probe;
+
+  while (TracerouteProbeTableExpireOldest(&self->_probeTable, now, &probe)) {
+    [timeoutResults addObject:[self createTimeoutResult:probe.hop
+                                         sequenceNumber:probe.sequenceNumber
+                                             probeIndex:probe.probeIndex
+                                             probeCount:1
+                                          actualTimeout:self.timeout]];
+  }
+  for (TracerouteHopResult *timeoutResult in timeoutResults) {
+    if (!self.isRunning) {
+      return; // The delegate stopped us
+    }
+    [self recordMultipathHopResult:timeoutResult];
+  }
+  [self advanceMultipathProbing];
 
-  // 6. Create hop result
-  uint8_t hopNumber = [probeInfo[@"hop"] unsignedCharValue];
-  TracerouteHopResult *result = [self createHopResult:hopNumber
-                                        routerAddress:routerAddress
-                                        roundTripTime:roundTripTime
-                                        isDestination:isDestination];
+  if (self.isRunning && self.probeDeadlineToken == 0) {
+    [self armProbeDeadlineTimer];
+  }
+}
 
-  result.sequenceNumber = sequenceNumber;
-  result.probeIndex = [probeInfo[@"probeIndex"] unsignedCharValue];
+#pragma mark * Continuous Probing Methods
 
-  NSLog(@"SimpleTraceroute: Parsed response - hop %d, RTT %.3fms, %@",
-        hopNumber, roundTripTime * 1000.0,
-        isDestination ? @"destination" : @"intermediate");
+/*! Switch to watching the path once it has been traced
+ *  \details Called instead of finishing. The socket, the probe results of the
+ * trace and the metrics all carry on; only what was still pending is dropped.
+ */
+- (void)startContinuousProbing {
+  // 1. Nothing of the trace is waited for any more
+  [self stopTimeoutTimer];
+  [self stopProbeDeadlineTimer];
+  TracerouteProbeTableReset(&self->_probeTable);
+  [self.pacedProbes removeAllObjects];
+  [self.parallelHopResults removeAllObjects];
+
+  // 2. Rounds go up to the lowest hop the destination answered at, or to
+  // maxHops if it never did
+  uint8_t destinationHop = 0;
+  for (uint32_t index = 0; index < self->_hopStore.count; index++) {
+    uint8_t hop = self->_hopStore.hopNumbers[index];
+    if ((self->_hopStore.flags[index] & kTracerouteHopRecordDestination) != 0 &&
+        (destinationHop == 0 || hop < destinationHop)) {
+      destinationHop = hop;
+    }
+  }
+  self->_continuousDestinationHop = destinationHop;
+  self->_continuousHopLimit =
+      (destinationHop != 0) ? destinationHop : self.maxHops;
+  self.currentHop = self->_continuousHopLimit;
+
+  // 3. The statistics are kept from here on
+  uint32_t capacity = (uint32_t)self.statisticsWindow;
+  if (self->_hopWindows != NULL && self->_hopWindows->capacity != capacity) {
+    TracerouteHopWindowsDestroy(self->_hopWindows);
+    free(self->_hopWindows);
+    self->_hopWindows = NULL;
+  }
+  if (self->_hopWindows == NULL) {
+    self->_hopWindows = malloc(sizeof(*self->_hopWindows));
+    if (self->_hopWindows == NULL) {
+      [self didFailWithError:[NSError errorWithDomain:NSPOSIXErrorDomain
+                                                 code:ENOMEM
+                                             userInfo:nil]];
+      return;
+    }
+    TracerouteHopWindowsInit(self->_hopWindows, capacity);
+  }
 
-  return result;
+  SimplePingLogInfo(SimplePingLogCategoryTraceroute,
+                    "Watching %d hops continuously", self->_continuousHopLimit);
+  self->_continuousPhase = YES;
+  [self startContinuousCycle];
 }
 
-/*! Process received response data
- *  \param responseData received raw data
- *  \param sourceAddress response source address
+/*! Send one probe to every watched hop, and schedule the next round
  */
-- (void)processReceivedData:(NSData *)responseData
-                fromAddress:(NSData *)sourceAddress {
-  // 1. Validate response packet
-  if (![self validateICMPResponse:responseData
-                    addressFamily:self.hostAddressFamily]) {
-    NSLog(@"SimpleTraceroute: Invalid ICMP response, ignoring");
-    return;
-  }
-
-  // 2. Parse response packet
-  TracerouteHopResult *hopResult = [self parseICMPResponse:responseData
-                                               fromAddress:sourceAddress];
-  if (hopResult == nil) {
-    NSLog(@"SimpleTraceroute: Failed to parse ICMP response");
-    return;
+- (void)startContinuousCycle {
+  // 1. A round still queued behind the pacer makes this one moot
+  if (self.pacedProbes.count == 0) {
+    self.cycleCount++;
+    for (NSUInteger hop = 1; hop <= self->_continuousHopLimit; hop++) {
+      [self.pacedProbes addObject:@(hop << 8)];
+    }
+    [self sendPacedProbes];
+    if (!self.isRunning) {
+      return;
+    }
   }
 
-  // 3. Process hop completion
-  [self handleHopCompletion:hopResult];
+  // 2. Rounds start on a fixed schedule, however long their probes take
+  self.cycleToken = [self
+      addTimeoutForKey:kTracerouteCycleKey
+              deadline:SimplePingMonotonicNanoseconds() +
+                       TracerouteNanosecondsFromSeconds(self.cycleInterval)];
 }
 
-/*! Process hop completion and decide next action
- *  \param hopResult current hop result
+/*! Add a probe that answered or timed out to its hop's statistics
+ *  \param hopResult result of one probe
  */
-- (void)handleHopCompletion:(TracerouteHopResult *)hopResult {
-  // 1. Add to completed list
-  [self.completedHops addObject:hopResult];
-
-  // 2. Notify delegate
+- (void)handleContinuousHopResult:(TracerouteHopResult *)hopResult {
+  uint8_t hop = hopResult.hopNumber;
+
+  // 1. Add it to the hop's window
+  uint64_t roundTripNanoseconds =
+      hopResult.isTimeout ? 0 : MAX(hopResult.roundTripNanoseconds, 1);
+  if (!TracerouteHopWindowsAdd(self->_hopWindows, hop, roundTripNanoseconds)) {
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Out of memory keeping hop %d statistics", hop);
+  }
+  if (!hopResult.isTimeout && hopResult.routerAddress != nil) {
+    self.continuousRouterAddresses[@(hop)] = hopResult.routerAddress;
+  }
+
+  // 2. An answer from the destination, lower than it was or after it went
+  // quiet, is where rounds stop now; silence from it sends them on to maxHops
+  // in case the path has grown
+  uint8_t destinationHop = self->_continuousDestinationHop;
+  if (hopResult.isDestination &&
+      (destinationHop == 0 || hop < destinationHop ||
+       self->_continuousHopLimit > destinationHop)) {
+    self->_continuousDestinationHop = hop;
+    self->_continuousHopLimit = hop;
+    TracerouteProbeTableRemoveHopsAbove(&self->_probeTable, hop);
+    [self discardPacedProbesForHop:hop above:YES];
+  } else if (hopResult.isTimeout && hop == destinationHop) {
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Destination hop %d went quiet, probing beyond it", hop);
+    self->_continuousHopLimit = self.maxHops;
+  }
+  self.currentHop = self->_continuousHopLimit;
+
+  // 3. Tell the delegate
   id<SimpleTracerouteDelegate> strongDelegate = self.delegate;
   if ((strongDelegate != nil) &&
       [strongDelegate respondsToSelector:@selector(simpleTraceroute:
-                                                     didCompleteHop:)]) {
-    [strongDelegate simpleTraceroute:self didCompleteHop:hopResult];
-  }
-
-  // 3. Check if destination reached
-  if (hopResult.isDestination) {
-    NSLog(@"SimpleTraceroute: Reached destination at hop %d",
-          hopResult.hopNumber);
-    [self stopTimeoutTimer]; // Stop current timer
-    [self finishTraceroute];
-    return;
-  }
-
-  // 4. Check if need to continue to next hop
-  if ([self shouldProceedToNextHop:hopResult.hopNumber]) {
-    NSLog(@"SimpleTraceroute: Proceeding to next hop after completing hop %d",
-          hopResult.hopNumber);
-    [self stopTimeoutTimer]; // Stop current timer
-    [self startNextHop];
-  } else {
-    NSLog(@"SimpleTraceroute: Waiting for more responses for hop %d",
-          hopResult.hopNumber);
-    // Keep current timeout timer running, wait for more responses or timeout
+                                             didUpdateHopStatistics:)]) {
+    TracerouteHopStatistics *statistics = [self statisticsForHop:hop];
+    if (statistics != nil) {
+      uint64_t callbackStart = SimplePingMonotonicNanoseconds();
+      [strongDelegate simpleTraceroute:self didUpdateHopStatistics:statistics];
+      SimplePingMetricsRecordCallback(&self->_metrics,
+                                      SimplePingMonotonicNanoseconds() -
+                                          callbackStart);
+    }
   }
 }
 
-/*! Determine if should proceed to next hop
- *  \param currentHop current hop number
- *  \returns Returns YES if should proceed to next hop, otherwise returns NO
- *  \details Decide whether to proceed to next hop based on received responses
- * count and strategy
+/*! Count every probe past its deadline as lost
  */
-- (BOOL)shouldProceedToNextHop:(uint8_t)currentHop {
-  // Strategy 1: Proceed to next hop after receiving first valid response (fast
-  // mode) This is traditional traceroute behavior - one response per hop is
-  // sufficient
-
-  // Strategy 2: Wait for all probe responses or timeout (complete mode)
-  // Strategy can be configured via property, using fast mode here
-
-  // Check if there are pending probes for current hop
-  NSUInteger pendingProbesForCurrentHop = 0;
-  for (NSString *key in self.pendingProbes) {
-    NSDictionary *probeInfo = self.pendingProbes[key];
-    uint8_t probeHop = [probeInfo[@"hop"] unsignedCharValue];
-    if (probeHop == currentHop) {
-      pendingProbesForCurrentHop++;
+- (void)expireContinuousProbes {
+  uint64_t now = SimplePingMonotonicNanoseconds();
+  NSMutableArray<TracerouteHopResult *> *timeoutResults =
+      [NSMutableArray array];
+  TracerouteProbeSlot probe;
+
+  while (TracerouteProbeTableExpireOldest(&self->_probeTable, now, &probe)) {
+    [timeoutResults addObject:[self createTimeoutResult:probe.hop
+                                         sequenceNumber:probe.sequenceNumber
+                                             probeIndex:probe.probeIndex
+                                             probeCount:1
+                                          actualTimeout:self.timeout]];
+  }
+  for (TracerouteHopResult *timeoutResult in timeoutResults) {
+    if (!self.isRunning) {
+      return; // The delegate stopped us
     }
+    [self handleContinuousHopResult:timeoutResult];
   }
 
-  NSLog(@"SimpleTraceroute: Hop %d has %lu pending probes", currentHop,
-        (unsigned long)pendingProbesForCurrentHop);
-
-  // Fast mode: Proceed to next hop upon receiving any response, don't wait for
-  // other probes If all probes have responded or this is timeout handling,
-  // proceed to next hop
-  return YES; // Use fast mode
-
-  // Optional complete mode implementation:
-  // return (pendingProbesForCurrentHop == 0);
+  if (self.isRunning && self.probeDeadlineToken == 0) {
+    [self armProbeDeadlineTimer];
+  }
 }
 
-/*! Read and process ICMP response data (replacement for placeholder
- * implementation) \details Read data from socket and trigger parsing process
+/*! Returns a snapshot of a hop's rolling statistics
+ *  \returns nil if the hop has none
  */
-- (void)readData {
-  if (self.socket == NULL) {
-    NSLog(@"SimpleTraceroute: No socket available for reading");
-    return;
-  }
+- (nullable TracerouteHopStatistics *)statisticsForHop:(uint8_t)hop {
+  TracerouteHopWindowSummary summary;
 
-  int socketFD = CFSocketGetNative(self.socket);
-  if (socketFD < 0) {
-    NSLog(@"SimpleTraceroute: Invalid socket for reading");
-    return;
+  if (self->_hopWindows == NULL ||
+      !TracerouteHopWindowsGetSummary(self->_hopWindows, hop, &summary)) {
+    return nil;
   }
+  return [[TracerouteHopStatistics alloc]
+      initWithHopNumber:hop
+          routerAddress:self.continuousRouterAddresses[@(hop)]
+          isDestination:(hop == self->_continuousDestinationHop)
+                summary:&summary];
+}
 
-  NSData *responseData = nil;
-  NSData *sourceAddress = nil;
-
-  // Read response data
-  if ([self readResponseFromSocket:socketFD
-                      responseData:&responseData
-                     sourceAddress:&sourceAddress]) {
-    // Process received data
-    [self processReceivedData:responseData fromAddress:sourceAddress];
+/*! Stops the continuous mode round timer.
+ */
+- (void)stopCycleTimer {
+  if (self.cycleToken != 0) {
+    [self.timeoutWheel cancelTimeout:self.cycleToken];
+    self.cycleToken = 0;
   }
 }
 
@@ -1733,69 +3458,63 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 
   // 2. Validate parameters
   if (hop < 1 || hop > 255) {
-    NSLog(@"SimpleTraceroute: Invalid hop number for timeout timer: %d", hop);
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Invalid hop number for timeout timer: %d", hop);
     return;
   }
 
   if (!self.isRunning) {
-    NSLog(@"SimpleTraceroute: Cannot start timeout timer - traceroute not "
-          @"running");
+    SimplePingLogError(SimplePingLogCategoryTraceroute,
+                       "Cannot start timeout timer - traceroute not running");
     return;
   }
 
-  // 3. Create user info dictionary (pass hop information to timer callback)
-  NSDictionary *userInfo = @{
-    @"hop" : @(hop),
-    @"timestamp" : @([NSDate timeIntervalSinceReferenceDate])
-  };
+  // 3. Remember the hop and start time for the timeout callback
+  self.hopTimeoutHop = hop;
+  self.hopTimeoutStartTime = [NSDate timeIntervalSinceReferenceDate];
 
-  // 4. Create and start timer
-  self.timeoutTimer =
-      [NSTimer scheduledTimerWithTimeInterval:self.timeout
-                                       target:self
-                                     selector:@selector(timeoutForHop:)
-                                     userInfo:userInfo
-                                      repeats:NO];
+  // 4. Schedule the timeout
+  self.hopTimeoutToken = [self
+      addTimeoutForKey:kTracerouteHopTimeoutKey
+              deadline:SimplePingMonotonicNanoseconds() +
+                       TracerouteNanosecondsFromSeconds(self.timeout)];
 
-  NSLog(@"SimpleTraceroute: Started timeout timer for hop %d (%.1fs)", hop,
-        self.timeout);
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Started timeout timer for hop %d (%.1fs)", hop,
+                     self.timeout);
 }
 
 /*! Timeout handling callback method
- *  \param timer triggered timer object
+ *  \param hop hop the timer was started for
+ *  \param startTimestamp when the timer was started
  *  \details Handle timed out hop, generate timeout result and decide next
  * action
  */
-- (void)timeoutForHop:(NSTimer *)timer {
-  // 1. Get timer information
-  NSDictionary *userInfo = timer.userInfo;
-  if (userInfo == nil) {
-    NSLog(@"SimpleTraceroute: Timeout timer fired with no user info");
-    return;
-  }
-
-  uint8_t hop = [userInfo[@"hop"] unsignedCharValue];
-  NSTimeInterval startTimestamp = [userInfo[@"timestamp"] doubleValue];
+- (void)timeoutForHop:(uint8_t)hop startTime:(NSTimeInterval)startTimestamp {
+  // 1. Work out how long the hop actually waited
   NSTimeInterval actualTimeout =
       [NSDate timeIntervalSinceReferenceDate] - startTimestamp;
 
-  NSLog(@"SimpleTraceroute: Timeout fired for hop %d after %.3fs", hop,
-        actualTimeout);
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Timeout fired for hop %d after %.3fs", hop,
+                     actualTimeout);
 
   // 2. Validate state
   if (!self.isRunning) {
-    NSLog(@"SimpleTraceroute: Ignoring timeout - traceroute stopped");
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Ignoring timeout - traceroute stopped");
     return;
   }
 
   if (hop != self.currentHop) {
-    NSLog(@"SimpleTraceroute: Timeout hop mismatch - expected %d, got %d",
-          self.currentHop, hop);
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "Timeout hop mismatch - expected %d, got %d",
+                       self.currentHop, hop);
     return;
   }
 
   // 3. Clean up timer
-  self.timeoutTimer = nil;
+  self.hopTimeoutToken = 0;
 
   // 4. Handle timeout situation for current hop
   [self handleTimeoutForHop:hop actualTimeout:actualTimeout];
@@ -1809,42 +3528,35 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
  */
 - (void)handleTimeoutForHop:(uint8_t)hop
               actualTimeout:(NSTimeInterval)actualTimeout {
-  NSLog(@"SimpleTraceroute: Processing timeout for hop %d", hop);
-
-  // 1. Count pending probe packets for current hop
-  NSMutableArray *timeoutProbes = [NSMutableArray array];
-  NSMutableArray *keysToRemove = [NSMutableArray array];
-
-  for (NSString *key in self.pendingProbes) {
-    NSDictionary *probeInfo = self.pendingProbes[key];
-    uint8_t probeHop = [probeInfo[@"hop"] unsignedCharValue];
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Processing timeout for hop %d", hop);
 
-    if (probeHop == hop) {
-      [timeoutProbes addObject:probeInfo];
-      [keysToRemove addObject:key];
-    }
-  }
-
-  // 2. Clean up timed out pending probe packets
-  for (NSString *key in keysToRemove) {
-    [self.pendingProbes removeObjectForKey:key];
-  }
+  // 1-2. Count and clean up timed out pending probe packets for current hop
+  uint16_t firstSequence = 0;
+  uint8_t firstProbeIndex = 0;
+  uint32_t timeoutProbeCount = TracerouteProbeTableRemoveHop(
+      &self->_probeTable, hop, &firstSequence, &firstProbeIndex);
+  [self discardPacedProbesForHop:hop above:NO];
 
-  NSLog(@"SimpleTraceroute: Found %lu timeout probes for hop %d",
-        (unsigned long)timeoutProbes.count, hop);
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Found %lu timeout probes for hop %d",
+                     (unsigned long)timeoutProbeCount, hop);
 
   // 3. Generate timeout result (if there are pending probe packets)
-  if (timeoutProbes.count > 0) {
+  if (timeoutProbeCount > 0) {
     TracerouteHopResult *timeoutResult =
         [self createTimeoutResult:hop
-                    timeoutProbes:timeoutProbes
+                   sequenceNumber:firstSequence
+                       probeIndex:firstProbeIndex
+                       probeCount:timeoutProbeCount
                     actualTimeout:actualTimeout];
     [self handleHopCompletion:timeoutResult];
   } else {
     // No pending probe packets, all probes may have been received
-    NSLog(@"SimpleTraceroute: No pending probes for hop %d timeout - all may "
-          @"have been received",
-          hop);
+    SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                       "No pending probes for hop %d timeout - all may "
+                       "have been received",
+                       hop);
 
     // Proceed directly to next hop (if still running)
     if (self.isRunning) {
@@ -1855,13 +3567,23 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 
 /*! Create timeout hop result
  *  \param hop hop number
- *  \param timeoutProbes array of timed out probe information
+ *  \param sequenceNumber sequence number of the first timed out probe
+ *  \param probeIndex probe index of the first timed out probe
+ *  \param probeCount number of timed out probes
  *  \param actualTimeout actual timeout duration
  *  \returns timeout hop result object
  */
 - (TracerouteHopResult *)createTimeoutResult:(uint8_t)hop
-                               timeoutProbes:(NSArray *)timeoutProbes
+                              sequenceNumber:(uint16_t)sequenceNumber
+                                  probeIndex:(uint8_t)probeIndex
+                                  probeCount:(NSUInteger)probeCount
                                actualTimeout:(NSTimeInterval)actualTimeout {
+  SimplePingSignpostEvent(SimplePingLogCategoryTraceroute,
+                          OS_SIGNPOST_ID_EXCLUSIVE, "Timeout",
+                          "hop=%d probes=%lu", hop, (unsigned long)probeCount);
+  SimplePingMetricsAdd(&self->_metrics, SimplePingMetricsCounterTimeouts,
+                       MAX(probeCount, (NSUInteger)1));
+
   TracerouteHopResult *result = [[TracerouteHopResult alloc] init];
   result.hopNumber = hop;
   result.routerAddress = nil;           // No address information for timeout
@@ -1871,17 +3593,26 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
   result.timestamp = [NSDate date];
 
   // Use sequence number from first timeout probe (if any)
-  if (timeoutProbes.count > 0) {
-    NSDictionary *firstProbe = timeoutProbes[0];
-    result.sequenceNumber = [firstProbe[@"sequenceNumber"] unsignedShortValue];
-    result.probeIndex = [firstProbe[@"probeIndex"] unsignedCharValue];
-  } else {
-    result.sequenceNumber = 0;
-    result.probeIndex = 0;
-  }
-
-  NSLog(@"SimpleTraceroute: Created timeout result for hop %d with %lu probes",
-        hop, (unsigned long)timeoutProbes.count);
+  result.sequenceNumber = (probeCount > 0) ? sequenceNumber : 0;
+  result.probeIndex = (probeCount > 0) ? probeIndex : 0;
+  result.probeCount = (uint8_t)MIN(MAX(probeCount, (NSUInteger)1), UINT8_MAX);
+
+  SimplePingSessionRecorder *recorder = self.sessionRecorder;
+  if (recorder != nil) {
+    SimplePingSessionRecord record;
+    SimplePingSessionRecordInit(&record, SimplePingSessionRecordKindTraceroute,
+                                self.sessionTargetIdentifier,
+                                SimplePingMonotonicNanoseconds());
+    record.flags = SimplePingSessionRecordFlagTimeout;
+    record.hopNumber = hop;
+    record.sequenceNumber = result.sequenceNumber;
+    record.identifier = self.identifier;
+    [recorder appendRecord:&record];
+  }
+
+  SimplePingLogDebug(SimplePingLogCategoryTraceroute,
+                     "Created timeout result for hop %d with %lu probes", hop,
+                     (unsigned long)probeCount);
 
   return result;
 }
@@ -1889,9 +3620,76 @@ static void SocketReadCallback(CFSocketRef s, CFSocketCallBackType type,
 /*! Stops the timeout timer.
  */
 - (void)stopTimeoutTimer {
-  if (self.timeoutTimer != nil) {
-    [self.timeoutTimer invalidate];
-    self.timeoutTimer = nil;
+  if (self.hopTimeoutToken != 0) {
+    [self.timeoutWheel cancelTimeout:self.hopTimeoutToken];
+    self.hopTimeoutToken = 0;
+  }
+}
+
+/*! Schedules a timeout on the timer wheel
+ *  \param key kTracerouteHopTimeoutKey or kTracerouteProbeDeadlineKey
+ *  \param deadline when it expires, see SimplePingMonotonicNanoseconds()
+ *  \returns The token to cancel it with
+ *  \details Traceroutes sharing an engine share its wheel, so thousands of
+ * them cost one timer. Without an engine the wheel is private and ticks every
+ * timerLeeway, but no faster than kTracerouteMinimumTimeoutTick.
+ */
+- (SimplePingTimeoutToken)addTimeoutForKey:(uint64_t)key
+                                  deadline:(uint64_t)deadline {
+  // 1. Join a wheel the first time
+  if (self.timeoutWheel == nil) {
+    if (self.engine != nil) {
+      self.timeoutWheel = self.engine.timeoutWheel;
+    } else {
+      self.timeoutWheel = [[SimplePingTimeoutWheel alloc]
+          initWithTickInterval:MAX(self.timerLeeway,
+                                   kTracerouteMinimumTimeoutTick)
+                         queue:self.dispatchQueue];
+    }
+    __weak SimpleTraceroute *weakSelf = self;
+    self.timeoutWheelClient = [self.timeoutWheel
+        addClientWithHandler:^(const uint64_t *keys, NSUInteger count) {
+          [weakSelf timeoutsExpired:keys count:count];
+        }];
+  }
+
+  // 2. Schedule it
+  return [self.timeoutWheel addTimeoutForKey:key
+                                      client:self.timeoutWheelClient
+                                    deadline:deadline];
+}
+
+/*! Leaves the timer wheel; the next run joins one again
+ *  \details A private wheel goes away with it, so a new dispatchQueue or
+ * timerLeeway takes effect on the next start.
+ */
+- (void)leaveTimeoutWheel {
+  [self.timeoutWheel removeClient:self.timeoutWheelClient];
+  self.timeoutWheel = nil;
+  self.timeoutWheelClient = 0;
+}
+
+/*! Timer wheel callback
+ *  \param keys keys of the expired timeouts
+ *  \param count number of keys
+ */
+- (void)timeoutsExpired:(const uint64_t *)keys count:(NSUInteger)count {
+  for (NSUInteger i = 0; i < count && self.isRunning; i++) {
+    switch (keys[i]) {
+    case kTracerouteHopTimeoutKey:
+      [self timeoutForHop:self.hopTimeoutHop
+                startTime:self.hopTimeoutStartTime];
+      break;
+    case kTracerouteProbeDeadlineKey:
+      [self probeDeadlineTimerFired];
+      break;
+    case kTracerouteCycleKey:
+      self.cycleToken = 0;
+      [self startContinuousCycle];
+      break;
+    default:
+      break;
+    }
   }
 }
 
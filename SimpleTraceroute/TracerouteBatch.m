@@ -0,0 +1,648 @@
+/*
+ Abstract:
+ Runs traceroutes to many destinations over a shared socket pool.
+ */
+
+#import "Public/TracerouteBatch.h"
+#import "TracerouteResultInternal.h"
+
+#include <math.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#pragma mark * TracerouteBatchMetrics
+
+@interface TracerouteBatchMetrics ()
+
+// Read/write versions of public properties
+@property(nonatomic, assign, readwrite) NSUInteger targetCount;
+@property(nonatomic, assign, readwrite) NSUInteger finishedCount;
+@property(nonatomic, assign, readwrite) NSUInteger failedCount;
+@property(nonatomic, assign, readwrite) NSUInteger deduplicatedCount;
+@property(nonatomic, assign, readwrite) NSUInteger tracerouteCount;
+@property(nonatomic, assign, readwrite) NSUInteger activeCount;
+@property(nonatomic, assign, readwrite) NSUInteger probesSent;
+@property(nonatomic, assign, readwrite) NSUInteger responsesReceived;
+@property(nonatomic, assign, readwrite) NSTimeInterval elapsedTime;
+
+- (instancetype)initSnapshot;
+
+@end
+
+@implementation TracerouteBatchMetrics
+
+- (instancetype)initSnapshot {
+  return [super init];
+}
+
+- (double)probesPerSecond {
+  return (self.elapsedTime > 0) ? self.probesSent / self.elapsedTime : 0;
+}
+
+- (double)targetsPerSecond {
+  return (self.elapsedTime > 0)
+             ? (self.finishedCount + self.failedCount) / self.elapsedTime
+             : 0;
+}
+
+- (NSString *)description {
+  return [NSString
+      stringWithFormat:@"%lu/%lu targets (%lu failed, %lu deduplicated) in "
+                       @"%.1fs, %lu probes, %.0f probes/s, %.1f targets/s",
+                       (unsigned long)(self.finishedCount + self.failedCount),
+                       (unsigned long)self.targetCount,
+                       (unsigned long)self.failedCount,
+                       (unsigned long)self.deduplicatedCount, self.elapsedTime,
+                       (unsigned long)self.probesSent, self.probesPerSecond,
+                       self.targetsPerSecond];
+}
+
+@end
+
+#pragma mark * TracerouteBatchJob
+
+/*! One traceroute of a batch, and every target waiting on it.
+ */
+@interface TracerouteBatchJob : NSObject
+
+/*! The targets sharing this job; the first one names the traceroute.
+ */
+@property(nonatomic, strong, readonly) NSMutableArray<NSString *> *hostNames;
+
+/*! Resolves the first host name, nil once resolved.
+ */
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingHostResolver *resolver;
+
+/*! The traceroute, nil until the address is known and once it has ended.
+ */
+@property(nonatomic, strong, readwrite, nullable) SimpleTraceroute *traceroute;
+
+/*! Key of the traced address, see TracerouteBatchAddressKey().
+ */
+@property(nonatomic, copy, readwrite, nullable) NSData *addressKey;
+
+@end
+
+@implementation TracerouteBatchJob
+
+- (instancetype)initWithHostNames:(NSArray<NSString *> *)hostNames {
+  self = [super init];
+  if (self != nil) {
+    self->_hostNames = [hostNames mutableCopy];
+  }
+  return self;
+}
+
+@end
+
+#pragma mark * Address Helpers
+
+/*! Picks the address to trace, the same way SimpleTraceroute does
+ *  \param addresses Resolved addresses, each a (struct sockaddr)
+ *  \param addressStyle Which IP versions are acceptable
+ *  \returns The first acceptable address, nil if there is none
+ */
+static NSData *_Nullable TracerouteBatchPickAddress(
+    NSArray<NSData *> *addresses, SimplePingAddressStyle addressStyle) {
+  for (NSData *address in addresses) {
+    if (address.length < sizeof(struct sockaddr)) {
+      continue;
+    }
+    switch (((const struct sockaddr *)address.bytes)->sa_family) {
+    case AF_INET:
+      if (addressStyle != SimplePingAddressStyleICMPv6) {
+        return address;
+      }
+      break;
+    case AF_INET6:
+      if (addressStyle != SimplePingAddressStyleICMPv4) {
+        return address;
+      }
+      break;
+    }
+  }
+  return nil;
+}
+
+/*! Builds a dictionary key that is equal for equal addresses
+ *  \details Ports and padding differ between resolvers, so only the family,
+ * the raw address and, for IPv6, the scope take part.
+ */
+static NSData *TracerouteBatchAddressKey(NSData *address) {
+  const struct sockaddr *addr = (const struct sockaddr *)address.bytes;
+  NSMutableData *key = [NSMutableData dataWithBytes:&addr->sa_family
+                                             length:sizeof(addr->sa_family)];
+
+  if (addr->sa_family == AF_INET &&
+      address.length >= sizeof(struct sockaddr_in)) {
+    const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+    [key appendBytes:&addr4->sin_addr length:sizeof(addr4->sin_addr)];
+  } else if (addr->sa_family == AF_INET6 &&
+             address.length >= sizeof(struct sockaddr_in6)) {
+    const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+    [key appendBytes:&addr6->sin6_addr length:sizeof(addr6->sin6_addr)];
+    [key appendBytes:&addr6->sin6_scope_id length:sizeof(addr6->sin6_scope_id)];
+  } else {
+    [key appendData:address];
+  }
+  return key;
+}
+
+#pragma mark * Private Interface
+
+@interface TracerouteBatch () <SimpleTracerouteDelegate>
+
+// Read/write versions of public properties
+@property(nonatomic, assign, readwrite) BOOL isRunning;
+
+// Targets, grouped by host name ignoring case, in order
+@property(nonatomic, copy, readonly) NSArray<NSArray<NSString *> *> *targetGroups;
+@property(nonatomic, assign, readwrite) NSUInteger nextTargetGroup;
+
+// Shared resources, created on start
+@property(nonatomic, copy, readwrite, nullable)
+    NSArray<SimplePingEngine *> *engines;
+@property(nonatomic, assign, readwrite) NSUInteger nextEngineIndex;
+@property(nonatomic, strong, readwrite, nullable)
+    SimplePingRateLimiter *rateLimiter;
+
+// Jobs resolving or tracing
+@property(nonatomic, strong, readonly)
+    NSMutableSet<TracerouteBatchJob *> *activeJobs;
+@property(nonatomic, strong, readonly)
+    NSMutableDictionary<NSData *, TracerouteBatchJob *> *jobsByAddress;
+@property(nonatomic, strong, readonly)
+    NSMapTable<SimpleTraceroute *, TracerouteBatchJob *> *jobsByTraceroute;
+
+// Finished traceroutes, for targets that resolve to the same address later
+@property(nonatomic, strong, readonly)
+    NSMutableDictionary<NSData *, TracerouteResult *> *resultsByAddress;
+@property(nonatomic, strong, readonly)
+    NSMutableDictionary<NSString *, TracerouteResult *> *mutableResults;
+
+@end
+
+@implementation TracerouteBatch {
+  // Counters behind metrics
+  NSUInteger _finishedCount;
+  NSUInteger _failedCount;
+  NSUInteger _deduplicatedCount;
+  NSUInteger _tracerouteCount;
+  NSUInteger _probesSent;
+  NSUInteger _responsesReceived;
+  // Monotonic start and end times, 0 if not yet
+  uint64_t _startTime;
+  uint64_t _endTime;
+  // YES while -scheduleTargets is running, see there
+  BOOL _scheduling;
+}
+
+#pragma mark * Initialization and Deallocation
+
+- (instancetype)initWithHostNames:(NSArray<NSString *> *)hostNames {
+  NSParameterAssert(hostNames != nil);
+  self = [super init];
+  if (self != nil) {
+    self->_hostNames = [hostNames copy];
+    self->_addressStyle = SimplePingAddressStyleAny;
+    self->_maxConcurrentTraceroutes = 64;
+    self->_packetsPerSecond = 500;
+    self->_socketPoolSize = 4;
+    self->_firstHop = 1;
+    self->_interfaceCache = [[TracerouteInterfaceCache alloc] init];
+
+    // Group the host names ignoring case, keeping the order of first use
+    NSMutableArray<NSMutableArray<NSString *> *> *groups =
+        [[NSMutableArray alloc] init];
+    NSMutableDictionary<NSString *, NSMutableArray<NSString *> *> *groupByKey =
+        [[NSMutableDictionary alloc] init];
+    for (NSString *hostName in self->_hostNames) {
+      NSString *key = hostName.lowercaseString;
+      NSMutableArray<NSString *> *group = groupByKey[key];
+      if (group == nil) {
+        group = [[NSMutableArray alloc] init];
+        groupByKey[key] = group;
+        [groups addObject:group];
+      }
+      [group addObject:hostName];
+    }
+    self->_targetGroups = [groups copy];
+
+    self->_activeJobs = [[NSMutableSet alloc] init];
+    self->_jobsByAddress = [[NSMutableDictionary alloc] init];
+    self->_jobsByTraceroute = [NSMapTable
+        mapTableWithKeyOptions:NSPointerFunctionsStrongMemory |
+                               NSPointerFunctionsObjectPointerPersonality
+                  valueOptions:NSPointerFunctionsStrongMemory];
+    self->_resultsByAddress = [[NSMutableDictionary alloc] init];
+    self->_mutableResults = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+}
+
+#pragma mark * Property Access
+
+- (NSDictionary<NSString *, TracerouteResult *> *)results {
+  return [self.mutableResults copy];
+}
+
+- (TracerouteBatchMetrics *)metrics {
+  TracerouteBatchMetrics *metrics = [[TracerouteBatchMetrics alloc] initSnapshot];
+  uint64_t end;
+
+  metrics.targetCount = self.hostNames.count;
+  metrics.finishedCount = self->_finishedCount;
+  metrics.failedCount = self->_failedCount;
+  metrics.deduplicatedCount = self->_deduplicatedCount;
+  metrics.tracerouteCount = self->_tracerouteCount;
+  metrics.activeCount = self.activeJobs.count;
+  metrics.probesSent = self->_probesSent;
+  metrics.responsesReceived = self->_responsesReceived;
+  if (self->_startTime != 0) {
+    end = (self->_endTime != 0) ? self->_endTime
+                                : SimplePingMonotonicNanoseconds();
+    metrics.elapsedTime = (NSTimeInterval)(end - self->_startTime) / NSEC_PER_SEC;
+  }
+  return metrics;
+}
+
+#pragma mark * Control Methods
+
+- (void)start {
+  assert(!self.isRunning);
+  if (self.isRunning) {
+    return;
+  }
+
+  // 1. Reset state
+  [self.mutableResults removeAllObjects];
+  [self.resultsByAddress removeAllObjects];
+  self.nextTargetGroup = 0;
+  self.nextEngineIndex = 0;
+  self->_finishedCount = 0;
+  self->_failedCount = 0;
+  self->_deduplicatedCount = 0;
+  self->_tracerouteCount = 0;
+  self->_probesSent = 0;
+  self->_responsesReceived = 0;
+  self->_endTime = 0;
+  self->_startTime = SimplePingMonotonicNanoseconds();
+
+  // 2. Create the socket pool; each engine opens its sockets on first use
+  NSUInteger engineCount = MAX(self.socketPoolSize, (NSUInteger)1);
+  NSMutableArray<SimplePingEngine *> *engines =
+      [[NSMutableArray alloc] initWithCapacity:engineCount];
+  for (NSUInteger i = 0; i < engineCount; i++) {
+    SimplePingEngine *engine = [[SimplePingEngine alloc] init];
+    engine.dispatchQueue = self.dispatchQueue;
+    [engines addObject:engine];
+  }
+  self.engines = engines;
+
+  // 3. One probe budget for every traceroute
+  if (self.packetsPerSecond > 0) {
+    NSUInteger burst = (NSUInteger)ceil(self.packetsPerSecond * 0.05);
+    self.rateLimiter =
+        [[SimplePingRateLimiter alloc] initWithRate:self.packetsPerSecond
+                                              burst:MAX(burst, (NSUInteger)1)];
+  }
+
+  // 4. Fill the concurrency window
+  self.isRunning = YES;
+  [self scheduleTargets];
+}
+
+- (void)stop {
+  if (!self.isRunning) {
+    return;
+  }
+  self.isRunning = NO;
+  self->_endTime = SimplePingMonotonicNanoseconds();
+
+  // Traceroutes must leave their engines before the engines go away
+  for (TracerouteBatchJob *job in [self.activeJobs allObjects]) {
+    [job.resolver cancel];
+    job.resolver = nil;
+    job.traceroute.delegate = nil;
+    [job.traceroute stop];
+    job.traceroute = nil;
+  }
+  [self releaseResources];
+}
+
+/*! Forgets the jobs and drops the socket pool and rate limiter
+ */
+- (void)releaseResources {
+  [self.activeJobs removeAllObjects];
+  [self.jobsByAddress removeAllObjects];
+  [self.jobsByTraceroute removeAllObjects];
+  self.engines = nil;
+  self.rateLimiter = nil;
+}
+
+#pragma mark * Scheduling
+
+/*! Starts targets until the concurrency window is full
+ *  \details Starting a target may finish it (and so call us again) before
+ * returning, for example if its name can't be resolved; the nested call
+ * returns straight away and this loop carries on instead.
+ */
+- (void)scheduleTargets {
+  if (self->_scheduling) {
+    return;
+  }
+  self->_scheduling = YES;
+
+  NSUInteger limit = MAX(self.maxConcurrentTraceroutes, (NSUInteger)1);
+  while (self.isRunning && self.activeJobs.count < limit &&
+         self.nextTargetGroup < self.targetGroups.count) {
+    NSArray<NSString *> *group = self.targetGroups[self.nextTargetGroup];
+    self.nextTargetGroup++;
+    [self startJobWithHostNames:group];
+  }
+
+  self->_scheduling = NO;
+
+  if (self.isRunning && self.activeJobs.count == 0 &&
+      self.nextTargetGroup == self.targetGroups.count) {
+    [self complete];
+  }
+}
+
+/*! Starts resolving a target
+ *  \param hostNames The target's host names, equal ignoring case
+ */
+- (void)startJobWithHostNames:(NSArray<NSString *> *)hostNames {
+  TracerouteBatchJob *job =
+      [[TracerouteBatchJob alloc] initWithHostNames:hostNames];
+  [self.activeJobs addObject:job];
+
+  job.resolver =
+      [[SimplePingHostResolver alloc] initWithHostName:hostNames.firstObject
+                                                 queue:self.dispatchQueue];
+  job.resolver.addressFamily =
+      SimplePingAddressFamilyForAddressStyle(self.addressStyle);
+
+  __weak TracerouteBatch *weakSelf = self;
+  __weak TracerouteBatchJob *weakJob = job;
+  [job.resolver startWithCompletionHandler:^(NSArray<NSData *> *addresses,
+                                             NSError *error) {
+    TracerouteBatchJob *strongJob = weakJob;
+    if (strongJob != nil) {
+      [weakSelf job:strongJob didResolveAddresses:addresses error:error];
+    }
+  }];
+}
+
+/*! Processes the result of resolving a target
+ *  \param job The job
+ *  \param addresses The addresses, if resolved
+ *  \param error The error, if not
+ */
+- (void)job:(TracerouteBatchJob *)job
+    didResolveAddresses:(nullable NSArray<NSData *> *)addresses
+                  error:(nullable NSError *)error {
+  job.resolver = nil;
+  if (!self.isRunning || ![self.activeJobs containsObject:job]) {
+    return;
+  }
+
+  // 1. Pick the address
+  NSData *address = nil;
+  if (error == nil) {
+    address = TracerouteBatchPickAddress(addresses, self.addressStyle);
+    if (address == nil) {
+      error = [NSError errorWithDomain:(NSString *)kCFErrorDomainCFNetwork
+                                  code:kCFHostErrorHostNotFound
+                              userInfo:nil];
+    }
+  }
+  if (error != nil) {
+    [self failJob:job withError:error];
+    return;
+  }
+
+  // 2. Share an earlier traceroute to the same address, finished or not
+  NSData *key = TracerouteBatchAddressKey(address);
+  TracerouteResult *result = self.resultsByAddress[key];
+  if (result != nil) {
+    self->_deduplicatedCount += job.hostNames.count;
+    [self finishJob:job withResult:result];
+    return;
+  }
+
+  TracerouteBatchJob *runningJob = self.jobsByAddress[key];
+  if (runningJob != nil) {
+    [runningJob.hostNames addObjectsFromArray:job.hostNames];
+    [self endJob:job];
+    return;
+  }
+
+  // 3. Otherwise trace it
+  [self startTracerouteForJob:job address:address key:key];
+}
+
+/*! Starts the traceroute of a resolved target
+ *  \param job The job
+ *  \param address The address to trace
+ *  \param key Its key, see TracerouteBatchAddressKey()
+ */
+- (void)startTracerouteForJob:(TracerouteBatchJob *)job
+                      address:(NSData *)address
+                          key:(NSData *)key {
+  SimplePingEngine *engine =
+      self.engines[self.nextEngineIndex % self.engines.count];
+  self.nextEngineIndex++;
+
+  SimpleTraceroute *traceroute =
+      [[SimpleTraceroute alloc] initWithHostName:job.hostNames.firstObject
+                                          engine:engine];
+  traceroute.firstHop = self.firstHop;
+  traceroute.interfaceCache = self.interfaceCache;
+  if (self.tracerouteConfigurationHandler != nil) {
+    self.tracerouteConfigurationHandler(traceroute);
+  }
+  traceroute.delegate = self;
+  traceroute.dispatchQueue = self.dispatchQueue;
+  traceroute.rateLimiter = self.rateLimiter;
+
+  job.traceroute = traceroute;
+  job.addressKey = key;
+  self.jobsByAddress[key] = job;
+  [self.jobsByTraceroute setObject:job forKey:traceroute];
+  self->_tracerouteCount++;
+
+  [traceroute startWithAddress:address];
+
+  // A traceroute that rejects its parameters doesn't tell its delegate
+  if (!traceroute.isRunning && job.traceroute == traceroute) {
+    [self detachTracerouteOfJob:job];
+    [self failJob:job
+        withError:[NSError
+                      errorWithDomain:NSInternalInconsistencyException
+                                 code:-5
+                             userInfo:@{
+                               NSLocalizedDescriptionKey :
+                                   @"Traceroute failed to start"
+                             }]];
+  }
+}
+
+/*! Forgets a job's traceroute once it has finished or failed
+ */
+- (void)detachTracerouteOfJob:(TracerouteBatchJob *)job {
+  SimpleTraceroute *traceroute = job.traceroute;
+  if (traceroute == nil) {
+    return;
+  }
+
+  // The traceroute stops itself after its delegate callback returns, so keep
+  // it alive until then
+  CFAutorelease(CFBridgingRetain(traceroute));
+
+  [self.jobsByTraceroute removeObjectForKey:traceroute];
+  if (job.addressKey != nil) {
+    [self.jobsByAddress removeObjectForKey:job.addressKey];
+  }
+  job.traceroute = nil;
+}
+
+/*! Reports a result to every target of a job and ends it
+ */
+- (void)finishJob:(TracerouteBatchJob *)job
+       withResult:(TracerouteResult *)result {
+  for (NSString *hostName in [job.hostNames copy]) {
+    if (!self.isRunning) {
+      return; // The delegate stopped us
+    }
+    TracerouteResult *targetResult = [result resultWithTargetHostname:hostName];
+    self.mutableResults[hostName] = targetResult;
+    self->_finishedCount++;
+
+    id<TracerouteBatchDelegate> strongDelegate = self.delegate;
+    if ((strongDelegate != nil) &&
+        [strongDelegate respondsToSelector:@selector(tracerouteBatch:
+                                                 didFinishHostName:
+                                                        withResult:)]) {
+      [strongDelegate tracerouteBatch:self
+                    didFinishHostName:hostName
+                           withResult:targetResult];
+    }
+  }
+  [self endJob:job];
+}
+
+/*! Reports an error to every target of a job and ends it
+ */
+- (void)failJob:(TracerouteBatchJob *)job withError:(NSError *)error {
+  for (NSString *hostName in [job.hostNames copy]) {
+    if (!self.isRunning) {
+      return; // The delegate stopped us
+    }
+    self->_failedCount++;
+
+    id<TracerouteBatchDelegate> strongDelegate = self.delegate;
+    if ((strongDelegate != nil) &&
+        [strongDelegate respondsToSelector:@selector(tracerouteBatch:
+                                                   didFailHostName:
+                                                         withError:)]) {
+      [strongDelegate tracerouteBatch:self
+                      didFailHostName:hostName
+                            withError:error];
+    }
+  }
+  [self endJob:job];
+}
+
+/*! Frees a job's concurrency slot and starts the next target
+ */
+- (void)endJob:(TracerouteBatchJob *)job {
+  if (!self.isRunning) {
+    return;
+  }
+  [self.activeJobs removeObject:job];
+  [self scheduleTargets];
+}
+
+/*! Stops the batch once every target is done and tells the delegate
+ */
+- (void)complete {
+  self.isRunning = NO;
+  self->_endTime = SimplePingMonotonicNanoseconds();
+  [self releaseResources];
+
+  TracerouteBatchMetrics *metrics = self.metrics;
+  SimplePingLogDebug(SimplePingLogCategoryEngine,
+                     "TracerouteBatch: Completed %{public}@", metrics);
+
+  id<TracerouteBatchDelegate> strongDelegate = self.delegate;
+  if ((strongDelegate != nil) &&
+      [strongDelegate respondsToSelector:@selector(tracerouteBatch:
+                                            didCompleteWithMetrics:)]) {
+    [strongDelegate tracerouteBatch:self didCompleteWithMetrics:metrics];
+  }
+}
+
+#pragma mark * SimpleTracerouteDelegate
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+     didStartWithAddress:(NSData *)address {
+#pragma unused(traceroute, address)
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+        didFailWithError:(NSError *)error {
+  TracerouteBatchJob *job = [self.jobsByTraceroute objectForKey:traceroute];
+  if (job == nil) {
+    return;
+  }
+  self->_deduplicatedCount += job.hostNames.count - 1;
+  [self detachTracerouteOfJob:job];
+  [self failJob:job withError:error];
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+          didCompleteHop:(TracerouteHopResult *)hopResult {
+#pragma unused(traceroute, hopResult)
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+     didFinishWithResult:(TracerouteResult *)result {
+  TracerouteBatchJob *job = [self.jobsByTraceroute objectForKey:traceroute];
+  if (job == nil) {
+    return;
+  }
+  if (job.addressKey != nil) {
+    self.resultsByAddress[job.addressKey] = result;
+  }
+  // Every extra host name shared this traceroute
+  self->_deduplicatedCount += job.hostNames.count - 1;
+  [self detachTracerouteOfJob:job];
+  [self finishJob:job withResult:result];
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+       didSendProbeToHop:(uint8_t)hopNumber
+          sequenceNumber:(uint16_t)sequenceNumber {
+#pragma unused(traceroute, hopNumber, sequenceNumber)
+  self->_probesSent++;
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+    didReceiveResponseFromHop:(uint8_t)hopNumber
+                      latency:(NSTimeInterval)latency {
+#pragma unused(traceroute, hopNumber, latency)
+  self->_responsesReceived++;
+}
+
+- (void)simpleTraceroute:(SimpleTraceroute *)traceroute
+        didTimeoutForHop:(uint8_t)hopNumber {
+#pragma unused(traceroute, hopNumber)
+}
+
+@end
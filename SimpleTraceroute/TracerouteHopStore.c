@@ -0,0 +1,402 @@
+/*
+ Abstract:
+ Packed, struct-of-arrays storage for the probe results of a traceroute.
+ */
+
+#include "TracerouteHopStore.h"
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! Grows an array to hold capacity elements.
+ *  \returns false if memory ran out, leaving the array as it was.
+ */
+static bool TracerouteHopStoreGrowArray(void **array, uint32_t capacity,
+                                        size_t elementSize) {
+  void *grown = realloc(*array, (size_t)capacity * elementSize);
+  if (grown == NULL) {
+    return false;
+  }
+  *array = grown;
+  return true;
+}
+
+/*! Makes room for at least one more record.
+ */
+static bool TracerouteHopStoreReserve(TracerouteHopStore *store,
+                                      uint32_t needed) {
+  if (needed <= store->capacity) {
+    return true;
+  }
+
+  uint32_t capacity = (store->capacity == 0) ? 32 : store->capacity;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+
+  // Arrays that grew before one fails just have spare room; capacity only
+  // changes once they all have
+  if (!TracerouteHopStoreGrowArray((void **)&store->roundTripNanoseconds,
+                                   capacity, sizeof(uint64_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->timestamps, capacity,
+                                   sizeof(double)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->deliveryDelayNanoseconds,
+                                   capacity, sizeof(uint32_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->addressIndices, capacity,
+                                   sizeof(uint32_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->sequenceNumbers, capacity,
+                                   sizeof(uint16_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->hopNumbers, capacity,
+                                   sizeof(uint8_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->probeIndices, capacity,
+                                   sizeof(uint8_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->probeCounts, capacity,
+                                   sizeof(uint8_t)) ||
+      !TracerouteHopStoreGrowArray((void **)&store->flags, capacity,
+                                   sizeof(uint8_t))) {
+    return false;
+  }
+  store->capacity = capacity;
+  return true;
+}
+
+/*! Makes room for the statistics of a hop, zeroing any new ones.
+ */
+static bool TracerouteHopStoreReserveHop(TracerouteHopStore *store,
+                                         uint8_t hopNumber) {
+  uint32_t needed = (uint32_t)hopNumber + 1;
+
+  if (needed > store->hopCapacity) {
+    // Hops are small numbers, so one step to a comfortable size is enough
+    uint32_t capacity = (needed < 64) ? 64 : 256;
+    if (!TracerouteHopStoreGrowArray((void **)&store->hopAccumulators,
+                                     capacity,
+                                     sizeof(TracerouteHopAccumulator))) {
+      return false;
+    }
+    store->hopCapacity = capacity;
+  }
+  if (needed > store->hopCount) {
+    memset(&store->hopAccumulators[store->hopCount], 0,
+           (needed - store->hopCount) * sizeof(TracerouteHopAccumulator));
+    store->hopCount = needed;
+  }
+  return true;
+}
+
+/*! Adds a record to its hop's statistics.
+ */
+static void
+TracerouteHopAccumulatorAdd(TracerouteHopAccumulator *accumulator,
+                            const TracerouteHopRecord *record) {
+  if ((record->flags & kTracerouteHopRecordTimeout) != 0) {
+    accumulator->probeCount +=
+        (record->probeCount != 0) ? record->probeCount : 1;
+    return;
+  }
+
+  uint64_t sample = record->roundTripNanoseconds;
+  accumulator->probeCount += 1;
+  accumulator->replyCount += 1;
+  if (accumulator->replyCount == 1 ||
+      sample < accumulator->minimumNanoseconds) {
+    accumulator->minimumNanoseconds = sample;
+  }
+  if (sample > accumulator->maximumNanoseconds) {
+    accumulator->maximumNanoseconds = sample;
+  }
+
+  // Welford's update
+  double delta = (double)sample - accumulator->meanNanoseconds;
+  accumulator->meanNanoseconds += delta / accumulator->replyCount;
+  accumulator->sumOfSquares +=
+      delta * ((double)sample - accumulator->meanNanoseconds);
+}
+
+/*! FNV-1a over an address.
+ */
+static uint32_t
+TracerouteRouterAddressHash(const TracerouteRouterAddress *address) {
+  uint32_t hash = 2166136261u;
+
+  hash = (hash ^ address->family) * 16777619u;
+  for (size_t i = 0; i < sizeof(address->bytes); i++) {
+    hash = (hash ^ address->bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/*! Rebuilds the address hash table with a bucket count, a power of two.
+ */
+static bool TracerouteHopStoreRehash(TracerouteHopStore *store,
+                                     uint32_t bucketCount) {
+  uint32_t *buckets = calloc(bucketCount, sizeof(uint32_t));
+  if (buckets == NULL) {
+    return false;
+  }
+
+  uint32_t mask = bucketCount - 1;
+  for (uint32_t index = 0; index < store->addressCount; index++) {
+    uint32_t bucket =
+        TracerouteRouterAddressHash(&store->addresses[index]) & mask;
+    while (buckets[bucket] != 0) {
+      bucket = (bucket + 1) & mask;
+    }
+    buckets[bucket] = index + 1;
+  }
+
+  free(store->addressBuckets);
+  store->addressBuckets = buckets;
+  store->addressBucketMask = mask;
+  return true;
+}
+
+void TracerouteHopStoreInit(TracerouteHopStore *store) {
+  memset(store, 0, sizeof(*store));
+}
+
+void TracerouteHopStoreDestroy(TracerouteHopStore *store) {
+  free(store->roundTripNanoseconds);
+  free(store->timestamps);
+  free(store->deliveryDelayNanoseconds);
+  free(store->addressIndices);
+  free(store->sequenceNumbers);
+  free(store->hopNumbers);
+  free(store->probeIndices);
+  free(store->probeCounts);
+  free(store->flags);
+  free(store->addresses);
+  free(store->addressBuckets);
+  free(store->hopAccumulators);
+  TracerouteHopStoreInit(store);
+}
+
+void TracerouteHopStoreReset(TracerouteHopStore *store) {
+  store->count = 0;
+  store->addressCount = 0;
+  store->hopCount = 0;
+  if (store->addressBuckets != NULL) {
+    memset(store->addressBuckets, 0,
+           ((size_t)store->addressBucketMask + 1) * sizeof(uint32_t));
+  }
+}
+
+uint32_t TracerouteHopStoreInternAddress(TracerouteHopStore *store,
+                                         const char *numericAddress) {
+  TracerouteRouterAddress address;
+
+  // 1. Parse it; router addresses are always numeric
+  if (numericAddress == NULL) {
+    return kTracerouteHopStoreNoAddress;
+  }
+  memset(&address, 0, sizeof(address));
+  if (inet_pton(AF_INET, numericAddress, address.bytes) == 1) {
+    address.family = AF_INET;
+  } else if (inet_pton(AF_INET6, numericAddress, address.bytes) == 1) {
+    address.family = AF_INET6;
+  } else {
+    return kTracerouteHopStoreNoAddress;
+  }
+
+  // 2. Keep the table at most half full
+  if (store->addressBuckets == NULL ||
+      (store->addressCount + 1) * 2 > store->addressBucketMask + 1) {
+    uint32_t bucketCount = 64;
+    while ((store->addressCount + 1) * 2 > bucketCount) {
+      bucketCount *= 2;
+    }
+    if (!TracerouteHopStoreRehash(store, bucketCount)) {
+      return kTracerouteHopStoreNoAddress;
+    }
+  }
+
+  // 3. Look it up
+  uint32_t bucket =
+      TracerouteRouterAddressHash(&address) & store->addressBucketMask;
+  while (store->addressBuckets[bucket] != 0) {
+    uint32_t index = store->addressBuckets[bucket] - 1;
+    if (memcmp(&store->addresses[index], &address, sizeof(address)) == 0) {
+      return index;
+    }
+    bucket = (bucket + 1) & store->addressBucketMask;
+  }
+
+  // 4. Add it to the empty bucket we stopped at
+  if (store->addressCount == store->addressCapacity) {
+    uint32_t capacity =
+        (store->addressCapacity == 0) ? 16 : store->addressCapacity * 2;
+    if (!TracerouteHopStoreGrowArray((void **)&store->addresses, capacity,
+                                     sizeof(TracerouteRouterAddress))) {
+      return kTracerouteHopStoreNoAddress;
+    }
+    store->addressCapacity = capacity;
+  }
+  uint32_t index = store->addressCount;
+  store->addresses[index] = address;
+  store->addressCount += 1;
+  store->addressBuckets[bucket] = index + 1;
+  return index;
+}
+
+bool TracerouteHopStoreAppend(TracerouteHopStore *store,
+                              const TracerouteHopRecord *record) {
+  if (!TracerouteHopStoreReserve(store, store->count + 1) ||
+      !TracerouteHopStoreReserveHop(store, record->hopNumber)) {
+    return false;
+  }
+  TracerouteHopAccumulatorAdd(&store->hopAccumulators[record->hopNumber],
+                              record);
+
+  uint32_t index = store->count;
+  store->roundTripNanoseconds[index] = record->roundTripNanoseconds;
+  store->timestamps[index] = record->timestamp;
+  store->deliveryDelayNanoseconds[index] = record->deliveryDelayNanoseconds;
+  store->addressIndices[index] = record->addressIndex;
+  store->sequenceNumbers[index] = record->sequenceNumber;
+  store->hopNumbers[index] = record->hopNumber;
+  store->probeIndices[index] = record->probeIndex;
+  store->probeCounts[index] = record->probeCount;
+  store->flags[index] = record->flags;
+  store->count += 1;
+  return true;
+}
+
+void TracerouteHopStoreGet(const TracerouteHopStore *store, uint32_t index,
+                           TracerouteHopRecord *recordOut) {
+  recordOut->roundTripNanoseconds = store->roundTripNanoseconds[index];
+  recordOut->timestamp = store->timestamps[index];
+  recordOut->deliveryDelayNanoseconds = store->deliveryDelayNanoseconds[index];
+  recordOut->addressIndex = store->addressIndices[index];
+  recordOut->sequenceNumber = store->sequenceNumbers[index];
+  recordOut->hopNumber = store->hopNumbers[index];
+  recordOut->probeIndex = store->probeIndices[index];
+  recordOut->probeCount = store->probeCounts[index];
+  recordOut->flags = store->flags[index];
+}
+
+bool TracerouteHopStoreGetAccumulator(
+    const TracerouteHopStore *store, uint8_t hopNumber,
+    TracerouteHopAccumulator *accumulatorOut) {
+  if (hopNumber >= store->hopCount ||
+      store->hopAccumulators[hopNumber].probeCount == 0) {
+    return false;
+  }
+  *accumulatorOut = store->hopAccumulators[hopNumber];
+  return true;
+}
+
+double TracerouteHopAccumulatorStandardDeviation(
+    const TracerouteHopAccumulator *accumulator) {
+  if (accumulator->replyCount < 2) {
+    return 0;
+  }
+  return sqrt(accumulator->sumOfSquares / accumulator->replyCount);
+}
+
+double
+TracerouteHopAccumulatorLossRatio(const TracerouteHopAccumulator *accumulator) {
+  if (accumulator->probeCount == 0) {
+    return 0;
+  }
+  return (double)(accumulator->probeCount - accumulator->replyCount) /
+         accumulator->probeCount;
+}
+
+bool TracerouteHopStoreFormatAddress(const TracerouteHopStore *store,
+                                     uint32_t addressIndex, char *buffer,
+                                     size_t bufferSize) {
+  if (addressIndex >= store->addressCount) {
+    return false;
+  }
+  const TracerouteRouterAddress *address = &store->addresses[addressIndex];
+  return inet_ntop(address->family, address->bytes, buffer,
+                   (socklen_t)bufferSize) != NULL;
+}
+
+socklen_t TracerouteHopStoreGetSockaddr(const TracerouteHopStore *store,
+                                        uint32_t addressIndex,
+                                        struct sockaddr_storage *addressOut) {
+  if (addressIndex >= store->addressCount) {
+    return 0;
+  }
+  const TracerouteRouterAddress *address = &store->addresses[addressIndex];
+
+  memset(addressOut, 0, sizeof(*addressOut));
+  if (address->family == AF_INET) {
+    struct sockaddr_in *addr4 = (struct sockaddr_in *)addressOut;
+#if defined(__APPLE__)
+    addr4->sin_len = sizeof(*addr4);
+#endif
+    addr4->sin_family = AF_INET;
+    memcpy(&addr4->sin_addr, address->bytes, sizeof(addr4->sin_addr));
+    return sizeof(*addr4);
+  } else {
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addressOut;
+#if defined(__APPLE__)
+    addr6->sin6_len = sizeof(*addr6);
+#endif
+    addr6->sin6_family = AF_INET6;
+    memcpy(&addr6->sin6_addr, address->bytes, sizeof(addr6->sin6_addr));
+    return sizeof(*addr6);
+  }
+}
+
+bool TracerouteHopStoreCopy(TracerouteHopStore *destination,
+                            const TracerouteHopStore *source) {
+  TracerouteHopStoreDestroy(destination);
+  if (!TracerouteHopStoreReserve(destination, source->count)) {
+    TracerouteHopStoreDestroy(destination);
+    return false;
+  }
+
+  // 1. Records
+  size_t count = source->count;
+  if (count != 0) {
+    memcpy(destination->roundTripNanoseconds, source->roundTripNanoseconds,
+           count * sizeof(uint64_t));
+    memcpy(destination->timestamps, source->timestamps, count * sizeof(double));
+    memcpy(destination->deliveryDelayNanoseconds,
+           source->deliveryDelayNanoseconds, count * sizeof(uint32_t));
+    memcpy(destination->addressIndices, source->addressIndices,
+           count * sizeof(uint32_t));
+    memcpy(destination->sequenceNumbers, source->sequenceNumbers,
+           count * sizeof(uint16_t));
+    memcpy(destination->hopNumbers, source->hopNumbers, count);
+    memcpy(destination->probeIndices, source->probeIndices, count);
+    memcpy(destination->probeCounts, source->probeCounts, count);
+    memcpy(destination->flags, source->flags, count);
+  }
+  destination->count = source->count;
+
+  // 2. Addresses; a copy is only read, so it needs no hash table
+  if (source->addressCount != 0) {
+    if (!TracerouteHopStoreGrowArray((void **)&destination->addresses,
+                                     source->addressCount,
+                                     sizeof(TracerouteRouterAddress))) {
+      TracerouteHopStoreDestroy(destination);
+      return false;
+    }
+    memcpy(destination->addresses, source->addresses,
+           source->addressCount * sizeof(TracerouteRouterAddress));
+    destination->addressCapacity = source->addressCount;
+  }
+  destination->addressCount = source->addressCount;
+
+  // 3. Hop statistics
+  if (source->hopCount != 0) {
+    if (!TracerouteHopStoreGrowArray((void **)&destination->hopAccumulators,
+                                     source->hopCount,
+                                     sizeof(TracerouteHopAccumulator))) {
+      TracerouteHopStoreDestroy(destination);
+      return false;
+    }
+    memcpy(destination->hopAccumulators, source->hopAccumulators,
+           source->hopCount * sizeof(TracerouteHopAccumulator));
+    destination->hopCapacity = source->hopCount;
+  }
+  destination->hopCount = source->hopCount;
+  return true;
+}
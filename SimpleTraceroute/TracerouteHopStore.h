@@ -0,0 +1,191 @@
+/*
+ Abstract:
+ Packed, struct-of-arrays storage for the probe results of a traceroute.
+ */
+
+#ifndef TracerouteHopStore_h
+#define TracerouteHopStore_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Address index of a record with no router address, such as a timeout.
+ */
+#define kTracerouteHopStoreNoAddress UINT32_MAX
+
+/*! Flags of a record.
+ */
+enum {
+  kTracerouteHopRecordDestination = 1u << 0, ///< Answered by the target
+  kTracerouteHopRecordTimeout = 1u << 1,     ///< No answer in time
+};
+
+/*! A router address, in binary form.
+ */
+typedef struct TracerouteRouterAddress {
+  uint8_t family;    ///< AF_INET or AF_INET6
+  uint8_t bytes[16]; ///< in_addr or in6_addr, zero padded
+} TracerouteRouterAddress;
+
+/*! One probe result, as passed in and out of a store.
+ *  \details The store itself keeps each field in its own array.
+ */
+typedef struct TracerouteHopRecord {
+  uint64_t roundTripNanoseconds;     ///< Round trip, or a timeout's wait
+  double timestamp;                  ///< Seconds since the reference date
+  uint32_t deliveryDelayNanoseconds; ///< Saturates at UINT32_MAX
+  uint32_t addressIndex;             ///< See TracerouteHopStoreInternAddress
+  uint16_t sequenceNumber;           ///< Sequence number of the probe
+  uint8_t hopNumber;                 ///< Hop (TTL) of the probe
+  uint8_t probeIndex;                ///< Index of the probe within its hop
+  uint8_t probeCount;                ///< Probes it stands for, see below
+  uint8_t flags;                     ///< kTracerouteHopRecord... flags
+} TracerouteHopRecord;
+
+/*! Latency statistics of one hop, kept up to date as records are appended.
+ *  \details A reply is one probe; a timeout stands for probeCount probes that
+ * went unanswered. Uses Welford's method, so adding a sample is O(1) and stays
+ * accurate however many there are.
+ */
+typedef struct TracerouteHopAccumulator {
+  uint32_t probeCount;         ///< Probes answered or given up on
+  uint32_t replyCount;         ///< Probes answered
+  uint64_t minimumNanoseconds; ///< Fastest reply, 0 if none
+  uint64_t maximumNanoseconds; ///< Slowest reply, 0 if none
+  double meanNanoseconds;      ///< Mean reply, 0 if none
+  double sumOfSquares;         ///< Of the replies' deviations from the mean
+} TracerouteHopAccumulator;
+
+/*! The probe results of a traceroute, in the order they were reported.
+ *  \details Records are about 32 bytes each, however many there are, and
+ * never reference objects. Each hop also keeps running statistics, see
+ * TracerouteHopAccumulator. Router addresses are interned: each distinct
+ * address is stored once and records refer to it by index, so a path that is
+ * traced again and again costs no more addresses.
+ */
+typedef struct TracerouteHopStore {
+  uint32_t count;    ///< Number of records
+  uint32_t capacity; ///< Number of records the arrays have room for
+  uint64_t *roundTripNanoseconds;
+  double *timestamps;
+  uint32_t *deliveryDelayNanoseconds;
+  uint32_t *addressIndices;
+  uint16_t *sequenceNumbers;
+  uint8_t *hopNumbers;
+  uint8_t *probeIndices;
+  uint8_t *probeCounts;
+  uint8_t *flags;
+
+  uint32_t addressCount;    ///< Number of distinct router addresses
+  uint32_t addressCapacity; ///< Room in addresses
+  TracerouteRouterAddress *addresses;
+  uint32_t *addressBuckets; ///< Open addressing, index + 1, 0 if empty
+  uint32_t addressBucketMask;
+
+  uint32_t hopCount;    ///< One more than the highest hop with a record
+  uint32_t hopCapacity; ///< Room in hopAccumulators
+  TracerouteHopAccumulator *hopAccumulators; ///< Indexed by hop number
+} TracerouteHopStore;
+
+/*! Initializes an empty store; it allocates nothing until used.
+ */
+extern void TracerouteHopStoreInit(TracerouteHopStore *store);
+
+/*! Frees everything a store holds.
+ *  \param store The store; it may be used again after TracerouteHopStoreInit.
+ */
+extern void TracerouteHopStoreDestroy(TracerouteHopStore *store);
+
+/*! Forgets every record and address, keeping the memory for reuse.
+ */
+extern void TracerouteHopStoreReset(TracerouteHopStore *store);
+
+/*! Returns the index of a router address, adding it if it's new.
+ *  \param store The store.
+ *  \param numericAddress The address in numeric form, such as "192.0.2.1".
+ *  \returns The index, or kTracerouteHopStoreNoAddress if the address is NULL
+ * or not numeric, or memory ran out.
+ */
+extern uint32_t TracerouteHopStoreInternAddress(TracerouteHopStore *store,
+                                                const char *numericAddress);
+
+/*! Appends a record, adding it to its hop's statistics.
+ *  \param store The store.
+ *  \param record The record; its addressIndex must come from this store.
+ *  \returns false if memory ran out, leaving the store as it was.
+ */
+extern bool TracerouteHopStoreAppend(TracerouteHopStore *store,
+                                     const TracerouteHopRecord *record);
+
+/*! Reads a record.
+ *  \param store The store.
+ *  \param index The index of the record, less than count.
+ *  \param recordOut Receives the record.
+ */
+extern void TracerouteHopStoreGet(const TracerouteHopStore *store,
+                                  uint32_t index,
+                                  TracerouteHopRecord *recordOut);
+
+/*! Reads the statistics of a hop.
+ *  \param store The store.
+ *  \param hopNumber The hop.
+ *  \param accumulatorOut Receives the statistics.
+ *  \returns false if the hop has no records.
+ */
+extern bool
+TracerouteHopStoreGetAccumulator(const TracerouteHopStore *store,
+                                 uint8_t hopNumber,
+                                 TracerouteHopAccumulator *accumulatorOut);
+
+/*! Returns the standard deviation of a hop's replies, in nanoseconds.
+ *  \details The population deviation, as ping's mdev; 0 with under two replies.
+ */
+extern double TracerouteHopAccumulatorStandardDeviation(
+    const TracerouteHopAccumulator *accumulator);
+
+/*! Returns the fraction of a hop's probes that went unanswered, 0 to 1.
+ */
+extern double
+TracerouteHopAccumulatorLossRatio(const TracerouteHopAccumulator *accumulator);
+
+/*! Formats a router address in numeric form.
+ *  \param store The store.
+ *  \param addressIndex The index of the address.
+ *  \param buffer Receives the address, NUL terminated.
+ *  \param bufferSize Size of buffer; INET6_ADDRSTRLEN always suffices.
+ *  \returns false if there's no such address or the buffer is too small.
+ */
+extern bool TracerouteHopStoreFormatAddress(const TracerouteHopStore *store,
+                                            uint32_t addressIndex,
+                                            char *buffer, size_t bufferSize);
+
+/*! Builds a sockaddr for a router address, with port 0.
+ *  \param store The store.
+ *  \param addressIndex The index of the address.
+ *  \param addressOut Receives the sockaddr_in or sockaddr_in6.
+ *  \returns The length of the sockaddr, or 0 if there's no such address.
+ */
+extern socklen_t
+TracerouteHopStoreGetSockaddr(const TracerouteHopStore *store,
+                              uint32_t addressIndex,
+                              struct sockaddr_storage *addressOut);
+
+/*! Copies a store.
+ *  \param destination An initialized store; its contents are replaced.
+ *  \param source The store to copy.
+ *  \returns false if memory ran out, leaving destination empty.
+ */
+extern bool TracerouteHopStoreCopy(TracerouteHopStore *destination,
+                                   const TracerouteHopStore *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TracerouteHopStore_h */
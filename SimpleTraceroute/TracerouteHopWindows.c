@@ -0,0 +1,166 @@
+/*
+ Abstract:
+ Rolling per-hop statistics over each hop's most recent probes.
+ */
+
+#include "TracerouteHopWindows.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void TracerouteHopWindowsInit(TracerouteHopWindows *windows,
+                              uint32_t capacity) {
+  memset(windows, 0, sizeof(*windows));
+  windows->capacity = (capacity == 0) ? 1 : capacity;
+}
+
+void TracerouteHopWindowsDestroy(TracerouteHopWindows *windows) {
+  for (size_t hop = 0; hop < 256; hop++) {
+    free(windows->hops[hop].samples);
+  }
+  memset(windows, 0, sizeof(*windows));
+}
+
+/*! Drops the front of a queue if its probe has left the window.
+ *  \param extremes The queue.
+ *  \param capacity The window's capacity.
+ *  \param firstProbeNumber The oldest probe still in the window.
+ */
+static void TracerouteHopExtremesEvict(TracerouteHopExtremes *extremes,
+                                       uint32_t capacity,
+                                       uint64_t firstProbeNumber) {
+  if (extremes->count != 0 &&
+      extremes->probeNumbers[extremes->head] < firstProbeNumber) {
+    extremes->head = (extremes->head + 1 == capacity) ? 0 : extremes->head + 1;
+    extremes->count--;
+  }
+}
+
+/*! Appends a reply to a queue, dropping the replies it beats from the back.
+ *  \param extremes The queue.
+ *  \param samples The window's samples, where the queue's replies are.
+ *  \param capacity The window's capacity.
+ *  \param probeNumber The reply's probe.
+ *  \param keepsMinimum true to keep the fastest replies, false the slowest.
+ */
+static void TracerouteHopExtremesPush(TracerouteHopExtremes *extremes,
+                                      const uint64_t *samples,
+                                      uint32_t capacity, uint64_t probeNumber,
+                                      bool keepsMinimum) {
+  uint64_t sample = samples[probeNumber % capacity];
+
+  while (extremes->count != 0) {
+    uint32_t back = (extremes->head + extremes->count - 1) % capacity;
+    uint64_t backSample = samples[extremes->probeNumbers[back] % capacity];
+    if (keepsMinimum ? (backSample < sample) : (backSample > sample)) {
+      break;
+    }
+    extremes->count--;
+  }
+  extremes->probeNumbers[(extremes->head + extremes->count) % capacity] =
+      probeNumber;
+  extremes->count++;
+}
+
+void TracerouteHopWindowsReset(TracerouteHopWindows *windows) {
+  for (size_t hop = 0; hop < 256; hop++) {
+    TracerouteHopWindow *window = &windows->hops[hop];
+    window->probeCount = 0;
+    window->lastNanoseconds = 0;
+    window->count = 0;
+    window->next = 0;
+    window->replyCount = 0;
+    window->mean = 0;
+    window->m2 = 0;
+    window->minimum.head = 0;
+    window->minimum.count = 0;
+    window->maximum.head = 0;
+    window->maximum.count = 0;
+  }
+}
+
+bool TracerouteHopWindowsAdd(TracerouteHopWindows *windows, uint8_t hopNumber,
+                             uint64_t roundTripNanoseconds) {
+  TracerouteHopWindow *window = &windows->hops[hopNumber];
+  uint32_t capacity = windows->capacity;
+
+  // 1. One block for the samples and both queues
+  if (window->samples == NULL) {
+    window->samples = malloc((size_t)capacity * 3 * sizeof(uint64_t));
+    if (window->samples == NULL) {
+      return false;
+    }
+    window->minimum.probeNumbers = window->samples + capacity;
+    window->maximum.probeNumbers = window->samples + 2 * (size_t)capacity;
+  }
+
+  // 2. Take the probe pushed out of a full window out of the sums; the slot
+  // is about to be reused, so this comes before the new sample is stored
+  if (window->count == capacity) {
+    uint64_t evicted = window->samples[window->next];
+    uint64_t firstProbeNumber = window->probeCount - capacity + 1;
+    if (evicted != 0) {
+      window->replyCount--;
+      if (window->replyCount == 0) {
+        window->mean = 0;
+        window->m2 = 0;
+      } else {
+        double delta = (double)evicted - window->mean;
+        window->mean -= delta / window->replyCount;
+        window->m2 -= delta * ((double)evicted - window->mean);
+      }
+    }
+    TracerouteHopExtremesEvict(&window->minimum, capacity, firstProbeNumber);
+    TracerouteHopExtremesEvict(&window->maximum, capacity, firstProbeNumber);
+  }
+
+  // 3. The new sample, and its reply into the sums (Welford)
+  window->samples[window->next] = roundTripNanoseconds;
+  if (roundTripNanoseconds != 0) {
+    double delta = (double)roundTripNanoseconds - window->mean;
+    window->lastNanoseconds = roundTripNanoseconds;
+    window->replyCount++;
+    window->mean += delta / window->replyCount;
+    window->m2 += delta * ((double)roundTripNanoseconds - window->mean);
+    TracerouteHopExtremesPush(&window->minimum, window->samples, capacity,
+                              window->probeCount, true);
+    TracerouteHopExtremesPush(&window->maximum, window->samples, capacity,
+                              window->probeCount, false);
+  }
+  window->next = (window->next + 1 == capacity) ? 0 : window->next + 1;
+  if (window->count < capacity) {
+    window->count++;
+  }
+  window->probeCount++;
+  return true;
+}
+
+bool TracerouteHopWindowsGetSummary(const TracerouteHopWindows *windows,
+                                    uint8_t hopNumber,
+                                    TracerouteHopWindowSummary *summaryOut) {
+  const TracerouteHopWindow *window = &windows->hops[hopNumber];
+  uint32_t capacity = windows->capacity;
+
+  if (window->count == 0) {
+    return false;
+  }
+  memset(summaryOut, 0, sizeof(*summaryOut));
+  summaryOut->probeCount = window->probeCount;
+  summaryOut->windowCount = window->count;
+  summaryOut->replyCount = window->replyCount;
+  summaryOut->lastNanoseconds = window->lastNanoseconds;
+  if (window->replyCount == 0) {
+    return true;
+  }
+  summaryOut->minimumNanoseconds =
+      window->samples[window->minimum.probeNumbers[window->minimum.head] %
+                      capacity];
+  summaryOut->maximumNanoseconds =
+      window->samples[window->maximum.probeNumbers[window->maximum.head] %
+                      capacity];
+  summaryOut->meanNanoseconds = window->mean;
+  summaryOut->standardDeviation =
+      sqrt((window->m2 > 0 ? window->m2 : 0) / window->replyCount);
+  return true;
+}
@@ -0,0 +1,113 @@
+/*
+ Abstract:
+ Rolling per-hop statistics over each hop's most recent probes.
+ */
+
+#ifndef TracerouteHopWindows_h
+#define TracerouteHopWindows_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! The replies of a window that could still become its fastest (or slowest).
+ *  \details Holds probe numbers, oldest first, whose round trips are monotonic
+ * from the front: each reply drops those it beats from the back, and the front
+ * leaves with its probe.  The front is the window's extreme.
+ */
+typedef struct TracerouteHopExtremes {
+  uint64_t *probeNumbers; ///< Ring of the window's capacity
+  uint32_t head;          ///< Index of the front
+  uint32_t count;         ///< Probe numbers in the ring
+} TracerouteHopExtremes;
+
+/*! The most recent probes of one hop, oldest overwritten first.
+ *  \details The sums of the replies in the window are kept as probes come and
+ * go, so a summary doesn't have to look at the samples.
+ */
+typedef struct TracerouteHopWindow {
+  uint64_t *samples;        ///< Ring of round trips, 0 for a lost probe
+  uint64_t probeCount;      ///< Every probe ever added
+  uint64_t lastNanoseconds; ///< Latest reply, 0 if none yet
+  uint32_t count;           ///< Samples in the ring
+  uint32_t next;            ///< Where the next sample goes
+  uint32_t replyCount;      ///< Replies in the ring
+  double mean;              ///< Mean of the replies in the ring, ns
+  double m2; ///< Sum of the replies' squared deviations from the mean
+  TracerouteHopExtremes minimum; ///< Fastest replies, in the samples' block
+  TracerouteHopExtremes maximum; ///< Slowest replies, in the samples' block
+} TracerouteHopWindow;
+
+/*! The windows of every hop of a traceroute.
+ *  \details A hop's ring is allocated with its first sample, so only hops that
+ * get probed cost anything beyond this struct.
+ */
+typedef struct TracerouteHopWindows {
+  uint32_t capacity;             ///< Samples each hop keeps
+  TracerouteHopWindow hops[256]; ///< Indexed by hop number
+} TracerouteHopWindows;
+
+/*! What a hop's window adds up to.
+ *  \details Latency figures cover the replies in the window, and are 0 if it
+ * has none.
+ */
+typedef struct TracerouteHopWindowSummary {
+  uint64_t probeCount;         ///< Every probe ever added
+  uint32_t windowCount;        ///< Probes in the window
+  uint32_t replyCount;         ///< Replies in the window
+  uint64_t lastNanoseconds;    ///< Latest reply, 0 if none yet
+  uint64_t minimumNanoseconds; ///< Fastest reply in the window
+  uint64_t maximumNanoseconds; ///< Slowest reply in the window
+  double meanNanoseconds;      ///< Mean reply in the window
+  double standardDeviation;    ///< Population deviation of the replies, ns
+} TracerouteHopWindowSummary;
+
+/*! Initializes empty windows; nothing is allocated until a sample is added.
+ *  \param windows The windows.
+ *  \param capacity The number of recent probes each hop keeps, at least 1.
+ */
+extern void TracerouteHopWindowsInit(TracerouteHopWindows *windows,
+                                     uint32_t capacity);
+
+/*! Frees every ring.
+ *  \param windows The windows; they may be used again after
+ * TracerouteHopWindowsInit.
+ */
+extern void TracerouteHopWindowsDestroy(TracerouteHopWindows *windows);
+
+/*! Forgets every sample, keeping the rings for reuse.
+ */
+extern void TracerouteHopWindowsReset(TracerouteHopWindows *windows);
+
+/*! Adds a probe to a hop's window, pushing out its oldest if it's full.
+ *  \param windows The windows.
+ *  \param hopNumber The hop.
+ *  \param roundTripNanoseconds The probe's round trip, at least 1, or 0 if it
+ * was lost.
+ *  \returns false if memory for the hop's ring ran out.
+ */
+extern bool TracerouteHopWindowsAdd(TracerouteHopWindows *windows,
+                                    uint8_t hopNumber,
+                                    uint64_t roundTripNanoseconds);
+
+/*! Sums up a hop's window.
+ *  \details The cost is constant, whatever the window's size.
+ *  \param windows The windows.
+ *  \param hopNumber The hop.
+ *  \param summaryOut Receives the summary.
+ *  \returns false if the hop has no samples.
+ */
+extern bool
+TracerouteHopWindowsGetSummary(const TracerouteHopWindows *windows,
+                               uint8_t hopNumber,
+                               TracerouteHopWindowSummary *summaryOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TracerouteHopWindows_h */
@@ -0,0 +1,80 @@
+/*
+ Abstract:
+ A shared set of router interfaces already seen at each hop.
+ */
+
+#import "Public/TracerouteInterfaceCache.h"
+
+#include <os/lock.h>
+
+@implementation TracerouteInterfaceCache {
+  os_unfair_lock _lock;
+  // Interfaces seen at each hop, created on first use; protected by _lock
+  NSMutableSet<NSString *> *_interfacesByHop[256];
+  NSUInteger _count;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self != nil) {
+    self->_lock = OS_UNFAIR_LOCK_INIT;
+  }
+  return self;
+}
+
+- (NSUInteger)count {
+  NSUInteger count;
+
+  os_unfair_lock_lock(&self->_lock);
+  count = self->_count;
+  os_unfair_lock_unlock(&self->_lock);
+  return count;
+}
+
+- (void)addInterface:(NSString *)routerAddress atHop:(uint8_t)hop {
+  (void)[self addInterfaceReturningWasKnown:routerAddress atHop:hop];
+}
+
+- (BOOL)containsInterface:(NSString *)routerAddress atHop:(uint8_t)hop {
+  BOOL known;
+
+  NSParameterAssert(routerAddress != nil);
+  os_unfair_lock_lock(&self->_lock);
+  known = [self->_interfacesByHop[hop] containsObject:routerAddress];
+  os_unfair_lock_unlock(&self->_lock);
+  return known;
+}
+
+- (BOOL)addInterfaceReturningWasKnown:(NSString *)routerAddress
+                                atHop:(uint8_t)hop {
+  BOOL known;
+
+  NSParameterAssert(routerAddress != nil);
+  // Copy outside the lock; the caller's string may be mutable
+  NSString *key = [routerAddress copy];
+
+  os_unfair_lock_lock(&self->_lock);
+  NSMutableSet<NSString *> *interfaces = self->_interfacesByHop[hop];
+  if (interfaces == nil) {
+    interfaces = [[NSMutableSet alloc] init];
+    self->_interfacesByHop[hop] = interfaces;
+  }
+  known = [interfaces containsObject:key];
+  if (!known) {
+    [interfaces addObject:key];
+    self->_count++;
+  }
+  os_unfair_lock_unlock(&self->_lock);
+  return known;
+}
+
+- (void)removeAllInterfaces {
+  os_unfair_lock_lock(&self->_lock);
+  for (NSUInteger hop = 0; hop < 256; hop++) {
+    self->_interfacesByHop[hop] = nil;
+  }
+  self->_count = 0;
+  os_unfair_lock_unlock(&self->_lock);
+}
+
+@end
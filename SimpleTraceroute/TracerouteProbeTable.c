@@ -0,0 +1,206 @@
+/*
+ Abstract:
+ A fixed ring of outstanding traceroute probes, indexed by sequence number.
+ */
+
+#include "TracerouteProbeTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*! Returns true if a slot holds an outstanding probe.
+ *  \details A pending slot whose epoch is behind its hop's epoch belongs to
+ * a hop that was cleared since, so it no longer counts.
+ */
+static bool TracerouteProbeSlotIsLive(const TracerouteProbeTable *table,
+                                      const TracerouteProbeSlot *slot) {
+  return (slot->state == kTracerouteProbeSlotPending) &&
+         (slot->epoch == table->hopEpoch[slot->hop]);
+}
+
+/*! Marks a live slot free and updates the counts.
+ */
+static void TracerouteProbeSlotRelease(TracerouteProbeTable *table,
+                                       TracerouteProbeSlot *slot) {
+  slot->state = kTracerouteProbeSlotFree;
+  table->pendingCount -= 1;
+  table->hopPendingCount[slot->hop] -= 1;
+}
+
+/*! Moves oldestSequence forward to the oldest live slot.
+ *  \returns That slot, or NULL if nothing is outstanding.
+ */
+static TracerouteProbeSlot *
+TracerouteProbeTableAdvanceOldest(TracerouteProbeTable *table) {
+  if (table->slots == NULL || table->pendingCount == 0) {
+    return NULL;
+  }
+
+  // Every live slot lies in [oldestSequence, newest recorded], so this stops
+  // at the first live one; stale and matched slots are skipped once.
+  for (;;) {
+    TracerouteProbeSlot *slot =
+        &table->slots[table->oldestSequence & table->mask];
+    if (slot->sequenceNumber == table->oldestSequence &&
+        TracerouteProbeSlotIsLive(table, slot)) {
+      return slot;
+    }
+    table->oldestSequence += 1;
+  }
+}
+
+bool TracerouteProbeTableInit(TracerouteProbeTable *table,
+                              uint32_t minimumCapacity) {
+  uint32_t capacity = 64;
+
+  while (capacity < minimumCapacity &&
+         capacity < kTracerouteProbeTableMaxCapacity) {
+    capacity <<= 1;
+  }
+
+  TracerouteProbeTableDestroy(table);
+  memset(table, 0, sizeof(*table));
+  table->slots = calloc(capacity, sizeof(TracerouteProbeSlot));
+  if (table->slots == NULL) {
+    return false;
+  }
+  table->mask = capacity - 1;
+  return true;
+}
+
+void TracerouteProbeTableDestroy(TracerouteProbeTable *table) {
+  free(table->slots);
+  table->slots = NULL;
+  table->mask = 0;
+  table->pendingCount = 0;
+}
+
+uint32_t TracerouteProbeTableCapacity(const TracerouteProbeTable *table) {
+  return (table->slots != NULL) ? table->mask + 1 : 0;
+}
+
+void TracerouteProbeTableReset(TracerouteProbeTable *table) {
+  if (table->slots != NULL) {
+    memset(table->slots, 0, (table->mask + 1) * sizeof(TracerouteProbeSlot));
+  }
+  table->pendingCount = 0;
+  table->oldestSequence = 0;
+  memset(table->hopEpoch, 0, sizeof(table->hopEpoch));
+  memset(table->hopPendingCount, 0, sizeof(table->hopPendingCount));
+  memset(table->hopFirstSequence, 0, sizeof(table->hopFirstSequence));
+  memset(table->hopFirstProbeIndex, 0, sizeof(table->hopFirstProbeIndex));
+}
+
+void TracerouteProbeTableRecord(TracerouteProbeTable *table,
+                                uint16_t sequenceNumber, uint8_t hop,
+                                uint8_t probeIndex, uint64_t sendTime,
+                                uint64_t deadline) {
+  if (table->slots == NULL) {
+    return;
+  }
+
+  TracerouteProbeSlot *slot = &table->slots[sequenceNumber & table->mask];
+
+  // A probe still in flight a full ring ago is evicted
+  if (TracerouteProbeSlotIsLive(table, slot)) {
+    TracerouteProbeSlotRelease(table, slot);
+  }
+
+  if (table->pendingCount == 0) {
+    table->oldestSequence = sequenceNumber;
+  }
+  if (table->hopPendingCount[hop] == 0) {
+    table->hopFirstSequence[hop] = sequenceNumber;
+    table->hopFirstProbeIndex[hop] = probeIndex;
+  }
+
+  slot->sendTime = sendTime;
+  slot->deadline = deadline;
+  slot->epoch = table->hopEpoch[hop];
+  slot->sequenceNumber = sequenceNumber;
+  slot->hop = hop;
+  slot->probeIndex = probeIndex;
+  slot->state = kTracerouteProbeSlotPending;
+
+  table->pendingCount += 1;
+  table->hopPendingCount[hop] += 1;
+}
+
+bool TracerouteProbeTableTake(TracerouteProbeTable *table,
+                              uint16_t sequenceNumber,
+                              TracerouteProbeSlot *probeOut) {
+  if (table->slots == NULL) {
+    return false;
+  }
+
+  TracerouteProbeSlot *slot = &table->slots[sequenceNumber & table->mask];
+  if (slot->sequenceNumber != sequenceNumber ||
+      !TracerouteProbeSlotIsLive(table, slot)) {
+    return false;
+  }
+  if (probeOut != NULL) {
+    *probeOut = *slot;
+  }
+  TracerouteProbeSlotRelease(table, slot);
+  return true;
+}
+
+uint32_t
+TracerouteProbeTablePendingCountForHop(const TracerouteProbeTable *table,
+                                       uint8_t hop) {
+  return table->hopPendingCount[hop];
+}
+
+uint32_t TracerouteProbeTableRemoveHop(TracerouteProbeTable *table,
+                                       uint8_t hop,
+                                       uint16_t *firstSequenceOut,
+                                       uint8_t *firstProbeIndexOut) {
+  uint32_t removed = table->hopPendingCount[hop];
+
+  if (firstSequenceOut != NULL) {
+    *firstSequenceOut = table->hopFirstSequence[hop];
+  }
+  if (firstProbeIndexOut != NULL) {
+    *firstProbeIndexOut = table->hopFirstProbeIndex[hop];
+  }
+
+  // Bumping the epoch makes every slot of the hop stale in one go
+  table->hopEpoch[hop] += 1;
+  table->hopPendingCount[hop] = 0;
+  table->pendingCount -= removed;
+  return removed;
+}
+
+void TracerouteProbeTableRemoveHopsAbove(TracerouteProbeTable *table,
+                                         uint8_t hop) {
+  for (unsigned int h = (unsigned int)hop + 1; h < 256; h++) {
+    if (table->hopPendingCount[h] != 0) {
+      TracerouteProbeTableRemoveHop(table, (uint8_t)h, NULL, NULL);
+    }
+  }
+}
+
+bool TracerouteProbeTableOldest(TracerouteProbeTable *table,
+                                TracerouteProbeSlot *probeOut) {
+  TracerouteProbeSlot *slot = TracerouteProbeTableAdvanceOldest(table);
+  if (slot == NULL) {
+    return false;
+  }
+  *probeOut = *slot;
+  return true;
+}
+
+bool TracerouteProbeTableExpireOldest(TracerouteProbeTable *table,
+                                      uint64_t now,
+                                      TracerouteProbeSlot *probeOut) {
+  TracerouteProbeSlot *slot = TracerouteProbeTableAdvanceOldest(table);
+  if (slot == NULL || slot->deadline > now) {
+    return false;
+  }
+  if (probeOut != NULL) {
+    *probeOut = *slot;
+  }
+  TracerouteProbeSlotRelease(table, slot);
+  table->oldestSequence += 1;
+  return true;
+}
@@ -0,0 +1,154 @@
+/*
+ Abstract:
+ A fixed ring of outstanding traceroute probes, indexed by sequence number.
+ */
+
+#ifndef TracerouteProbeTable_h
+#define TracerouteProbeTable_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Largest number of slots a table can have; one per 16-bit sequence number.
+ */
+#define kTracerouteProbeTableMaxCapacity 65536u
+
+/*! One outstanding probe.
+ *  \details Times are opaque ticks chosen by the caller (SimpleTraceroute uses
+ * SimplePingMonotonicNanoseconds()); the table only compares them.
+ */
+typedef struct TracerouteProbeSlot {
+  uint64_t sendTime;       ///< When the probe was sent
+  uint64_t deadline;       ///< When the probe times out
+  uint32_t epoch;          ///< Hop epoch at record time, see hopEpoch
+  uint16_t sequenceNumber; ///< Sequence number of the probe
+  uint8_t hop;             ///< Hop (TTL) the probe was sent with
+  uint8_t probeIndex;      ///< Index of the probe within its hop
+  uint8_t state;           ///< kTracerouteProbeSlotFree or ...Pending
+} TracerouteProbeSlot;
+
+enum {
+  kTracerouteProbeSlotFree = 0,
+  kTracerouteProbeSlotPending = 1,
+};
+
+/*! Outstanding probes of one traceroute.
+ *  \details Slots are indexed by `sequenceNumber & mask`, so recording,
+ * matching and expiring a probe are O(1) and never allocate. Removing every
+ * probe of a hop is O(1) too: it bumps the hop's epoch, which turns all of
+ * its slots stale without touching them.
+ *
+ *      The table assumes the sequence numbers it is given increase (modulo
+ * 2^16) and that deadlines increase with them, which is what lets expiry
+ * look only at the oldest outstanding probe. Recording over a slot that is
+ * still pending evicts that older probe, so the capacity should cover the
+ * largest number of probes in flight.
+ */
+typedef struct TracerouteProbeTable {
+  TracerouteProbeSlot *slots;        ///< capacity slots, NULL until initialized
+  uint32_t mask;                     ///< capacity - 1, capacity is a power of 2
+  uint32_t pendingCount;             ///< Number of live slots
+  uint16_t oldestSequence;           ///< No live slot is older than this
+  uint32_t hopEpoch[256];            ///< Current epoch of each hop
+  uint16_t hopPendingCount[256];     ///< Number of live slots of each hop
+  uint16_t hopFirstSequence[256];    ///< First probe recorded since the hop was cleared
+  uint8_t hopFirstProbeIndex[256];   ///< Probe index of that first probe
+} TracerouteProbeTable;
+
+/*! Allocates the slots of a table.
+ *  \param table The table to initialize; any previous slots are freed.
+ *  \param minimumCapacity Number of probes that may be in flight at once; it
+ * is rounded up to a power of two (at least 64, at most 65536).
+ *  \returns true on success, false if the allocation failed.
+ */
+extern bool TracerouteProbeTableInit(TracerouteProbeTable *table,
+                                     uint32_t minimumCapacity);
+
+/*! Frees the slots of a table.
+ *  \param table The table; it may be used again after TracerouteProbeTableInit.
+ */
+extern void TracerouteProbeTableDestroy(TracerouteProbeTable *table);
+
+/*! Returns the number of slots of a table.
+ */
+extern uint32_t TracerouteProbeTableCapacity(const TracerouteProbeTable *table);
+
+/*! Forgets every outstanding probe.
+ */
+extern void TracerouteProbeTableReset(TracerouteProbeTable *table);
+
+/*! Records a probe that has just been sent.
+ *  \param table The table.
+ *  \param sequenceNumber Sequence number of the probe.
+ *  \param hop Hop (TTL) of the probe.
+ *  \param probeIndex Index of the probe within its hop.
+ *  \param sendTime When the probe was sent.
+ *  \param deadline When the probe times out.
+ */
+extern void TracerouteProbeTableRecord(TracerouteProbeTable *table,
+                                       uint16_t sequenceNumber, uint8_t hop,
+                                       uint8_t probeIndex, uint64_t sendTime,
+                                       uint64_t deadline);
+
+/*! Matches a response against the outstanding probes and removes the probe.
+ *  \param table The table.
+ *  \param sequenceNumber Sequence number found in the response.
+ *  \param probeOut If not NULL, receives a copy of the matched probe.
+ *  \returns true if a probe with that sequence number was outstanding.
+ */
+extern bool TracerouteProbeTableTake(TracerouteProbeTable *table,
+                                     uint16_t sequenceNumber,
+                                     TracerouteProbeSlot *probeOut);
+
+/*! Returns the number of outstanding probes of a hop.
+ */
+extern uint32_t
+TracerouteProbeTablePendingCountForHop(const TracerouteProbeTable *table,
+                                       uint8_t hop);
+
+/*! Removes every outstanding probe of a hop.
+ *  \param table The table.
+ *  \param hop The hop.
+ *  \param firstSequenceOut If not NULL, receives the sequence number of the
+ * first probe recorded for the hop since it was last cleared.
+ *  \param firstProbeIndexOut If not NULL, receives that probe's index.
+ *  \returns The number of probes removed.
+ */
+extern uint32_t TracerouteProbeTableRemoveHop(TracerouteProbeTable *table,
+                                              uint8_t hop,
+                                              uint16_t *firstSequenceOut,
+                                              uint8_t *firstProbeIndexOut);
+
+/*! Removes every outstanding probe of the hops above a hop.
+ */
+extern void TracerouteProbeTableRemoveHopsAbove(TracerouteProbeTable *table,
+                                                uint8_t hop);
+
+/*! Returns the oldest outstanding probe.
+ *  \param table The table.
+ *  \param probeOut Receives a copy of the probe.
+ *  \returns true if any probe is outstanding.
+ */
+extern bool TracerouteProbeTableOldest(TracerouteProbeTable *table,
+                                       TracerouteProbeSlot *probeOut);
+
+/*! Removes the oldest outstanding probe if its deadline has passed.
+ *  \details Call repeatedly to expire every probe due by `now`.
+ *  \param table The table.
+ *  \param now The current time, in the same ticks as the deadlines.
+ *  \param probeOut If not NULL, receives a copy of the expired probe.
+ *  \returns true if a probe was expired.
+ */
+extern bool TracerouteProbeTableExpireOldest(TracerouteProbeTable *table,
+                                             uint64_t now,
+                                             TracerouteProbeSlot *probeOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TracerouteProbeTable_h */
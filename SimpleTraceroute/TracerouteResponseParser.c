@@ -0,0 +1,130 @@
+/*
+ Abstract:
+ Decodes an ICMP response to a traceroute probe in a single pass.
+ */
+
+#include "TracerouteResponseParser.h"
+
+#include <string.h>
+
+enum {
+  kIPv4MinimumHeaderLength = 20,
+  kIPv6HeaderLength = 40,
+  kICMPHeaderLength = 8,
+
+  kICMPv4EchoReply = 0,
+  kICMPv4TimeExceeded = 11,
+  kICMPv6TimeExceeded = 3,
+  kICMPv6EchoReply = 129,
+};
+
+/*! Reads a big endian 16-bit value.
+ */
+static inline uint16_t TracerouteReadBigEndian16(const uint8_t *bytes) {
+  return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+/*! Returns the length of the IPv4 header at the start of a packet.
+ *  \returns 0 if there isn't a plausible one.
+ */
+static size_t TracerouteIPv4HeaderLength(const uint8_t *bytes, size_t length) {
+  size_t headerLength;
+
+  if (length < kIPv4MinimumHeaderLength || (bytes[0] >> 4) != 4) {
+    return 0;
+  }
+  headerLength = (size_t)(bytes[0] & 0x0f) * 4;
+  if (headerLength < kIPv4MinimumHeaderLength || headerLength > length) {
+    return 0;
+  }
+  return headerLength;
+}
+
+/*! Decodes the echo message at the start of bytes: its identifier and
+ * sequence number, and as much of the probe payload as is there.
+ */
+static void TracerouteDecodeEcho(const uint8_t *echo, size_t length,
+                                 TracerouteResponse *response) {
+  response->identifier = TracerouteReadBigEndian16(echo + 4);
+  response->sequenceNumber = TracerouteReadBigEndian16(echo + 6);
+  if (length >= kTracerouteProbeIndexOffset + 1) {
+    memcpy(&response->sendTime, echo + kTracerouteProbeSendTimeOffset,
+           sizeof(response->sendTime));
+    response->probeHop = echo[kTracerouteProbeHopOffset];
+    response->probeIndex = echo[kTracerouteProbeIndexOffset];
+    response->hasProbePayload = true;
+  }
+}
+
+bool TracerouteResponseParse(const uint8_t *bytes, size_t length,
+                             sa_family_t addressFamily,
+                             TracerouteResponse *response) {
+  size_t icmpOffset = 0;
+  const uint8_t *icmp;
+  const uint8_t *quoted;
+  size_t icmpLength;
+  size_t quotedLength;
+
+  memset(response, 0, sizeof(*response));
+
+  // 1. Outer header: IPv4 sockets usually return the IP header, which has
+  // the response's TTL; IPv6 ones never do
+  if (addressFamily == AF_INET) {
+    size_t headerLength = TracerouteIPv4HeaderLength(bytes, length);
+    if (headerLength != 0) {
+      icmpOffset = headerLength;
+      response->responseTTL = bytes[8];
+    } else if (length >= kIPv4MinimumHeaderLength && (bytes[0] >> 4) == 4) {
+      return false;
+    }
+  } else if (addressFamily != AF_INET6) {
+    return false;
+  }
+  if (length < icmpOffset + kICMPHeaderLength) {
+    return false;
+  }
+
+  // 2. ICMP header
+  icmp = bytes + icmpOffset;
+  icmpLength = length - icmpOffset;
+  response->icmpOffset = (uint16_t)icmpOffset;
+  response->icmpType = icmp[0];
+  response->icmpCode = icmp[1];
+
+  if ((addressFamily == AF_INET && icmp[0] == kICMPv4EchoReply) ||
+      (addressFamily == AF_INET6 && icmp[0] == kICMPv6EchoReply)) {
+    response->kind = kTracerouteResponseEchoReply;
+    TracerouteDecodeEcho(icmp, icmpLength, response);
+    return true;
+  }
+  if (!((addressFamily == AF_INET && icmp[0] == kICMPv4TimeExceeded) ||
+        (addressFamily == AF_INET6 && icmp[0] == kICMPv6TimeExceeded))) {
+    return false;
+  }
+
+  // 3. Quoted request: its IP header, then at least the 8 bytes of its ICMP
+  // header, and with luck our payload
+  response->kind = kTracerouteResponseTimeExceeded;
+  quoted = icmp + kICMPHeaderLength;
+  quotedLength = icmpLength - kICMPHeaderLength;
+  if (addressFamily == AF_INET) {
+    size_t innerLength = TracerouteIPv4HeaderLength(quoted, quotedLength);
+    if (innerLength == 0 || quotedLength < innerLength + kICMPHeaderLength) {
+      return false;
+    }
+    response->quotedTTL = quoted[8];
+    quoted += innerLength;
+    quotedLength -= innerLength;
+  } else {
+    if (quotedLength < kIPv6HeaderLength + kICMPHeaderLength) {
+      return false;
+    }
+    response->quotedTTL = quoted[7];
+    quoted += kIPv6HeaderLength;
+    quotedLength -= kIPv6HeaderLength;
+  }
+
+  // 4. Quoted ICMP header and payload
+  TracerouteDecodeEcho(quoted, quotedLength, response);
+  return true;
+}
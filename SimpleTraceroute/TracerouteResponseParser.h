@@ -0,0 +1,75 @@
+/*
+ Abstract:
+ Decodes an ICMP response to a traceroute probe in a single pass.
+ */
+
+#ifndef TracerouteResponseParser_h
+#define TracerouteResponseParser_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Layout of the probe payload, as offsets from the start of the ICMP header
+ *  \details SimpleTraceroute patches these into each probe, see
+ * -sendProbeForHop:probeIndex:, and reads them back from the request a
+ * response quotes.
+ */
+enum {
+  kTracerouteProbeSendTimeOffset = 8, // uint64_t, host byte order
+  kTracerouteProbeHopOffset = 16,     // uint8_t
+  kTracerouteProbeIndexOffset = 17,   // uint8_t
+  kTracerouteProbeFlowOffset = 18,    // uint16_t, holds the checksum steady
+  kTracerouteProbePayloadLength = 16
+};
+
+/*! What a response is.
+ */
+enum {
+  kTracerouteResponseEchoReply = 1,    ///< From the target
+  kTracerouteResponseTimeExceeded = 2, ///< From a router on the way
+};
+
+/*! A decoded response.
+ *  \details The identifier, sequence number and payload fields are those of
+ * the echo reply, or of the echo request a time exceeded message quotes; the
+ * payload fields are only set if enough of the probe came back.
+ */
+typedef struct TracerouteResponse {
+  uint64_t sendTime;       ///< Send time from the probe payload
+  uint16_t icmpOffset;     ///< Offset of the ICMP header in the packet
+  uint16_t identifier;     ///< ICMP identifier, host byte order
+  uint16_t sequenceNumber; ///< ICMP sequence number, host byte order
+  uint8_t kind;            ///< kTracerouteResponse... kind
+  uint8_t icmpType;        ///< ICMP type of the response
+  uint8_t icmpCode;        ///< ICMP code of the response
+  uint8_t responseTTL;     ///< TTL of the response, 0 if unknown (IPv6)
+  uint8_t quotedTTL;       ///< TTL the quoted request arrived with, or 0
+  uint8_t probeHop;        ///< Hop from the probe payload
+  uint8_t probeIndex;      ///< Probe index from the probe payload
+  bool hasProbePayload;    ///< Whether the payload fields are set
+} TracerouteResponse;
+
+/*! Decodes a response, reading each header once and copying nothing.
+ *  \param bytes The packet as the socket returned it: for IPv4 usually with
+ * its IP header, for IPv6 bare ICMPv6.
+ *  \param length Length of the packet.
+ *  \param addressFamily AF_INET or AF_INET6.
+ *  \param response Receives the decoded fields.
+ *  \returns false if the packet is not a well formed echo reply or time
+ * exceeded message, leaving response undefined.
+ */
+extern bool TracerouteResponseParse(const uint8_t *bytes, size_t length,
+                                    sa_family_t addressFamily,
+                                    TracerouteResponse *response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TracerouteResponseParser_h */
@@ -0,0 +1,43 @@
+/*
+ Abstract:
+ Interfaces of TracerouteResult shared by SimpleTraceroute and TracerouteBatch.
+ */
+
+#import "Public/TracerouteTypes.h"
+#import "TracerouteHopStore.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface TracerouteResult ()
+
+/*! Initialize a result from the probe results of a traceroute
+ *  \details The store is copied, so the traceroute can go on reusing its own;
+ *  `hops` and `hopResults` are built from the copy when first asked for.
+ *  \param hopStore probe results, in the order they were reported
+ *  \param routerHostNames names of router addresses, keyed by numeric address
+ */
+- (instancetype)initWithTargetHostname:(NSString *)targetHostname
+                         targetAddress:(NSData *)targetAddress
+                               maxHops:(uint8_t)maxHops
+                            actualHops:(uint8_t)actualHops
+                             totalTime:(double)totalTime
+                              hopStore:(const TracerouteHopStore *)hopStore
+                       routerHostNames:
+                           (NSDictionary<NSString *, NSString *> *)
+                               routerHostNames
+                         reachedTarget:(BOOL)reachedTarget;
+
+/*! Whether each probe result's probeIndex is its flow, so pathGraph can be
+ *  built
+ *  \details Set by multipath traceroutes before the result is handed out.
+ */
+@property(nonatomic, assign, readwrite) BOOL hasFlows;
+
+/*! Returns the same result labelled with another target's host name
+ *  \details The probe results are shared, not copied.
+ */
+- (TracerouteResult *)resultWithTargetHostname:(NSString *)targetHostname;
+
+@end
+
+NS_ASSUME_NONNULL_END
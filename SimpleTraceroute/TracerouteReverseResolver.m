@@ -0,0 +1,326 @@
+/*
+ Abstract:
+ A shared, caching reverse DNS resolver for the router addresses of hops.
+ */
+
+#import "Public/TracerouteReverseResolver.h"
+#import "../SimplePing/Public/SimplePingTiming.h"
+
+#include <netdb.h>
+#include <os/lock.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/*! Returns the current monotonic time in seconds, for cache expiry
+ */
+static NSTimeInterval TracerouteReverseResolverNow(void) {
+  return (NSTimeInterval)SimplePingMonotonicNanoseconds() / 1e9;
+}
+
+/*! Looks up the name of a numeric address, blocking
+ *  \param routerAddress address in numeric form
+ *  \returns The name, or nil if the address has none or the lookup failed
+ */
+static NSString *_Nullable TracerouteReverseResolverLookUp(
+    NSString *routerAddress) {
+  struct addrinfo hints;
+  struct addrinfo *list;
+  char hostName[NI_MAXHOST];
+  NSString *result;
+
+  // 1. Turn the string back into a sockaddr; AI_NUMERICHOST never hits DNS
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICHOST;
+  list = NULL;
+  if (getaddrinfo(routerAddress.UTF8String, NULL, &hints, &list) != 0) {
+    return nil;
+  }
+
+  // 2. Ask for a real name; NI_NAMEREQD fails rather than echoing the address
+  result = nil;
+  if ((list != NULL) && (list->ai_addr != NULL) &&
+      getnameinfo(list->ai_addr, list->ai_addrlen, hostName, sizeof(hostName),
+                  NULL, 0, NI_NAMEREQD) == 0) {
+    result = [NSString stringWithUTF8String:hostName];
+  }
+  freeaddrinfo(list);
+  return result;
+}
+
+#pragma mark * TracerouteReverseLookup
+
+/*! One cache entry; while `finished` is NO the lookup is queued or running
+ *  \details All properties are protected by the resolver's lock.
+ */
+@interface TracerouteReverseLookup : NSObject
+@property(nonatomic, copy, readonly) NSString *routerAddress;
+@property(nonatomic, copy, readwrite, nullable) NSString *hostName;
+@property(nonatomic, assign, readwrite) BOOL finished;
+@property(nonatomic, assign, readwrite) NSTimeInterval expiryTime;
+// Completion handlers of everyone waiting, each already bound to its queue
+@property(nonatomic, strong, readonly)
+    NSMutableArray<void (^)(NSString *_Nullable)> *waiters;
+@end
+
+@implementation TracerouteReverseLookup
+
+- (instancetype)initWithRouterAddress:(NSString *)routerAddress {
+  self = [super init];
+  if (self != nil) {
+    self->_routerAddress = [routerAddress copy];
+    self->_waiters = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+@end
+
+#pragma mark * TracerouteReverseResolver
+
+@implementation TracerouteReverseResolver {
+  os_unfair_lock _lock;
+  // Everything below is protected by _lock
+  NSMutableDictionary<NSString *, TracerouteReverseLookup *> *_lookups;
+  NSMutableArray<TracerouteReverseLookup *> *_queuedLookups;
+  NSUInteger _runningLookupCount;
+  NSTimeInterval _cacheLifetime;
+  NSTimeInterval _negativeCacheLifetime;
+  NSUInteger _maxConcurrentLookups;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self != nil) {
+    self->_lock = OS_UNFAIR_LOCK_INIT;
+    self->_lookups = [[NSMutableDictionary alloc] init];
+    self->_queuedLookups = [[NSMutableArray alloc] init];
+    self->_cacheLifetime = 3600.0;
+    self->_negativeCacheLifetime = 300.0;
+    self->_maxConcurrentLookups = 4;
+  }
+  return self;
+}
+
+#pragma mark * Property Access
+
+- (NSTimeInterval)cacheLifetime {
+  NSTimeInterval result;
+
+  os_unfair_lock_lock(&self->_lock);
+  result = self->_cacheLifetime;
+  os_unfair_lock_unlock(&self->_lock);
+  return result;
+}
+
+- (void)setCacheLifetime:(NSTimeInterval)cacheLifetime {
+  os_unfair_lock_lock(&self->_lock);
+  self->_cacheLifetime = cacheLifetime;
+  os_unfair_lock_unlock(&self->_lock);
+}
+
+- (NSTimeInterval)negativeCacheLifetime {
+  NSTimeInterval result;
+
+  os_unfair_lock_lock(&self->_lock);
+  result = self->_negativeCacheLifetime;
+  os_unfair_lock_unlock(&self->_lock);
+  return result;
+}
+
+- (void)setNegativeCacheLifetime:(NSTimeInterval)negativeCacheLifetime {
+  os_unfair_lock_lock(&self->_lock);
+  self->_negativeCacheLifetime = negativeCacheLifetime;
+  os_unfair_lock_unlock(&self->_lock);
+}
+
+- (NSUInteger)maxConcurrentLookups {
+  NSUInteger result;
+
+  os_unfair_lock_lock(&self->_lock);
+  result = self->_maxConcurrentLookups;
+  os_unfair_lock_unlock(&self->_lock);
+  return result;
+}
+
+- (void)setMaxConcurrentLookups:(NSUInteger)maxConcurrentLookups {
+  NSParameterAssert(maxConcurrentLookups >= 1);
+  os_unfair_lock_lock(&self->_lock);
+  self->_maxConcurrentLookups = MAX(maxConcurrentLookups, (NSUInteger)1);
+  os_unfair_lock_unlock(&self->_lock);
+}
+
+- (NSUInteger)count {
+  NSUInteger count;
+
+  os_unfair_lock_lock(&self->_lock);
+  count = 0;
+  for (TracerouteReverseLookup *lookup in self->_lookups.objectEnumerator) {
+    if (lookup.finished) {
+      count++;
+    }
+  }
+  os_unfair_lock_unlock(&self->_lock);
+  return count;
+}
+
+#pragma mark * Lookups
+
+/*! Wraps a completion handler so it runs on a queue, or on the current run loop
+ *  \param queue target queue, or nil for the current run loop
+ *  \param completionHandler handler to wrap
+ *  \returns A block that may be called from any thread
+ */
+static void (^TracerouteReverseResolverBindHandler(
+    dispatch_queue_t _Nullable queue,
+    void (^completionHandler)(NSString *_Nullable)))(NSString *_Nullable) {
+  if (queue != nil) {
+    return ^(NSString *_Nullable hostName) {
+      dispatch_async(queue, ^{
+        completionHandler(hostName);
+      });
+    };
+  }
+
+  // Runs the handler on our run loop's thread, same as the CFHost callbacks
+  CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+  CFRetain(runLoop);
+  return ^(NSString *_Nullable hostName) {
+    CFRunLoopPerformBlock(runLoop, kCFRunLoopDefaultMode, ^{
+      completionHandler(hostName);
+    });
+    CFRunLoopWakeUp(runLoop);
+    CFRelease(runLoop);
+  };
+}
+
+- (void)resolveAddress:(NSString *)routerAddress
+                 queue:(dispatch_queue_t)queue
+     completionHandler:(void (^)(NSString *_Nullable hostName))completionHandler {
+  NSParameterAssert(routerAddress != nil);
+  NSParameterAssert(completionHandler != nil);
+
+  void (^waiter)(NSString *_Nullable) =
+      TracerouteReverseResolverBindHandler(queue, completionHandler);
+  BOOL cached = NO;
+  NSString *hostName = nil;
+  NSArray<TracerouteReverseLookup *> *lookupsToRun;
+
+  os_unfair_lock_lock(&self->_lock);
+  TracerouteReverseLookup *lookup = self->_lookups[routerAddress];
+  if (lookup != nil && lookup.finished &&
+      lookup.expiryTime <= TracerouteReverseResolverNow()) {
+    // Expired; look it up again
+    lookup = nil;
+  }
+  if (lookup == nil) {
+    lookup = [[TracerouteReverseLookup alloc] initWithRouterAddress:routerAddress];
+    self->_lookups[lookup.routerAddress] = lookup;
+    [self->_queuedLookups addObject:lookup];
+  }
+  if (lookup.finished) {
+    cached = YES;
+    hostName = lookup.hostName;
+  } else {
+    [lookup.waiters addObject:waiter];
+  }
+  lookupsToRun = [self dequeueLookupsLocked];
+  os_unfair_lock_unlock(&self->_lock);
+
+  if (cached) {
+    waiter(hostName);
+  }
+  for (TracerouteReverseLookup *next in lookupsToRun) {
+    [self runLookup:next];
+  }
+}
+
+- (NSString *)cachedHostNameForAddress:(NSString *)routerAddress
+                                 found:(BOOL *)found {
+  NSString *hostName = nil;
+  BOOL isCached = NO;
+
+  NSParameterAssert(routerAddress != nil);
+  os_unfair_lock_lock(&self->_lock);
+  TracerouteReverseLookup *lookup = self->_lookups[routerAddress];
+  if (lookup != nil && lookup.finished &&
+      lookup.expiryTime > TracerouteReverseResolverNow()) {
+    isCached = YES;
+    hostName = lookup.hostName;
+  }
+  os_unfair_lock_unlock(&self->_lock);
+
+  if (found != NULL) {
+    *found = isCached;
+  }
+  return hostName;
+}
+
+- (void)removeAllHostNames {
+  os_unfair_lock_lock(&self->_lock);
+  // Keep the lookups that are queued or running, so their waiters are called
+  NSMutableArray<NSString *> *finishedAddresses = [[NSMutableArray alloc] init];
+  [self->_lookups enumerateKeysAndObjectsUsingBlock:^(
+                      NSString *address, TracerouteReverseLookup *lookup,
+                      BOOL *stop) {
+#pragma unused(stop)
+    if (lookup.finished) {
+      [finishedAddresses addObject:address];
+    }
+  }];
+  [self->_lookups removeObjectsForKeys:finishedAddresses];
+  os_unfair_lock_unlock(&self->_lock);
+}
+
+/*! Takes as many queued lookups as there are free slots
+ *  \details Must be called with _lock held; the caller runs them after unlocking
+ *  \returns The lookups to run, now counted as running
+ */
+- (NSArray<TracerouteReverseLookup *> *)dequeueLookupsLocked {
+  NSMutableArray<TracerouteReverseLookup *> *lookups = nil;
+
+  while (self->_queuedLookups.count != 0 &&
+         self->_runningLookupCount < self->_maxConcurrentLookups) {
+    if (lookups == nil) {
+      lookups = [[NSMutableArray alloc] init];
+    }
+    [lookups addObject:self->_queuedLookups.firstObject];
+    [self->_queuedLookups removeObjectAtIndex:0];
+    self->_runningLookupCount++;
+  }
+  return lookups ?: @[];
+}
+
+/*! Runs one lookup on a global queue and completes it
+ *  \param lookup lookup to run, already counted as running
+ */
+- (void)runLookup:(TracerouteReverseLookup *)lookup {
+  // The resolver stays alive until every lookup it started has finished
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+    NSString *hostName = TracerouteReverseResolverLookUp(lookup.routerAddress);
+    NSArray<void (^)(NSString *_Nullable)> *waiters;
+    NSArray<TracerouteReverseLookup *> *lookupsToRun;
+
+    os_unfair_lock_lock(&self->_lock);
+    lookup.hostName = hostName;
+    lookup.finished = YES;
+    lookup.expiryTime =
+        TracerouteReverseResolverNow() +
+        (hostName != nil ? self->_cacheLifetime : self->_negativeCacheLifetime);
+    waiters = [lookup.waiters copy];
+    [lookup.waiters removeAllObjects];
+    self->_runningLookupCount--;
+    lookupsToRun = [self dequeueLookupsLocked];
+    os_unfair_lock_unlock(&self->_lock);
+
+    for (void (^waiter)(NSString *_Nullable) in waiters) {
+      waiter(hostName);
+    }
+    for (TracerouteReverseLookup *next in lookupsToRun) {
+      [self runLookup:next];
+    }
+  });
+}
+
+@end
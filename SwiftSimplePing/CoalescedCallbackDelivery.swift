@@ -0,0 +1,195 @@
+/*
+ Abstract:
+ Hands callbacks from the queue that produces them to a callback queue in coalesced batches.
+ */
+
+import Foundation
+import SimplePing
+
+/// Where a pinger or traceroute runs: a serial queue, or the run loop of a thread
+enum ExecutionContext {
+    case queue(DispatchQueue)
+    case runLoop(CFRunLoop)
+
+    /// A queue if there is one, otherwise a run loop
+    init(queue: DispatchQueue?, runLoop: CFRunLoop) {
+        self = queue.map { .queue($0) } ?? .runLoop(runLoop)
+    }
+
+    /// Runs a block there, from any thread
+    ///
+    /// On a run loop the block runs in the common modes, once the run loop next gets round to
+    /// it; it never runs if the run loop isn't running.
+    /// - Parameters:
+    ///   - delay: Nanoseconds to wait first
+    ///   - block: The block
+    func async(afterNanoseconds delay: Int = 0, _ block: @escaping @Sendable () -> Void) {
+        switch self {
+        case .queue(let queue):
+            if delay > 0 {
+                queue.asyncAfter(deadline: .now() + .nanoseconds(delay), execute: block)
+            } else {
+                queue.async(execute: block)
+            }
+        case .runLoop(let runLoop):
+            if delay > 0 {
+                let timer = CFRunLoopTimerCreateWithHandler(
+                    kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + Double(delay) / 1e9, 0, 0, 0
+                ) { _ in block() }
+                CFRunLoopAddTimer(runLoop, timer, .commonModes)
+            } else {
+                CFRunLoopPerformBlock(runLoop, CFRunLoopMode.commonModes.rawValue, block)
+            }
+            CFRunLoopWakeUp(runLoop)
+        }
+    }
+}
+
+/// Hands values from the serial queue that produces them to a callback queue in batches
+///
+/// The producer calls `append(_:flushImmediately:)` in `producer`, its serial queue or its
+/// thread's run loop, and batches are closed there too, so the ring only ever has one producer.
+/// At most `maximumRate` times a second (with a rate of 0, as soon as `producer` is next free)
+/// the batch is closed with whatever `closeBatch` returns, such as a statistics snapshot worth
+/// building only once per batch, and a single block in `consumer` passes every value to
+/// `handler` in order. Values cross between the queues through a `SimplePingDeliveryQueue`, a lock-free
+/// single-producer, single-consumer ring; any that find it full wait, in order, on the
+/// producer's side for the next batch.
+final class CoalescedCallbackDelivery<Element>: @unchecked Sendable {
+
+    /// What the ring points at; one per value, retained by the ring until it's popped
+    private final class Box {
+        let element: Element
+
+        init(_ element: Element) {
+            self.element = element
+        }
+    }
+
+    let producer: ExecutionContext
+    let consumer: ExecutionContext
+
+    private let ring: OpaquePointer
+    private let minimumInterval: UInt64
+    private let closeBatch: () -> Element?
+    private let handler: (Element) -> Void
+
+    // Producer side only
+    private var overflow: [Element] = []
+    private var hasPendingValues = false
+    private var isFlushScheduled = false
+    private var lastFlushTime: UInt64 = 0
+
+    /// - Parameters:
+    ///   - producer: Where values are appended
+    ///   - consumer: Where `handler` is called; may be `producer`
+    ///   - maximumRate: Most batches a second, or 0 for no limit
+    ///   - capacity: Values the ring holds between batches
+    ///   - closeBatch: Called in `producer`, queue or run loop, as each batch is closed, to add a
+    ///     last value
+    ///   - handler: Called in `consumer`, queue or run loop, with each value
+    /// - Returns: nil if there isn't the memory for the ring
+    init?(
+        producer: ExecutionContext, consumer: ExecutionContext, maximumRate: Double,
+        capacity: Int = 1024, closeBatch: @escaping () -> Element? = { nil },
+        handler: @escaping (Element) -> Void
+    ) {
+        guard let ring = SimplePingDeliveryQueueCreate(max(1, capacity)) else { return nil }
+        self.ring = ring
+        self.producer = producer
+        self.consumer = consumer
+        self.minimumInterval = maximumRate > 0 ? UInt64(1e9 / maximumRate) : 0
+        self.closeBatch = closeBatch
+        self.handler = handler
+    }
+
+    deinit {
+        // Nothing can be draining: a pending drain holds a reference
+        while let pointer = SimplePingDeliveryQueuePop(ring) {
+            Unmanaged<Box>.fromOpaque(pointer).release()
+        }
+        SimplePingDeliveryQueueDestroy(ring)
+    }
+
+    /// Adds a value to the current batch; producer side
+    /// - Parameters:
+    ///   - element: The value
+    ///   - flushImmediately: Whether to close the batch now rather than when the rate allows,
+    ///     for rare values that shouldn't wait, such as a failure
+    func append(_ element: Element, flushImmediately: Bool = false) {
+        enqueue(element)
+        setNeedsFlush()
+        if flushImmediately {
+            flush()
+        }
+    }
+
+    /// Has the current batch closed when the rate allows, even if nothing is appended to it;
+    /// producer side
+    ///
+    /// For when `closeBatch` has something new to say.
+    func setNeedsFlush() {
+        hasPendingValues = true
+        guard !isFlushScheduled else { return }
+        isFlushScheduled = true
+
+        let now = SimplePingMonotonicNanoseconds()
+        let due = lastFlushTime + minimumInterval
+        let delay = due > now ? Int(clamping: due - now) : 0
+        producer.async(afterNanoseconds: delay) { [weak self] in
+            guard let self = self else { return }
+            self.isFlushScheduled = false
+            self.flush()
+        }
+    }
+
+    /// Closes the current batch and has it delivered, if there's anything in it; producer side
+    func flush() {
+        guard hasPendingValues else { return }
+        hasPendingValues = false
+        lastFlushTime = SimplePingMonotonicNanoseconds()
+
+        // 1. Values that found the ring full go first
+        var moved = 0
+        while moved < overflow.count && push(overflow[moved]) {
+            moved += 1
+        }
+        overflow.removeFirst(moved)
+        if let last = closeBatch() {
+            enqueue(last)
+        }
+
+        // 2. Whatever still doesn't fit goes in the next batch
+        if !overflow.isEmpty {
+            setNeedsFlush()
+        }
+
+        // 3. One block delivers the lot
+        consumer.async { self.drain() }
+    }
+
+    // MARK: - Private Methods
+
+    /// Pushes a value, or keeps it for later if the ring is full or others are already waiting
+    private func enqueue(_ element: Element) {
+        if !overflow.isEmpty || !push(element) {
+            overflow.append(element)
+        }
+    }
+
+    private func push(_ element: Element) -> Bool {
+        let pointer = Unmanaged.passRetained(Box(element)).toOpaque()
+        if SimplePingDeliveryQueuePush(ring, pointer) {
+            return true
+        }
+        Unmanaged<Box>.fromOpaque(pointer).release()
+        return false
+    }
+
+    /// Passes everything in the ring to the handler; consumer side
+    private func drain() {
+        while let pointer = SimplePingDeliveryQueuePop(ring) {
+            handler(Unmanaged<Box>.fromOpaque(pointer).takeRetainedValue().element)
+        }
+    }
+}
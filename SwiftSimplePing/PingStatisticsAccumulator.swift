@@ -0,0 +1,477 @@
+/*
+ Abstract:
+ Streaming latency statistics: a history ring, windowed Welford moments, RFC 3550 jitter and a quantile sketch.
+ */
+
+import Foundation
+import SimplePing
+
+// MARK: - LatencyHistory
+
+/// The most recent latencies, oldest first, kept in a fixed-size ring
+///
+/// Appending is O(1) and never moves the stored values. The storage is a Swift array, so
+/// copies of a history share it until one of them is modified.
+public struct LatencyHistory: RandomAccessCollection, Sendable {
+    private var storage: [TimeInterval]
+    private var head: Int = 0
+    public private(set) var count: Int = 0
+
+    /// The largest number of latencies kept
+    public let capacity: Int
+
+    /// Create an empty history
+    /// - Parameter capacity: The largest number of latencies to keep (at least 1)
+    public init(capacity: Int) {
+        self.capacity = max(1, capacity)
+        self.storage = []
+        self.storage.reserveCapacity(self.capacity)
+    }
+
+    public var startIndex: Int { return 0 }
+    public var endIndex: Int { return count }
+
+    public subscript(position: Int) -> TimeInterval {
+        precondition(position >= 0 && position < count, "LatencyHistory index out of range")
+        let physical = head + position
+        return storage[physical < capacity ? physical : physical - capacity]
+    }
+
+    /// The oldest latency, which the next append evicts once the history is full
+    var evictionCandidate: TimeInterval? {
+        return count == capacity ? storage[head] : nil
+    }
+
+    /// Append a latency, evicting the oldest one if full
+    mutating func append(_ latency: TimeInterval) {
+        if storage.count < capacity {
+            storage.append(latency)
+            count += 1
+        } else {
+            storage[head] = latency
+            head = head + 1 == capacity ? 0 : head + 1
+        }
+    }
+}
+
+// MARK: - LatencySketch
+
+/// A mergeable quantile sketch of latencies (DDSketch)
+///
+/// Values are counted in logarithmic buckets, so any quantile is returned within
+/// `relativeAccuracy` of the true value, whatever the distribution. Adding a value is O(1);
+/// the memory used depends on the range of the values, not on how many there are. Two
+/// sketches with the same accuracy can be merged, for example to combine several pingers.
+public struct LatencySketch: Sendable {
+    /// The relative error of the quantiles returned
+    public let relativeAccuracy: Double
+
+    /// The largest number of buckets kept; beyond this the lowest buckets are collapsed
+    public let maximumBucketCount: Int
+
+    /// The number of values added
+    public private(set) var count: UInt64 = 0
+
+    private let gamma: Double
+    private let logGamma: Double
+    private var zeroCount: UInt64 = 0
+    private var bins: [UInt64] = []
+    private var minimumKey: Int = 0  // key of bins[0]
+
+    /// Values at or below this are counted as zero
+    private static let minimumIndexableValue: Double = 1e-9
+
+    /// Create an empty sketch
+    /// - Parameters:
+    ///   - relativeAccuracy: Relative error of the quantiles, between 0 and 1 (default: 1%)
+    ///   - maximumBucketCount: Memory bound, in buckets (default: 2048)
+    public init(relativeAccuracy: Double = 0.01, maximumBucketCount: Int = 2048) {
+        precondition(relativeAccuracy > 0 && relativeAccuracy < 1, "relativeAccuracy must be in (0, 1)")
+        self.relativeAccuracy = relativeAccuracy
+        self.maximumBucketCount = max(1, maximumBucketCount)
+        self.gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy)
+        self.logGamma = log(gamma)
+    }
+
+    public var isEmpty: Bool { return count == 0 }
+
+    /// Add a value
+    public mutating func add(_ value: TimeInterval) {
+        add(value, occurrences: 1)
+    }
+
+    /// Add the values of another sketch
+    /// - Parameter other: A sketch with the same `relativeAccuracy`
+    public mutating func merge(_ other: LatencySketch) {
+        precondition(other.relativeAccuracy == relativeAccuracy, "Cannot merge sketches of different accuracy")
+        zeroCount += other.zeroCount
+        count += other.zeroCount
+        for (offset, binCount) in other.bins.enumerated() where binCount != 0 {
+            add(key: other.minimumKey + offset, occurrences: binCount)
+        }
+    }
+
+    /// The value at a quantile
+    /// - Parameter quantile: The quantile, from 0 (minimum) to 1 (maximum)
+    /// - Returns: The value, or nil if the sketch is empty
+    public func value(atQuantile quantile: Double) -> TimeInterval? {
+        guard count > 0 else { return nil }
+        let q = min(max(quantile, 0), 1)
+        let rank = UInt64(q * Double(count - 1))
+
+        if rank < zeroCount {
+            return 0
+        }
+        var seen = zeroCount
+        for (offset, binCount) in bins.enumerated() {
+            seen += binCount
+            if seen > rank {
+                return 2 * pow(gamma, Double(minimumKey + offset)) / (gamma + 1)
+            }
+        }
+        return 2 * pow(gamma, Double(minimumKey + bins.count - 1)) / (gamma + 1)
+    }
+
+    /// The values at several quantiles, in one pass over the buckets
+    /// - Parameter quantiles: The quantiles, from 0 (minimum) to 1 (maximum), in increasing order
+    /// - Returns: The value at each quantile, or nils if the sketch is empty
+    public func values(atQuantiles quantiles: [Double]) -> [TimeInterval?] {
+        guard count > 0 else { return quantiles.map { _ in nil } }
+        var values: [TimeInterval?] = []
+        values.reserveCapacity(quantiles.count)
+        var seen = zeroCount
+        var offset = -1
+        for quantile in quantiles {
+            let q = min(max(quantile, 0), 1)
+            let rank = UInt64(q * Double(count - 1))
+            if rank < zeroCount {
+                values.append(0)
+                continue
+            }
+            while seen <= rank && offset + 1 < bins.count {
+                offset += 1
+                seen += bins[offset]
+            }
+            values.append(2 * pow(gamma, Double(minimumKey + max(offset, 0))) / (gamma + 1))
+        }
+        return values
+    }
+
+    private mutating func add(_ value: TimeInterval, occurrences: UInt64) {
+        if value <= LatencySketch.minimumIndexableValue {
+            zeroCount += occurrences
+            count += occurrences
+        } else {
+            add(key: Int((log(value) / logGamma).rounded(.up)), occurrences: occurrences)
+        }
+    }
+
+    private mutating func add(key: Int, occurrences: UInt64) {
+        count += occurrences
+        if bins.isEmpty {
+            bins = [occurrences]
+            minimumKey = key
+            return
+        }
+
+        // Grow the dense bucket range to cover the key, collapsing the lowest buckets
+        // into one if that would exceed the bound.
+        var key = key
+        if key < minimumKey {
+            key = max(key, minimumKey + bins.count - maximumBucketCount)
+            if key < minimumKey {
+                bins.insert(contentsOf: repeatElement(0, count: minimumKey - key), at: 0)
+                minimumKey = key
+            }
+        } else if key >= minimumKey + bins.count {
+            let spanNeeded = key - minimumKey + 1
+            if spanNeeded > maximumBucketCount {
+                collapse(below: key - maximumBucketCount + 1)
+            }
+            bins.append(contentsOf: repeatElement(0, count: key - minimumKey - bins.count + 1))
+        }
+        bins[key - minimumKey] += occurrences
+    }
+
+    /// Fold every bucket below a key into that key's bucket
+    private mutating func collapse(below key: Int) {
+        let dropped = min(key - minimumKey, bins.count)
+        guard dropped > 0 else { return }
+        let folded = bins[0..<dropped].reduce(0, +)
+        bins.removeFirst(dropped)
+        minimumKey += dropped
+        if bins.isEmpty {
+            bins = [0]
+            minimumKey = key
+        }
+        bins[0] += folded
+    }
+}
+
+// MARK: - PingStatisticsAccumulator
+
+/// Maintains ping statistics incrementally
+///
+/// Each recorded reply costs O(1), however long the history:
+///
+/// - the minimum, maximum, mean and standard deviation of the history are kept with monotonic
+///   queues and Welford's algorithm, which also removes the latencies the history evicts;
+/// - jitter is the RFC 3550 interarrival jitter estimator applied to successive round trip
+///   times, and the smoothed latency is an EWMA with the TCP SRTT gain of 1/8;
+/// - percentiles come from a `LatencySketch` of every reply since the last reset.
+public struct PingStatisticsAccumulator: Sendable {
+    public private(set) var packetsSent: Int = 0
+    public private(set) var packetsReceived: Int = 0
+    public private(set) var history: LatencyHistory
+
+    private var sketch: LatencySketch
+    private var sampleIndex: Int = 0  // number of latencies ever recorded
+    private var mean: Double = 0
+    private var m2: Double = 0
+    private var minimumQueue: MonotonicQueue
+    private var maximumQueue: MonotonicQueue
+    private var jitter: Double?
+    private var smoothedLatency: Double?
+    private var previousLatency: Double?
+
+    /// Create an empty accumulator
+    /// - Parameters:
+    ///   - historyCapacity: Number of latencies kept in the history (default: 100)
+    ///   - relativeAccuracy: Relative error of the percentiles (default: 1%)
+    public init(historyCapacity: Int = 100, relativeAccuracy: Double = 0.01) {
+        self.history = LatencyHistory(capacity: historyCapacity)
+        self.sketch = LatencySketch(relativeAccuracy: relativeAccuracy)
+        self.minimumQueue = MonotonicQueue(capacity: history.capacity, keepsMinimum: true)
+        self.maximumQueue = MonotonicQueue(capacity: history.capacity, keepsMinimum: false)
+    }
+
+    /// The statistics so far
+    public var statistics: PingStatistics {
+        let windowCount = history.count
+        return PingStatistics(
+            sent: packetsSent,
+            received: packetsReceived,
+            history: history,
+            minLatency: minimumQueue.front,
+            maxLatency: maximumQueue.front,
+            averageLatency: windowCount > 0 ? mean : nil,
+            standardDeviation: windowCount > 0
+                ? (windowCount > 1 ? sqrt(max(0, m2) / Double(windowCount - 1)) : 0) : nil,
+            jitter: jitter,
+            smoothedLatency: smoothedLatency,
+            latencySketch: sketch
+        )
+    }
+
+    /// Quantile sketch of every latency since the last reset
+    public var latencySketch: LatencySketch {
+        return sketch
+    }
+
+    /// Count sent packets
+    public mutating func recordSent(count: Int = 1) {
+        packetsSent += count
+    }
+
+    /// Record the latency of a reply
+    public mutating func recordLatency(_ latency: TimeInterval) {
+        packetsReceived += 1
+
+        // Windowed Welford: take the evicted latency out before putting the new one in
+        if let evicted = history.evictionCandidate {
+            let remaining = history.count - 1
+            if remaining == 0 {
+                mean = 0
+                m2 = 0
+            } else {
+                let delta = evicted - mean
+                mean -= delta / Double(remaining)
+                m2 -= delta * (evicted - mean)
+            }
+        }
+        history.append(latency)
+        let delta = latency - mean
+        mean += delta / Double(history.count)
+        m2 += delta * (latency - mean)
+
+        let firstLiveIndex = sampleIndex + 1 - history.count
+        minimumQueue.push(latency, index: sampleIndex, firstLiveIndex: firstLiveIndex)
+        maximumQueue.push(latency, index: sampleIndex, firstLiveIndex: firstLiveIndex)
+        sampleIndex += 1
+
+        // RFC 3550 section 6.4.1: J += (|D| - J) / 16
+        if let previous = previousLatency {
+            let difference = abs(latency - previous)
+            jitter = (jitter ?? 0) + (difference - (jitter ?? 0)) / 16
+        }
+        previousLatency = latency
+        smoothedLatency = smoothedLatency.map { $0 + (latency - $0) / 8 } ?? latency
+
+        sketch.add(latency)
+    }
+
+    /// Change the history capacity, keeping the most recent latencies
+    ///
+    /// This rebuilds the windowed statistics from the kept latencies, so it's O(n).
+    public mutating func setHistoryCapacity(_ capacity: Int) {
+        let kept = history.suffix(max(1, capacity))
+        history = LatencyHistory(capacity: capacity)
+        minimumQueue = MonotonicQueue(capacity: history.capacity, keepsMinimum: true)
+        maximumQueue = MonotonicQueue(capacity: history.capacity, keepsMinimum: false)
+        mean = 0
+        m2 = 0
+        sampleIndex = 0
+        for latency in kept {
+            history.append(latency)
+            let delta = latency - mean
+            mean += delta / Double(history.count)
+            m2 += delta * (latency - mean)
+            minimumQueue.push(latency, index: sampleIndex, firstLiveIndex: 0)
+            maximumQueue.push(latency, index: sampleIndex, firstLiveIndex: 0)
+            sampleIndex += 1
+        }
+    }
+
+    /// Forget everything, keeping the history capacity
+    public mutating func reset() {
+        self = PingStatisticsAccumulator(
+            historyCapacity: history.capacity, relativeAccuracy: sketch.relativeAccuracy)
+    }
+}
+
+// MARK: - Session Replay
+
+extension PingStatisticsAccumulator {
+
+    /// Counts a recorded ping: a reply as sent and received with its round trip time, a loss
+    /// as sent only
+    ///
+    /// A reply whose send time wasn't known has no round trip time, so is counted as received
+    /// without a latency.
+    fileprivate mutating func record(_ sessionRecord: SimplePingSessionRecord) {
+        if sessionRecord.flags & UInt8(SimplePingSessionRecordFlagValid) != 0 {
+            recordSent()
+            if sessionRecord.roundTripNanoseconds != 0 {
+                recordLatency(TimeInterval(sessionRecord.roundTripNanoseconds) / 1e9)
+            } else {
+                packetsReceived += 1
+            }
+        } else if sessionRecord.flags & UInt8(SimplePingSessionRecordFlagTimeout) != 0 {
+            recordSent()
+        }
+    }
+
+    /// Rebuilds the statistics of pings recorded by a `SimplePingSessionRecorder`
+    /// - Parameters:
+    ///   - path: The recording
+    ///   - targetIdentifier: The `sessionTargetIdentifier` of the pinger to count, or nil to
+    ///     count every pinger in the recording together
+    ///   - historyCapacity: Number of latencies kept in the history
+    /// - Throws: An `NSPOSIXErrorDomain` error if the file can't be read, `EFTYPE` if it isn't
+    ///   a recording
+    public static func replaying(
+        sessionAt path: String, targetIdentifier: UInt32? = nil, historyCapacity: Int = 100
+    ) throws -> PingStatisticsAccumulator {
+        var reader: OpaquePointer?
+        let err = SimplePingSessionReaderOpen(path, &reader)
+        guard err == 0, let reader = reader else {
+            throw NSError(
+                domain: NSPOSIXErrorDomain, code: Int(err),
+                userInfo: [NSFilePathErrorKey: path])
+        }
+        defer { SimplePingSessionReaderClose(reader) }
+
+        var accumulator = PingStatisticsAccumulator(historyCapacity: historyCapacity)
+        var probes = SessionReplayProbes()
+        for index in 0..<SimplePingSessionReaderRecordCount(reader) {
+            let record = SimplePingSessionReaderRecordAtIndex(reader, index).pointee
+            guard record.kind == UInt8(SimplePingSessionRecordKindPing) else { continue }
+            guard targetIdentifier == nil || record.targetIdentifier == targetIdentifier else {
+                continue
+            }
+            let counted =
+                UInt8(SimplePingSessionRecordFlagValid) | UInt8(SimplePingSessionRecordFlagTimeout)
+            if record.flags & counted != 0 && probes.insert(record) {
+                accumulator.record(record)
+            }
+        }
+        return accumulator
+    }
+}
+
+/// The pings a replay has already counted
+///
+/// A ping can be recorded more than once: a timeout followed by the late reply, which
+/// `SimplePing` still accepts while its sequence number is inside `sequenceWindow`, or a
+/// reply followed by its duplicates. Live, only the first of these is counted, so the replay
+/// does the same. Sequence numbers wrap, so a ping only matches one counted within the
+/// last half of the sequence space, the most `sequenceWindow` can be.
+private struct SessionReplayProbes {
+    private struct Pinger: Hashable {
+        let targetIdentifier: UInt32
+        let identifier: UInt16
+    }
+
+    private var countedPings: [Pinger: Int] = [:]
+    private var countedAt: [Pinger: [UInt16: Int]] = [:]
+
+    /// Notes a recorded ping
+    /// - Returns: true if the ping hadn't been counted yet
+    mutating func insert(_ sessionRecord: SimplePingSessionRecord) -> Bool {
+        let pinger = Pinger(
+            targetIdentifier: sessionRecord.targetIdentifier,
+            identifier: sessionRecord.identifier)
+        let ordinal = countedPings[pinger, default: 0]
+        if let previous = countedAt[pinger]?[sessionRecord.sequenceNumber],
+            ordinal - previous < 32768
+        {
+            return false
+        }
+        countedAt[pinger, default: [:]][sessionRecord.sequenceNumber] = ordinal
+        countedPings[pinger] = ordinal + 1
+        return true
+    }
+}
+
+// MARK: - MonotonicQueue
+
+/// The minimum (or maximum) of a sliding window in amortised O(1)
+///
+/// Holds, in a fixed ring, the window's values that could still become the extremum: each
+/// push drops the values it dominates from the back, and values that have left the window
+/// are dropped from the front.
+private struct MonotonicQueue: Sendable {
+    private var values: [Double]
+    private var indices: [Int]
+    private var head: Int = 0
+    private var count: Int = 0
+    private let keepsMinimum: Bool
+
+    init(capacity: Int, keepsMinimum: Bool) {
+        self.values = [Double](repeating: 0, count: capacity)
+        self.indices = [Int](repeating: 0, count: capacity)
+        self.keepsMinimum = keepsMinimum
+    }
+
+    var front: Double? {
+        return count > 0 ? values[head] : nil
+    }
+
+    mutating func push(_ value: Double, index: Int, firstLiveIndex: Int) {
+        let capacity = values.count
+        while count > 0 && indices[head] < firstLiveIndex {
+            head = head + 1 == capacity ? 0 : head + 1
+            count -= 1
+        }
+        while count > 0 {
+            let back = (head + count - 1) % capacity
+            let dominated = keepsMinimum ? values[back] >= value : values[back] <= value
+            guard dominated else { break }
+            count -= 1
+        }
+        let slot = (head + count) % capacity
+        values[slot] = value
+        indices[slot] = index
+        count += 1
+    }
+}
@@ -0,0 +1,37 @@
+/*
+    Abstract:
+    Logging for the Swift wrappers, through the SimplePing logging layer.
+ */
+
+import Foundation
+import SimplePing
+import os.log
+
+extension SimplePingLogLevel {
+    /// The unified log type messages at this level are logged as
+    var osLogType: OSLogType {
+        switch self {
+        case .error:
+            return .error
+        case .debug:
+            return .debug
+        default:
+            return .default
+        }
+    }
+}
+
+/// Logs a message through the SimplePing logging layer
+///
+/// The message is only built if `level` is enabled, so formatting costs nothing for messages
+/// that aren't logged; see `SimplePingLogSetLevel`.
+/// - Parameters:
+///   - level: The message's level
+///   - category: What the message is about
+///   - message: Builds the message
+func simplePingLog(
+    _ level: SimplePingLogLevel, _ category: SimplePingLogCategory, _ message: () -> String
+) {
+    guard SimplePingLogLevelEnabled(level) else { return }
+    os_log("%{public}@", log: SimplePingLogHandle(category), type: level.osLogType, message() as NSString)
+}
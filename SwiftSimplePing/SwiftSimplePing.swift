@@ -7,32 +7,113 @@ import Foundation
 @_exported import SimplePing
 
 /// Statistics for ping operations
+///
+/// `minLatency`, `maxLatency`, `averageLatency` and `standardDeviation` describe the most recent
+/// latencies. `jitter`, `smoothedLatency` and the percentiles cover every reply since the
+/// statistics were reset.
+///
+/// The statistics are computed when the snapshot is taken. The deprecated `latencies`, `history`
+/// and `latencySketch` share the pinger's storage, so a snapshot kept past the next reply makes
+/// that reply copy them; read `SwiftSimplePing.latencies` and `SwiftSimplePing.latencySketch`
+/// when they're needed instead.
 public struct PingStatistics: Sendable {
     public let packetsSent: Int
     public let packetsReceived: Int
     public let packetsLost: Int
+    /// Percentage of sent packets that got no reply, 0 to 100
     public let lossPercentage: Double
     public let minLatency: TimeInterval?
     public let maxLatency: TimeInterval?
     public let averageLatency: TimeInterval?
-    public let latencies: [TimeInterval]
+    /// Sample standard deviation of the most recent latencies
+    public let standardDeviation: TimeInterval?
+    /// RFC 3550 interarrival jitter of successive round trip times
+    public let jitter: TimeInterval?
+    /// Exponentially weighted moving average of the latency, with a gain of 1/8
+    public let smoothedLatency: TimeInterval?
+    /// Median latency, within the sketch's relative accuracy
+    public let medianLatency: TimeInterval?
+    /// 95th percentile latency, within the sketch's relative accuracy
+    public let p95Latency: TimeInterval?
+    /// 99th percentile latency, within the sketch's relative accuracy
+    public let p99Latency: TimeInterval?
+
+    private let sharedHistory: LatencyHistory
+    private let sharedSketch: LatencySketch
+
+    /// The most recent latencies, oldest first, sharing the pinger's ring
+    @available(*, deprecated, message: "Use SwiftSimplePing.latencies")
+    public var history: LatencyHistory {
+        return sharedHistory
+    }
+
+    /// The most recent latencies, oldest first
+    ///
+    /// This copies the history into an array each time it's read.
+    @available(*, deprecated, message: "Use SwiftSimplePing.latencies")
+    public var latencies: [TimeInterval] {
+        return Array(sharedHistory)
+    }
+
+    /// Quantile sketch of every latency, mergeable with other pingers' sketches
+    @available(*, deprecated, message: "Use SwiftSimplePing.latencySketch")
+    public var latencySketch: LatencySketch {
+        return sharedSketch
+    }
+
+    /// The latency at a quantile, from 0 (minimum) to 1 (maximum)
+    @available(*, deprecated, message: "Use SwiftSimplePing.latencySketch")
+    public func latency(atQuantile quantile: Double) -> TimeInterval? {
+        return sharedSketch.value(atQuantile: quantile)
+    }
 
     public init(sent: Int, received: Int, latencies: [TimeInterval]) {
+        var accumulator = PingStatisticsAccumulator(historyCapacity: max(1, latencies.count))
+        for latency in latencies {
+            accumulator.recordLatency(latency)
+        }
+        self.init(accumulator.statistics, sent: sent, received: received)
+    }
+
+    init(
+        sent: Int, received: Int, history: LatencyHistory, minLatency: TimeInterval?,
+        maxLatency: TimeInterval?, averageLatency: TimeInterval?, standardDeviation: TimeInterval?,
+        jitter: TimeInterval?, smoothedLatency: TimeInterval?, latencySketch: LatencySketch
+    ) {
+        let percentiles = latencySketch.values(atQuantiles: [0.5, 0.95, 0.99])
         self.packetsSent = sent
         self.packetsReceived = received
         self.packetsLost = sent - received
         self.lossPercentage = sent > 0 ? Double(packetsLost) / Double(sent) * 100.0 : 0.0
-        self.latencies = latencies
+        self.minLatency = minLatency
+        self.maxLatency = maxLatency
+        self.averageLatency = averageLatency
+        self.standardDeviation = standardDeviation
+        self.jitter = jitter
+        self.smoothedLatency = smoothedLatency
+        self.medianLatency = percentiles[0]
+        self.p95Latency = percentiles[1]
+        self.p99Latency = percentiles[2]
+        self.sharedHistory = history
+        self.sharedSketch = latencySketch
+    }
 
-        if !latencies.isEmpty {
-            self.minLatency = latencies.min()
-            self.maxLatency = latencies.max()
-            self.averageLatency = latencies.reduce(0, +) / Double(latencies.count)
-        } else {
-            self.minLatency = nil
-            self.maxLatency = nil
-            self.averageLatency = nil
-        }
+    private init(_ statistics: PingStatistics, sent: Int, received: Int) {
+        self.packetsSent = sent
+        self.packetsReceived = received
+        self.packetsLost = sent - received
+        self.lossPercentage = sent > 0 ? Double(packetsLost) / Double(sent) * 100.0 : 0.0
+        self.minLatency = statistics.minLatency
+        self.maxLatency = statistics.maxLatency
+        self.averageLatency = statistics.averageLatency
+        self.standardDeviation = statistics.standardDeviation
+        self.jitter = statistics.jitter
+        self.smoothedLatency = statistics.smoothedLatency
+        self.medianLatency = statistics.medianLatency
+        self.p95Latency = statistics.p95Latency
+        self.p99Latency = statistics.p99Latency
+        self.sharedHistory = statistics.sharedHistory
+        self.sharedSketch = statistics.sharedSketch
     }
 }
 
@@ -42,10 +123,62 @@ public struct PingResult: Sendable {
     public let latency: TimeInterval?
     public let error: Error?
     public let packetSize: Int
+    /// Round trip time in nanoseconds, from the monotonic send stamp to the kernel receive stamp
+    public let rttNanoseconds: UInt64?
+    /// Time the response waited between the kernel receiving it and us reading it, in nanoseconds
+    public let deliveryDelayNanoseconds: UInt64?
 
     public var isSuccess: Bool {
         return error == nil && latency != nil
     }
+
+    public init(
+        sequenceNumber: UInt16,
+        latency: TimeInterval?,
+        error: Error?,
+        packetSize: Int,
+        rttNanoseconds: UInt64? = nil,
+        deliveryDelayNanoseconds: UInt64? = nil
+    ) {
+        self.sequenceNumber = sequenceNumber
+        self.latency = latency
+        self.error = error
+        self.packetSize = packetSize
+        self.rttNanoseconds = rttNanoseconds
+        self.deliveryDelayNanoseconds = deliveryDelayNanoseconds
+    }
+}
+
+/// Summary of a flood ping run, see `SwiftSimplePing.flood(rate:count:duration:linger:completion:)`
+public struct FloodPingSummary: Sendable {
+    /// The rate asked for, in packets per second
+    public let requestedRate: Double
+    public let packetsSent: Int
+    public let packetsReceived: Int
+    /// Sends skipped because the sender fell more than a batch behind its schedule
+    public let missedSendDeadlines: Int
+    /// Seconds from the first send to the last
+    public let sendDuration: TimeInterval
+    /// Seconds from the first send to the last reply
+    public let receiveDuration: TimeInterval
+    /// Latency statistics of the run
+    public let statistics: PingStatistics
+
+    /// Achieved send rate, in packets per second
+    public var sendRate: Double {
+        return sendDuration > 0 ? Double(packetsSent) / sendDuration : 0
+    }
+
+    /// Achieved receive rate, in packets per second
+    public var receiveRate: Double {
+        return receiveDuration > 0 ? Double(packetsReceived) / receiveDuration : 0
+    }
+
+    /// Percentage of sent packets that got no reply
+    public var lossPercentage: Double {
+        return packetsSent > 0
+            ? Double(packetsSent - packetsReceived) / Double(packetsSent) * 100.0 : 0.0
+    }
 }
 
 /// Delegate protocol for SwiftSimplePing
@@ -67,7 +200,14 @@ public protocol SwiftSimplePingDelegate: AnyObject {
 }
 
 /// Swift wrapper around SimplePing with convenience methods and statistics
-public class SwiftSimplePing: NSObject {
+///
+/// An instance runs either on the run loop of the thread that creates it, which must also be
+/// the thread that starts it, or, if created with a `queue`, entirely on that serial queue with
+/// no run loop involved. All methods must be called on that thread or queue, apart from the
+/// `async` methods and `pingResults(interval:)`, which may be called from anywhere and hop
+/// there themselves. Without a queue, that thread's run loop must be running for them to get
+/// anywhere; command line tools and tests that don't run one should pass a `queue`.
+public class SwiftSimplePing: NSObject, @unchecked Sendable {
 
     // MARK: - Public Properties
 
@@ -81,14 +221,94 @@ public class SwiftSimplePing: NSObject {
     }
 
     /// The delegate for callbacks
+    ///
+    /// With a `callbackQueue` it's read there, so set it before starting.
     public weak var delegate: SwiftSimplePingDelegate?
 
+    /// The serial queue delegate callbacks are made on, or nil to make them on the pinger's own
+    /// queue or thread
+    ///
+    /// With a callback queue, or a `maximumCallbackRate`, callbacks are coalesced: results wait
+    /// in a lock-free ring and are delivered together, in order, at most `maximumCallbackRate`
+    /// times a second, followed by one `didUpdateStatistics` per batch instead of one per
+    /// reply. Start, stop and failure callbacks close the batch at once. Single ping
+    /// completions and `pingResults(interval:)` aren't affected. Set it before starting.
+    public var callbackQueue: DispatchQueue?
+
+    /// Most batches of delegate callbacks a second, such as 60 for a UI, or 0 for no limit
+    ///
+    /// Anything but 0 coalesces callbacks, as `callbackQueue` describes, even without a callback
+    /// queue. Set it before starting.
+    public var maximumCallbackRate: Double = 0
+
+    /// How long a continuous or flood ping waits for its reply, in seconds
+    ///
+    /// A continuous ping that isn't answered in time is reported lost, as a `PingResult` whose
+    /// error is `SwiftSimplePingError.timeout`; a flood ping is just forgotten. Either way a
+    /// lossy path leaves nothing behind. Timeouts are kept on a `SimplePingTimeoutWheel`, the
+    /// engine's if there is one, so they cost no timer per ping. Set it to 0 to wait until
+    /// `stop()`. Single pings use the timeout they were sent with instead.
+    public var replyTimeout: TimeInterval = 5.0
+
+    /// Whether other processes' pings, and other ICMP traffic that can't be about ours, are
+    /// dropped rather than reported
+    ///
+    /// Every ICMP socket sees every ICMP message, so without this a busy host produces a stream
+    /// of results carrying `UnexpectedICMPPacketError`. Errors about our own pings are still
+    /// reported. See `SimplePing.ignoresForeignPackets`; set it before starting.
+    public var ignoresForeignPackets = true
+
+    /// Whether the pinger's socket is connected to the host, so the kernel drops everyone else's
+    /// replies
+    ///
+    /// It then also drops ICMP errors from routers along the way. Has no effect with an engine.
+    /// See `SimplePing.usesConnectedSocket`; set it before starting.
+    public var usesConnectedSocket = false
+
+    /// Where to record every reply, and every ping lost, or nil not to
+    ///
+    /// Replies are recorded by the `SimplePing`, with their raw bytes; losses, which only the
+    /// reply timeout knows about, are recorded here. Flood pings' losses aren't recorded. See
+    /// `SimplePing.sessionRecorder`; set it before starting.
+    public var sessionRecorder: SimplePingSessionRecorder?
+
+    /// The `targetIdentifier` of the pinger's records, to tell targets apart in a shared recording
+    public var sessionTargetIdentifier: UInt32 = 0
+
     /// Current statistics
-    public private(set) var statistics: PingStatistics
+    public var statistics: PingStatistics {
+        return accumulator.statistics
+    }
+
+    /// The most recent latencies, oldest first
+    ///
+    /// This copies the history into an array each time it's read. Like `statistics`, read it on
+    /// the pinger's own queue or thread.
+    public var latencies: [TimeInterval] {
+        return Array(accumulator.history)
+    }
+
+    /// Quantile sketch of every latency since the statistics were reset, mergeable with other
+    /// pingers' sketches
+    ///
+    /// The sketch shares its storage with the pinger's until the next reply, which then copies it
+    /// once.
+    public var latencySketch: LatencySketch {
+        return accumulator.latencySketch
+    }
+
+    /// Packet counters and callback latencies of the running `SimplePing`, or nil when stopped
+    ///
+    /// Unlike `statistics` these count everything the socket did, including packets that weren't
+    /// ours and sends that failed. See `SimplePing.metrics`, and
+    /// `SimplePingMetricsSnapshot.processSnapshot()` for the totals of every pinger and traceroute.
+    public var metrics: SimplePingMetricsSnapshot? {
+        return simplePing?.metrics
+    }
 
     /// Whether the pinger is currently running
     public var isRunning: Bool {
-        return simplePing != nil && sendTimer != nil
+        return simplePing != nil && (sendScheduler != nil || floodRun != nil)
     }
 
     /// The address being pinged (available after start)
@@ -96,27 +316,60 @@ public class SwiftSimplePing: NSObject {
         return simplePing?.hostAddress
     }
 
+    /// The engine whose shared ICMP sockets this pinger uses, if any
+    public let engine: SimplePingEngine?
+
+    /// The serial queue the pinger runs on, or nil to use the run loop of the thread that creates it
+    public let queue: DispatchQueue?
+
     // MARK: - Private Properties
 
+    private let initialHostAddress: Data?
+    // The run loop of the thread that created the pinger, used without a queue
+    private let runLoop: CFRunLoop = CFRunLoopGetCurrent()
     private var simplePing: SimplePing?
-    private var sendTimer: Timer?
+    private var sendScheduler: SimplePingSendScheduler?
     private var pingInterval: TimeInterval = 1.0
-    private var pendingPings: [UInt16: Date] = [:]
-    private var packetsSent: Int = 0
-    private var packetsReceived: Int = 0
-    private var latencies: [TimeInterval] = []
-    private var maxLatencyHistory: Int = 100
+    private var isContinuous = false
+    private var pendingPings: [UInt16: PendingPing] = [:]
+    private var accumulator = PingStatisticsAccumulator(historyCapacity: 100)
+
+    // Single ping support; any number may be in flight, matched by sequence number
+    private var singlePingsAwaitingStart: [SinglePingRequest] = []
+    private var singlePingsInFlight: [UInt16: SinglePingRequest] = [:]
+    // Every single ping with a timeout scheduled, waiting or in flight, for timeoutsExpired
+    private var singlePingsByID: [UInt64: SinglePingRequest] = [:]
+
+    // Continuous stream support; closures over the stream's continuation, whose type needs a
+    // newer OS than the package supports
+    private var resultStreamYield: ((PingResult) -> Void)?
+    private var resultStreamFinish: ((Error?) -> Void)?
 
-    // Single ping support
-    private var singlePingCompletion: ((PingResult) -> Void)?
-    private var singlePingTimeoutTimer: Timer?
-    private var lastSinglePingSequenceNumber: UInt16?
+    // Coalesced delegate callbacks, see callbackQueue; created on first use
+    private var callbackDelivery: CoalescedCallbackDelivery<DelegateCallback>?
+    private var statisticsChanged = false
+
+    // Flood ping support, see flood(rate:count:duration:linger:completion:)
+    private var floodRun: FloodRun?
+
+    // Timeouts of pending pings and single pings, see addTimeout(key:interval:)
+    private var timeoutWheel: SimplePingTimeoutWheel?
+    private var timeoutWheelClient = 0
+    private var nextSinglePingID: UInt64 = 0
+
+    /// Timeout keys at or above this are single ping IDs, below it sequence numbers
+    private static let singlePingTimeoutKeyBase: UInt64 = 1 << 32
 
     // Errors
     public enum SwiftSimplePingError: Error {
         case continuousPingRunning
+        /// A flood was asked for with a rate that isn't positive
+        case invalidRate
+        @available(*, deprecated, message: "Single pings may now overlap; this is no longer returned")
         case singlePingAlreadyInProgress
         case timeout
+        /// The pinger was stopped before the ping completed
+        case stopped
     }
 
     // Internal error wrapper for unexpected packets
@@ -124,29 +377,219 @@ public class SwiftSimplePing: NSObject {
         let description: String
     }
 
+    /// A delegate callback waiting in `callbackDelivery`
+    private enum DelegateCallback {
+        case start(Data)
+        case result(PingResult)
+        case statistics(PingStatistics)
+        case stop
+        case failure(Error)
+    }
+
+    /// A sent ping that hasn't been answered
+    private struct PendingPing {
+        /// Monotonic send time in nanoseconds
+        var sendTime: UInt64
+        /// The ping's reply timeout, or 0 if it has none
+        var timeout: SimplePingTimeoutToken
+    }
+
+    /// A single ping waiting for its reply
+    ///
+    /// Only ever touched on the pinger's queue or thread, which is what makes passing it through
+    /// the async API's `@Sendable` closures safe.
+    private final class SinglePingRequest: @unchecked Sendable {
+        var completion: ((PingResult) -> Void)?
+        var sequenceNumber: UInt16?
+        var id: UInt64 = 0
+        var timeoutToken: SimplePingTimeoutToken = 0
+        var isCancelled = false
+
+        init(completion: ((PingResult) -> Void)? = nil) {
+            self.completion = completion
+        }
+    }
+
+    /// State of a flood ping run; only touched on the pinger's queue or thread
+    private final class FloodRun: @unchecked Sendable {
+        let rate: Double
+        let count: Int?
+        let duration: TimeInterval?
+        let linger: TimeInterval
+        var completion: ((Result<FloodPingSummary, Error>) -> Void)?
+        var scheduler: SimplePingSendScheduler?
+        var lingerTimer: SimplePingTimerSource?
+        var startTime: UInt64 = 0
+        var sendEndTime: UInt64 = 0
+        var lastReceiveTime: UInt64 = 0
+        var packetsSent = 0
+        var packetsReceived = 0
+        var missedSendDeadlines = 0
+        var isSending: Bool { return scheduler != nil }
+
+        init(
+            rate: Double, count: Int?, duration: TimeInterval?, linger: TimeInterval,
+            completion: @escaping (Result<FloodPingSummary, Error>) -> Void
+        ) {
+            self.rate = rate
+            self.count = count
+            self.duration = duration
+            self.linger = linger
+            self.completion = completion
+        }
+    }
+
     // MARK: - Initialization
 
     /// Initialize with hostname
     /// - Parameter hostName: The hostname or IP address to ping
-    public init(hostName: String) {
+    public convenience init(hostName: String) {
+        self.init(hostName: hostName, engine: nil, queue: nil)
+    }
+
+    /// Initialize with hostname and a shared ping engine
+    /// - Parameters:
+    ///   - hostName: The hostname or IP address to ping
+    ///   - engine: An engine to share ICMP sockets with other pingers, or nil for a private socket
+    public convenience init(hostName: String, engine: SimplePingEngine?) {
+        self.init(hostName: hostName, engine: engine, queue: nil)
+    }
+
+    /// Initialize with hostname and a serial queue to run on
+    /// - Parameters:
+    ///   - hostName: The hostname or IP address to ping
+    ///   - queue: The serial queue for sockets, timers and delegate callbacks
+    public convenience init(hostName: String, queue: DispatchQueue) {
+        self.init(hostName: hostName, engine: nil, queue: queue)
+    }
+
+    /// Initialize with hostname, a shared ping engine and a serial queue to run on
+    /// - Parameters:
+    ///   - hostName: The hostname or IP address to ping
+    ///   - engine: An engine to share ICMP sockets with other pingers, or nil for a private socket
+    ///   - queue: The serial queue for sockets, timers and delegate callbacks, or nil to use the
+    ///     run loop. With an engine this must be the engine's `dispatchQueue`; if nil, the
+    ///     engine's `dispatchQueue` is used.
+    public init(hostName: String, engine: SimplePingEngine?, queue: DispatchQueue?) {
         self.hostName = hostName
-        self.statistics = PingStatistics(sent: 0, received: 0, latencies: [])
+        self.initialHostAddress = nil
+        self.engine = engine
+        self.queue = queue ?? engine?.dispatchQueue
+        super.init()
+    }
+
+    /// Initialize with an address that has already been resolved
+    ///
+    /// Starting, and every restart after `stop()`, then skips name resolution entirely;
+    /// `hostName` is the address in numeric form and `addressStyle` is not consulted.
+    /// - Parameters:
+    ///   - hostAddress: A `(struct sockaddr)` of some form, such as another pinger's `hostAddress`
+    ///   - engine: An engine to share ICMP sockets with other pingers, or nil for a private socket
+    ///   - queue: The serial queue to run on, or nil to use the run loop; see
+    ///     `init(hostName:engine:queue:)`
+    public init(hostAddress: Data, engine: SimplePingEngine? = nil, queue: DispatchQueue? = nil) {
+        self.hostName = Self.displayAddressForAddress(address: hostAddress as NSData)
+        self.initialHostAddress = hostAddress
+        self.engine = engine
+        self.queue = queue ?? engine?.dispatchQueue
         super.init()
     }
 
+    deinit {
+        timeoutWheel?.removeClient(timeoutWheelClient)
+    }
+
     // MARK: - Public Methods
 
     /// Start continuous ping with specified interval
     /// - Parameter interval: Time interval between pings (default: 1.0 second)
     public func ping(interval: TimeInterval = 1.0) {
-        guard !isRunning else {
-            NSLog("SwiftSimplePing: Already running")
+        guard !isContinuous, floodRun == nil else {
+            simplePingLog(.info, .ping) {
+                "Already running"
+            }
             return
         }
 
         self.pingInterval = interval
+        self.isContinuous = true
+        resetStatistics()
+        if simplePing == nil {
+            startPing()
+        } else if simplePing?.hostAddress != nil {
+            // Already started for single pings
+            startContinuousPing()
+        }
+    }
+
+    /// Ping as fast as asked, like `ping -f`, to measure capacity
+    ///
+    /// Pings go out on a fixed schedule of deadlines at `rate` per second, batched so that the
+    /// pinger wakes at most once a millisecond, until `count` have been sent or `duration` has
+    /// passed, whichever comes first. After the last send the pinger waits up to `linger`
+    /// seconds for the remaining replies, then stops and completes with the achieved send
+    /// rate, receive rate and loss. Replies aren't passed to the delegate one by one, but
+    /// `statistics` is kept up to date. Calling `stop()` ends the run early and completes it
+    /// with what was measured so far.
+    ///
+    /// The sequence window of the underlying `SimplePing` is scaled to the rate, so that
+    /// replies stay recognisable once sequence numbers have wrapped.
+    /// - Parameters:
+    ///   - rate: Packets per second; must be positive
+    ///   - count: Number of pings to send, or nil for no limit
+    ///   - duration: Seconds to send for, or nil for no limit; with neither limit the run
+    ///     continues until `stop()`
+    ///   - linger: Seconds to wait for replies after the last send
+    ///   - completion: Called once with the summary, or with the error that stopped the pinger
+    public func flood(
+        rate: Double, count: Int? = nil, duration: TimeInterval? = nil, linger: TimeInterval = 1.0,
+        completion: @escaping (Result<FloodPingSummary, Error>) -> Void
+    ) {
+        guard rate > 0 else {
+            completion(.failure(SwiftSimplePingError.invalidRate))
+            return
+        }
+        guard !isContinuous, floodRun == nil else {
+            completion(.failure(SwiftSimplePingError.continuousPingRunning))
+            return
+        }
+
+        floodRun = FloodRun(
+            rate: rate, count: count, duration: duration, linger: linger, completion: completion)
         resetStatistics()
-        startPing()
+        if simplePing == nil {
+            startPing()
+        } else if simplePing?.hostAddress != nil {
+            startFlood()
+        }
+    }
+
+    /// Ping as fast as asked and wait for the summary
+    ///
+    /// See `flood(rate:count:duration:linger:completion:)`. Cancelling the task stops the run
+    /// and returns what was measured so far.
+    @available(macOS 10.15, iOS 13.0, tvOS 13.0, watchOS 6.0, *)
+    public func flood(
+        rate: Double, count: Int? = nil, duration: TimeInterval? = nil, linger: TimeInterval = 1.0
+    ) async throws -> FloodPingSummary {
+        return try await withTaskCancellationHandler {
+            try await withCheckedThrowingContinuation {
+                (continuation: CheckedContinuation<FloodPingSummary, Error>) in
+                self.perform {
+                    self.flood(
+                        rate: rate, count: count, duration: duration, linger: linger
+                    ) { result in
+                        continuation.resume(with: result)
+                    }
+                }
+            }
+        } onCancel: {
+            self.perform {
+                if self.floodRun != nil {
+                    self.stop()
+                }
+            }
+        }
     }
 
     /// Send a single ping
@@ -156,108 +599,431 @@ public class SwiftSimplePing: NSObject {
     }
 
     /// Send a single ping with timeout and completion handler
+    ///
+    /// Any number of single pings may be outstanding at once, alongside continuous pinging; each
+    /// reply is matched to its ping by sequence number.
     /// - Parameters:
     ///   - timeout: Timeout in seconds (default 5 seconds)
     ///   - completion: Called with the `PingResult` (success or error/timeout)
     public func pingOnce(timeout: TimeInterval = 5.0, completion: @escaping (PingResult) -> Void) {
-        // Cannot start a single ping while continuous mode running
-        if sendTimer != nil {  // indicates continuous mode
-            completion(
-                PingResult(
-                    sequenceNumber: 0, latency: nil,
-                    error: SwiftSimplePingError.continuousPingRunning, packetSize: 0))
-            NSLog("SwiftSimplePing: Cannot perform single ping while continuous ping is running")
-            return
-        }
-        // Avoid overlapping single pings
-        if singlePingCompletion != nil {
-            completion(
-                PingResult(
-                    sequenceNumber: 0, latency: nil,
-                    error: SwiftSimplePingError.singlePingAlreadyInProgress, packetSize: 0))
-            NSLog("SwiftSimplePing: Single ping already in progress")
-            return
-        }
-
-        singlePingCompletion = completion
-        pingInterval = 0  // prevent timer creation in didStart
+        startSinglePing(SinglePingRequest(completion: completion), timeout: timeout)
+    }
 
-        if simplePing == nil {
-            startPing(continuous: false)
-        } else {
-            sendSinglePing()
+    /// Send a single ping and wait for its result
+    ///
+    /// Cancelling the task abandons the ping and throws `CancellationError`.
+    /// - Parameter timeout: Timeout in seconds, or 0 for none
+    /// - Returns: The successful result
+    /// - Throws: `SwiftSimplePingError.timeout`, a send error, or the error that stopped the pinger
+    @available(macOS 10.15, iOS 13.0, tvOS 13.0, watchOS 6.0, *)
+    public func ping(timeout: TimeInterval) async throws -> PingResult {
+        let request = SinglePingRequest()
+        return try await withTaskCancellationHandler {
+            try await withCheckedThrowingContinuation {
+                (continuation: CheckedContinuation<PingResult, Error>) in
+                self.perform {
+                    request.completion = { result in
+                        if let error = result.error {
+                            continuation.resume(throwing: error)
+                        } else {
+                            continuation.resume(returning: result)
+                        }
+                    }
+                    self.startSinglePing(request, timeout: timeout)
+                }
+            }
+        } onCancel: {
+            self.perform {
+                self.cancelSinglePing(request)
+            }
         }
+    }
 
-        // Setup timeout
-        if timeout > 0 {
-            singlePingTimeoutTimer = Timer.scheduledTimer(
-                timeInterval: timeout, target: self, selector: #selector(handleSinglePingTimeout),
-                userInfo: nil, repeats: false)
+    /// Ping continuously, delivering each result through an async sequence
+    ///
+    /// The stream finishes when the pinger stops, throws if it fails, and stops the pinger when
+    /// the consumer stops iterating.
+    /// - Parameter interval: Time interval between pings (default: 1.0 second)
+    /// - Returns: A stream of every result, successful or not
+    @available(macOS 10.15, iOS 13.0, tvOS 13.0, watchOS 6.0, *)
+    public func pingResults(interval: TimeInterval = 1.0) -> AsyncThrowingStream<PingResult, Error> {
+        return AsyncThrowingStream { continuation in
+            continuation.onTermination = { [weak self] termination in
+                guard let self = self, case .cancelled = termination else { return }
+                self.perform {
+                    self.resultStreamYield = nil
+                    self.resultStreamFinish = nil
+                    self.stop()
+                }
+            }
+            self.perform {
+                guard self.resultStreamFinish == nil, !self.isContinuous else {
+                    continuation.finish(throwing: SwiftSimplePingError.continuousPingRunning)
+                    return
+                }
+                self.resultStreamYield = { continuation.yield($0) }
+                self.resultStreamFinish = { error in
+                    if let error = error {
+                        continuation.finish(throwing: error)
+                    } else {
+                        continuation.finish()
+                    }
+                }
+                self.ping(interval: interval)
+            }
         }
     }
 
     /// Stop all ping operations
+    ///
+    /// Outstanding single pings complete with `SwiftSimplePingError.stopped`.
     public func stop() {
-        sendTimer?.invalidate()
-        sendTimer = nil
-
-        simplePing?.stop()
-        simplePing = nil
-
-        pendingPings.removeAll()
-
-        delegate?.swiftSimplePingDidStop(self)
+        finishOperations(error: SwiftSimplePingError.stopped)
+        notifyDelegate(.stop)
     }
 
     /// Configure maximum number of latency values to keep in history
     /// - Parameter maxHistory: Maximum number of latency values (default: 100)
     public func setMaxLatencyHistory(_ maxHistory: Int) {
-        self.maxLatencyHistory = max(1, maxHistory)
-        if latencies.count > maxLatencyHistory {
-            latencies = Array(latencies.suffix(maxLatencyHistory))
-        }
+        accumulator.setHistoryCapacity(maxHistory)
     }
 
     // MARK: - Private Methods
 
-    private func startPing(continuous: Bool = true) {
-        let pinger = SimplePing(hostName: hostName)
+    /// Runs a block on the pinger's queue, or on its thread's run loop without one
+    private func perform(_ block: @escaping @Sendable () -> Void) {
+        ExecutionContext(queue: queue, runLoop: runLoop).async(block)
+    }
+
+    private func startPing() {
+        let pinger =
+            initialHostAddress.map { SimplePing(hostAddress: $0, engine: engine) }
+            ?? SimplePing(hostName: hostName, engine: engine)
         self.simplePing = pinger
         pinger.delegate = self
+        pinger.dispatchQueue = queue
+        pinger.ignoresForeignPackets = ignoresForeignPackets
+        pinger.usesConnectedSocket = usesConnectedSocket
+        pinger.sessionRecorder = sessionRecorder
+        pinger.sessionTargetIdentifier = sessionTargetIdentifier
         pinger.start()
+        // Pings are sent from didStartWithAddress
+    }
+
+    private func startContinuousPing() {
+        guard pingInterval > 0 else {
+            sendSinglePing()
+            return
+        }
+        // Deadline-based, so short intervals don't drift; the first deadline is now. A ping
+        // that falls behind is skipped rather than sent in a burst.
+        if sendScheduler == nil {
+            let scheduler = SimplePingSendScheduler(rate: 1.0 / pingInterval, queue: queue) {
+                [weak self] count in
+                for _ in 0..<count {
+                    self?.sendPeriodicPing()
+                }
+            }
+            scheduler.maximumBatch = 1
+            sendScheduler = scheduler
+        }
+    }
+
+    private func startFlood() {
+        guard let run = floodRun, let pinger = simplePing, run.scheduler == nil else { return }
+
+        // Keep a couple of minutes' worth of sequence numbers recognisable, as at 1 pps
+        pinger.sequenceWindow = Int(max(120.0, min(32768.0, run.rate * 120.0)))
+
+        run.startTime = SimplePingMonotonicNanoseconds()
+        run.scheduler = SimplePingSendScheduler(rate: run.rate, queue: queue) { [weak self] count in
+            self?.sendFloodPings(count)
+        }
+    }
+
+    private func sendFloodPings(_ count: Int) {
+        guard let run = floodRun, let scheduler = run.scheduler else { return }
+
+        let now = SimplePingMonotonicNanoseconds()
+        let durationEnded =
+            run.duration.map { Double(now - run.startTime) / 1_000_000_000 >= $0 } ?? false
+        for _ in 0..<count {
+            if durationEnded || run.count.map({ run.packetsSent >= $0 }) ?? false {
+                break
+            }
+            sendSinglePing()
+            run.packetsSent += 1
+        }
+        if durationEnded || run.count.map({ run.packetsSent >= $0 }) ?? false {
+            run.missedSendDeadlines = Int(scheduler.missedDeadlineCount)
+            endFloodSending(run)
+        }
+    }
 
-        if continuous {
-            // Timer will be started in didStartWithAddress
+    /// Stops sending and waits `linger` for the last replies
+    private func endFloodSending(_ run: FloodRun) {
+        run.scheduler?.invalidate()
+        run.scheduler = nil
+        run.sendEndTime = SimplePingMonotonicNanoseconds()
+        if run.packetsReceived >= run.packetsSent || run.linger <= 0 {
+            finishFlood()
+            return
+        }
+        run.lingerTimer = SimplePingTimerSource(
+            interval: run.linger, leeway: 0, repeats: false, queue: queue
+        ) { [weak self] in
+            self?.finishFlood()
         }
     }
 
-    private func sendSinglePing() {
-        guard let pinger = simplePing else { return }
+    /// Completes the flood run with its summary, stopping the pinger if nothing else needs it
+    private func finishFlood(error: Error? = nil) {
+        guard let run = floodRun else { return }
+        floodRun = nil
+
+        if let scheduler = run.scheduler {
+            run.missedSendDeadlines = Int(scheduler.missedDeadlineCount)
+            scheduler.invalidate()
+            run.scheduler = nil
+            run.sendEndTime = SimplePingMonotonicNanoseconds()
+        }
+        run.lingerTimer?.invalidate()
+        run.lingerTimer = nil
+
+        let completion = run.completion
+        run.completion = nil
+        if let error = error {
+            completion?(.failure(error))
+        } else {
+            let seconds = { (end: UInt64) -> TimeInterval in
+                end > run.startTime ? TimeInterval(end - run.startTime) / 1_000_000_000 : 0
+            }
+            completion?(
+                .success(
+                    FloodPingSummary(
+                        requestedRate: run.rate,
+                        packetsSent: run.packetsSent,
+                        packetsReceived: run.packetsReceived,
+                        missedSendDeadlines: run.missedSendDeadlines,
+                        sendDuration: seconds(run.sendEndTime),
+                        receiveDuration: seconds(run.lastReceiveTime),
+                        statistics: accumulator.statistics
+                    )))
+        }
+        updateStatistics()
+
+        if !isContinuous && simplePing != nil && singlePingsInFlight.isEmpty
+            && singlePingsAwaitingStart.isEmpty
+        {
+            stop()
+        }
+    }
+
+    private func startSinglePing(_ request: SinglePingRequest, timeout: TimeInterval) {
+        // The task may have been cancelled before we got here
+        if request.isCancelled {
+            let completion = request.completion
+            request.completion = nil
+            completion?(
+                PingResult(sequenceNumber: 0, latency: nil, error: CancellationError(), packetSize: 0))
+            return
+        }
+
+        nextSinglePingID += 1
+        request.id = nextSinglePingID
+        if timeout > 0 {
+            request.timeoutToken = addTimeout(
+                key: Self.singlePingTimeoutKeyBase + request.id, interval: timeout)
+            singlePingsByID[request.id] = request
+        }
+
+        if let pinger = simplePing, pinger.hostAddress != nil {
+            sendSinglePing(for: request)
+        } else {
+            singlePingsAwaitingStart.append(request)
+            if simplePing == nil {
+                startPing()
+            }
+        }
+    }
+
+    @discardableResult
+    private func sendSinglePing(for request: SinglePingRequest? = nil) -> UInt16? {
+        guard let pinger = simplePing else { return nil }
 
         let sequenceNumber = pinger.nextSequenceNumber
-        lastSinglePingSequenceNumber = sequenceNumber
-        pendingPings[sequenceNumber] = Date()
-        packetsSent += 1
+        if let stale = pendingPings[sequenceNumber] {
+            // Sequence numbers have wrapped; don't let the old ping's timeout take the new one
+            timeoutWheel?.cancelTimeout(stale.timeout)
+        }
+        let timeout =
+            (request == nil && replyTimeout > 0)
+            ? addTimeout(key: UInt64(sequenceNumber), interval: replyTimeout) : 0
+        pendingPings[sequenceNumber] = PendingPing(
+            sendTime: SimplePingMonotonicNanoseconds(), timeout: timeout)
+        if let request = request {
+            request.sequenceNumber = sequenceNumber
+            singlePingsInFlight[sequenceNumber] = request
+        }
+        accumulator.recordSent()
 
         pinger.send(with: nil)
+        return sequenceNumber
     }
 
-    @objc private func sendPeriodicPing() {
+    private func sendPeriodicPing() {
         sendSinglePing()
     }
 
     private func resetStatistics() {
-        packetsSent = 0
-        packetsReceived = 0
-        latencies.removeAll()
-        pendingPings.removeAll()
+        accumulator.reset()
         updateStatistics()
     }
 
     private func updateStatistics() {
-        statistics = PingStatistics(
-            sent: packetsSent, received: packetsReceived, latencies: latencies)
-        delegate?.swiftSimplePing(self, didUpdateStatistics: statistics)
+        // Only built when someone is listening; a snapshot that isn't kept costs no copies
+        guard let delegate = delegate else { return }
+        if let delivery = coalescedDelivery() {
+            // Built once, as the batch closes
+            statisticsChanged = true
+            delivery.setNeedsFlush()
+            return
+        }
+        delegate.swiftSimplePing(self, didUpdateStatistics: accumulator.statistics)
+    }
+
+    /// Makes a delegate callback, now or as part of a coalesced batch
+    private func notifyDelegate(_ callback: DelegateCallback) {
+        guard delegate != nil else { return }
+        if let delivery = coalescedDelivery() {
+            switch callback {
+            case .result, .statistics:
+                delivery.append(callback)
+            case .start, .stop, .failure:
+                delivery.append(callback, flushImmediately: true)
+            }
+        } else {
+            callDelegate(callback)
+        }
+    }
+
+    private func callDelegate(_ callback: DelegateCallback) {
+        guard let delegate = delegate else { return }
+        switch callback {
+        case .start(let address):
+            delegate.swiftSimplePing(self, didStartWithAddress: address)
+        case .result(let result):
+            delegate.swiftSimplePing(self, didReceivePingResult: result)
+        case .statistics(let statistics):
+            delegate.swiftSimplePing(self, didUpdateStatistics: statistics)
+        case .stop:
+            delegate.swiftSimplePingDidStop(self)
+        case .failure(let error):
+            delegate.swiftSimplePing(self, didFailWithError: error)
+        }
+    }
+
+    /// The coalesced delivery of delegate callbacks, or nil if they're made as they happen
+    ///
+    /// Created on first use, on the pinger's queue or thread, so without a queue batches are
+    /// closed on the run loop the callbacks are produced on.
+    private func coalescedDelivery() -> CoalescedCallbackDelivery<DelegateCallback>? {
+        if let delivery = callbackDelivery {
+            return delivery
+        }
+        guard callbackQueue != nil || maximumCallbackRate > 0 else { return nil }
+        let producer = ExecutionContext(queue: queue, runLoop: CFRunLoopGetCurrent())
+        callbackDelivery = CoalescedCallbackDelivery(
+            producer: producer,
+            consumer: callbackQueue.map { .queue($0) } ?? producer,
+            maximumRate: maximumCallbackRate,
+            closeBatch: { [weak self] in
+                guard let self = self, self.statisticsChanged else { return nil }
+                self.statisticsChanged = false
+                return .statistics(self.accumulator.statistics)
+            },
+            handler: { [weak self] callback in
+                self?.callDelegate(callback)
+            })
+        return callbackDelivery
+    }
+
+    private func cancelSinglePing(_ request: SinglePingRequest) {
+        request.isCancelled = true
+        guard request.completion != nil else { return }  // not started yet
+        finishSinglePing(
+            request,
+            result: PingResult(
+                sequenceNumber: request.sequenceNumber ?? 0, latency: nil,
+                error: CancellationError(), packetSize: 0))
+    }
+
+    /// Completes a single ping, stopping the pinger if nothing else needs it
+    private func finishSinglePing(_ request: SinglePingRequest, result: PingResult) {
+        guard let completion = request.completion else { return }
+        request.completion = nil
+        timeoutWheel?.cancelTimeout(request.timeoutToken)
+        request.timeoutToken = 0
+        singlePingsByID.removeValue(forKey: request.id)
+        if let sequenceNumber = request.sequenceNumber {
+            singlePingsInFlight.removeValue(forKey: sequenceNumber)
+        } else {
+            singlePingsAwaitingStart.removeAll { $0 === request }
+        }
+
+        completion(result)
+
+        // Stop underlying SimplePing to release resources (will trigger delegate didStop)
+        if !isContinuous && simplePing != nil && singlePingsInFlight.isEmpty
+            && singlePingsAwaitingStart.isEmpty
+        {
+            stop()
+        }
+    }
+
+    /// Tears everything down, completing outstanding single pings and the result stream
+    private func finishOperations(error: Error) {
+        sendScheduler?.invalidate()
+        sendScheduler = nil
+        isContinuous = false
+
+        simplePing?.stop()
+        simplePing = nil
+
+        pendingPings.removeAll()
+        if let wheel = timeoutWheel {
+            wheel.removeTimeouts(forClient: timeoutWheelClient)
+        }
+
+        // Stopping a flood early still reports what it measured
+        if floodRun != nil {
+            if case SwiftSimplePingError.stopped = error {
+                finishFlood()
+            } else {
+                finishFlood(error: error)
+            }
+        }
+
+        // Take the requests first, as their completions may start new pings
+        let requests = singlePingsAwaitingStart + Array(singlePingsInFlight.values)
+        singlePingsAwaitingStart.removeAll()
+        singlePingsInFlight.removeAll()
+        singlePingsByID.removeAll()
+        for request in requests {
+            request.timeoutToken = 0
+            let completion = request.completion
+            request.completion = nil
+            completion?(
+                PingResult(
+                    sequenceNumber: request.sequenceNumber ?? 0, latency: nil, error: error,
+                    packetSize: 0))
+        }
+
+        if let finish = resultStreamFinish {
+            resultStreamYield = nil
+            resultStreamFinish = nil
+            finish(error is SwiftSimplePingError ? nil : error)
+        }
     }
 
     // MARK: - Utility Methods
@@ -267,7 +1033,7 @@ public class SwiftSimplePing: NSObject {
     /// - parameter address: Contains a `(struct sockaddr)` with the address to render.
     ///
     /// - returns: A string representation of that address.
-    private func displayAddressForAddress(address: NSData) -> String {
+    private static func displayAddressForAddress(address: NSData) -> String {
         var hostStr = [Int8](repeating: 0, count: Int(NI_MAXHOST))
 
         let success =
@@ -381,40 +1147,67 @@ public class SwiftSimplePing: NSObject {
         return "ICMP " + typeDesc(icmpType, icmpCode) + extra
     }
 
-    private func handlePingResponse(sequenceNumber: UInt16, packetSize: Int) {
-        let now = Date()
+    private func handlePingResponse(
+        sequenceNumber: UInt16, packetSize: Int, timing: SimplePingTiming? = nil,
+        updatesStatistics: Bool = true
+    ) {
         var latency: TimeInterval? = nil
-
-        if let sendTime = pendingPings.removeValue(forKey: sequenceNumber) {
-            latency = now.timeIntervalSince(sendTime)
-            packetsReceived += 1
-
-            // Add to latency history
-            latencies.append(latency!)
-            if latencies.count > maxLatencyHistory {
-                latencies.removeFirst()
+        var rttNanoseconds: UInt64? = nil
+        var deliveryDelayNanoseconds: UInt64? = nil
+
+        if let pending = pendingPings.removeValue(forKey: sequenceNumber) {
+            timeoutWheel?.cancelTimeout(pending.timeout)
+            let sendTime = pending.sendTime
+            // Prefer the kernel receive stamp and the send stamp taken right before sendto()
+            let now = SimplePingMonotonicNanoseconds()
+            var exchange =
+                timing ?? SimplePingTiming(sendTime: 0, kernelReceiveTime: now, userReceiveTime: now)
+            if exchange.sendTime == 0 {
+                exchange.sendTime = sendTime
+            }
+            let rtt = SimplePingTimingRoundTripNanoseconds(exchange)
+            rttNanoseconds = rtt
+            deliveryDelayNanoseconds = SimplePingTimingDeliveryDelayNanoseconds(exchange)
+            latency = TimeInterval(rtt) / 1_000_000_000
+            accumulator.recordLatency(latency!)
+
+            if let run = floodRun {
+                // Floods report a summary rather than each reply
+                run.packetsReceived += 1
+                run.lastReceiveTime = exchange.kernelReceiveTime
+                if !run.isSending && run.packetsReceived >= run.packetsSent {
+                    finishFlood()
+                }
+                return
             }
         }
+        if floodRun != nil {
+            return  // a reply that came too late to count
+        }
 
         let result = PingResult(
             sequenceNumber: sequenceNumber,
             latency: latency,
             error: nil,
-            packetSize: packetSize
+            packetSize: packetSize,
+            rttNanoseconds: rttNanoseconds,
+            deliveryDelayNanoseconds: deliveryDelayNanoseconds
         )
 
-        delegate?.swiftSimplePing(self, didReceivePingResult: result)
-        updateStatistics()
+        deliver(result)
+        if updatesStatistics {
+            updateStatistics()
+        }
 
-        // Finish single ping mode
-        if let completion = singlePingCompletion {
-            completion(result)
-            cleanupSinglePing()
+        if let request = singlePingsInFlight[sequenceNumber] {
+            finishSinglePing(request, result: result)
         }
     }
 
     private func handlePingError(sequenceNumber: UInt16, error: Error) {
-        pendingPings.removeValue(forKey: sequenceNumber)
+        if let pending = pendingPings.removeValue(forKey: sequenceNumber) {
+            timeoutWheel?.cancelTimeout(pending.timeout)
+        }
 
         let result = PingResult(
             sequenceNumber: sequenceNumber,
@@ -423,34 +1216,91 @@ public class SwiftSimplePing: NSObject {
             packetSize: 0
         )
 
-        delegate?.swiftSimplePing(self, didReceivePingResult: result)
+        deliver(result)
         updateStatistics()
 
-        if let completion = singlePingCompletion {
-            completion(result)
-            cleanupSinglePing()
+        if let request = singlePingsInFlight[sequenceNumber] {
+            finishSinglePing(request, result: result)
         }
     }
 
-    private func cleanupSinglePing() {
-        singlePingTimeoutTimer?.invalidate()
-        singlePingTimeoutTimer = nil
-        singlePingCompletion = nil
-        lastSinglePingSequenceNumber = nil
-        // Stop underlying SimplePing to release resources (will trigger delegate didStop)
-        if sendTimer == nil {  // only if not in continuous mode
-            stop()
+    private func handleSinglePingTimeout(_ request: SinglePingRequest) {
+        guard request.completion != nil else { return }
+        let seq = request.sequenceNumber ?? 0
+        request.timeoutToken = 0
+        if let sequenceNumber = request.sequenceNumber {
+            pendingPings.removeValue(forKey: sequenceNumber)  // a late reply counts as lost
+            recordLoss(sequenceNumber: sequenceNumber)
         }
-    }
-
-    @objc private func handleSinglePingTimeout() {
-        guard let completion = singlePingCompletion else { return }
-        let seq = lastSinglePingSequenceNumber ?? 0
         let result = PingResult(
             sequenceNumber: seq, latency: nil, error: SwiftSimplePingError.timeout, packetSize: 0)
-        completion(result)
-        delegate?.swiftSimplePing(self, didReceivePingResult: result)
-        cleanupSinglePing()
+        deliver(result)
+        finishSinglePing(request, result: result)
+    }
+
+    /// Appends a timeout record for a lost ping to `sessionRecorder`, if there is one
+    private func recordLoss(sequenceNumber: UInt16) {
+        guard let recorder = sessionRecorder else { return }
+        var record = SimplePingSessionRecord()
+        SimplePingSessionRecordInit(
+            &record, UInt8(SimplePingSessionRecordKindPing), sessionTargetIdentifier,
+            SimplePingMonotonicNanoseconds())
+        record.flags = UInt8(SimplePingSessionRecordFlagTimeout)
+        record.sequenceNumber = sequenceNumber
+        record.identifier = simplePing?.identifier ?? 0
+        recorder.append(&record)
+    }
+
+    /// Schedules a timeout on the engine's timer wheel, or on our own
+    /// - Parameters:
+    ///   - key: A sequence number, or `singlePingTimeoutKeyBase` plus a single ping's ID
+    ///   - interval: Seconds until it expires
+    /// - Returns: The token to cancel it with
+    private func addTimeout(key: UInt64, interval: TimeInterval) -> SimplePingTimeoutToken {
+        let wheel: SimplePingTimeoutWheel
+        if let existing = timeoutWheel {
+            wheel = existing
+        } else {
+            wheel = engine?.timeoutWheel ?? SimplePingTimeoutWheel(tickInterval: 0.01, queue: queue)
+            timeoutWheelClient = wheel.addClient { [weak self] keys, count in
+                self?.timeoutsExpired(UnsafeBufferPointer(start: keys, count: count))
+            }
+            timeoutWheel = wheel
+        }
+        return wheel.addTimeout(forKey: key, client: timeoutWheelClient, afterInterval: interval)
+    }
+
+    /// Timer wheel callback; reports lost pings and times out single pings
+    private func timeoutsExpired(_ keys: UnsafeBufferPointer<UInt64>) {
+        var reportedLoss = false
+        for key in keys {
+            if key >= Self.singlePingTimeoutKeyBase {
+                if let request = singlePingsByID[key - Self.singlePingTimeoutKeyBase] {
+                    handleSinglePingTimeout(request)
+                }
+            } else {
+                let sequenceNumber = UInt16(truncatingIfNeeded: key)
+                guard pendingPings.removeValue(forKey: sequenceNumber) != nil else { continue }
+                if floodRun == nil {
+                    recordLoss(sequenceNumber: sequenceNumber)
+                    deliver(
+                        PingResult(
+                            sequenceNumber: sequenceNumber, latency: nil,
+                            error: SwiftSimplePingError.timeout, packetSize: 0))
+                    reportedLoss = true
+                }
+            }
+        }
+        // One statistics update per batch of losses
+        if reportedLoss {
+            updateStatistics()
+        }
+    }
+
+    /// Passes a result to the delegate and to the result stream, if any
+    private func deliver(_ result: PingResult) {
+        notifyDelegate(.result(result))
+        resultStreamYield?(result)
     }
 }
 
@@ -459,49 +1309,59 @@ public class SwiftSimplePing: NSObject {
 extension SwiftSimplePing: SimplePingDelegate {
 
     public func simplePing(_ pinger: SimplePing, didStartWithAddress address: Data) {
-        NSLog(
-            "SwiftSimplePing: Started pinging host:%@ %@",
-            self.hostName,
-            displayAddressForAddress(address: address as NSData))
+        simplePingLog(.info, .ping) {
+            String(
+                format: "Started pinging host:%@ %@",
+                self.hostName, Self.displayAddressForAddress(address: address as NSData))
+        }
 
-        delegate?.swiftSimplePing(self, didStartWithAddress: address)
+        notifyDelegate(.start(address))
 
-        // Send first ping immediately
-        sendSinglePing()
+        // Send the single pings that were waiting for the address
+        let requests = singlePingsAwaitingStart
+        singlePingsAwaitingStart.removeAll()
+        for request in requests {
+            sendSinglePing(for: request)
+        }
 
-        // Start timer for continuous pings if needed
-        if sendTimer == nil && pingInterval > 0 {
-            sendTimer = Timer.scheduledTimer(
-                timeInterval: pingInterval,
-                target: self,
-                selector: #selector(sendPeriodicPing),
-                userInfo: nil,
-                repeats: true
-            )
+        // Send first ping immediately, then start timer for continuous pings if needed
+        if isContinuous {
+            startContinuousPing()
+        }
+        if floodRun != nil {
+            startFlood()
         }
     }
 
     public func simplePing(_ pinger: SimplePing, didFailWithError error: Error) {
-        NSLog(
-            "SwiftSimplePing: host:%@ Failed with error: %@",
-            self.hostName,
-            shortErrorFromError(error: error as NSError))
+        simplePingLog(.error, .ping) {
+            String(
+                format: "host:%@ Failed with error: %@",
+                self.hostName, shortErrorFromError(error: error as NSError))
+        }
 
-        stop()
-        delegate?.swiftSimplePing(self, didFailWithError: error)
+        finishOperations(error: error)
+        notifyDelegate(.stop)
+        notifyDelegate(.failure(error))
     }
 
     public func simplePing(_ pinger: SimplePing, didSendPacket packet: Data, sequenceNumber: UInt16)
     {
-        NSLog("SwiftSimplePing: host:%@ #%u sent", self.hostName, sequenceNumber)
+        // Thousands a second in a flood; the summary says it all
+        guard floodRun == nil else { return }
+        simplePingLog(.debug, .ping) {
+            String(format: "host:%@ #%u sent", self.hostName, sequenceNumber)
+        }
     }
 
     public func simplePing(
         _ pinger: SimplePing, didFailToSendPacket packet: Data, sequenceNumber: UInt16, error: Error
     ) {
-        NSLog(
-            "SwiftSimplePing: host:%@ #%u send failed: %@", self.hostName, sequenceNumber,
-            shortErrorFromError(error: error as NSError))
+        simplePingLog(.error, .ping) {
+            String(
+                format: "host:%@ #%u send failed: %@",
+                self.hostName, sequenceNumber, shortErrorFromError(error: error as NSError))
+        }
 
         handlePingError(sequenceNumber: sequenceNumber, error: error)
     }
@@ -509,22 +1369,61 @@ extension SwiftSimplePing: SimplePingDelegate {
     public func simplePing(
         _ pinger: SimplePing, didReceivePingResponsePacket packet: Data, sequenceNumber: UInt16
     ) {
-        NSLog(
-            "SwiftSimplePing:host:%@ #%u received, size=%zu", self.hostName, sequenceNumber,
-            packet.count)
+        if floodRun == nil {
+            simplePingLog(.debug, .ping) {
+                String(
+                    format: "host:%@ #%u received, size=%zu",
+                    self.hostName, sequenceNumber, packet.count)
+            }
+        }
 
         handlePingResponse(sequenceNumber: sequenceNumber, packetSize: packet.count)
     }
 
+    public func simplePing(
+        _ pinger: SimplePing, didReceivePingResponsePacket packet: Data, sequenceNumber: UInt16,
+        timing: SimplePingTiming
+    ) {
+        if floodRun == nil {
+            simplePingLog(.debug, .ping) {
+                String(
+                    format: "host:%@ #%u received, size=%zu",
+                    self.hostName, sequenceNumber, packet.count)
+            }
+        }
+
+        handlePingResponse(sequenceNumber: sequenceNumber, packetSize: packet.count, timing: timing)
+    }
+
+    public func simplePing(_ pinger: SimplePing, didReceivePingResponses responses: [SimplePingResponse]) {
+        if floodRun == nil {
+            simplePingLog(.debug, .ping) {
+                String(
+                    format: "host:%@ received %u responses",
+                    self.hostName, UInt32(responses.count))
+            }
+        }
+
+        // One statistics update per batch rather than per response
+        for response in responses {
+            handlePingResponse(
+                sequenceNumber: response.sequenceNumber, packetSize: response.packet.count,
+                timing: response.timing, updatesStatistics: false)
+        }
+        updateStatistics()
+    }
+
     public func simplePing(_ pinger: SimplePing, didReceiveUnexpectedPacket packet: Data) {
         let desc = parseUnexpectedPacket(packet)
-        NSLog(
-            "SwiftSimplePing: host:%@ Unexpected packet: %@, size=%zu", self.hostName, desc,
-            packet.count)
+        simplePingLog(.debug, .ping) {
+            String(
+                format: "host:%@ Unexpected packet: %@, size=%zu",
+                self.hostName, desc, packet.count)
+        }
         let error = UnexpectedICMPPacketError(description: desc)
         let result = PingResult(
             sequenceNumber: 0, latency: nil, error: error, packetSize: packet.count)
-        delegate?.swiftSimplePing(self, didReceivePingResult: result)
+        deliver(result)
         // stats unchanged, but notify to maintain visibility if needed
         updateStatistics()
     }
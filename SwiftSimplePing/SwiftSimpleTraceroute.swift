@@ -11,7 +11,14 @@ import Foundation
 #endif
 
 /// Swift wrapper around SimpleTraceroute with convenience methods and statistics
-public class SwiftSimpleTraceroute: NSObject {
+///
+/// Besides the delegate, any number of observers (hop publishers and streams, `trace()`) can
+/// follow a traceroute at once. The traceroute runs on `dispatchQueue`, or without one on the run
+/// loop of the thread that creates it, which must also be the thread that starts it; the async
+/// and Combine entry points hop there themselves. Without a queue, that thread's run loop must
+/// be running for them to get anywhere; command line tools and tests that don't run one should
+/// set a `dispatchQueue`.
+public class SwiftSimpleTraceroute: NSObject, @unchecked Sendable {
 
     // MARK: - Public Properties
 
@@ -43,11 +50,25 @@ public class SwiftSimpleTraceroute: NSObject {
         return simpleTraceroute?.hostAddress
     }
 
+    /// Packet counters and callback latencies of the running `SimpleTraceroute`, or nil when stopped
+    ///
+    /// See `SimpleTraceroute.metrics`.
+    public var metrics: SimplePingMetricsSnapshot? {
+        return simpleTraceroute?.metrics
+    }
+
     /// Current hop number being traced
     public var currentHop: UInt8 {
         return simpleTraceroute?.currentHop ?? 0
     }
 
+    /// Rolling statistics of every hop of a continuous traceroute, in hop order
+    ///
+    /// Empty until the path has first been traced; see `STracerouteConfiguration.continuous`.
+    public var hopStatistics: [STracerouteHopStatistics] {
+        return simpleTraceroute?.hopStatistics.map(STracerouteHopStatistics.init) ?? []
+    }
+
     /// Maximum number of hops to trace
     public var maxHops: UInt8 {
         get { return configuration.maxHops }
@@ -75,6 +96,42 @@ public class SwiftSimpleTraceroute: NSObject {
         }
     }
 
+    /// Whether each hop waits for all of its probes
+    ///
+    /// Set this before starting; see `SimpleTraceroute.waitsForAllProbes`.
+    public var waitsForAllProbes: Bool {
+        get { return configuration.waitsForAllProbes }
+        set { configuration.waitsForAllProbes = newValue }
+    }
+
+    /// Rate limit shared with other traceroutes, or nil for none
+    ///
+    /// Set this before starting; see `SimpleTraceroute.rateLimiter`.
+    public var rateLimiter: SimplePingRateLimiter?
+
+    /// The serial queue to run on, or nil to use the run loop of the thread that creates it
+    ///
+    /// Set this before starting; see `SimpleTraceroute.dispatchQueue`.
+    public var dispatchQueue: DispatchQueue?
+
+    /// Looks up router names off the probe path, or nil not to
+    ///
+    /// Hops are reported without a name first; names arrive later through
+    /// `swiftSimpleTraceroute(_:didResolveHostNameForHop:)`, often after the traceroute has
+    /// finished, and are filled into the hops of the last result. Share one resolver between
+    /// traceroutes to share its cache. Set this before starting; see
+    /// `SimpleTraceroute.reverseResolver`.
+    public var reverseResolver: TracerouteReverseResolver?
+
+    /// Where to record every response and probe timeout, or nil not to
+    ///
+    /// Set this before starting; see `SimpleTraceroute.sessionRecorder`.
+    public var sessionRecorder: SimplePingSessionRecorder?
+
+    /// The `targetIdentifier` of the traceroute's records, to tell targets apart in a shared
+    /// recording
+    public var sessionTargetIdentifier: UInt32 = 0
+
     // MARK: - Private Properties
 
     private var simpleTraceroute: SimpleTraceroute?
@@ -84,7 +141,17 @@ public class SwiftSimpleTraceroute: NSObject {
     private var responsesReceived: Int = 0
     private var timeouts: Int = 0
     private var latencies: [TimeInterval] = []
+    private var hopSamples: [UInt8: STracerouteHopSamples] = [:]
     private var finalResult: STracerouteResult?
+    // The traceroute of the last run, whose names are still wanted after it finishes
+    private var lastTracerouteID: ObjectIdentifier?
+
+    // Observers, keyed by their token, and whether they started the traceroute
+    private var observers: [ObjectIdentifier: TracerouteObserver] = [:]
+    private var observersStartedTraceroute = false
+
+    // The run loop of the thread that created the traceroute, used without a dispatchQueue
+    private let runLoop: CFRunLoop = CFRunLoopGetCurrent()
 
     // MARK: - Initialization
 
@@ -142,8 +209,9 @@ public class SwiftSimpleTraceroute: NSObject {
             completeTraceroute(reachedTarget: false)
         }
 
-        delegate?.swiftSimpleTraceroute(
-            self, didFinishWithResult: finalResult ?? createEmptyResult())
+        let result = finalResult ?? createEmptyResult()
+        delegate?.swiftSimpleTraceroute(self, didFinishWithResult: result)
+        notifyObservers(.finished(result))
     }
 
     /// Update the configuration (only when not running)
@@ -163,6 +231,7 @@ public class SwiftSimpleTraceroute: NSObject {
     private func startTraceroute() {
         let traceroute = SimpleTraceroute(hostName: hostName)
         self.simpleTraceroute = traceroute
+        self.lastTracerouteID = ObjectIdentifier(traceroute)
         traceroute.delegate = self
 
         // Apply configuration
@@ -170,6 +239,19 @@ public class SwiftSimpleTraceroute: NSObject {
         traceroute.maxHops = configuration.maxHops
         traceroute.timeout = configuration.timeout
         traceroute.probesPerHop = configuration.probesPerHop
+        traceroute.waitsForAllProbes = configuration.waitsForAllProbes
+        traceroute.probeMode = configuration.probeMode
+        traceroute.keepsFlowStable = configuration.keepsFlowStable
+        traceroute.flowIdentifier = configuration.flowIdentifier
+        traceroute.continuous = configuration.continuous
+        traceroute.cycleInterval = configuration.cycleInterval
+        traceroute.parallelWindow = configuration.parallelWindow
+        traceroute.probeInterval = configuration.probeInterval
+        traceroute.rateLimiter = rateLimiter
+        traceroute.dispatchQueue = dispatchQueue
+        traceroute.reverseResolver = reverseResolver
+        traceroute.sessionRecorder = sessionRecorder
+        traceroute.sessionTargetIdentifier = sessionTargetIdentifier
 
         // traceroute.delegate = self
         traceroute.start()
@@ -183,6 +265,7 @@ public class SwiftSimpleTraceroute: NSObject {
         responsesReceived = 0
         timeouts = 0
         latencies.removeAll()
+        hopSamples.removeAll()
         startTime = nil
         finalResult = nil
         updateStatistics()
@@ -198,7 +281,7 @@ public class SwiftSimpleTraceroute: NSObject {
         delegate?.swiftSimpleTraceroute(self, didUpdateStatistics: statistics)
     }
 
-    private func completeTraceroute(reachedTarget: Bool) {
+    private func completeTraceroute(reachedTarget: Bool, pathGraph: STraceroutePathGraph? = nil) {
         guard let startTime = startTime else { return }
 
         let totalTime = Date().timeIntervalSince(startTime)
@@ -213,7 +296,9 @@ public class SwiftSimpleTraceroute: NSObject {
             totalTime: totalTime,
             hops: completedHops,
             reachedTarget: reachedTarget,
-            statistics: statistics
+            statistics: statistics,
+            hopSamples: hopSamples.values.sorted { $0.hopNumber < $1.hopNumber },
+            pathGraph: pathGraph
         )
 
         self.startTime = nil
@@ -320,9 +405,11 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
     @objc public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didStartWithAddress address: Data
     ) {
-        NSLog(
-            "SwiftSimpleTraceroute: Started tracing to %@",
-            displayAddressForAddress(address: address as NSData))
+        simplePingLog(.info, .traceroute) {
+            String(
+                format: "Started tracing to %@",
+                displayAddressForAddress(address: address as NSData))
+        }
 
         let addressString = displayAddressForAddress(address: address as NSData)
         delegate?.swiftSimpleTraceroute(self, didStartWithAddress: addressString)
@@ -331,11 +418,12 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
     @objc public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didFailWithError error: Error
     ) {
-        NSLog(
-            "SwiftSimpleTraceroute: Failed with error: %@",
-            shortErrorFromError(error: error as NSError))
+        simplePingLog(.error, .traceroute) {
+            String(format: "Failed with error: %@", shortErrorFromError(error: error as NSError))
+        }
 
         let tracerouteError = convertTracerouteError(error as NSError)
+        notifyObservers(.failed(tracerouteError))
         stop()
         delegate?.swiftSimpleTraceroute(self, didFailWithError: tracerouteError)
     }
@@ -343,50 +431,64 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
     @objc public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didCompleteHop hopResult: TracerouteHopResult
     ) {
-        NSLog(
-            "SwiftSimpleTraceroute: Completed hop %u: %@ (%.1f ms)",
-            hopResult.hopNumber,
-            hopResult.routerAddress ?? "timeout",
-            hopResult.roundTripTime * 1000)
+        simplePingLog(.debug, .traceroute) {
+            String(
+                format: "Completed hop %u: %@ (%.1f ms)",
+                hopResult.hopNumber, hopResult.routerAddress ?? "timeout",
+                hopResult.roundTripTime * 1000)
+        }
 
         // Convert Objective-C hop result to Swift type
         let hop = STracerouteHop(
             hopNumber: hopResult.hopNumber,
             routerAddress: hopResult.routerAddress,
-            hostName: nil,  // TODO: Add hostname resolution if needed
+            hostName: hopResult.hostName,
             roundTripTime: hopResult.isTimeout ? nil : hopResult.roundTripTime,
             isDestination: hopResult.isDestination,
             isTimeout: hopResult.isTimeout,
             timestamp: hopResult.timestamp ?? Date(),
             sequenceNumber: hopResult.sequenceNumber,
-            probeIndex: hopResult.probeIndex
+            probeIndex: hopResult.probeIndex,
+            roundTripNanoseconds: hopResult.isTimeout ? nil : hopResult.roundTripNanoseconds,
+            deliveryDelayNanoseconds: hopResult.isTimeout ? nil : hopResult.deliveryDelayNanoseconds
         )
 
         completedHops.append(hop)
 
         // Update statistics
         responsesReceived += 1
+        var samples =
+            hopSamples[hopResult.hopNumber]
+            ?? STracerouteHopSamples(hopNumber: hopResult.hopNumber)
         if hopResult.isTimeout {
             timeouts += 1
+            samples.addLosses(Int(hopResult.probeCount))
         } else {
             latencies.append(hopResult.roundTripTime)
+            samples.addReply(latency: hopResult.roundTripTime)
         }
+        hopSamples[hopResult.hopNumber] = samples
         updateStatistics()
 
         delegate?.swiftSimpleTraceroute(self, didCompleteHop: hop)
+        notifyObservers(.hop(hop))
     }
 
     public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didFinishWith result: TracerouteResult
     ) {
-        NSLog(
-            "SwiftSimpleTraceroute: Finished - reached target: %@, hops: %u",
-            result.reachedTarget ? "YES" : "NO", result.actualHops)
+        simplePingLog(.info, .traceroute) {
+            String(
+                format: "Finished - reached target: %@, hops: %u",
+                result.reachedTarget ? "YES" : "NO", result.actualHops)
+        }
 
-        completeTraceroute(reachedTarget: result.reachedTarget)
+        completeTraceroute(
+            reachedTarget: result.reachedTarget, pathGraph: result.pathGraph.map(STraceroutePathGraph.init))
 
         if let finalResult = self.finalResult {
             delegate?.swiftSimpleTraceroute(self, didFinishWithResult: finalResult)
+            notifyObservers(.finished(finalResult))
         }
 
         // Clean up
@@ -398,7 +500,9 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
     @objc public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didSendProbeToHop hopNumber: UInt8, sequenceNumber: UInt16
     ) {
-        NSLog("SwiftSimpleTraceroute: Sent probe to hop %u, seq=%u", hopNumber, sequenceNumber)
+        simplePingLog(.debug, .traceroute) {
+            String(format: "Sent probe to hop %u, seq=%u", hopNumber, sequenceNumber)
+        }
 
         probesSent += 1
         updateStatistics()
@@ -411,7 +515,9 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
         _ traceroute: SimpleTraceroute, didReceiveResponseFromHop hopNumber: UInt8,
         latency: TimeInterval
     ) {
-        NSLog("SwiftSimpleTraceroute: Response from hop %u: %.1f ms", hopNumber, latency * 1000)
+        simplePingLog(.debug, .traceroute) {
+            String(format: "Response from hop %u: %.1f ms", hopNumber, latency * 1000)
+        }
 
         delegate?.swiftSimpleTraceroute(
             self, didReceiveResponseFromHop: hopNumber, latency: latency)
@@ -420,11 +526,158 @@ extension SwiftSimpleTraceroute: SimpleTracerouteDelegate {
     @objc public func simpleTraceroute(
         _ traceroute: SimpleTraceroute, didTimeoutForHop hopNumber: UInt8
     ) {
-        NSLog("SwiftSimpleTraceroute: Timeout for hop %u", hopNumber)
+        simplePingLog(.debug, .traceroute) {
+            String(format: "Timeout for hop %u", hopNumber)
+        }
 
         delegate?.swiftSimpleTraceroute(self, didTimeoutForHop: hopNumber)
     }
 
+    @objc public func simpleTraceroute(
+        _ traceroute: SimpleTraceroute, didResolveHostName hostName: String,
+        forHop hopResult: TracerouteHopResult
+    ) {
+        // Names for a run we've since replaced are of no use
+        guard ObjectIdentifier(traceroute) == lastTracerouteID,
+            let index = completedHops.firstIndex(where: {
+                $0.sequenceNumber == hopResult.sequenceNumber
+                    && $0.hopNumber == hopResult.hopNumber
+                    && $0.probeIndex == hopResult.probeIndex
+            })
+        else { return }
+
+        let hop = completedHops[index].withHostName(hostName)
+        completedHops[index] = hop
+        if let result = finalResult {
+            finalResult = STracerouteResult(
+                targetHostname: result.targetHostname,
+                targetAddress: result.targetAddress,
+                maxHops: result.maxHops,
+                actualHops: result.actualHops,
+                totalTime: result.totalTime,
+                hops: completedHops,
+                reachedTarget: result.reachedTarget,
+                statistics: result.statistics,
+                hopSamples: result.hopSamples,
+                pathGraph: result.pathGraph
+            )
+        }
+
+        delegate?.swiftSimpleTraceroute(self, didResolveHostNameForHop: hop)
+    }
+
+    @objc public func simpleTraceroute(
+        _ traceroute: SimpleTraceroute, didUpdateHopStatistics statistics: TracerouteHopStatistics
+    ) {
+        guard ObjectIdentifier(traceroute) == lastTracerouteID else { return }
+
+        delegate?.swiftSimpleTraceroute(
+            self, didUpdateHopStatistics: STracerouteHopStatistics(statistics))
+    }
+
+}
+
+// MARK: - Observers
+
+/// What observers of a traceroute are told, after the delegate
+enum TracerouteEvent {
+    case hop(STracerouteHop)
+    case finished(STracerouteResult)
+    case failed(STracerouteError)
+}
+
+/// Identifies an observer of a traceroute
+final class TracerouteObserverToken: Sendable {}
+
+/// An observer of a traceroute; it holds its token so the token's identity stays unique
+struct TracerouteObserver {
+    let token: TracerouteObserverToken
+    let handler: (TracerouteEvent) -> Void
+}
+
+extension SwiftSimpleTraceroute {
+
+    /// Runs a block on the traceroute's queue, or on its thread's run loop without one
+    func perform(_ block: @escaping @Sendable () -> Void) {
+        ExecutionContext(queue: dispatchQueue, runLoop: runLoop).async(block)
+    }
+
+    /// Adds an observer and starts the traceroute unless it's already running
+    ///
+    /// The observer is removed after it's told the traceroute finished or failed. If starting
+    /// fails, the observer is told so straight away.
+    func addObserver(
+        _ token: TracerouteObserverToken, handler: @escaping (TracerouteEvent) -> Void
+    ) {
+        observers[ObjectIdentifier(token)] = TracerouteObserver(token: token, handler: handler)
+        guard !isRunning else { return }
+        do {
+            try start()
+            observersStartedTraceroute = true
+        } catch {
+            observers.removeValue(forKey: ObjectIdentifier(token))
+            handler(
+                .failed(
+                    error as? STracerouteError
+                        ?? .systemError(underlying: error.localizedDescription)))
+        }
+    }
+
+    /// Removes an observer, stopping the traceroute if observers started it and none remain
+    func removeObserver(_ token: TracerouteObserverToken) {
+        guard observers.removeValue(forKey: ObjectIdentifier(token)) != nil else { return }
+        if observers.isEmpty && observersStartedTraceroute && isRunning {
+            stop()
+        }
+    }
+
+    fileprivate func notifyObservers(_ event: TracerouteEvent) {
+        let handlers = observers.values.map { $0.handler }
+        switch event {
+        case .hop:
+            break
+        case .finished, .failed:
+            observers.removeAll()
+            observersStartedTraceroute = false
+        }
+        for handler in handlers {
+            handler(event)
+        }
+    }
+
+    /// Stream each hop as it completes, including timeouts
+    ///
+    /// Starts the traceroute unless it's already running, in which case the stream joins it
+    /// from the next hop. Hops the consumer hasn't taken yet wait in a ring of `limit` hops,
+    /// which drops the oldest when full. The stream finishes with the traceroute, and stops
+    /// it on cancellation if streams or publishers started it and no others remain.
+    /// - Parameter limit: Number of hops to buffer (default: 256)
+    /// - Returns: A stream of hops
+    @available(macOS 10.15, iOS 13.0, tvOS 13.0, watchOS 6.0, *)
+    public func hops(bufferingNewest limit: Int = 256) -> AsyncThrowingStream<STracerouteHop, Error> {
+        return AsyncThrowingStream(bufferingPolicy: .bufferingNewest(max(1, limit))) {
+            continuation in
+            let token = TracerouteObserverToken()
+            continuation.onTermination = { [weak self] _ in
+                guard let self = self else { return }
+                self.perform {
+                    self.removeObserver(token)
+                }
+            }
+            self.perform {
+                self.addObserver(token) { event in
+                    switch event {
+                    case .hop(let hop):
+                        continuation.yield(hop)
+                    case .finished:
+                        continuation.finish()
+                    case .failed(let error):
+                        continuation.finish(throwing: error)
+                    }
+                }
+            }
+        }
+    }
 }
 
 // MARK: - Convenience Methods
@@ -441,6 +694,11 @@ extension SwiftSimpleTraceroute {
         try start(with: .detailed)
     }
 
+    /// Start parallel traceroute (all hops probed at once)
+    public func startParallel() throws {
+        try start(with: .parallel)
+    }
+
     /// Start IPv4-only traceroute
     public func startIPv4Only() throws {
         try start(with: .ipv4Only)
@@ -463,7 +721,18 @@ extension SwiftSimpleTraceroute {
             return TraceroutePublisher(traceroute: self)
         }
 
+        /// Publisher that emits each hop as it completes, including timeouts
+        /// - Parameter bufferSize: Number of hops held for a subscriber without demand; the
+        ///   oldest are dropped beyond this (default: 256)
+        public func hopPublisher(bufferSize: Int = 256) -> TracerouteHopPublisher {
+            return TracerouteHopPublisher(traceroute: self, bufferSize: bufferSize)
+        }
+
         /// Combine publisher for traceroute operations
+        ///
+        /// Subscribing starts the traceroute unless it's already running, in which case the
+        /// subscriber joins it. Any number of subscribers may share one traceroute, alongside
+        /// the delegate.
         public struct TraceroutePublisher: Publisher {
             public typealias Output = STracerouteResult
             public typealias Failure = STracerouteError
@@ -477,76 +746,165 @@ extension SwiftSimpleTraceroute {
             public func receive<S>(subscriber: S)
             where S: Subscriber, STracerouteError == S.Failure, STracerouteResult == S.Input {
                 let subscription = TracerouteSubscription(
-                    subscriber: subscriber, traceroute: traceroute)
+                    subscriber: subscriber, traceroute: traceroute, bufferSize: 1
+                ) { event in
+                    if case .finished(let result) = event {
+                        return result
+                    }
+                    return nil
+                }
                 subscriber.receive(subscription: subscription)
             }
         }
 
-        private class TracerouteSubscription<S: Subscriber>: NSObject, Subscription,
-            SwiftSimpleTracerouteDelegate
-        where S.Input == STracerouteResult, S.Failure == STracerouteError {
+        /// Combine publisher of the hops of a traceroute, as they complete
+        ///
+        /// Subscribing starts the traceroute unless it's already running, in which case the
+        /// subscriber joins it from the next hop. Each subscriber gets its own bounded buffer,
+        /// so a slow subscriber loses its oldest hops rather than holding up the others.
+        public struct TracerouteHopPublisher: Publisher {
+            public typealias Output = STracerouteHop
+            public typealias Failure = STracerouteError
 
-            private var subscriber: S?
             private let traceroute: SwiftSimpleTraceroute
+            private let bufferSize: Int
 
-            init(subscriber: S, traceroute: SwiftSimpleTraceroute) {
-                self.subscriber = subscriber
+            init(traceroute: SwiftSimpleTraceroute, bufferSize: Int) {
                 self.traceroute = traceroute
-                super.init()
-                traceroute.delegate = self
+                self.bufferSize = max(1, bufferSize)
             }
 
-            func request(_ demand: Subscribers.Demand) {
-                // Start traceroute when demand is requested
-                do {
-                    try traceroute.start()
-                } catch let error as STracerouteError {
-                    subscriber?.receive(completion: .failure(error))
-                } catch {
-                    subscriber?.receive(
-                        completion: .failure(.systemError(underlying: error.localizedDescription)))
+            public func receive<S>(subscriber: S)
+            where S: Subscriber, STracerouteError == S.Failure, STracerouteHop == S.Input {
+                let subscription = TracerouteSubscription(
+                    subscriber: subscriber, traceroute: traceroute, bufferSize: bufferSize
+                ) { event in
+                    if case .hop(let hop) = event {
+                        return hop
+                    }
+                    return nil
                 }
+                subscriber.receive(subscription: subscription)
             }
+        }
 
-            func cancel() {
-                traceroute.stop()
-                subscriber = nil
-            }
-
-            // MARK: - SwiftSimpleTracerouteDelegate
+        /// A subscription to a traceroute's events, honouring demand
+        ///
+        /// Events arrive on the traceroute's thread or queue while demand may arrive on any
+        /// thread, so the state is guarded by a lock that is never held while calling the
+        /// subscriber. Outputs wait in a ring until demanded; completion waits for the ring
+        /// to drain.
+        private final class TracerouteSubscription<S: Subscriber>: Subscription,
+            @unchecked Sendable
+        where S.Failure == STracerouteError {
 
-            func swiftSimpleTraceroute(
-                _ traceroute: SwiftSimpleTraceroute, didStartWithAddress address: String
+            private let traceroute: SwiftSimpleTraceroute
+            private let output: (TracerouteEvent) -> S.Input?
+            private let token = TracerouteObserverToken()
+            private let lock = NSLock()
+            private var subscriber: S?
+            private var demand = Subscribers.Demand.none
+            private var buffer: [S.Input?]
+            private var bufferHead = 0
+            private var bufferCount = 0
+            private var pendingCompletion: Subscribers.Completion<STracerouteError>?
+            private var isAttached = false
+            private var isDelivering = false
+
+            init(
+                subscriber: S, traceroute: SwiftSimpleTraceroute, bufferSize: Int,
+                output: @escaping (TracerouteEvent) -> S.Input?
             ) {
-                // Optional: Could emit intermediate updates here
+                self.subscriber = subscriber
+                self.traceroute = traceroute
+                self.output = output
+                self.buffer = [S.Input?](repeating: nil, count: bufferSize)
             }
 
-            func swiftSimpleTraceroute(
-                _ traceroute: SwiftSimpleTraceroute, didFailWithError error: STracerouteError
-            ) {
-                subscriber?.receive(completion: .failure(error))
-                subscriber = nil
+            func request(_ demand: Subscribers.Demand) {
+                lock.lock()
+                self.demand += demand
+                let needsAttach = !isAttached
+                isAttached = true
+                lock.unlock()
+
+                if needsAttach {
+                    traceroute.perform {
+                        self.traceroute.addObserver(self.token) { [weak self] event in
+                            self?.receive(event)
+                        }
+                    }
+                }
+                drain()
             }
 
-            func swiftSimpleTraceroute(
-                _ traceroute: SwiftSimpleTraceroute, didCompleteHop hop: STracerouteHop
-            ) {
-                // Optional: Could emit hop updates here
+            func cancel() {
+                lock.lock()
+                subscriber = nil
+                bufferCount = 0
+                lock.unlock()
+
+                traceroute.perform {
+                    self.traceroute.removeObserver(self.token)
+                }
             }
 
-            func swiftSimpleTraceroute(
-                _ traceroute: SwiftSimpleTraceroute,
-                didUpdateStatistics statistics: STracerouteStatistics
-            ) {
-                // Optional: Could emit statistics updates here
+            private func receive(_ event: TracerouteEvent) {
+                lock.lock()
+                if let value = output(event) {
+                    // A full ring drops its oldest value
+                    let tail = (bufferHead + bufferCount) % buffer.count
+                    buffer[tail] = value
+                    if bufferCount == buffer.count {
+                        bufferHead = (bufferHead + 1) % buffer.count
+                    } else {
+                        bufferCount += 1
+                    }
+                }
+                switch event {
+                case .hop:
+                    break
+                case .finished:
+                    pendingCompletion = .finished
+                case .failed(let error):
+                    pendingCompletion = .failure(error)
+                }
+                lock.unlock()
+                drain()
             }
 
-            func swiftSimpleTraceroute(
-                _ traceroute: SwiftSimpleTraceroute, didFinishWithResult result: STracerouteResult
-            ) {
-                _ = subscriber?.receive(result)
-                subscriber?.receive(completion: .finished)
-                subscriber = nil
+            /// Delivers buffered values while there is demand, then any completion
+            private func drain() {
+                lock.lock()
+                guard !isDelivering else {
+                    // The delivering call sees whatever we changed when it retakes the lock
+                    lock.unlock()
+                    return
+                }
+                isDelivering = true
+                while let subscriber = subscriber {
+                    if demand > 0 && bufferCount > 0 {
+                        let value = buffer[bufferHead]!
+                        buffer[bufferHead] = nil
+                        bufferHead = (bufferHead + 1) % buffer.count
+                        bufferCount -= 1
+                        demand -= 1
+                        lock.unlock()
+                        let additional = subscriber.receive(value)
+                        lock.lock()
+                        demand += additional
+                    } else if bufferCount == 0, let completion = pendingCompletion {
+                        self.subscriber = nil
+                        pendingCompletion = nil
+                        lock.unlock()
+                        subscriber.receive(completion: completion)
+                        lock.lock()
+                    } else {
+                        break
+                    }
+                }
+                isDelivering = false
+                lock.unlock()
             }
         }
     }
@@ -558,22 +916,22 @@ extension SwiftSimpleTraceroute {
 extension SwiftSimpleTraceroute {
 
     /// Perform traceroute asynchronously
+    ///
+    /// If the traceroute is already running, this waits for it to finish.
     /// - Returns: TracerouteResult when complete
     /// - Throws: TracerouteError if operation fails
     public func trace() async throws -> STracerouteResult {
         return try await withCheckedThrowingContinuation { continuation in
-            let delegate = AsyncTracerouteDelegate(continuation: continuation)
-            self.delegate = delegate
-
-            do {
-                try self.start()
-            } catch {
-                if let tracerouteError = error as? STracerouteError {
-                    continuation.resume(throwing: tracerouteError)
-                } else {
-                    continuation.resume(
-                        throwing: STracerouteError.systemError(
-                            underlying: error.localizedDescription))
+            self.perform {
+                self.addObserver(TracerouteObserverToken()) { event in
+                    switch event {
+                    case .hop:
+                        break
+                    case .finished(let result):
+                        continuation.resume(returning: result)
+                    case .failed(let error):
+                        continuation.resume(throwing: error)
+                    }
                 }
             }
         }
@@ -589,48 +947,4 @@ extension SwiftSimpleTraceroute {
         self.configuration = configuration
         return try await trace()
     }
-
-    private class AsyncTracerouteDelegate: SwiftSimpleTracerouteDelegate {
-        private let continuation: CheckedContinuation<STracerouteResult, Error>
-        private var hasResumed = false
-
-        init(continuation: CheckedContinuation<STracerouteResult, Error>) {
-            self.continuation = continuation
-        }
-
-        func swiftSimpleTraceroute(
-            _ traceroute: SwiftSimpleTraceroute, didStartWithAddress address: String
-        ) {
-            // Do nothing, wait for completion
-        }
-
-        func swiftSimpleTraceroute(
-            _ traceroute: SwiftSimpleTraceroute, didFailWithError error: STracerouteError
-        ) {
-            guard !hasResumed else { return }
-            hasResumed = true
-            continuation.resume(throwing: error)
-        }
-
-        func swiftSimpleTraceroute(
-            _ traceroute: SwiftSimpleTraceroute, didCompleteHop hop: STracerouteHop
-        ) {
-            // Do nothing, wait for completion
-        }
-
-        func swiftSimpleTraceroute(
-            _ traceroute: SwiftSimpleTraceroute,
-            didUpdateStatistics statistics: STracerouteStatistics
-        ) {
-            // Do nothing, wait for completion
-        }
-
-        func swiftSimpleTraceroute(
-            _ traceroute: SwiftSimpleTraceroute, didFinishWithResult result: STracerouteResult
-        ) {
-            guard !hasResumed else { return }
-            hasResumed = true
-            continuation.resume(returning: result)
-        }
-    }
 }
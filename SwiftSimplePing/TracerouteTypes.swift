@@ -14,9 +14,10 @@ import Foundation
 
 /// Details of a single hop
 public struct STracerouteHop: Sendable, Equatable, Identifiable {
-    public let id = UUID()
+    public let id: UUID
     public let hopNumber: UInt8
     public let routerAddress: String?
+    /// Reverse DNS name of `routerAddress`, once resolved; see `SwiftSimpleTraceroute.reverseResolver`
     public let hostName: String?
     public let roundTripTime: TimeInterval?
     public let isDestination: Bool
@@ -24,6 +25,10 @@ public struct STracerouteHop: Sendable, Equatable, Identifiable {
     public let timestamp: Date
     public let sequenceNumber: UInt16
     public let probeIndex: UInt8
+    /// Round trip time in nanoseconds, from the monotonic send stamp to the kernel receive stamp
+    public let roundTripNanoseconds: UInt64?
+    /// Time the response waited between the kernel receiving it and us reading it, in nanoseconds
+    public let deliveryDelayNanoseconds: UInt64?
 
     /// Hop status
     public enum Status: Equatable {
@@ -56,10 +61,31 @@ public struct STracerouteHop: Sendable, Equatable, Identifiable {
 
     /// Formatted hop description
     public var description: String {
-        let addressStr = routerAddress ?? "unknown"
+        var addressStr = routerAddress ?? "unknown"
+        if let hostName = hostName {
+            addressStr = "\(hostName) (\(addressStr))"
+        }
         return "\(hopNumber): \(addressStr) \(formattedLatency)"
     }
 
+    /// The same hop, with the same `id`, and its router's name filled in
+    public func withHostName(_ hostName: String?) -> STracerouteHop {
+        return STracerouteHop(
+            hopNumber: hopNumber,
+            routerAddress: routerAddress,
+            hostName: hostName,
+            roundTripTime: roundTripTime,
+            isDestination: isDestination,
+            isTimeout: isTimeout,
+            timestamp: timestamp,
+            sequenceNumber: sequenceNumber,
+            probeIndex: probeIndex,
+            roundTripNanoseconds: roundTripNanoseconds,
+            deliveryDelayNanoseconds: deliveryDelayNanoseconds,
+            id: id
+        )
+    }
+
     public init(
         hopNumber: UInt8,
         routerAddress: String? = nil,
@@ -69,8 +95,12 @@ public struct STracerouteHop: Sendable, Equatable, Identifiable {
         isTimeout: Bool = false,
         timestamp: Date = Date(),
         sequenceNumber: UInt16 = 0,
-        probeIndex: UInt8 = 0
+        probeIndex: UInt8 = 0,
+        roundTripNanoseconds: UInt64? = nil,
+        deliveryDelayNanoseconds: UInt64? = nil,
+        id: UUID = UUID()
     ) {
+        self.id = id
         self.hopNumber = hopNumber
         self.routerAddress = routerAddress
         self.hostName = hostName
@@ -80,6 +110,8 @@ public struct STracerouteHop: Sendable, Equatable, Identifiable {
         self.timestamp = timestamp
         self.sequenceNumber = sequenceNumber
         self.probeIndex = probeIndex
+        self.roundTripNanoseconds = roundTripNanoseconds
+        self.deliveryDelayNanoseconds = deliveryDelayNanoseconds
     }
 }
 
@@ -88,6 +120,7 @@ public struct STracerouteStatistics: Sendable, Equatable {
     public let probesSent: Int
     public let responsesReceived: Int
     public let timeouts: Int
+    /// Percentage of probes that timed out, 0 to 100
     public let lossPercentage: Double
     public let averageLatency: TimeInterval?
     public let minLatency: TimeInterval?
@@ -127,6 +160,166 @@ public struct STracerouteStatistics: Sendable, Equatable {
     }
 }
 
+/// Latency samples of one hop, with statistics updated as each one is added
+///
+/// Covers every probe of the hop, however many `probesPerHop` asks for; set
+/// `waitsForAllProbes` to have a hop wait for all of them.
+public struct STracerouteHopSamples: Sendable, Equatable {
+    public let hopNumber: UInt8
+    /// Probes answered or given up on
+    public private(set) var probeCount: Int = 0
+    /// Every reply's latency, in the order they arrived
+    public private(set) var latencies: [TimeInterval] = []
+    public private(set) var minLatency: TimeInterval?
+    public private(set) var maxLatency: TimeInterval?
+    public private(set) var averageLatency: TimeInterval?
+    // Sum of the replies' squared deviations from the mean, by Welford's method
+    private var sumOfSquares: Double = 0
+
+    public init(hopNumber: UInt8) {
+        self.hopNumber = hopNumber
+    }
+
+    /// Probes answered
+    public var replyCount: Int {
+        return latencies.count
+    }
+
+    /// Percentage of probes that went unanswered, 0 to 100
+    ///
+    /// `TracerouteHopSamples.lossRatio` is the same loss as a fraction, 0 to 1.
+    public var lossPercentage: Double {
+        return probeCount > 0 ? Double(probeCount - replyCount) / Double(probeCount) * 100.0 : 0.0
+    }
+
+    /// Population standard deviation of the replies, as ping's mdev; nil with no replies
+    public var standardDeviation: TimeInterval? {
+        guard averageLatency != nil else { return nil }
+        return replyCount > 1 ? (sumOfSquares / Double(replyCount)).squareRoot() : 0
+    }
+
+    /// Formatted min/avg/max/stddev string
+    public var formattedSummary: String {
+        guard let min = minLatency, let avg = averageLatency, let max = maxLatency,
+            let stddev = standardDeviation
+        else {
+            return "\(hopNumber): no replies, \(probeCount) lost"
+        }
+        return String(
+            format: "%u: %d/%d replies, %.3f/%.3f/%.3f/%.3f ms", hopNumber, replyCount,
+            probeCount, min * 1000, avg * 1000, max * 1000, stddev * 1000)
+    }
+
+    /// Adds an answered probe
+    public mutating func addReply(latency: TimeInterval) {
+        probeCount += 1
+        latencies.append(latency)
+        minLatency = Swift.min(minLatency ?? latency, latency)
+        maxLatency = Swift.max(maxLatency ?? latency, latency)
+
+        let mean = averageLatency ?? 0
+        let delta = latency - mean
+        let newMean = mean + delta / Double(replyCount)
+        sumOfSquares += delta * (latency - newMean)
+        averageLatency = newMean
+    }
+
+    /// Adds probes that went unanswered
+    public mutating func addLosses(_ count: Int) {
+        probeCount += count
+    }
+}
+
+/// The paths to a target through load balancers, found in multipath mode
+///
+/// Interfaces are the vertices and links the edges, each from one hop to the next.
+public struct STraceroutePathGraph: Sendable, Equatable {
+    /// One link: some flow reached `toAddress` one hop after `fromAddress`
+    public struct Link: Sendable, Equatable {
+        public let hopNumber: UInt8
+        public let fromAddress: String
+        public let toAddress: String
+        /// Flows seen taking the link
+        public let flowCount: Int
+    }
+
+    /// Element n is hop n + 1; empty for hops nothing answered
+    public let interfacesByHop: [[String]]
+    /// Every link, in hop order
+    public let links: [Link]
+    /// Most flows any hop was probed with
+    public let flowCount: Int
+
+    public init(_ graph: TraceroutePathGraph) {
+        interfacesByHop = graph.interfacesByHop
+        links = graph.links.map {
+            Link(
+                hopNumber: $0.hopNumber, fromAddress: $0.fromAddress, toAddress: $0.toAddress,
+                flowCount: Int($0.flowCount))
+        }
+        flowCount = Int(graph.flowCount)
+    }
+
+    /// The interfaces of one hop, empty if it has none
+    public func interfaces(atHop hopNumber: UInt8) -> [String] {
+        let index = Int(hopNumber) - 1
+        return interfacesByHop.indices.contains(index) ? interfacesByHop[index] : []
+    }
+}
+
+/// Rolling statistics of one hop of a continuous traceroute, as mtr shows them
+public struct STracerouteHopStatistics: Sendable, Equatable {
+    public let hopNumber: UInt8
+    /// The router that last answered the hop
+    public let routerAddress: String?
+    public let isDestination: Bool
+    /// Probes sent to the hop since continuous probing began
+    public let sentCount: Int
+    /// Probes the statistics cover, at most `statisticsWindow`
+    public let windowCount: Int
+    /// Probes in the window that were answered
+    public let replyCount: Int
+    /// Percentage of the window's probes that went unanswered, 0 to 100
+    ///
+    /// `TracerouteHopStatistics.lossRatio` is the same loss as a fraction, 0 to 1.
+    public let lossPercentage: Double
+    /// Latencies of the window's replies; nil with no replies
+    public let lastLatency: TimeInterval?
+    public let minLatency: TimeInterval?
+    public let averageLatency: TimeInterval?
+    public let maxLatency: TimeInterval?
+    public let standardDeviation: TimeInterval?
+
+    public init(_ statistics: TracerouteHopStatistics) {
+        let hasReplies = statistics.replyCount > 0
+        hopNumber = statistics.hopNumber
+        routerAddress = statistics.routerAddress
+        isDestination = statistics.isDestination
+        sentCount = Int(statistics.sentCount)
+        windowCount = Int(statistics.windowCount)
+        replyCount = Int(statistics.replyCount)
+        lossPercentage = statistics.lossRatio * 100.0
+        lastLatency = statistics.lastLatency > 0 ? statistics.lastLatency : nil
+        minLatency = hasReplies ? statistics.minimumLatency : nil
+        averageLatency = hasReplies ? statistics.averageLatency : nil
+        maxLatency = hasReplies ? statistics.maximumLatency : nil
+        standardDeviation = hasReplies ? statistics.standardDeviation : nil
+    }
+
+    /// Formatted loss and last/min/avg/max/stddev string
+    public var formattedSummary: String {
+        guard let last = lastLatency, let min = minLatency, let avg = averageLatency,
+            let max = maxLatency, let stddev = standardDeviation
+        else {
+            return "\(hopNumber): \(routerAddress ?? "???") 100% loss of \(windowCount)"
+        }
+        return String(
+            format: "%u: %@ %.1f%% loss of %d, %.3f %.3f/%.3f/%.3f/%.3f ms", hopNumber,
+            routerAddress ?? "???", lossPercentage, windowCount, last * 1000, min * 1000,
+            avg * 1000, max * 1000, stddev * 1000)
+    }
+}
+
 /// Complete traceroute result
 public struct STracerouteResult: Sendable {
     public let targetHostname: String
@@ -137,6 +330,15 @@ public struct STracerouteResult: Sendable {
     public let hops: [STracerouteHop]
     public let reachedTarget: Bool
     public let statistics: STracerouteStatistics
+    /// Latency samples of every hop that reported, in hop order
+    public let hopSamples: [STracerouteHopSamples]
+    /// Every interface and link found in multipath mode, nil in the other modes
+    public let pathGraph: STraceroutePathGraph?
+
+    /// The samples of one hop, or nil if it has none
+    public func samples(forHop hopNumber: UInt8) -> STracerouteHopSamples? {
+        return hopSamples.first { $0.hopNumber == hopNumber }
+    }
 
     /// Whether successfully reached the target
     public var isSuccessful: Bool {
@@ -165,7 +367,9 @@ public struct STracerouteResult: Sendable {
         totalTime: TimeInterval,
         hops: [STracerouteHop],
         reachedTarget: Bool,
-        statistics: STracerouteStatistics
+        statistics: STracerouteStatistics,
+        hopSamples: [STracerouteHopSamples] = [],
+        pathGraph: STraceroutePathGraph? = nil
     ) {
         self.targetHostname = targetHostname
         self.targetAddress = targetAddress
@@ -175,6 +379,8 @@ public struct STracerouteResult: Sendable {
         self.hops = hops
         self.reachedTarget = reachedTarget
         self.statistics = statistics
+        self.hopSamples = hopSamples
+        self.pathGraph = pathGraph
     }
 }
 
@@ -247,17 +453,51 @@ public struct STracerouteConfiguration: Sendable, Equatable {
     public var timeout: TimeInterval
     public var probesPerHop: UInt8
     public var addressStyle: SimplePingAddressStyle
+    /// Sequential (hop by hop) or parallel (mtr-style) probing
+    public var probeMode: SimpleTracerouteProbeMode
+    /// Number of TTLs in flight in parallel mode (0 probes all hops at once)
+    public var parallelWindow: UInt8
+    /// Interval between consecutive probes in seconds (0 sends them back-to-back); in parallel
+    /// mode, between the probes of each hop only
+    public var probeInterval: TimeInterval
+    /// Whether each hop waits for all of its probes, for per-hop jitter and loss
+    public var waitsForAllProbes: Bool
+    /// Whether every probe takes the same path through load balancers (Paris traceroute)
+    public var keepsFlowStable: Bool
+    /// The flow probed when `keepsFlowStable` is set; the first flow in multipath mode
+    public var flowIdentifier: UInt16
+    /// Whether to keep watching the path, mtr-style, once it's traced, see
+    /// `swiftSimpleTraceroute(_:didUpdateHopStatistics:)`
+    public var continuous: Bool
+    /// Seconds between the rounds of probes of a continuous traceroute
+    public var cycleInterval: TimeInterval
 
     public init(
         maxHops: UInt8 = 30,
         timeout: TimeInterval = 5.0,
         probesPerHop: UInt8 = 3,
-        addressStyle: SimplePingAddressStyle = .any
+        addressStyle: SimplePingAddressStyle = .any,
+        probeMode: SimpleTracerouteProbeMode = .sequential,
+        parallelWindow: UInt8 = 0,
+        probeInterval: TimeInterval = 0.01,
+        waitsForAllProbes: Bool = false,
+        keepsFlowStable: Bool = false,
+        flowIdentifier: UInt16 = 0,
+        continuous: Bool = false,
+        cycleInterval: TimeInterval = 1.0
     ) {
         self.maxHops = maxHops
         self.timeout = timeout
         self.probesPerHop = probesPerHop
         self.addressStyle = addressStyle
+        self.probeMode = probeMode
+        self.parallelWindow = parallelWindow
+        self.probeInterval = probeInterval
+        self.waitsForAllProbes = waitsForAllProbes
+        self.keepsFlowStable = keepsFlowStable
+        self.flowIdentifier = flowIdentifier
+        self.continuous = continuous
+        self.cycleInterval = cycleInterval
     }
 
     /// Validate the validity of the configuration
@@ -268,8 +508,15 @@ public struct STracerouteConfiguration: Sendable, Equatable {
         guard timeout > 0 && timeout <= 60 else {
             throw STracerouteError.invalidConfiguration("timeout must be between 0 and 60 seconds")
         }
-        guard probesPerHop >= 1 && probesPerHop <= 10 else {
-            throw STracerouteError.invalidConfiguration("probesPerHop must be between 1 and 10")
+        guard probesPerHop >= 1 && Int(probesPerHop) <= kTracerouteMaxProbesPerHop else {
+            throw STracerouteError.invalidConfiguration(
+                "probesPerHop must be between 1 and \(kTracerouteMaxProbesPerHop)")
+        }
+        guard probeInterval >= 0 && probeInterval <= timeout else {
+            throw STracerouteError.invalidConfiguration("probeInterval must be between 0 and timeout")
+        }
+        guard !continuous || cycleInterval > 0 else {
+            throw STracerouteError.invalidConfiguration("cycleInterval must be positive")
         }
     }
 
@@ -283,6 +530,26 @@ public struct STracerouteConfiguration: Sendable, Equatable {
         return STracerouteConfiguration(maxHops: 30, timeout: 10.0, probesPerHop: 3)
     }
 
+    /// Preset configuration: every probe of 16 per hop, for per-hop jitter and loss
+    public static var statistical: STracerouteConfiguration {
+        return STracerouteConfiguration(probesPerHop: 16, waitsForAllProbes: true)
+    }
+
+    /// Preset configuration: parallel traceroute probing all hops at once
+    public static var parallel: STracerouteConfiguration {
+        return STracerouteConfiguration(probeMode: .parallel)
+    }
+
+    /// Preset configuration: every path through load balancers, see `STracerouteResult.pathGraph`
+    public static var multipath: STracerouteConfiguration {
+        return STracerouteConfiguration(probeMode: .multipath)
+    }
+
+    /// Preset configuration: keep watching the path, one round of probes a second
+    public static var continuous: STracerouteConfiguration {
+        return STracerouteConfiguration(probesPerHop: 1, continuous: true)
+    }
+
     /// Preset configuration: IPv4 only
     public static var ipv4Only: STracerouteConfiguration {
         return STracerouteConfiguration(addressStyle: .icmPv4)
@@ -317,6 +584,10 @@ public protocol SwiftSimpleTracerouteDelegate: AnyObject {
     /// Traceroute completed
     func swiftSimpleTraceroute(
         _ traceroute: SwiftSimpleTraceroute, didFinishWithResult result: STracerouteResult)
+
+    /// A hop's router name was found (optional, see the extension below)
+    func swiftSimpleTraceroute(
+        _ traceroute: SwiftSimpleTraceroute, didResolveHostNameForHop hop: STracerouteHop)
 }
 
 // MARK: - Optional Delegate Methods
@@ -338,4 +609,15 @@ extension SwiftSimpleTracerouteDelegate {
     public func swiftSimpleTraceroute(
         _ traceroute: SwiftSimpleTraceroute, didTimeoutForHop hopNumber: UInt8
     ) {}
+
+    /// Optional: A hop's router name was found; `hop` has the same `id` as the one completed
+    /// earlier, now with `hostName` set. This may come after the traceroute has finished.
+    public func swiftSimpleTraceroute(
+        _ traceroute: SwiftSimpleTraceroute, didResolveHostNameForHop hop: STracerouteHop
+    ) {}
+
+    /// Optional: A probe of a continuous traceroute was answered or timed out
+    public func swiftSimpleTraceroute(
+        _ traceroute: SwiftSimpleTraceroute, didUpdateHopStatistics statistics: STracerouteHopStatistics
+    ) {}
 }